@@ -149,7 +149,9 @@ pll_loop:       LDR     R3, [R0, #PLLSTAT_OFS]
                 MSR     CPSR_c, #PROCESSOR_MODE_SUPERVISOR|0x80|0x40
                 MOV     SP, R0
                 SUB     R0, R0, #STACK_SIZE_SUPERVISOR
-                MSR     CPSR_c, #PROCESSOR_MODE_USER
+                /* System mode shares the User mode registers, it is 
+                 * privileged so sched_idle() can mask IRQs in the CPSR */
+                MSR     CPSR_c, #PROCESSOR_MODE_SYSTEM
                 MOV     SP, R0
 
 	/* enter C code */
@@ -160,6 +162,22 @@ pll_loop:       LDR     R3, [R0, #PLLSTAT_OFS]
                 BX      R0
                 ENDP
 
+/* cpu_irq_disable() sets the I bit and returns the CPSR as it was,
+ * cpu_irq_restore() puts it back */
+PUBLIC cpu_irq_disable?A
+cpu_irq_disable?A PROC  CODE32
+                MRS     R0, CPSR
+                ORR     R1, R0, #0x80
+                MSR     CPSR_c, R1
+                BX      LR
+                ENDP
+
+PUBLIC cpu_irq_restore?A
+cpu_irq_restore?A PROC  CODE32
+                MSR     CPSR_c, R0
+                BX      LR
+                ENDP
+
 PUBLIC exit?A
 exit?A          PROC    CODE32
                 B       exit?A
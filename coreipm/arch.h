@@ -23,9 +23,9 @@ See http://www.coreipm.com for documentation, latest information, licensing,
 support and contact details.
 -------------------------------------------------------------------------------
 */
-#ifdef IPMC
+#if defined (IPMC)
 #include "lpc23nn.h"
-#elif
+#else
 #include "lpc21nn.h"
 #endif
 
@@ -97,12 +97,54 @@ support and contact details.
  * 	.
  * 	.
  * 	ENABLE_INTERRUPTS( interrupt_mask );
- */
-#define CURRENT_INTERRUPT_MASK	VICIntEnable
-//#define DISABLE_INTERRUPTS	( VICIntEnClr = 0xFFFFFFFF )		// disable all interrupts handled by VIC
-//#define ENABLE_INTERRUPTS(mask)	( VICIntEnable = mask ) 
+ *
+ * The work set queues, the callout wheel, the scheduler work bits and
+ * the I2C channel queues are shared with the ISRs, they rely on these.
+ * Sections nest, an inner one saves the (empty) mask the outer one left
+ * and restores it. Writing 0 to a VICIntEnable bit has no effect, so
+ * restoring only turns back on what was enabled before. */
+#if defined (POSIX)
+#define CURRENT_INTERRUPT_MASK	0
 #define DISABLE_INTERRUPTS	
 #define ENABLE_INTERRUPTS(mask)
+#else
+#define CURRENT_INTERRUPT_MASK	VICIntEnable
+#define DISABLE_INTERRUPTS	( VICIntEnClr = 0xFFFFFFFF )		// disable all interrupts handled by VIC
+#define ENABLE_INTERRUPTS(mask)	( VICIntEnable = ( mask ) ) 
+#endif
+
+/* IRQ masking in the CPSR, for entering Idle mode without losing a
+ * wakeup: a masked interrupt still ends Idle and is taken once the
+ * CPSR is restored. main() has to run in a privileged mode, System 
+ * mode in the startup code.
+ *
+ * Usage:
+ *
+ * 	unsigned long cpsr;
+ * 	CPU_IRQ_DISABLE( cpsr );
+ * 	.
+ * 	CPU_IRQ_RESTORE( cpsr );
+ *
+ * CPU_IRQ_MASKED( cpsr ) tells whether IRQs were masked already.
+ */
+#if defined (__CA__)
+unsigned long cpu_irq_disable( void ) __arm;	/* Startup_carm.s */
+void cpu_irq_restore( unsigned long cpsr ) __arm;
+#define CPU_IRQ_DISABLE( cpsr )	( ( cpsr ) = cpu_irq_disable() )
+#define CPU_IRQ_RESTORE( cpsr )	cpu_irq_restore( cpsr )
+#define CPU_IRQ_MASKED( cpsr )	( ( cpsr ) & 0x80 )
+#elif defined (__CC_ARM)
+#define CPU_IRQ_DISABLE( cpsr )	( ( cpsr ) = __disable_irq() )
+#define CPU_IRQ_RESTORE( cpsr )	{ if( !( cpsr ) ) __enable_irq(); }
+#define CPU_IRQ_MASKED( cpsr )	( cpsr )
+#elif defined (__GNUC__) && !defined (POSIX)
+#define CPU_IRQ_DISABLE( cpsr )	\
+	__asm__ __volatile__ ( "mrs %0, cpsr\n\torr r1, %0, #0x80\n\tmsr cpsr_c, r1" \
+		: "=r" ( cpsr ) : : "r1", "memory" )
+#define CPU_IRQ_RESTORE( cpsr )	\
+	__asm__ __volatile__ ( "msr cpsr_c, %0" : : "r" ( cpsr ) : "memory" )
+#define CPU_IRQ_MASKED( cpsr )	( ( cpsr ) & 0x80 )
+#endif
 
 /*======================================================================*/
 /*			Controller Types				*/
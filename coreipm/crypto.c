@@ -0,0 +1,408 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/crypto.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+Crypto for RMCP+ sessions
+
+The RAKP-HMAC-SHA1 authentication, HMAC-SHA1-96 integrity and AES-CBC-128
+confidentiality algorithms of IPMI v2.0 need SHA-1, HMAC-SHA1 and AES-128.
+They are here so the host build does not depend on a crypto library. 
+
+AES uses 32 bit lookup tables built the first time a key is set, one for
+encryption and one for decryption, the other three columns are rotations
+of them. Keys hold both the encryption and the decryption round keys.
+
+Checked against FIPS 180-1, RFC 2202 and FIPS 197 test vectors.
+*/
+
+#include <string.h>
+#include "crypto.h"
+
+#define ROL32( x, n )	( ( ( x ) << ( n ) ) | ( ( x ) >> ( 32 - ( n ) ) ) )
+#define ROR32( x, n )	( ( ( x ) >> ( n ) ) | ( ( x ) << ( 32 - ( n ) ) ) )
+#define GET32( p )	( ( ( unsigned int )( p )[0] << 24 ) | ( ( unsigned int )( p )[1] << 16 ) \
+			| ( ( unsigned int )( p )[2] << 8 ) | ( p )[3] )
+#define PUT32( p, v )	do { ( p )[0] = ( v ) >> 24; ( p )[1] = ( v ) >> 16; \
+			( p )[2] = ( v ) >> 8; ( p )[3] = ( v ); } while( 0 )
+
+unsigned char	aes_sbox[256];
+unsigned char	aes_inv_sbox[256];
+unsigned int	aes_te[256];		/* SubBytes and MixColumns, column 0 */
+unsigned int	aes_td[256];		/* InvSubBytes and InvMixColumns, column 0 */
+unsigned char	aes_tables_ready;
+const unsigned char aes_rcon[10] = 
+	{ 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+void sha1_block( SHA1_CTX *ctx, const unsigned char *block );
+unsigned char aes_mul( unsigned char a, unsigned char b );
+void aes_init_tables( void );
+
+/*==============================================================
+ * SHA-1
+ *==============================================================*/
+void
+sha1_init( SHA1_CTX *ctx )
+{
+	ctx->h[0] = 0x67452301;
+	ctx->h[1] = 0xEFCDAB89;
+	ctx->h[2] = 0x98BADCFE;
+	ctx->h[3] = 0x10325476;
+	ctx->h[4] = 0xC3D2E1F0;
+	ctx->len = 0;
+	ctx->buf_len = 0;
+}
+
+void
+sha1_block( SHA1_CTX *ctx, const unsigned char *block )
+{
+	unsigned int w[80], a, b, c, d, e, t;
+	int i;
+
+	for( i = 0; i < 16; i++ )
+		w[i] = GET32( block + 4 * i );
+	for( ; i < 80; i++ ) {
+		t = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+		w[i] = ROL32( t, 1 );
+	}
+
+	a = ctx->h[0]; b = ctx->h[1]; c = ctx->h[2]; d = ctx->h[3]; e = ctx->h[4];
+	for( i = 0; i < 80; i++ ) {
+		if( i < 20 )
+			t = ( ( b & c ) | ( ~b & d ) ) + 0x5A827999;
+		else if( i < 40 )
+			t = ( b ^ c ^ d ) + 0x6ED9EBA1;
+		else if( i < 60 )
+			t = ( ( b & c ) | ( b & d ) | ( c & d ) ) + 0x8F1BBCDC;
+		else
+			t = ( b ^ c ^ d ) + 0xCA62C1D6;
+		t += ROL32( a, 5 ) + e + w[i];
+		e = d; d = c; c = ROL32( b, 30 ); b = a; a = t;
+	}
+	ctx->h[0] += a; ctx->h[1] += b; ctx->h[2] += c; ctx->h[3] += d; ctx->h[4] += e;
+}
+
+void
+sha1_update( SHA1_CTX *ctx, const unsigned char *data, unsigned len )
+{
+	unsigned n;
+
+	ctx->len += len;
+	if( ctx->buf_len ) {
+		n = SHA1_BLOCK_LEN - ctx->buf_len;
+		if( n > len )
+			n = len;
+		memcpy( ctx->buf + ctx->buf_len, data, n );
+		ctx->buf_len += n;
+		data += n;
+		len -= n;
+		if( ctx->buf_len < SHA1_BLOCK_LEN )
+			return;
+		sha1_block( ctx, ctx->buf );
+		ctx->buf_len = 0;
+	}
+	for( ; len >= SHA1_BLOCK_LEN; data += SHA1_BLOCK_LEN, len -= SHA1_BLOCK_LEN )
+		sha1_block( ctx, data );
+	memcpy( ctx->buf, data, len );
+	ctx->buf_len = len;
+}
+
+void
+sha1_final( SHA1_CTX *ctx, unsigned char *digest )
+{
+	unsigned long long bits = ctx->len * 8;
+	int i;
+
+	ctx->buf[ctx->buf_len++] = 0x80;
+	if( ctx->buf_len > SHA1_BLOCK_LEN - 8 ) {
+		memset( ctx->buf + ctx->buf_len, 0, SHA1_BLOCK_LEN - ctx->buf_len );
+		sha1_block( ctx, ctx->buf );
+		ctx->buf_len = 0;
+	}
+	memset( ctx->buf + ctx->buf_len, 0, SHA1_BLOCK_LEN - 8 - ctx->buf_len );
+	for( i = 0; i < 8; i++ )
+		ctx->buf[SHA1_BLOCK_LEN - 1 - i] = bits >> ( 8 * i );
+	sha1_block( ctx, ctx->buf );
+
+	for( i = 0; i < 5; i++ )
+		PUT32( digest + 4 * i, ctx->h[i] );
+}
+
+/*==============================================================
+ * HMAC-SHA1
+ *==============================================================*/
+void
+hmac_sha1_init( HMAC_SHA1_CTX *ctx, const unsigned char *key, unsigned key_len )
+{
+	unsigned char pad[SHA1_BLOCK_LEN], digest[SHA1_DIGEST_LEN];
+	int i;
+
+	if( key_len > SHA1_BLOCK_LEN ) {
+		sha1_init( &ctx->inner );
+		sha1_update( &ctx->inner, key, key_len );
+		sha1_final( &ctx->inner, digest );
+		key = digest;
+		key_len = SHA1_DIGEST_LEN;
+	}
+
+	memset( pad, 0x36, sizeof( pad ) );
+	for( i = 0; i < key_len; i++ )
+		pad[i] ^= key[i];
+	sha1_init( &ctx->inner );
+	sha1_update( &ctx->inner, pad, sizeof( pad ) );
+
+	memset( pad, 0x5c, sizeof( pad ) );
+	for( i = 0; i < key_len; i++ )
+		pad[i] ^= key[i];
+	sha1_init( &ctx->outer );
+	sha1_update( &ctx->outer, pad, sizeof( pad ) );
+}
+
+/* mac gets SHA1_DIGEST_LEN bytes, ctx can be used again */
+void
+hmac_sha1_mac( const HMAC_SHA1_CTX *ctx, const unsigned char *data, 
+	unsigned len, unsigned char *mac )
+{
+	SHA1_CTX sha;
+
+	sha = ctx->inner;
+	sha1_update( &sha, data, len );
+	sha1_final( &sha, mac );
+	sha = ctx->outer;
+	sha1_update( &sha, mac, SHA1_DIGEST_LEN );
+	sha1_final( &sha, mac );
+}
+
+void
+hmac_sha1( const unsigned char *key, unsigned key_len, 
+	const unsigned char *data, unsigned len, unsigned char *mac )
+{
+	HMAC_SHA1_CTX ctx;
+
+	hmac_sha1_init( &ctx, key, key_len );
+	hmac_sha1_mac( &ctx, data, len, mac );
+}
+
+/*==============================================================
+ * AES-128
+ *==============================================================*/
+
+/* multiply in GF(2^8) */
+unsigned char
+aes_mul( unsigned char a, unsigned char b )
+{
+	unsigned char p = 0;
+
+	while( b ) {
+		if( b & 1 )
+			p ^= a;
+		a = ( a << 1 ) ^ ( ( a & 0x80 ) ? 0x1B : 0 );
+		b >>= 1;
+	}
+	return( p );
+}
+
+void
+aes_init_tables( void )
+{
+	unsigned char p = 1, q = 1, s;
+	int i;
+
+	/* walk the multiplicative group with generator 3, q is the 
+	 * inverse of p, the S-box is the affine transform of q */
+	do {
+		p = p ^ ( p << 1 ) ^ ( ( p & 0x80 ) ? 0x1B : 0 );
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if( q & 0x80 )
+			q ^= 0x09;
+		s = q ^ ( ( q << 1 ) | ( q >> 7 ) ) ^ ( ( q << 2 ) | ( q >> 6 ) )
+			^ ( ( q << 3 ) | ( q >> 5 ) ) ^ ( ( q << 4 ) | ( q >> 4 ) );
+		aes_sbox[p] = s ^ 0x63;
+	} while( p != 1 );
+	aes_sbox[0] = 0x63;
+
+	for( i = 0; i < 256; i++ )
+		aes_inv_sbox[aes_sbox[i]] = i;
+
+	for( i = 0; i < 256; i++ ) {
+		s = aes_sbox[i];
+		aes_te[i] = ( ( unsigned int )aes_mul( s, 2 ) << 24 ) | ( s << 16 ) 
+			| ( s << 8 ) | aes_mul( s, 3 );
+		s = aes_inv_sbox[i];
+		aes_td[i] = ( ( unsigned int )aes_mul( s, 14 ) << 24 ) | ( aes_mul( s, 9 ) << 16 ) 
+			| ( aes_mul( s, 13 ) << 8 ) | aes_mul( s, 11 );
+	}
+	aes_tables_ready = 1;
+}
+
+#define TE0( x )	aes_te[x]
+#define TE1( x )	ROR32( aes_te[x], 8 )
+#define TE2( x )	ROR32( aes_te[x], 16 )
+#define TE3( x )	ROR32( aes_te[x], 24 )
+#define TD0( x )	aes_td[x]
+#define TD1( x )	ROR32( aes_td[x], 8 )
+#define TD2( x )	ROR32( aes_td[x], 16 )
+#define TD3( x )	ROR32( aes_td[x], 24 )
+#define B0( x )		( ( x ) >> 24 )
+#define B1( x )		( ( ( x ) >> 16 ) & 0xff )
+#define B2( x )		( ( ( x ) >> 8 ) & 0xff )
+#define B3( x )		( ( x ) & 0xff )
+
+void
+aes128_set_key( AES_KEY *key, const unsigned char *user_key )
+{
+	unsigned int *ek = key->ek, *dk = key->dk, t;
+	int i, j;
+
+	if( !aes_tables_ready )
+		aes_init_tables();
+
+	for( i = 0; i < 4; i++ )
+		ek[i] = GET32( user_key + 4 * i );
+	for( i = 4; i < 4 * ( AES128_ROUNDS + 1 ); i++ ) {
+		t = ek[i - 1];
+		if( !( i % 4 ) )
+			t = ( ( ( unsigned int )aes_sbox[B1( t )] << 24 ) | ( aes_sbox[B2( t )] << 16 )
+				| ( aes_sbox[B3( t )] << 8 ) | aes_sbox[B0( t )] )
+				^ ( ( unsigned int )aes_rcon[i / 4 - 1] << 24 );
+		ek[i] = ek[i - 4] ^ t;
+	}
+
+	/* the decryption round keys are the encryption ones in reverse
+	 * order with InvMixColumns applied to all but the first and last */
+	for( i = 0; i <= AES128_ROUNDS; i++ )
+		for( j = 0; j < 4; j++ )
+			dk[4 * i + j] = ek[4 * ( AES128_ROUNDS - i ) + j];
+	for( i = 4; i < 4 * AES128_ROUNDS; i++ ) {
+		t = dk[i];
+		dk[i] = TD0( aes_sbox[B0( t )] ) ^ TD1( aes_sbox[B1( t )] ) 
+			^ TD2( aes_sbox[B2( t )] ) ^ TD3( aes_sbox[B3( t )] );
+	}
+}
+
+void
+aes128_encrypt( const AES_KEY *key, const unsigned char *in, unsigned char *out )
+{
+	const unsigned int *rk = key->ek;
+	unsigned int s0, s1, s2, s3, t0, t1, t2, t3;
+	int r;
+
+	s0 = GET32( in ) ^ rk[0];
+	s1 = GET32( in + 4 ) ^ rk[1];
+	s2 = GET32( in + 8 ) ^ rk[2];
+	s3 = GET32( in + 12 ) ^ rk[3];
+	for( r = 1; r < AES128_ROUNDS; r++ ) {
+		rk += 4;
+		t0 = TE0( B0( s0 ) ) ^ TE1( B1( s1 ) ) ^ TE2( B2( s2 ) ) ^ TE3( B3( s3 ) ) ^ rk[0];
+		t1 = TE0( B0( s1 ) ) ^ TE1( B1( s2 ) ) ^ TE2( B2( s3 ) ) ^ TE3( B3( s0 ) ) ^ rk[1];
+		t2 = TE0( B0( s2 ) ) ^ TE1( B1( s3 ) ) ^ TE2( B2( s0 ) ) ^ TE3( B3( s1 ) ) ^ rk[2];
+		t3 = TE0( B0( s3 ) ) ^ TE1( B1( s0 ) ) ^ TE2( B2( s1 ) ) ^ TE3( B3( s2 ) ) ^ rk[3];
+		s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+	}
+	rk += 4;
+	t0 = ( ( unsigned int )aes_sbox[B0( s0 )] << 24 ) | ( aes_sbox[B1( s1 )] << 16 )
+		| ( aes_sbox[B2( s2 )] << 8 ) | aes_sbox[B3( s3 )];
+	t1 = ( ( unsigned int )aes_sbox[B0( s1 )] << 24 ) | ( aes_sbox[B1( s2 )] << 16 )
+		| ( aes_sbox[B2( s3 )] << 8 ) | aes_sbox[B3( s0 )];
+	t2 = ( ( unsigned int )aes_sbox[B0( s2 )] << 24 ) | ( aes_sbox[B1( s3 )] << 16 )
+		| ( aes_sbox[B2( s0 )] << 8 ) | aes_sbox[B3( s1 )];
+	t3 = ( ( unsigned int )aes_sbox[B0( s3 )] << 24 ) | ( aes_sbox[B1( s0 )] << 16 )
+		| ( aes_sbox[B2( s1 )] << 8 ) | aes_sbox[B3( s2 )];
+	PUT32( out, t0 ^ rk[0] );
+	PUT32( out + 4, t1 ^ rk[1] );
+	PUT32( out + 8, t2 ^ rk[2] );
+	PUT32( out + 12, t3 ^ rk[3] );
+}
+
+void
+aes128_decrypt( const AES_KEY *key, const unsigned char *in, unsigned char *out )
+{
+	const unsigned int *rk = key->dk;
+	unsigned int s0, s1, s2, s3, t0, t1, t2, t3;
+	int r;
+
+	s0 = GET32( in ) ^ rk[0];
+	s1 = GET32( in + 4 ) ^ rk[1];
+	s2 = GET32( in + 8 ) ^ rk[2];
+	s3 = GET32( in + 12 ) ^ rk[3];
+	for( r = 1; r < AES128_ROUNDS; r++ ) {
+		rk += 4;
+		t0 = TD0( B0( s0 ) ) ^ TD1( B1( s3 ) ) ^ TD2( B2( s2 ) ) ^ TD3( B3( s1 ) ) ^ rk[0];
+		t1 = TD0( B0( s1 ) ) ^ TD1( B1( s0 ) ) ^ TD2( B2( s3 ) ) ^ TD3( B3( s2 ) ) ^ rk[1];
+		t2 = TD0( B0( s2 ) ) ^ TD1( B1( s1 ) ) ^ TD2( B2( s0 ) ) ^ TD3( B3( s3 ) ) ^ rk[2];
+		t3 = TD0( B0( s3 ) ) ^ TD1( B1( s2 ) ) ^ TD2( B2( s1 ) ) ^ TD3( B3( s0 ) ) ^ rk[3];
+		s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+	}
+	rk += 4;
+	t0 = ( ( unsigned int )aes_inv_sbox[B0( s0 )] << 24 ) | ( aes_inv_sbox[B1( s3 )] << 16 )
+		| ( aes_inv_sbox[B2( s2 )] << 8 ) | aes_inv_sbox[B3( s1 )];
+	t1 = ( ( unsigned int )aes_inv_sbox[B0( s1 )] << 24 ) | ( aes_inv_sbox[B1( s0 )] << 16 )
+		| ( aes_inv_sbox[B2( s3 )] << 8 ) | aes_inv_sbox[B3( s2 )];
+	t2 = ( ( unsigned int )aes_inv_sbox[B0( s2 )] << 24 ) | ( aes_inv_sbox[B1( s1 )] << 16 )
+		| ( aes_inv_sbox[B2( s0 )] << 8 ) | aes_inv_sbox[B3( s3 )];
+	t3 = ( ( unsigned int )aes_inv_sbox[B0( s3 )] << 24 ) | ( aes_inv_sbox[B1( s2 )] << 16 )
+		| ( aes_inv_sbox[B2( s1 )] << 8 ) | aes_inv_sbox[B3( s0 )];
+	PUT32( out, t0 ^ rk[0] );
+	PUT32( out + 4, t1 ^ rk[1] );
+	PUT32( out + 8, t2 ^ rk[2] );
+	PUT32( out + 12, t3 ^ rk[3] );
+}
+
+/* len is a multiple of AES_BLOCK_LEN, buf is encrypted in place */
+void
+aes128_cbc_encrypt( const AES_KEY *key, const unsigned char *iv, 
+	unsigned char *buf, unsigned len )
+{
+	int i;
+
+	for( ; len >= AES_BLOCK_LEN; len -= AES_BLOCK_LEN, buf += AES_BLOCK_LEN ) {
+		for( i = 0; i < AES_BLOCK_LEN; i++ )
+			buf[i] ^= iv[i];
+		aes128_encrypt( key, buf, buf );
+		iv = buf;
+	}
+}
+
+void
+aes128_cbc_decrypt( const AES_KEY *key, const unsigned char *iv, 
+	unsigned char *buf, unsigned len )
+{
+	unsigned char prev[AES_BLOCK_LEN], cur[AES_BLOCK_LEN];
+	int i;
+
+	memcpy( prev, iv, AES_BLOCK_LEN );
+	for( ; len >= AES_BLOCK_LEN; len -= AES_BLOCK_LEN, buf += AES_BLOCK_LEN ) {
+		memcpy( cur, buf, AES_BLOCK_LEN );
+		aes128_decrypt( key, buf, buf );
+		for( i = 0; i < AES_BLOCK_LEN; i++ )
+			buf[i] ^= prev[i];
+		memcpy( prev, cur, AES_BLOCK_LEN );
+	}
+}
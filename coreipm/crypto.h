@@ -0,0 +1,69 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/crypto.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* SHA-1, HMAC-SHA1 and AES-128, see crypto.c */
+
+#define SHA1_DIGEST_LEN		20
+#define SHA1_BLOCK_LEN		64
+
+typedef struct sha1_ctx {
+	unsigned int h[5];
+	unsigned long long len;		/* bytes hashed so far */
+	unsigned char buf[SHA1_BLOCK_LEN];
+	unsigned buf_len;
+} SHA1_CTX;
+
+/* HMAC with the key already folded into the inner and outer hash, for 
+ * keys that are used for many messages */
+typedef struct hmac_sha1_ctx {
+	SHA1_CTX inner;
+	SHA1_CTX outer;
+} HMAC_SHA1_CTX;
+
+#define AES_BLOCK_LEN		16
+#define AES128_KEY_LEN		16
+#define AES128_ROUNDS		10
+
+typedef struct aes_key {
+	unsigned int ek[4 * ( AES128_ROUNDS + 1 )];	/* encryption round keys */
+	unsigned int dk[4 * ( AES128_ROUNDS + 1 )];	/* decryption round keys */
+} AES_KEY;
+
+void sha1_init( SHA1_CTX *ctx );
+void sha1_update( SHA1_CTX *ctx, const unsigned char *data, unsigned len );
+void sha1_final( SHA1_CTX *ctx, unsigned char *digest );
+void hmac_sha1( const unsigned char *key, unsigned key_len, 
+	const unsigned char *data, unsigned len, unsigned char *mac );
+void hmac_sha1_init( HMAC_SHA1_CTX *ctx, const unsigned char *key, unsigned key_len );
+void hmac_sha1_mac( const HMAC_SHA1_CTX *ctx, const unsigned char *data, 
+	unsigned len, unsigned char *mac );
+void aes128_set_key( AES_KEY *key, const unsigned char *user_key );
+void aes128_encrypt( const AES_KEY *key, const unsigned char *in, unsigned char *out );
+void aes128_decrypt( const AES_KEY *key, const unsigned char *in, unsigned char *out );
+void aes128_cbc_encrypt( const AES_KEY *key, const unsigned char *iv, 
+	unsigned char *buf, unsigned len );
+void aes128_cbc_decrypt( const AES_KEY *key, const unsigned char *iv, 
+	unsigned char *buf, unsigned len );
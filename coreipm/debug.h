@@ -50,6 +50,9 @@ void putstr( char *str );
 void dputstr( unsigned flags, char *str);
 
 #ifndef USE_DPRINTF
+#if defined (POSIX)
+#include <stdio.h>	/* declares a dprintf() of its own */
+#endif
 #define dprintf
 #endif
 
@@ -0,0 +1,437 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/dispatch.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+Command dispatch
+
+Every request command the controller implements is listed in one of the 
+tables below together with its handler, the minimum request data length and
+flags. The tables are fixed at compile time, which commands are in depends 
+on the module type (PICMG, MMC). dispatch_init() indexes them by netfn and
+command so dispatch_request() finds the handler with two array lookups and 
+checks the request length before the handler sees it. Each table entry also
+has a set of counters, updated by dispatch_account() once the request has
+been serviced and read back through the statistics commands (stats.c).
+In the host build a request that came in on a LAN session is refused with
+CC_SECURITY_RESTRICTION unless the session is at the privilege level the
+flags of the command ask for, see rmcpd_get_priv().
+
+Board ports add OEM commands with their own table under one of the 
+controller specific netfns (30h-3Eh), registered from module_init():
+
+	const IPMI_CMD_DESC board_cmd[] = {
+		{ 0x01, 2, 0, board_set_something },
+	};
+	dispatch_register( 0x30, board_cmd, 1 );
+*/
+
+#include "ipmi.h"
+#include "debug.h"
+#include "error.h"
+#include "picmg.h"
+#include "event.h"
+#include "sensor.h"
+#include "dispatch.h"
+#include "stats.h"
+#ifdef MMC
+#include "mmc.h"
+#endif
+#if defined (POSIX)
+#include "rmcp.h"
+#include "rmcpd.h"
+#endif
+
+/*==============================================================*/
+/* Command tables						*/
+/*==============================================================*/
+
+/* NETFN_APP_REQ */
+const IPMI_CMD_DESC app_cmd[] = {
+	/* command				min len	flags	handler */
+	{ IPMI_CMD_GET_DEVICE_ID,		0,	0,	ipmi_get_device_id },
+	{ IPMI_CMD_COLD_RESET,			0,	CMD_FL_ADMIN,	ipmi_cold_reset },
+	{ IPMI_CMD_WARM_RESET,			0,	CMD_FL_ADMIN,	ipmi_warm_reset },
+	{ IPMI_CMD_GET_SELF_TEST_RESULTS,	0,	0,	ipmi_get_self_test_results },
+	{ IPMI_CMD_RESET_WATCHDOG_TIMER,	0,	CMD_FL_OPERATOR,	ipmi_reset_watchdog_timer },
+	{ IPMI_CMD_SET_WATCHDOG_TIMER,		6,	CMD_FL_OPERATOR,	ipmi_set_watchdog_timer },
+	{ IPMI_CMD_GET_WATCHDOG_TIMER,		0,	0,	ipmi_get_watchdog_timer },
+	{ IPMI_CMD_SEND_MESSAGE,		2,	0,	ipmi_send_message_cmd },
+#if defined (POSIX)
+	{ IPMI_CMD_GET_CHANNEL_AUTH_CAP,	2,	0,	rmcpd_get_channel_auth_cap },
+	{ IPMI_CMD_SET_SESSION_PRIV,		1,	0,	rmcpd_set_session_priv },
+	{ IPMI_CMD_CLOSE_SESSION,		4,	0,	rmcpd_close_session },
+#endif
+};
+
+/* NETFN_EVENT_REQ, sensor/event commands */
+const IPMI_CMD_DESC event_cmd[] = {
+	/* command				min len	flags	handler */
+	{ IPMI_SE_CMD_SET_EVENT_RECEIVER,	2,	CMD_FL_ADMIN,	ipmi_set_event_receiver },
+	{ IPMI_SE_CMD_GET_EVENT_RECEIVER,	0,	0,	ipmi_get_event_receiver },
+	{ IPMI_SE_PLATFORM_EVENT,		7,	CMD_FL_OPERATOR,	ipmi_platform_event },
+	{ IPMI_SE_CMD_GET_PEF_CAPABILITIES,	0,	0,	ipmi_get_pef_capabilities },
+	{ IPMI_SE_CMD_ARM_PEF_POSTPONE_TIMER,	1,	CMD_FL_ADMIN,	ipmi_arm_pef_postpone_timer },
+	{ IPMI_SE_CMD_SET_PEF_CONFIG_PARAMS,	2,	CMD_FL_ADMIN,	ipmi_set_pef_config_params },
+	{ IPMI_SE_CMD_GET_PEF_CONFIG_PARAMS,	3,	CMD_FL_OPERATOR,	ipmi_get_pef_config_params },
+	{ IPMI_SE_CMD_SET_LAST_PROCESSED_EVENT,	3,	CMD_FL_ADMIN,	ipmi_set_last_processed_event },
+	{ IPMI_SE_CMD_GET_LAST_PROCESSED_EVENT,	0,	CMD_FL_ADMIN,	ipmi_get_last_processed_event },
+	{ IPMI_SE_CMD_GET_DEVICE_SDR_INFO,	0,	0,	ipmi_get_device_sdr_info },
+	{ IPMI_SE_CMD_GET_DEVICE_SDR,		6,	0,	ipmi_get_device_sdr },
+	{ IPMI_SE_CMD_RSV_DEVICE_SDR_REPOSITORY, 0,	0,	ipmi_reserve_device_sdr_repository },
+	{ IPMI_SE_CMD_GET_SENSOR_READING,	1,	0,	ipmi_get_sensor_reading },
+};
+
+/* NETFN_NVSTORE_REQ, FRU inventory. SDR repository and SEL commands are
+ * not implemented. */
+const IPMI_CMD_DESC nvstore_cmd[] = {
+	/* command					min len	flags	handler */
+	{ IPMI_STO_CMD_GET_FRU_INVENTORY_AREA_INFO,	1,	0,	ipmi_get_fru_inventory_area_info },
+	{ IPMI_STO_CMD_READ_FRU_DATA,			4,	0,	ipmi_read_fru_data },
+	{ IPMI_STO_CMD_WRITE_FRU_DATA,			3,	CMD_FL_OPERATOR,	ipmi_write_fru_data },
+};
+
+#ifdef PICMG
+/* NETFN_PICMG_REQ, AdvancedTCA and AMC group extension */
+const IPMI_CMD_DESC picmg_cmd[] = {
+	/* command				min len	flags		handler */
+	{ ATCA_CMD_GET_PICMG_PROPERTIES,	1,	CMD_FL_PICMG,	picmg_get_picmg_properties },
+	{ ATCA_CMD_GET_ADDRESS_INFO,		1,	CMD_FL_PICMG,	picmg_get_address_info },
+	{ ATCA_CMD_GET_SHELF_ADDRESS_INFO,	1,	CMD_FL_PICMG,	picmg_get_shelf_address_info },
+	{ ATCA_CMD_SET_SHELF_ADDRESS_INFO,	2,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_shelf_address_info },
+	{ ATCA_CMD_FRU_CONTROL,			3,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_fru_control },
+	{ ATCA_CMD_GET_FRU_LED_PROPERTIES,	2,	CMD_FL_PICMG,	picmg_get_fru_led_properties },
+	{ ATCA_CMD_GET_LED_COLOR,		3,	CMD_FL_PICMG,	picmg_get_led_color_capabilities },
+	{ ATCA_CMD_SET_FRU_LED_STATE,		6,	CMD_FL_PICMG | CMD_FL_OPERATOR,	picmg_set_fru_led_state },
+	{ ATCA_CMD_GET_FRU_LED_STATE,		3,	CMD_FL_PICMG,	picmg_get_fru_led_state },
+	{ ATCA_CMD_SET_IPMB_STATE,		3,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_ipmb_state },
+	{ ATCA_CMD_SET_FRU_ACTIVATION_POLICY,	4,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_fru_activation_policy },
+	{ ATCA_CMD_GET_FRU_ACTIVATION_POLICY,	2,	CMD_FL_PICMG,	picmg_get_fru_activation_policy },
+	{ ATCA_CMD_SET_FRU_ACTIVATION,		3,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_fru_activation },
+	{ ATCA_CMD_GET_DEVICE_LOCATOR_REC_ID,	2,	CMD_FL_PICMG,	picmg_get_device_locator_rec_id },
+	{ ATCA_CMD_SET_PORT_STATE,		6,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_port_state },
+	{ ATCA_CMD_GET_PORT_STATE,		2,	CMD_FL_PICMG,	picmg_get_port_state },
+	{ ATCA_CMD_COMPUTE_POWER_PROPERTIES,	2,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_compute_power_properties },
+	{ ATCA_CMD_SET_POWER_LEVEL,		4,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_set_power_level },
+	{ ATCA_CMD_GET_POWER_LEVEL,		3,	CMD_FL_PICMG,	picmg_get_power_level },
+	{ ATCA_CMD_RENEGOTIATE_POWER,		1,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_renegotiate_power },
+	{ ATCA_CMD_GET_FAN_SPEED_PROPERTIES,	2,	CMD_FL_PICMG,	picmg_get_fan_speed_properties },
+	{ ATCA_CMD_SET_FAN_LEVEL,		3,	CMD_FL_PICMG | CMD_FL_OPERATOR,	picmg_set_fan_level },
+	{ ATCA_CMD_GET_FAN_LEVEL,		2,	CMD_FL_PICMG,	picmg_get_fan_level },
+	{ ATCA_CMD_BUSED_RESOURCE_CONTROL,	3,	CMD_FL_PICMG | CMD_FL_ADMIN,	picmg_bused_resource_control },
+	{ ATCA_CMD_GET_IPMB_LINK_INFO,		3,	CMD_FL_PICMG,	picmg_get_ipmb_link_info },
+#ifdef MMC
+	{ ATCA_CMD_FRU_CONTROL_CAPABILITIES,	2,	CMD_FL_PICMG,	mmc_get_fru_control_capabilities },
+	{ ATCA_CMD_SET_AMC_PORT_STATE,		6,	CMD_FL_PICMG | CMD_FL_ADMIN,	mmc_set_port_state },
+	{ ATCA_CMD_GET_AMC_PORT_STATE,		2,	CMD_FL_PICMG,	mmc_get_port_state },
+	{ ATCA_CMD_SET_CLOCK_STATE,		4,	CMD_FL_PICMG | CMD_FL_ADMIN,	mmc_set_clock_state },
+	{ ATCA_CMD_GET_CLOCK_STATE,		2,	CMD_FL_PICMG,	mmc_get_clock_state },
+#endif
+};
+#endif
+
+/* NETFN_OEM_REQ, our own commands under COREIPM_IANA */
+const IPMI_CMD_DESC oem_cmd[] = {
+	/* command				min len	flags	handler */
+	{ OEM_CMD_GET_STATS,			4,	0,	stats_get },
+	{ OEM_CMD_CLEAR_STATS,			3,	CMD_FL_OPERATOR,	stats_clear },
+};
+
+/*==============================================================*/
+/* Index							*/
+/*==============================================================*/
+
+typedef struct dispatch_netfn {
+	const IPMI_CMD_DESC *table;
+	unsigned char	netfn;
+	unsigned char	first_cmd;	/* command of index[0] */
+	unsigned	num_cmd;	/* index entries */
+	unsigned	count;		/* table entries */
+	unsigned char	*index;		/* command - first_cmd -> table entry + 1, 0 = none */
+	IPMI_CMD_STATS	*stats;		/* one per table entry */
+} DISPATCH_NETFN;
+
+/* netfn >> 1 -> dispatch_netfn entry + 1, 0 = none */
+unsigned char dispatch_netfn_index[DISPATCH_NUM_NETFN];
+DISPATCH_NETFN dispatch_netfn[DISPATCH_MAX_NETFN];
+unsigned dispatch_netfn_count = 0;
+unsigned char dispatch_index[DISPATCH_INDEX_SIZE];
+unsigned dispatch_index_used = 0;
+IPMI_CMD_STATS dispatch_stats[DISPATCH_MAX_CMDS];
+unsigned dispatch_stats_used = 0;
+unsigned long dispatch_invalid_count = 0;
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+int dispatch_lookup( unsigned char netfn, unsigned char command, DISPATCH_NETFN **nfp );
+void dispatch_error( IPMI_PKT *pkt, const IPMI_CMD_DESC *cmd, unsigned char completion_code );
+void dispatch_init_table( unsigned char netfn, const IPMI_CMD_DESC *table, int count );
+#if defined (POSIX)
+unsigned char dispatch_priv( const IPMI_CMD_DESC *cmd );
+#endif
+
+/*==============================================================*/
+/* Functions							*/
+/*==============================================================*/
+
+/*==============================================================
+ * dispatch_init()
+ * 	Register the standard command tables.
+ *==============================================================*/
+void
+dispatch_init( void )
+{
+	dispatch_init_table( NETFN_APP_REQ, app_cmd, 
+		sizeof( app_cmd ) / sizeof( IPMI_CMD_DESC ) );
+	dispatch_init_table( NETFN_EVENT_REQ, event_cmd, 
+		sizeof( event_cmd ) / sizeof( IPMI_CMD_DESC ) );
+	dispatch_init_table( NETFN_NVSTORE_REQ, nvstore_cmd, 
+		sizeof( nvstore_cmd ) / sizeof( IPMI_CMD_DESC ) );
+#ifdef PICMG
+	dispatch_init_table( NETFN_PICMG_REQ, picmg_cmd, 
+		sizeof( picmg_cmd ) / sizeof( IPMI_CMD_DESC ) );
+#endif
+	dispatch_init_table( NETFN_OEM_REQ, oem_cmd, 
+		sizeof( oem_cmd ) / sizeof( IPMI_CMD_DESC ) );
+}
+
+/* a standard table that does not fit leaves its netfn answering 
+ * CC_INVALID_CMD, say so */
+void
+dispatch_init_table( unsigned char netfn, const IPMI_CMD_DESC *table, int count )
+{
+	switch( dispatch_register( netfn, table, count ) ) {
+		case ESUCCESS:
+			break;
+		case ENOMEM:
+			dputstr( DBG_IPMI | DBG_ERR, "dispatch_init: no room for command table\n" );
+			break;
+		default:
+			dputstr( DBG_IPMI | DBG_ERR, "dispatch_init: bad or duplicate command table\n" );
+			break;
+	}
+}
+
+/*==============================================================
+ * dispatch_register()
+ * 	Make the commands in table available under netfn. A netfn
+ * 	has one table, the table must stay around. Returns ESUCCESS,
+ * 	EINVAL if netfn already has a table or ENOMEM if the index 
+ * 	or statistics space has run out.
+ *==============================================================*/
+int
+dispatch_register( 
+	unsigned char netfn, 
+	const IPMI_CMD_DESC *table, 
+	int count )
+{
+	DISPATCH_NETFN *nf;
+	unsigned char first = 0xff, last = 0;
+	int i;
+
+	if( ( count <= 0 ) || ( count > 255 ) || ( netfn & 1 ) 
+	    || dispatch_netfn_index[netfn >> 1] )
+		return( EINVAL );
+
+	for( i = 0; i < count; i++ ) {
+		if( table[i].command < first )
+			first = table[i].command;
+		if( table[i].command > last )
+			last = table[i].command;
+	}
+
+	if( ( dispatch_netfn_count >= DISPATCH_MAX_NETFN ) 
+	    || ( dispatch_index_used + last - first + 1 > DISPATCH_INDEX_SIZE ) 
+	    || ( dispatch_stats_used + count > DISPATCH_MAX_CMDS ) )
+		return( ENOMEM );
+
+	nf = &dispatch_netfn[dispatch_netfn_count];
+	nf->table = table;
+	nf->netfn = netfn;
+	nf->first_cmd = first;
+	nf->num_cmd = last - first + 1;
+	nf->count = count;
+	nf->index = &dispatch_index[dispatch_index_used];
+	dispatch_index_used += nf->num_cmd;
+	nf->stats = &dispatch_stats[dispatch_stats_used];
+	dispatch_stats_used += count;
+
+	for( i = 0; i < count; i++ )
+		nf->index[table[i].command - first] = i + 1;
+
+	dispatch_netfn_index[netfn >> 1] = ++dispatch_netfn_count;
+
+	return( ESUCCESS );
+}
+
+/* table entry of netfn/command, -1 if there is none */
+int
+dispatch_lookup( 
+	unsigned char netfn, 
+	unsigned char command, 
+	DISPATCH_NETFN **nfp )
+{
+	DISPATCH_NETFN *nf;
+	unsigned char n, i;
+
+	if( !( n = dispatch_netfn_index[( netfn >> 1 ) & ( DISPATCH_NUM_NETFN - 1 )] ) )
+		return( -1 );
+
+	nf = &dispatch_netfn[n - 1];
+	i = command - nf->first_cmd;
+	if( ( i >= nf->num_cmd ) || !nf->index[i] )
+		return( -1 );
+
+	*nfp = nf;
+	return( nf->index[i] - 1 );
+}
+
+/*==============================================================
+ * dispatch_request()
+ * 	Look up the handler of the request in pkt, check the request
+ * 	length and call it. The handler fills in the completion code,
+ * 	response data and pkt->hdr.resp_data_len.
+ *==============================================================*/
+void
+dispatch_request( IPMI_PKT *pkt )
+{
+	const IPMI_CMD_DESC *cmd;
+	DISPATCH_NETFN *nf;
+	int i;
+
+	dputstr( DBG_IPMI | DBG_INOUT, "dispatch_request: ingress\n" );
+
+	if( ( i = dispatch_lookup( pkt->hdr.netfn, pkt->req->command, &nf ) ) < 0 ) {
+		dputstr( DBG_IPMI | DBG_LVL1, "dispatch_request: invalid command\n" );
+		dispatch_invalid_count++;
+		dispatch_error( pkt, 0, CC_INVALID_CMD );
+	} else if( pkt->hdr.req_data_len < ( cmd = &nf->table[i] )->min_req_len ) {
+		dputstr( DBG_IPMI | DBG_ERR, "dispatch_request: request too short\n" );
+		dispatch_error( pkt, cmd, CC_RQST_DATA_LEN_INVALID );
+#if defined (POSIX)
+	} else if( rmcpd_get_priv( ( IPMI_WS * )pkt->hdr.ws ) < dispatch_priv( cmd ) ) {
+		dputstr( DBG_IPMI | DBG_ERR, "dispatch_request: insufficient privilege\n" );
+		dispatch_error( pkt, cmd, CC_SECURITY_RESTRICTION );
+#endif
+	} else {
+		( *cmd->handler )( pkt );
+	}
+
+	dputstr( DBG_IPMI | DBG_INOUT, "dispatch_request: egress\n" );
+}
+
+#if defined (POSIX)
+/* privilege level a LAN session needs for cmd */
+unsigned char
+dispatch_priv( const IPMI_CMD_DESC *cmd )
+{
+	if( cmd->flags & CMD_FL_ADMIN )
+		return( IPMI_PRIV_ADMIN );
+	if( cmd->flags & CMD_FL_OPERATOR )
+		return( IPMI_PRIV_OPERATOR );
+	return( IPMI_PRIV_USER );
+}
+#endif
+
+/* error response, PICMG commands return the PICMG Identifier with it */
+void
+dispatch_error( 
+	IPMI_PKT *pkt, 
+	const IPMI_CMD_DESC *cmd, 
+	unsigned char completion_code )
+{
+	pkt->resp->completion_code = completion_code;
+	pkt->hdr.resp_data_len = 0;
+
+	if( cmd && ( cmd->flags & CMD_FL_PICMG ) ) {
+		( ( PICMG_CMD_RESP * )pkt->resp )->picmg_id = PICMG_ID;
+		pkt->hdr.resp_data_len = 1;
+	}
+}
+
+/*==============================================================
+ * dispatch_account()
+ * 	Add a request that took time us to the counters of its
+ * 	command.
+ *==============================================================*/
+void
+dispatch_account( IPMI_PKT *pkt, unsigned long time )
+{
+	IPMI_CMD_STATS *stats;
+	DISPATCH_NETFN *nf;
+	int i;
+
+	if( ( i = dispatch_lookup( pkt->hdr.netfn, pkt->req->command, &nf ) ) < 0 )
+		return;
+
+	stats = &nf->stats[i];
+	if( !stats->count || ( time < stats->min_time ) )
+		stats->min_time = time;
+	if( time > stats->max_time )
+		stats->max_time = time;
+	stats->total_time += time;
+	stats->count++;
+}
+
+/*==============================================================
+ * dispatch_get_stats()
+ * 	Counters of the n'th registered command, 0 past the last 
+ * 	one.
+ *==============================================================*/
+IPMI_CMD_STATS *
+dispatch_get_stats( 
+	unsigned n, 
+	unsigned char *netfn, 
+	unsigned char *command )
+{
+	DISPATCH_NETFN *nf;
+	unsigned i;
+
+	for( i = 0; i < dispatch_netfn_count; i++ ) {
+		nf = &dispatch_netfn[i];
+		if( n < nf->count ) {
+			*netfn = nf->netfn;
+			*command = nf->table[n].command;
+			return( &nf->stats[n] );
+		}
+		n -= nf->count;
+	}
+	return( 0 );
+}
+
+void
+dispatch_clear_stats( void )
+{
+	unsigned i;
+
+	for( i = 0; i < dispatch_stats_used; i++ ) {
+		dispatch_stats[i].count = 0;
+		dispatch_stats[i].min_time = 0;
+		dispatch_stats[i].max_time = 0;
+		dispatch_stats[i].total_time = 0;
+	}
+	dispatch_invalid_count = 0;
+}
@@ -0,0 +1,67 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/dispatch.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Command table entry. min_req_len is the number of request data bytes 
+ * that follow the command byte, shorter requests are answered with 
+ * CC_RQST_DATA_LEN_INVALID without calling the handler. */
+typedef struct ipmi_cmd_desc {
+	unsigned char	command;
+	unsigned char	min_req_len;
+	unsigned char	flags;
+	void		( *handler )( IPMI_PKT *pkt );
+} IPMI_CMD_DESC;
+
+/* flags */
+#define CMD_FL_PICMG	0x01	/* request data starts with the PICMG Identifier,
+				   error responses return it */
+#define CMD_FL_OPERATOR	0x02	/* a LAN session needs Operator privilege, */
+#define CMD_FL_ADMIN	0x04	/* or Administrator, User without either */
+
+#define DISPATCH_NUM_NETFN	32	/* request netfns, netfn >> 1 */
+#define DISPATCH_MAX_NETFN	8	/* netfns with a command table */
+#define DISPATCH_INDEX_SIZE	256	/* command index bytes, all tables */
+#define DISPATCH_MAX_CMDS	64	/* table entries, all tables */
+
+/* Per command counters, kept for every table entry. Times are in us,
+ * from ipmi_process_pkt() picking the request up to the handler 
+ * returning, for delayed completions that is only the part done 
+ * before the handler returns. The total wraps, read and clear 
+ * periodically. */
+typedef struct ipmi_cmd_stats {
+	unsigned long	count;
+	unsigned long	min_time;
+	unsigned long	max_time;
+	unsigned long	total_time;
+} IPMI_CMD_STATS;
+
+extern unsigned long dispatch_invalid_count;	/* requests for unknown commands */
+
+void dispatch_init( void );
+int  dispatch_register( unsigned char netfn, const IPMI_CMD_DESC *table, int count );
+void dispatch_request( IPMI_PKT *pkt );
+void dispatch_account( IPMI_PKT *pkt, unsigned long time );
+IPMI_CMD_STATS *dispatch_get_stats( unsigned n, unsigned char *netfn, unsigned char *command );
+void dispatch_clear_stats( void );
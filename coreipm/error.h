@@ -27,6 +27,8 @@ support and contact details.
 #define ESUCCESS	0
 #define ENOERR		0
 #define EIO		5
+#define EAGAIN		11
 #define	ENOMEM		12
+#define	EINVAL		22
 
 
@@ -32,6 +32,7 @@ contact details.
 #include "i2c.h"
 #include "timer.h"
 #include "ws.h"
+#include "seq.h"
 #include "module.h"
 #include <string.h>
 
@@ -74,85 +75,6 @@ void ipmi_event_init( void )
 	evt_config.receiver_lun = 0;
 	evt_config.evt_enabled = 1;
 }
-	
-void
-ipmi_process_event_req( IPMI_PKT *pkt )
-{
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_event_req: ingress\n" );
-
-	switch( pkt->req->command )
-	{
-		case IPMI_SE_CMD_GET_PEF_CAPABILITIES:
-			ipmi_get_pef_capabilities( pkt );
-			break;
-			
-		case IPMI_SE_CMD_ARM_PEF_POSTPONE_TIMER:
-			ipmi_arm_pef_postpone_timer( pkt );
-			break;
-			
-		case IPMI_SE_CMD_SET_PEF_CONFIG_PARAMS:
-			ipmi_set_pef_config_params( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_PEF_CONFIG_PARAMS:
-			ipmi_get_pef_config_params( pkt );
-			break;
-			
-		case IPMI_SE_CMD_SET_LAST_PROCESSED_EVENT:
-			ipmi_set_last_processed_event( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_LAST_PROCESSED_EVENT:
-			ipmi_get_last_processed_event( pkt );
-			break;
-		
-		case IPMI_SE_CMD_SET_EVENT_RECEIVER:
-			ipmi_set_event_receiver( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_EVENT_RECEIVER:
-			ipmi_get_event_receiver( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_DEVICE_SDR_INFO:
-			ipmi_get_device_sdr_info( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_DEVICE_SDR:
-			ipmi_get_device_sdr( pkt );
-			break;
-			
-		case IPMI_SE_CMD_RSV_DEVICE_SDR_REPOSITORY:
-			ipmi_reserve_device_sdr_repository( pkt );
-			break;
-			
-		case IPMI_SE_CMD_GET_SENSOR_READING:
-			ipmi_get_sensor_reading( pkt );
-			break;
-
-		case IPMI_SE_PLATFORM_EVENT:
-			ipmi_platform_event( pkt );
-			break;
-
-		case IPMI_SE_CMD_GET_SENSOR_READING_FACTORS:
-		case IPMI_SE_CMD_SET_SENSOR_HYSTERESIS:
-		case IPMI_SE_CMD_GET_SENSOR_HYSTERESIS:
-		case IPMI_SE_CMD_SET_SENSOR_THRESHOLD:
-		case IPMI_SE_CMD_GET_SENSOR_THRESHOLD:
-		case IPMI_SE_CMD_SET_SENSOR_EVENT_ENABLE:
-		case IPMI_SE_CMD_GET_SENSOR_EVENT_ENABLE:
-		case IPMI_SE_CMD_REARM_SENSOR_EVENTS:
-		case IPMI_SE_CMD_GET_SENSOR_EVENT_STATUS:
-		case IPMI_SE_CMD_SET_SENSOR_TYPE:
-		case IPMI_SE_CMD_GET_SENSOR_TYPE:
-		case IPMI_SE_CMD_ALERT_IMMEDIATE:
-		case IPMI_SE_CMD_PET_ACKNOWLEDGE:
-		default:
-			pkt->resp->completion_code = CC_INVALID_CMD;
-			pkt->hdr.resp_data_len = 0;
-			break;
-	}
-}
 
 
 /*======================================================================*/
@@ -726,15 +648,17 @@ ipmi_send_event_req( uchar *msg_cmd, unsigned msg_len, void(*ipmi_completion_fun
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = msg_len - 1;
 	
-	ipmi_get_next_seq( &seq );
+	/* the response goes to module_process_response(), not tracked */
+	seq = seq_get_next( evt_config.receiver_slave_addr );
 	
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
 	req_ws->ipmi_completion_function = ipmi_completion_function;
+	req_ws->priority = WS_PRIO_EVENT;
 	
 	switch( req_ws->outgoing_protocol ) {
 		case IPMI_CH_PROTOCOL_IPMB: {
-			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 			req_ws->addr_out = evt_config.receiver_slave_addr;
 			pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command );
 
@@ -764,7 +688,7 @@ ipmi_send_event_req( uchar *msg_cmd, unsigned msg_len, void(*ipmi_completion_fun
 		
 		case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
 			IPMI_TERMINAL_MODE_REQUEST *tm_req = 
-				( IPMI_TERMINAL_MODE_REQUEST * )&( req_ws->pkt_in );
+				( IPMI_TERMINAL_MODE_REQUEST * )( req_ws->pkt_in );
 
 			pkt->req = ( IPMI_CMD_REQ * )&( tm_req->command );
 
@@ -87,6 +87,7 @@ taken
 #define ARCH LPC214x
 
 #include <stdio.h>
+#include <string.h>
 #include "arch.h"
 #include "timer.h"
 #include "ipmi.h"
@@ -96,30 +97,95 @@ taken
 #include "serial.h"
 #include "debug.h"
 #include "module.h"
+#include "error.h"
+#include "sched.h"
+#include "i2ctime.h"
 
 #define MAX_DELIVERY_ATTEMPTS 1
 
+/* work list state a master transfer goes back to when it can not be sent */
+#define I2C_WS_REQUEUE_STATE( ws )	\
+	( ( ( ws )->ws_state == WS_ACTIVE_MASTER_READ_PENDING ) ? \
+	  WS_ACTIVE_MASTER_READ : WS_ACTIVE_MASTER_WRITE )
+
+/* direction a device transaction starts in, a transaction with nothing
+ * to transfer just addresses the device */
+#define I2C_XACT_OP( xact )	\
+	( ( ( xact )->wlen || !( xact )->rlen ) ? OP_MODE_MASTER_XMIT : OP_MODE_MASTER_RCV )
+
+/* interrupts the fast path takes, and the block descriptor stat that
+ * turns it off */
+#define I2C_BLOCK_HIT( context, i2stat )	\
+	( ( ( i2stat ) == ( context )->blk.stat ) && ( ( context )->blk.buf < ( context )->blk.end ) )
+#define I2C_BLOCK_NONE		I2STAT_NADDR_SLAVE_MODE
+
+#ifdef I2C_PROFILE
+#define I2C_PROC_STAT( i2stat, channel )	i2c_profile_proc_stat( i2stat, channel )
+#define I2C_PROF_CYCLES( counts )	( ( counts ) * ( CCLK / PCLK ) )
+#else
+#define I2C_PROC_STAT( i2stat, channel )	i2c_proc_stat( i2stat, channel )
+#endif
+
+/* Data bytes of the transfer on the bus. The interrupt that sets it up
+ * moves the first byte, the ones after it up to end are moved at the 
+ * top of i2c_proc_stat() for as long as the bus reports stat, without
+ * going through the state machine. */
+typedef struct i2c_block {
+	unsigned char *buf;		/* next byte */
+	unsigned char *end;		/* past the last one */
+	unsigned char stat;		/* I2STAT_xx the fast path takes */
+} I2C_BLOCK;
+
 /* keep track of channel specific information */
 typedef struct i2c_context {
-	unsigned state_transition_timer;	/* timer handle */
+	I2C_BLOCK blk;			/* data bytes for the fast path */
+	unsigned long start;		/* timer_us() when the master transfer was started */
 	unsigned char state;		/* current state */
 	unsigned char op_type;		/* indicates master or slave op., used for buffer allocation */
 	unsigned char channel;		/* which channel this context belongs to */
-	unsigned error_count;
+	unsigned char enabled;		/* cleared when Set IPMB State isolates the channel */
+	unsigned char score;		/* decaying error score, see i2c_channel_state() */
+	unsigned char q_count;		/* master transfers waiting for this channel */
+	IPMI_WS *queue[I2C_CH_QUEUE_LEN];	/* oldest first */
+	I2C_BATCH *batch;		/* device transactions on the bus */
+	I2C_BATCH *batch_head;		/* batches waiting for this channel */
+	I2C_BATCH *batch_tail;
+	unsigned char timed_out;	/* i2c_timeout() went off, see i2c_timeout_recover() */
 	unsigned master_xmit_count;
 	unsigned slave_rcv_count;	/* counts the incoming slave reqs */
 	IPMI_WS *ws;		/* ptr to any buffers we are currently using */
 } I2C_CONTEXT;
 
+#ifdef I2C_PROFILE
+/* interrupt times per channel, in Timer0 counts */
+typedef struct i2c_prof {
+	unsigned long isr_count;
+	unsigned long isr_max;
+	unsigned long byte_count;	/* data bytes moved on the fast path */
+	unsigned long byte_time;
+	unsigned long frame_count;	/* master transfers, slave frames, batches */
+	unsigned long frame_time;	/* interrupt time spent on them */
+	unsigned long frame_max;
+	unsigned long frame_acc;	/* the one on the bus */
+	unsigned long hist[I2C_PROF_HIST_BUCKETS];	/* in CPU cycles */
+} I2C_PROF;
+#endif
+
 /*==============================================================*/
 /* Local Variables						*/
 /*==============================================================*/
 unsigned int	i2c_lock;
 I2C_CONTEXT	i2c_context[I2C_NUM_CHANNELS];
-unsigned	i2c_channel_selection_policy = CH_POLICY_0_ONLY;
+I2C_STATS	i2c_stats[I2C_NUM_CHANNELS];
+unsigned	i2c_channel_selection_policy = I2C_CH_POLICY;
 unsigned	i2c_last_channel_used = 1;
 unsigned	i2c_enable_timeout = 1;
-unsigned char 	retry_timer_handle;
+unsigned char 	decay_timer_handle;
+I2C_BATCH	*i2c_batch_done_head;	/* batches for i2c_batch_process() */
+I2C_BATCH	*i2c_batch_done_tail;
+#ifdef I2C_PROFILE
+I2C_PROF	i2c_prof[I2C_NUM_CHANNELS];
+#endif
 struct {
 	unsigned char *ptr;
 	unsigned len;
@@ -140,10 +206,30 @@ unsigned int remote_i2c_address;	/* used for debugging only */
 /* Local Function Prototypes					*/
 /*==============================================================*/
 void i2c_proc_stat( unsigned i2stat, unsigned channel );
+void i2c_block_set( I2C_CONTEXT *context, unsigned char *buf, unsigned len, unsigned char stat );
+#ifdef I2C_PROFILE
+void i2c_profile_proc_stat( unsigned i2stat, unsigned channel );
+#endif
 void i2c_timeout( unsigned char *arg );
+void i2c_timeout_recover( I2C_CONTEXT *context );
 void i2c_master_complete( IPMI_WS *ws, int status );
 void i2c_slave_complete( IPMI_WS *ws, int status );
-void i2c_retry_enable( unsigned char *arg );
+void i2c_score_decay( unsigned char *arg );
+void i2c_channel_error( I2C_CONTEXT *context );
+int i2c_select_channel( IPMI_WS *ws, unsigned *channel );
+void i2c_master_submit( IPMI_WS *ws );
+void i2c_master_start( I2C_CONTEXT *context, IPMI_WS *ws );
+void i2c_channel_next( I2C_CONTEXT *context );
+IPMI_WS *i2c_channel_take( I2C_CONTEXT *context, unsigned index );
+void i2c_channel_flush( I2C_CONTEXT *context );
+int i2c_batch_proc_stat( I2C_CONTEXT *context, unsigned i2stat );
+void i2c_batch_start( I2C_CONTEXT *context );
+void i2c_batch_arm( I2C_CONTEXT *context );
+void i2c_batch_done( I2C_CONTEXT *context, unsigned char status );
+void i2c_batch_next( I2C_CONTEXT *context, unsigned char status );
+void i2c_batch_detach( I2C_CONTEXT *context, unsigned char status );
+void i2c_batch_finish( I2C_BATCH *batch );
+I2C_STATS *i2c_stats_update( IPMI_WS *ws, int status );
 
 /* I2C ISR */
 #if defined (__CA__) || defined (__CC_ARM)
@@ -191,8 +277,14 @@ void i2c_initialize( void )
 	
 	for( channel = 0 ; channel < I2C_NUM_CHANNELS; channel++ ) {
 		i2c_context[channel].state = I2STAT_NADDR_SLAVE_MODE;
+		i2c_context[channel].blk.stat = I2C_BLOCK_NONE;
 		i2c_context[channel].channel = channel;
-		i2c_context[channel].error_count = 0;
+		i2c_context[channel].enabled = 1;
+		i2c_context[channel].score = 0;
+		i2c_context[channel].q_count = 0;
+		i2c_context[channel].batch = 0;
+		i2c_context[channel].batch_head = 0;
+		i2c_context[channel].batch_tail = 0;
 		i2c_context[channel].master_xmit_count = 0;
 		i2c_context[channel].slave_rcv_count = 0;
 	}
@@ -272,10 +364,10 @@ void i2c_initialize( void )
 	/* ISR address written to the respective address register*/
  	I2C1CONSET = I2C_CTRL_FL_I2EN | I2C_CTRL_FL_AA; /* enabling I2C */
 
-	/* start channel retry timer */
-	/* this resets error counts so failed channels get another chance to try */
-	timer_add_callout_queue( (void *)&retry_timer_handle,
-		       	30*HZ, i2c_retry_enable, 0 ); /* 30 sec timeout */
+	/* start the channel error score decay timer, failed channels
+	 * get back into rotation once they stop failing */
+	timer_add_callout_queue( (void *)&decay_timer_handle,
+		       	HZ, i2c_score_decay, 0 );
 
 }
 
@@ -292,7 +384,7 @@ void I2C_ISR_0( void )
 	unsigned int i2c_stat = 0;
 	
 	i2c_stat = I2C0STAT;
-	i2c_proc_stat( i2c_stat, 0 );
+	I2C_PROC_STAT( i2c_stat, 0 );
 	
 	VICVectAddr = 0xFF;	/* - update priority hardware -
 				 * the value written here is irrelevant */
@@ -307,7 +399,7 @@ void I2C_ISR_1( void )
 	unsigned int i2c_stat = 0;
 	
 	i2c_stat = I2C1STAT;
-	i2c_proc_stat( i2c_stat, 1 );
+	I2C_PROC_STAT( i2c_stat, 1 );
 	
 	VICVectAddr = 0xFF;
 }
@@ -359,6 +451,8 @@ that the IPMB message is prefixed with the 00h broadcast address.
  * i2c_proc_stat()
  * 	i2c state machine
  * 	We can only be in OP_MODE_MASTER or OP_MODE_SLAVE.
+ * 	The data bytes of a master write or a slave receive after
+ * 	the first one bypass it, see I2C_BLOCK.
  *==============================================================*/
 void
 i2c_proc_stat(unsigned i2stat, unsigned channel)
@@ -366,9 +460,24 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 	I2C_CONTEXT *context = &i2c_context[channel];
 	unsigned start_timer = 1;
 	
-	/* remove the state transition timer from the callout queue */
-	timer_remove_callout_queue( (void *)&(context->state_transition_timer) );
-	
+	/* fast path, one byte in or out and on to the next */
+	if( I2C_BLOCK_HIT( context, i2stat ) ) {
+		if( i2stat == I2STAT_MASTER_DATA_SENT_ACKED ) {
+			I2CDAT_WRITE( *context->blk.buf++, channel );
+		} else {
+			*context->blk.buf++ = I2CDAT_READ( channel );
+		}
+		I2CCONCLR( I2C_CTRL_FL_SI, channel );
+		return;
+	}
+
+	/* a batch of device transactions holds the bus from its first 
+	 * START to its last STOP */
+	if( context->batch && i2c_batch_proc_stat( context, i2stat ) ) {
+		i2c_channel_next( context );
+		return;
+	}
+
 	switch( i2stat ) {
 		/* Master transmitter/receiver mode common */
 		case I2STAT_START_SENT:
@@ -478,9 +587,11 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 				I2CCONCLR( I2C_CTRL_FL_SI, channel ); 
 			} else {
 				context->state = I2STAT_SLAW_SENT_ACKED;
-				/* write first byte of data */
-				context->ws->len_sent = 1;
-				I2CDAT_WRITE( context->ws->pkt_out[0], channel );
+				/* write first byte of data, the rest goes out
+				 * on the fast path */
+				i2c_block_set( context, WS_FRAME_OUT( context->ws ),
+					context->ws->len_out, I2STAT_MASTER_DATA_SENT_ACKED );
+				I2CDAT_WRITE( *context->blk.buf++, channel );
 				I2CCONCLR( I2C_CTRL_FL_SI, channel ); 
 			}
 			break;
@@ -491,8 +602,8 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			 * Release current ws & enter not adressed slave mode. */
 			
 			/* We will end up here if there are no listeners/open circuit
-			 * on the bus so increment the channel error count. */
-			context->error_count++;
+			 * on the bus so count it against the channel. */
+			i2c_channel_error( context );
 			
 			if( context->ws ) {
 				(*context->ws->xport_completion_function)( context->ws, I2ERR_SLARW_SENT_NOT_ACKED );
@@ -528,6 +639,8 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 				I2CCONCLR( I2C_CTRL_FL_SI, channel ); 
 			} else {
 				context->state = I2STAT_MASTER_DATA_SENT_ACKED;
+				/* this is the actual count of bytes sent */
+				context->ws->len_sent = context->blk.buf - WS_FRAME_OUT( context->ws );
 				if (context->ws->len_sent >= context->ws->len_out ) {
 					/* we've sent all the data requested of us */
 					(*context->ws->xport_completion_function)( context->ws, I2ERR_NOERR );
@@ -545,8 +658,7 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 					}
 					I2CCONCLR( I2C_CTRL_FL_SI, channel );
 				} else {
-					I2CDAT_WRITE( context->ws->pkt_out[context->ws->len_sent], channel );
-					context->ws->len_sent++;	/* this is the actual count of bytes sent */
+					I2CDAT_WRITE( *context->blk.buf++, channel );
 					I2CCONSET( I2C_CTRL_FL_AA, channel );
 					I2CCONCLR( I2C_CTRL_FL_SI, channel );
 				}
@@ -559,6 +671,7 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			 */
 			if( context->ws ) {
 				(*context->ws->xport_completion_function)( context->ws, I2ERR_NAK_RCVD );
+				context->ws = 0;
 			}
 			context->state = I2STAT_NADDR_SLAVE_MODE;
 			start_timer = 0;
@@ -615,7 +728,7 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 				I2CCONSET( I2C_CTRL_FL_STO, channel );
 				I2CCONCLR( I2C_CTRL_FL_SI, channel ); 
 			} else {
-				if( context->ws->len_in > WS_BUF_LEN ) {	
+				if( context->ws->len_in > context->ws->buf_len ) {	
 					(*context->ws->xport_completion_function)( context->ws, 
 							I2ERR_BUFFER_OVERFLOW );
 					context->ws = 0;
@@ -646,8 +759,8 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			 * Release current ws & enter not adressed slave mode. */
 			
 			/* We will end up here if there are no listeners/open circuit
-			 * on the bus so increment the channel error count. */
-			context->error_count++;
+			 * on the bus so count it against the channel. */
+			i2c_channel_error( context );
 			
 			if( context->ws ) {
 				(*context->ws->xport_completion_function)( context->ws, I2ERR_SLARW_SENT_NOT_ACKED );
@@ -706,6 +819,9 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			context->ws->xport_completion_function = i2c_slave_complete; 
 			context->ws->ipmi_completion_function = i2c_slave_receive_callback;
 			context->ws->len_in = 0; /* reset data counter */
+			/* the first data byte turns the fast path on */
+			i2c_block_set( context, context->ws->pkt_in, 
+				context->ws->buf_len, I2C_BLOCK_NONE );
 			context->state = I2STAT_SLAW_RCVD_ACKED;
 			context->slave_rcv_count++;
 			if( i2stat == I2STAT_GENERAL_CALL_RCVD_ACKED )
@@ -743,7 +859,7 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 				break;
 			}
 				
-			if( context->ws->len_in >= WS_BUF_LEN ) {
+			if( !context->ws || ( context->blk.buf >= context->blk.end ) ) {
 				if( context->ws ) {
 					(*context->ws->xport_completion_function)( context->ws, I2ERR_BUFFER_OVERFLOW );
 					context->ws = 0;
@@ -754,8 +870,9 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 				I2CCONCLR( I2C_CTRL_FL_AA, channel );
 
 			} else {
-				context->ws->pkt_in[context->ws->len_in] = I2CDAT_READ( channel );
-				context->ws->len_in++;
+				*context->blk.buf++ = I2CDAT_READ( channel );
+				/* the rest of the frame comes in on the fast path */
+				context->blk.stat = i2stat;
 			
 				/* set AA flag to get next data byte */
 				I2CCONSET( I2C_CTRL_FL_AA, channel );
@@ -784,6 +901,8 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			context->op_type = OP_MODE_SLAVE_ALLOC;
 			context->ws->xport_completion_function = i2c_slave_complete; 
 			context->ws->len_in = 0; /* reset data counter */
+			i2c_block_set( context, context->ws->pkt_in, 
+				context->ws->buf_len, I2C_BLOCK_NONE );
 			context->state = i2stat;
 			I2CCONSET( I2C_CTRL_FL_AA, channel );
 			I2CCONCLR( I2C_CTRL_FL_SI, channel );
@@ -805,6 +924,7 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			if( ( context->state == I2STAT_SLAVE_DATA_RCVD_ACKED ) ||
 			    ( context->state == I2STAT_GENERAL_CALL_DATA_RCVD_ACKED ) ) {
 				if( context->ws ) {
+					context->ws->len_in = context->blk.buf - context->ws->pkt_in;
 					(*context->ws->xport_completion_function)( context->ws, I2ERR_NOERR );
 					context->ws = 0;
 				}
@@ -895,42 +1015,124 @@ i2c_proc_stat(unsigned i2stat, unsigned channel)
 			break;
 	}
 
-	if( start_timer && i2c_enable_timeout ) {
-		timer_add_callout_queue( (void *)&context->state_transition_timer,
-		       	10*HZ, i2c_timeout, ( unsigned char * )context ); /* 10 sec timeout */
+	/* no fast path without a transfer on the bus */
+	if( !context->ws )
+		context->blk.stat = I2C_BLOCK_NONE;
+
+	/* A master transfer runs against the deadline set when it was
+	 * started. Anything else gets I2C_SLAVE_TIMEOUT to the next state
+	 * change. The fast path does not come back here, the state that
+	 * turns it on gets the time for the rest of the block as well. */
+	if( !context->ws || ( ( context->op_type != OP_MODE_MASTER_XMIT )
+	    && ( context->op_type != OP_MODE_MASTER_RCV ) ) ) {
+		context->timed_out = 0;
+		if( start_timer && i2c_enable_timeout )
+			timer_us_arm( TIMER_US_SLOT_I2C + channel, I2C_SLAVE_TIMEOUT
+				+ ( ( context->blk.stat != I2C_BLOCK_NONE ) 
+				? ( context->blk.end - context->blk.buf ) * I2C_SLAVE_BYTE_TIMEOUT : 0 ),
+				i2c_timeout, ( unsigned char * )context );
+		else
+			timer_us_cancel( TIMER_US_SLOT_I2C + channel );
 	}
+
+	/* back in slave standby, start the next master transfer waiting
+	 * for this channel */
+	i2c_channel_next( context );
 }
 
+/* point the fast path at len bytes from buf, taken on stat */
 void
-i2c_retry_enable( unsigned char *arg )
+i2c_block_set( I2C_CONTEXT *context, unsigned char *buf, unsigned len, unsigned char stat )
+{
+	context->blk.buf = buf;
+	context->blk.end = buf + len;
+	context->blk.stat = stat;
+}
+
+/* Channel error scores lose a quarter of their value every second, a
+ * single failure is forgotten in about 8 seconds. */
+void
+i2c_score_decay( unsigned char *arg )
 {
 	unsigned char channel;
 
-	/* reset error counts so failed channels get another chance to try */
 	for( channel = 0 ; channel < I2C_NUM_CHANNELS; channel++ ) {
-		i2c_context[channel].error_count = 0;
+		i2c_context[channel].score -= ( i2c_context[channel].score + 3 ) >> 2;
 	}
 
-	/* restart channel retry timer to reset the error counts again in 30 secs */
-	timer_add_callout_queue( (void *)&retry_timer_handle,
-		       	30*HZ, i2c_retry_enable, 0 ); 
+	timer_add_callout_queue( (void *)&decay_timer_handle,
+		       	HZ, i2c_score_decay, 0 );
+}
+
+/* count a failure against the channel */
+void
+i2c_channel_error( I2C_CONTEXT *context )
+{
+	if( context->score > I2C_SCORE_MAX - I2C_SCORE_ERROR )
+		context->score = I2C_SCORE_MAX;
+	else
+		context->score += I2C_SCORE_ERROR;
+}
+
+/*==============================================================
+ * i2c_channel_state()
+ * 	Health of an IPMB channel, I2C_CH_STATE_xx. The error score
+ * 	is returned in score.
+ *==============================================================*/
+unsigned char
+i2c_channel_state( unsigned channel, unsigned char *score )
+{
+	I2C_CONTEXT *context = &i2c_context[channel];
+
+	*score = context->score;
+	if( !context->enabled )
+		return( I2C_CH_STATE_DISABLED );
+	if( context->score >= I2C_SCORE_DEAD )
+		return( I2C_CH_STATE_ENABLED_DEAD );
+	if( context->score >= I2C_SCORE_DEGRADED )
+		return( I2C_CH_STATE_ENABLED_DEGRADED );
+	return( I2C_CH_STATE_ENABLED_FUNCTIONAL );
 }
 
+/* Timer1 match, the channel has not moved on in time. Putting it back
+ * in order touches the channel queue and the batch lists, that is left
+ * to the main loop. */
 void
 i2c_timeout( unsigned char *arg )
 {
 	I2C_CONTEXT *context = ( I2C_CONTEXT * )arg;
-	
+
+	context->timed_out = 1;
+	sched_post( SCHED_I2C );
+}
+
+/* Fail whatever is on a channel that timed out and put the channel back
+ * in slave standby, from i2c_batch_process(). Nothing is done if the 
+ * channel has been re-armed or cancelled since, the transfer got on. */
+void
+i2c_timeout_recover( I2C_CONTEXT *context )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	if( !context->timed_out ) {
+		ENABLE_INTERRUPTS( interrupt_mask );
+		return;
+	}
+	context->timed_out = 0;
+
 	/* state transition timeout handling */
-	dputstr( DBG_I2C | DBG_ERR, "i2c_timeout: \n" );
+	dputstr( DBG_I2C | DBG_ERR, "i2c_timeout_recover: \n" );
 
-	/* increment the channel error count. */
-	context->error_count++;
+	i2c_channel_error( context );
 	
 	if( context->ws ) {
 		(*context->ws->xport_completion_function)( context->ws, I2ERR_TIMEOUT );
 		context->ws = 0;
 	}
+	context->blk.stat = I2C_BLOCK_NONE;
+	if( context->batch )
+		i2c_batch_detach( context, I2ERR_TIMEOUT );
 
 	/* If an uncontrolled source generates a superfluous START or masks a 
 	 * STOP condition, then the I2C-bus stays busy indefinitely. If the STA
@@ -946,77 +1148,533 @@ i2c_timeout( unsigned char *arg )
 	context->state = I2STAT_NADDR_SLAVE_MODE;
 	context->op_type = OP_MODE_SLAVE;
 	I2CCONSET( I2C_CTRL_FL_STO | I2C_CTRL_FL_AA, context->channel );
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	/* the bus may still be stuck, whatever was waiting for it gets
+	 * another channel. Device batches have to stay, the next one
+	 * goes ahead and runs against its own deadline. */
+	i2c_channel_flush( context );
+	i2c_channel_next( context );
 }
 
-void
-i2c_master_read( IPMI_WS *ws )
+/*==============================================================
+ * i2c_select_channel()
+ * 	Pick the channel for a master transfer. A transfer goes to
+ * 	the channel it can start on soonest, counting what is in
+ * 	flight and queued there and holding degraded and dead
+ * 	channels back. Equal channels take turns. Returns ESUCCESS
+ * 	with the channel, EAGAIN if every usable channel has a full
+ * 	queue or EIO if none is enabled. Called with interrupts
+ * 	disabled.
+ *==============================================================*/
+int
+i2c_select_channel( IPMI_WS *ws, unsigned *channel )
 {
-	unsigned channel = 0;
 	I2C_CONTEXT *context;
+	unsigned mask, ch, n, cost, best_cost = ~0;
+	unsigned char score;
+	int status = EIO;
 
-	ws->xport_completion_function = i2c_master_complete; 
-
-	/* select channel */
 	switch( i2c_channel_selection_policy ) {
 		case CH_POLICY_0_ONLY:
-			channel = i2c_last_channel_used = 0;
+			mask = 1;
 			break;
 		case CH_POLICY_1_ONLY:
-			channel = i2c_last_channel_used = 1;
+			mask = 2;
 			break;
-		case CH_POLICY_ALL:
-			/* If we have two redundant channels, try to 
-			 * alternate the transmission of messages between
-			 * them. If we are unable to transmit on the desired
-			 * channel then we will try to send the message on the
-			 * alternate channel. If a channel error count exceeds
-			 * a threshold use the channel with least errors.
-			 * TODO use a threshold value. */
-			if( i2c_context[0].error_count == i2c_context[1].error_count ) {
-				if( i2c_last_channel_used == 0)
-					channel = i2c_last_channel_used = 1;
-				else
-					channel = i2c_last_channel_used = 0;
-			} else if ( i2c_context[0].error_count > i2c_context[1].error_count ) {
-				channel = i2c_last_channel_used = 1;
-			} else {
-				channel = i2c_last_channel_used = 0;
-			}
+		default:
+			mask = ( 1 << I2C_NUM_CHANNELS ) - 1;
 			break;
-	} 
-	
+	}
+
 	// TODO fix this code, this is a hack.
 	if( ws->interface == 1 )
-		channel = i2c_last_channel_used = ws->interface;
+		mask = 2;
+
+	for( n = 0; n < I2C_NUM_CHANNELS; n++ ) {
+		/* start after the last channel used */
+		ch = ( i2c_last_channel_used + 1 + n ) % I2C_NUM_CHANNELS;
+		context = &i2c_context[ch];
+		if( !( mask & ( 1 << ch ) ) || !context->enabled )
+			continue;
+		if( context->q_count == I2C_CH_QUEUE_LEN ) {
+			status = EAGAIN;
+			continue;
+		}
 
-	context = &i2c_context[channel];
-	
-	if( context->state == I2STAT_NADDR_SLAVE_MODE ) {
-		context->state = I2STAT_START_MASTER;
+		cost = context->q_count;
+		if( ( context->state != I2STAT_NADDR_SLAVE_MODE ) || context->ws )
+			cost++;
+		switch( i2c_channel_state( ch, &score ) ) {
+			case I2C_CH_STATE_ENABLED_DEGRADED:
+				cost += 2;
+				break;
+			case I2C_CH_STATE_ENABLED_DEAD:
+				cost += I2C_CH_QUEUE_LEN + 2;
+				break;
+		}
+		if( cost < best_cost ) {
+			best_cost = cost;
+			*channel = ch;
+			status = ESUCCESS;
+		}
+	}
+	return( status );
+}
+
+/*==============================================================
+ * i2c_master_submit()
+ * 	Hand a master read or write to the channel scheduler. It
+ * 	starts right away if the channel picked is idle and waits in
+ * 	the channel queue otherwise.
+ *==============================================================*/
+void
+i2c_master_submit( IPMI_WS *ws )
+{
+	I2C_CONTEXT *context;
+	unsigned channel;
+	int status;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	ws->xport_completion_function = i2c_master_complete;
+
+	DISABLE_INTERRUPTS;
+	if( ( status = i2c_select_channel( ws, &channel ) ) == ESUCCESS ) {
+		i2c_last_channel_used = channel;
+		context = &i2c_context[channel];
+		if( ( context->state == I2STAT_NADDR_SLAVE_MODE )
+		    && !context->ws && !context->q_count ) {
+			i2c_master_start( context, ws );
+		} else {
+			context->queue[context->q_count++] = ws;
+		}
+	}
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	if( status == EAGAIN ) {
+		/* back to the queue */
+		ws_set_state( ws, I2C_WS_REQUEUE_STATE( ws ) );
+	} else if( status != ESUCCESS ) {
+		dputstr( DBG_I2C | DBG_ERR, "i2c_master_submit: no channel enabled\n" );
+		i2c_master_complete( ws, I2ERR_STATE_TRANSITION );
+	}
+}
+
+/* take the bus for ws, called with interrupts disabled */
+void
+i2c_master_start( I2C_CONTEXT *context, IPMI_WS *ws )
+{
+	unsigned channel = context->channel;
+
+	context->state = I2STAT_START_MASTER;
+	if( ws->ws_state == WS_ACTIVE_MASTER_READ_PENDING )
 		context->op_type = OP_MODE_MASTER_RCV;
-		context->ws = ws;
-		/* Set start bit */
-		/* interrupt service routines will take care of the rest */
-		/* The master transmitter mode is entered by setting
-		 * the STA bit. The I2C logic will now test the I2C-bus and 
-		 * generate a start condition as soon as the bus becomes free.
-		 * When a START condition is transmitted, the serial interrupt 
-		 * flag (SI) is set, and the status code in the status register 
-		 * (I2STAT) will be I2STAT_START_SENT (0x08). */
-		
-		I2CCONSET( I2C_CTRL_FL_STA | I2C_CTRL_FL_I2EN, channel );
-
-		/* we will wait until a START can be sent, need to start timeout
-		 * here so we can recover and try a different channel */
-		if( i2c_enable_timeout ) {
-			timer_add_callout_queue( (void *)&context->state_transition_timer,
-		       		10*HZ, i2c_timeout, 0 ); /* 10 sec timeout */
+	else
+		context->op_type = OP_MODE_MASTER_XMIT;
+	context->ws = ws;
+
+	/* Set start bit */
+	/* interrupt service routines will take care of the rest */
+	/* The master transmitter mode is entered by setting
+	 * the STA bit. The I2C logic will now test the I2C-bus and
+	 * generate a start condition as soon as the bus becomes free.
+	 * When a START condition is transmitted, the serial interrupt
+	 * flag (SI) is set, and the status code in the status register
+	 * (I2STAT) will be I2STAT_START_SENT (0x08). */
+
+	dputstr( DBG_I2C | DBG_LVL1, "i2c_master_start: sending START bit\n" );
+
+	I2CCONCLR( I2C_CTRL_FL_STO, channel ); /* clear any residual bits */
+	I2CCONSET( I2C_CTRL_FL_STA | I2C_CTRL_FL_I2EN | I2C_CTRL_FL_AA, channel );
+
+	/* we will wait until a START can be sent, need to start timeout
+	 * here so we can recover and try a different channel or abort.
+	 * The time allowed depends on how fast this target has been. */
+	context->start = timer_us();
+	context->timed_out = 0;
+	if( i2c_enable_timeout ) {
+		timer_us_arm( TIMER_US_SLOT_I2C + channel, 
+			i2ctime_timeout( ws->addr_out, ( context->op_type == OP_MODE_MASTER_RCV ) 
+				? ws->len_rcv : ws->len_out ),
+			i2c_timeout, ( unsigned char * )context );
+	}
+}
+
+/* start the most urgent queued transfer if the channel is idle, 
+ * responses and events go ahead of sensor polling. Device batches
+ * count as WS_PRIO_BACKGROUND. */
+void
+i2c_channel_next( I2C_CONTEXT *context )
+{
+	unsigned index = 0;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	if( ( context->state == I2STAT_NADDR_SLAVE_MODE )
+	    && !context->ws && !context->batch ) {
+		if( context->q_count )
+			index = ws_prio_select( context->queue, context->q_count );
+		if( context->batch_head && ( !context->q_count 
+		    || ( ws_prio_aged( WS_PRIO_BACKGROUND, context->batch_head->queued ) 
+		    < ws_prio_rank( context->queue[index] ) ) ) )
+			i2c_batch_start( context );
+		else if( context->q_count )
+			i2c_master_start( context, i2c_channel_take( context, index ) );
+	}
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/* remove entry index from the channel queue, called with interrupts
+ * disabled */
+IPMI_WS *
+i2c_channel_take( I2C_CONTEXT *context, unsigned index )
+{
+	IPMI_WS *ws = context->queue[index];
+
+	context->q_count--;
+	for( ; index < context->q_count; index++ )
+		context->queue[index] = context->queue[index + 1];
+	return( ws );
+}
+
+/* put the transfers queued on a channel that failed or was isolated
+ * back on the work list, they get picked up by the other channel */
+void
+i2c_channel_flush( I2C_CONTEXT *context )
+{
+	IPMI_WS *ws;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	for( ;; ) {
+		DISABLE_INTERRUPTS;
+		if( !context->q_count ) {
+			ENABLE_INTERRUPTS( interrupt_mask );
+			break;
 		}
+		ws = i2c_channel_take( context, 0 );
+		ENABLE_INTERRUPTS( interrupt_mask );
+
+		ws_set_state( ws, I2C_WS_REQUEUE_STATE( ws ) );
+	}
+}
+
+/*==============================================================
+ * DEVICE TRANSACTIONS
+ *
+ * Sensors and other devices on the I2C buses are read through
+ * I2C_BATCH descriptors instead of a ws each. A batch is queued on its
+ * channel and run from the interrupt handler, one repeated START after
+ * another, so polling all the devices on a bus is one submit and one
+ * completion in the main loop however many there are. The devices do
+ * not have to be IPMB capable, a batch is never moved to the other 
+ * channel.
+ *==============================================================*/
+
+/*==============================================================
+ * i2c_batch_submit()
+ * 	Queue batch on batch->channel. complete is called from the
+ * 	main loop once every transaction has been tried, with the
+ * 	result of each in its status and the number that failed in
+ * 	batch->failed. Returns EINVAL for an empty batch or a bad
+ * 	channel, EAGAIN if the batch is still in use and EIO if the
+ * 	channel has been isolated.
+ *==============================================================*/
+int
+i2c_batch_submit( I2C_BATCH *batch )
+{
+	I2C_CONTEXT *context;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	if( !batch->count || ( batch->channel >= I2C_NUM_CHANNELS ) )
+		return( EINVAL );
+	if( batch->busy )
+		return( EAGAIN );
+	context = &i2c_context[batch->channel];
+	if( !context->enabled )
+		return( EIO );
+
+	batch->busy = 1;
+	batch->cur = 0;
+	batch->pos = 0;
+	batch->failed = 0;
+	batch->next = 0;
+	batch->queued = sched_clock();
+
+	DISABLE_INTERRUPTS;
+	if( context->batch_tail )
+		context->batch_tail->next = batch;
+	else
+		context->batch_head = batch;
+	context->batch_tail = batch;
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	i2c_channel_next( context );
+	return( ESUCCESS );
+}
+
+/*==============================================================
+ * i2c_batch_process()
+ * 	SCHED_I2C, recover the channels that timed out and hand 
+ * 	the batches that are done back to their owners.
+ *==============================================================*/
+void
+i2c_batch_process( void )
+{
+	I2C_BATCH *batch;
+	unsigned channel;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	for( channel = 0; channel < I2C_NUM_CHANNELS; channel++ ) {
+		if( i2c_context[channel].timed_out )
+			i2c_timeout_recover( &i2c_context[channel] );
+	}
+
+	for( ;; ) {
+		DISABLE_INTERRUPTS;
+		if( ( batch = i2c_batch_done_head ) ) {
+			if( !( i2c_batch_done_head = batch->next ) )
+				i2c_batch_done_tail = 0;
+			batch->next = 0;
+			batch->busy = 0;
+		}
+		ENABLE_INTERRUPTS( interrupt_mask );
+		if( !batch )
+			break;
+		if( batch->complete )
+			( batch->complete )( batch );
+	}
+}
+
+/* take the bus for the batch at the head of the channel queue, called
+ * with interrupts disabled */
+void
+i2c_batch_start( I2C_CONTEXT *context )
+{
+	I2C_BATCH *batch = context->batch_head;
+	unsigned channel = context->channel;
+
+	if( !( context->batch_head = batch->next ) )
+		context->batch_tail = 0;
+	batch->next = 0;
+	context->batch = batch;
+	context->state = I2STAT_START_MASTER;
+	context->op_type = I2C_XACT_OP( &batch->xact[batch->cur] );
+
+	I2CCONCLR( I2C_CTRL_FL_STO, channel );
+	I2CCONSET( I2C_CTRL_FL_STA | I2C_CTRL_FL_I2EN | I2C_CTRL_FL_AA, channel );
+	i2c_batch_arm( context );
+}
+
+/* start the clock on the transaction about to go out */
+void
+i2c_batch_arm( I2C_CONTEXT *context )
+{
+	I2C_XACT *xact = &context->batch->xact[context->batch->cur];
+
+	context->start = timer_us();
+	context->timed_out = 0;
+	if( i2c_enable_timeout ) {
+		timer_us_arm( TIMER_US_SLOT_I2C + context->channel,
+			i2ctime_timeout( xact->addr, xact->wlen + xact->rlen ),
+			i2c_timeout, ( unsigned char * )context );
+	}
+}
+
+/*==============================================================
+ * i2c_batch_proc_stat()
+ * 	i2c state machine for the batch on the bus. Returns 0 if
+ * 	the batch has let go of the bus and i2c_proc_stat() has to
+ * 	handle i2stat as usual, e.g. arbitration lost or a bus
+ * 	error.
+ *==============================================================*/
+int
+i2c_batch_proc_stat( I2C_CONTEXT *context, unsigned i2stat )
+{
+	I2C_BATCH *batch = context->batch;
+	I2C_XACT *xact = &batch->xact[batch->cur];
+	unsigned channel = context->channel;
+
+	switch( i2stat ) {
+		case I2STAT_START_SENT:
+		case I2STAT_REP_START_SENT:
+			/* the write part goes first, the read follows it 
+			 * after a repeated START */
+			context->state = i2stat;
+			if( context->op_type == OP_MODE_MASTER_XMIT ) {
+				I2CDAT_WRITE( xact->addr | DATA_DIRECTION_WRITE, channel );
+			} else {
+				I2CDAT_WRITE( xact->addr | DATA_DIRECTION_READ, channel );
+			}
+			I2CCONCLR( I2C_CTRL_FL_SI | I2C_CTRL_FL_STA, channel );
+			break;
+
+		case I2STAT_SLAW_SENT_ACKED:
+		case I2STAT_MASTER_DATA_SENT_ACKED:
+			context->state = i2stat;
+			if( batch->pos < xact->wlen ) {
+				I2CDAT_WRITE( xact->wbuf[batch->pos], channel );
+				batch->pos++;
+				I2CCONCLR( I2C_CTRL_FL_SI, channel );
+			} else if( xact->rlen ) {
+				batch->pos = 0;
+				context->op_type = OP_MODE_MASTER_RCV;
+				I2CCONSET( I2C_CTRL_FL_STA, channel );
+				I2CCONCLR( I2C_CTRL_FL_SI, channel );
+			} else {
+				i2c_batch_next( context, I2ERR_NOERR );
+			}
+			break;
+
+		case I2STAT_SLAR_SENT_ACKED:
+			/* acknowledge every byte but the last */
+			context->state = i2stat;
+			if( xact->rlen > 1 ) {
+				I2CCONSET( I2C_CTRL_FL_AA, channel );
+			} else {
+				I2CCONCLR( I2C_CTRL_FL_AA, channel );
+			}
+			I2CCONCLR( I2C_CTRL_FL_SI, channel );
+			break;
+
+		case I2STAT_MASTER_DATA_RCVD_ACKED:
+			context->state = i2stat;
+			xact->rbuf[batch->pos] = I2CDAT_READ( channel );
+			batch->pos++;
+			if( batch->pos + 1 < xact->rlen ) {
+				I2CCONSET( I2C_CTRL_FL_AA, channel );
+			} else {
+				I2CCONCLR( I2C_CTRL_FL_AA, channel );
+			}
+			I2CCONCLR( I2C_CTRL_FL_SI, channel );
+			break;
+
+		case I2STAT_MASTER_DATA_RCVD_NOT_ACKED:
+			/* the last byte */
+			xact->rbuf[batch->pos] = I2CDAT_READ( channel );
+			batch->pos++;
+			i2c_batch_next( context, I2ERR_NOERR );
+			break;
+
+		/* a device that is not there or not ready does not count
+		 * against the channel, it may not be on the IPMB */
+		case I2STAT_SLAW_SENT_NOT_ACKED:
+		case I2STAT_SLAR_SENT_NOT_ACKED:
+			i2c_batch_next( context, I2ERR_SLARW_SENT_NOT_ACKED );
+			break;
+
+		case I2STAT_MASTER_DATA_SENT_NOT_ACKED:
+			i2c_batch_next( context, I2ERR_NAK_RCVD );
+			break;
+
+		case I2STAT_ARBITRATION_LOST:
+		case I2STAT_ARB_LOST_SLAW_RCVD_ACKED:
+		case I2STAT_ARB_LOST_GENERAL_CALL_RCVD_ACKED:
+		case I2STAT_ARB_LOST_SLAR_RCVD_ACKED:
+			i2c_batch_detach( context, I2ERR_ARBITRATION_LOST );
+			return( 0 );
+
+		default:
+			i2c_batch_detach( context, I2ERR_STATE_TRANSITION );
+			return( 0 );
+	}
+	return( 1 );
+}
+
+/* account for the transaction on the bus */
+void
+i2c_batch_done( I2C_CONTEXT *context, unsigned char status )
+{
+	I2C_BATCH *batch = context->batch;
+	I2C_XACT *xact = &batch->xact[batch->cur];
+
+	xact->status = status;
+	switch( status ) {
+		case I2ERR_NOERR:
+			i2c_stats[context->channel].master_count++;
+			i2ctime_done( xact->addr, context->start );
+			break;
+		case I2ERR_SLARW_SENT_NOT_ACKED:
+		case I2ERR_NAK_RCVD:
+			i2c_stats[context->channel].nak_count++;
+			batch->failed++;
+			break;
+		case I2ERR_TIMEOUT:
+			i2ctime_expired( xact->addr );
+			/* fall through */
+		default:
+			i2c_stats[context->channel].error_count++;
+			batch->failed++;
+			break;
+	}
+	batch->cur++;
+	batch->pos = 0;
+}
+
+/* finish the transaction on the bus and go on to the next one with a
+ * repeated START, or release the bus after the last one. Called from
+ * the interrupt handler. */
+void
+i2c_batch_next( I2C_CONTEXT *context, unsigned char status )
+{
+	I2C_BATCH *batch = context->batch;
+	unsigned channel = context->channel;
+
+	i2c_batch_done( context, status );
+	if( batch->cur < batch->count ) {
+		context->op_type = I2C_XACT_OP( &batch->xact[batch->cur] );
+		I2CCONSET( I2C_CTRL_FL_STA, channel );
+		I2CCONCLR( I2C_CTRL_FL_SI, channel );
+		i2c_batch_arm( context );
+		return;
+	}
+
+	context->batch = 0;
+	context->state = I2STAT_NADDR_SLAVE_MODE;
+	context->op_type = OP_MODE_SLAVE;
+	I2CCONSET( I2C_CTRL_FL_AA | I2C_CTRL_FL_STO, channel );
+	I2CCONCLR( I2C_CTRL_FL_SI, channel );
+	context->timed_out = 0;
+	timer_us_cancel( TIMER_US_SLOT_I2C + channel );
+	i2c_batch_finish( batch );
+}
+
+/* The batch has lost the bus. The transaction on it fails and the rest
+ * of the batch goes back to the head of the channel queue. The caller
+ * puts the bus back in order. Called with interrupts disabled. */
+void
+i2c_batch_detach( I2C_CONTEXT *context, unsigned char status )
+{
+	I2C_BATCH *batch = context->batch;
+
+	i2c_batch_done( context, status );
+	context->batch = 0;
+	if( batch->cur < batch->count ) {
+		if( !( batch->next = context->batch_head ) )
+			context->batch_tail = batch;
+		context->batch_head = batch;
 	} else {
-		/* back to the queue */
-		ws_set_state( ws, WS_ACTIVE_MASTER_READ );
-	}		
+		i2c_batch_finish( batch );
+	}
+}
 
+/* pass batch on to i2c_batch_process(), called with interrupts
+ * disabled */
+void
+i2c_batch_finish( I2C_BATCH *batch )
+{
+	batch->next = 0;
+	if( i2c_batch_done_tail )
+		i2c_batch_done_tail->next = batch;
+	else
+		i2c_batch_done_head = batch;
+	i2c_batch_done_tail = batch;
+	sched_post( SCHED_I2C );
+}
+
+void
+i2c_master_read( IPMI_WS *ws )
+{
+	i2c_master_submit( ws );
 }
 
 /*
@@ -1027,76 +1685,52 @@ i2c_master_read( IPMI_WS *ws )
 void 
 i2c_master_write( IPMI_WS *ws )
 {
-	unsigned channel = 0;
-	I2C_CONTEXT *context;
+	i2c_master_submit( ws );
+}
 
-	ws->xport_completion_function = i2c_master_complete; 
-	
-	/* select channel */
-	switch( i2c_channel_selection_policy ) {
-		case CH_POLICY_0_ONLY:
-			channel = i2c_last_channel_used = 0;
+/* count a master transfer against the channel that carried it and time it */
+I2C_STATS *
+i2c_stats_update( IPMI_WS *ws, int status )
+{
+	I2C_STATS *stats = &i2c_stats[0];
+	I2C_CONTEXT *context = 0;
+	unsigned channel;
+
+	for( channel = 0; channel < I2C_NUM_CHANNELS; channel++ ) {
+		if( i2c_context[channel].ws == ws ) {
+			stats = &i2c_stats[channel];
+			context = &i2c_context[channel];
 			break;
-		case CH_POLICY_1_ONLY:
-			channel = i2c_last_channel_used = 1;
+		}
+	}
+
+	switch( status ) {
+		case I2ERR_NOERR:
+			stats->master_count++;
+			if( context )
+				i2ctime_done( ws->addr_out, context->start );
 			break;
-		case CH_POLICY_ALL:
-			/* If we have two redundant channels, try to 
-			 * alternate the transmission of messages between
-			 * them. If we are unable to transmit on the desired
-			 * channel then we will try to send the message on the
-			 * alternate channel. If a channel error count exceeds
-			 * a threshold use the channel with least errors.
-			 * TODO use a threshold value. */
-			if( i2c_context[0].error_count == i2c_context[1].error_count ) {
-				if( i2c_last_channel_used == 0)
-					channel = i2c_last_channel_used = 1;
-				else
-					channel = i2c_last_channel_used = 0;
-			} else if ( i2c_context[0].error_count > i2c_context[1].error_count ) {
-				channel = i2c_last_channel_used = 1;
-			} else {
-				channel = i2c_last_channel_used = 0;
-			}
+		case I2ERR_TIMEOUT:
+			stats->error_count++;
+			i2ctime_expired( ws->addr_out );
 			break;
-	} /* end of switch */
-	
-	context = &i2c_context[channel];
-	
-	if( context->state == I2STAT_NADDR_SLAVE_MODE ) {
-		context->state = I2STAT_START_MASTER;
-		context->op_type = OP_MODE_MASTER_XMIT;
-		context->ws = ws;
-		/* Set start bit */
-		/* interrupt service routines will take care of the rest */
-		/* The master transmitter mode is entered by setting
-		 * the STA bit. The I2C logic will now test the I2C-bus and 
-		 * generate a start condition as soon as the bus becomes free.
-		 * When a START condition is transmitted, the serial interrupt 
-		 * flag (SI) is set, and the status code in the status register 
-		 * (I2STAT) will be I2STAT_START_SENT (0x08). */
-		
-		dputstr( DBG_I2C | DBG_LVL1, "i2c_master_write: sending START bit\n" );
-
-		I2CCONCLR( I2C_CTRL_FL_STO, channel ); /* clear any residual bits */
-		I2CCONSET( I2C_CTRL_FL_STA | I2C_CTRL_FL_I2EN | I2C_CTRL_FL_AA, channel );
-		
-		/* we will wait until a START can be sent, need to start timeout
-		 * here so we can recover and try a different channel or abort */
-		if( i2c_enable_timeout ) {
-			timer_add_callout_queue( (void *)&context->state_transition_timer,
-		       		10*HZ, i2c_timeout, ( unsigned char * )context ); /* 10 sec timeout */
-		}
-	} else {
-		/* back to the queue */
-		ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
-	}		
+		case I2ERR_SLARW_SENT_NOT_ACKED:
+		case I2ERR_NAK_RCVD:
+			stats->nak_count++;
+			break;
+		default:
+			stats->error_count++;
+			break;
+	}
+	return( stats );
 }
 
 /* Master op transport completion routine */
 void
 i2c_master_complete( IPMI_WS *ws, int status )
 {
+	I2C_STATS *stats = i2c_stats_update( ws, status );
+
 	switch( status ) {
 		case I2ERR_NOERR:
 			dputstr( DBG_I2C | DBG_LVL1, "i2c_master_complete: completed with I2ERR_NOERR\n" );
@@ -1124,11 +1758,13 @@ i2c_master_complete( IPMI_WS *ws, int status )
 			if( ( WS_ACTIVE_MASTER_WRITE_PENDING == ws->ws_state ) 
 					&& ( ws->delivery_attempts < MAX_DELIVERY_ATTEMPTS ) ) 
 			{
+				stats->retry_count++;
 				ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
 			} 
 			else if( ( WS_ACTIVE_MASTER_READ_PENDING == ws->ws_state ) 
 					&& ( ws->delivery_attempts < MAX_DELIVERY_ATTEMPTS ) ) 
 			{
+				stats->retry_count++;
 				ws_set_state( ws, WS_ACTIVE_MASTER_READ );
 			} else {
 				/* invalid state or exceeded retries - return error to upper layer */
@@ -1165,13 +1801,22 @@ i2c_slave_complete( IPMI_WS *ws, int status )
 void
 i2c_interface_enable_local_control( uchar channel, uchar link_id )
 {
+	if( channel >= I2C_NUM_CHANNELS )
+		return;
+	i2c_context[channel].enabled = 1;
 	I2CCONSET( I2C_CTRL_FL_I2EN, channel );
 }
 
+/* An isolated channel takes no more master transfers, the ones queued
+ * for it move to the other channel. A transfer in progress times out. */
 void
 i2c_interface_disable( uchar channel, uchar link_id )
 {
+	if( channel >= I2C_NUM_CHANNELS )
+		return;
+	i2c_context[channel].enabled = 0;
 	I2CCONCLR( I2C_CTRL_FL_I2EN, channel );
+	i2c_channel_flush( &i2c_context[channel] );
 }
 
 
@@ -1191,6 +1836,111 @@ i2c_set_slave_receive_callback( void ( *callback_fn )( void *, int ) )
 	i2c_slave_receive_callback = callback_fn;
 }
 
+#ifdef I2C_PROFILE
+/*==============================================================*/
+/*			INTERRUPT PROFILE			*/
+/*==============================================================*/
+
+/*==============================================================
+ * i2c_profile_proc_stat()
+ * 	i2c_proc_stat() timed against Timer0 for I2C_PROFILE
+ * 	builds. The time goes to the interrupt histogram, to the
+ * 	fast path byte time if the interrupt took it and to the
+ * 	frame it belongs to, a master transfer, a slave frame or a
+ * 	batch from its first interrupt to the one that completes it.
+ *==============================================================*/
+void
+i2c_profile_proc_stat( unsigned i2stat, unsigned channel )
+{
+	I2C_CONTEXT *context = &i2c_context[channel];
+	I2C_PROF *prof = &i2c_prof[channel];
+	IPMI_WS *ws = context->ws;
+	I2C_BATCH *batch = context->batch;
+	unsigned long begin, end, counts;
+	unsigned fast, bucket;
+
+	begin = T0TC;
+	fast = I2C_BLOCK_HIT( context, i2stat );
+
+	i2c_proc_stat( i2stat, channel );
+
+	/* Timer0 resets on match, hardclock() can not run before we
+	 * return */
+	end = T0TC;
+	if( end >= begin )
+		counts = end - begin;
+	else
+		counts = end + T0MR0 + 1 - begin;
+
+	prof->isr_count++;
+	if( counts > prof->isr_max )
+		prof->isr_max = counts;
+	for( bucket = 0; bucket < I2C_PROF_HIST_BUCKETS - 1; bucket++ ) {
+		if( I2C_PROF_CYCLES( counts ) < ( I2C_PROF_HIST_BASE << bucket ) )
+			break;
+	}
+	prof->hist[bucket]++;
+
+	if( fast ) {
+		prof->byte_count++;
+		prof->byte_time += counts;
+	}
+
+	/* a frame ends when the interrupt let go of its work set or
+	 * batch, the next one may already have started */
+	if( ws || batch || context->ws )
+		prof->frame_acc += counts;
+	if( ( ws && ( context->ws != ws ) ) || ( batch && ( context->batch != batch ) ) ) {
+		prof->frame_count++;
+		prof->frame_time += prof->frame_acc;
+		if( prof->frame_acc > prof->frame_max )
+			prof->frame_max = prof->frame_acc;
+		prof->frame_acc = 0;
+	}
+}
+
+/*==============================================================
+ * i2c_profile_reset()
+ *==============================================================*/
+void
+i2c_profile_reset( void )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	memset( i2c_prof, 0, sizeof( i2c_prof ) );
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * i2c_profile_print()
+ * 	[SYS STATS] lines, one per channel. Times are in CPU cycles,
+ * 	the longest interrupt, the average per fast path byte and
+ * 	the average and longest interrupt time per frame, followed
+ * 	by the interrupt histogram.
+ *==============================================================*/
+void
+i2c_profile_print( void )
+{
+	I2C_PROF *prof;
+	unsigned channel, bucket;
+
+	for( channel = 0; channel < I2C_NUM_CHANNELS; channel++ ) {
+		prof = &i2c_prof[channel];
+		printf( "I2C%u isr %lu max %lu byte %lu avg %lu frame %lu avg %lu max %lu cyc hist",
+			channel, prof->isr_count, I2C_PROF_CYCLES( prof->isr_max ),
+			prof->byte_count, prof->byte_count ? 
+			I2C_PROF_CYCLES( prof->byte_time / prof->byte_count ) : 0,
+			prof->frame_count, prof->frame_count ?
+			I2C_PROF_CYCLES( prof->frame_time / prof->frame_count ) : 0,
+			I2C_PROF_CYCLES( prof->frame_max ) );
+		for( bucket = 0; bucket < I2C_PROF_HIST_BUCKETS; bucket++ )
+			printf( " %lu", prof->hist[bucket] );
+		printf( "\n" );
+	}
+}
+#endif
+
 /*==============================================================*/
 /*			TEST & DEBUG FUNCTIONS			*/
 /*==============================================================*/
@@ -54,6 +54,17 @@ Available addresses are therefore:
 
 #define I2C_NUM_CHANNELS	2
 #define I2C_CLOCK_RATE		100000
+#define I2C_SLAVE_TIMEOUT	25000	/* us from one slave state to the next */
+#define I2C_SLAVE_BYTE_TIMEOUT	( 4 * 9 * 1000000 / I2C_CLOCK_RATE )
+					/* us more for each data byte the fast 
+					   path takes, at a quarter of the 
+					   clock rate */
+
+/* I2C_PROFILE builds time every I2C interrupt, see i2c_profile_print() */
+#define I2C_PROF_HIST_BUCKETS	8	/* bucket n counts interrupts under
+					   I2C_PROF_HIST_BASE << n CPU cycles,
+					   the last one the rest */
+#define I2C_PROF_HIST_BASE	64
 
 /*==============================================================*/
 /* I2C control flags						*/
@@ -125,6 +136,18 @@ Available addresses are therefore:
 #define I2C_CH_STATE_ENABLED_DEGRADED	0x2
 #define I2C_CH_STATE_ENABLED_DEAD	0x3
 
+/* Channel scheduler. Every failed transfer adds I2C_SCORE_ERROR to the
+ * channel error score, which loses a quarter of its value each second.
+ * The channel health follows from the score. */
+#ifndef I2C_CH_POLICY
+#define I2C_CH_POLICY		CH_POLICY_0_ONLY
+#endif
+#define I2C_CH_QUEUE_LEN	4	/* transfers waiting for a channel */
+#define I2C_SCORE_ERROR		16
+#define I2C_SCORE_DEGRADED	32	/* used when the other channel is busy */
+#define I2C_SCORE_DEAD		128	/* used when no other channel can take it */
+#define I2C_SCORE_MAX		255
+
 /* Error codes */
 #define I2ERR_NOERR			0x0
 #define I2ERR_STATE_TRANSITION		0x1
@@ -192,7 +215,45 @@ Available addresses are therefore:
 /*==============================================================*/
 /* Data Structures						*/
 /*==============================================================*/
+/* master transfer counts per channel, unlike the channel error count
+ * these are never reset by the driver */
+typedef struct i2c_stats {
+	unsigned long master_count;	/* master transfers completed */
+	unsigned long retry_count;	/* failed transfers put back on the queue */
+	unsigned long nak_count;	/* address or data not acknowledged */
+	unsigned long error_count;	/* arbitration lost, timeouts, bus errors */
+} I2C_STATS;
+
+extern I2C_STATS i2c_stats[I2C_NUM_CHANNELS];
+
+/* Raw device access, separate from the IPMI work sets. A transaction
+ * writes wlen bytes, typically a register pointer, then reads rlen bytes
+ * after a repeated START, either may be 0. A batch runs its transactions
+ * back to back on one channel, each following the last with another 
+ * repeated START, and releases the bus after the last one. The caller
+ * owns the batch and the buffers until complete is called. */
+typedef struct i2c_xact {
+	unsigned char addr;		/* slave address, R/W bit clear */
+	unsigned char wlen;		/* bytes to write from wbuf */
+	unsigned char rlen;		/* bytes to read into rbuf */
+	unsigned char status;		/* I2ERR_xx once the batch is done */
+	unsigned char *wbuf;
+	unsigned char *rbuf;
+} I2C_XACT;
 
+typedef struct i2c_batch {
+	struct i2c_batch *next;		/* channel queue, then the done list */
+	I2C_XACT *xact;			/* count transactions */
+	unsigned char count;
+	unsigned char channel;
+	unsigned char busy;		/* from i2c_batch_submit() until complete */
+	unsigned char cur;		/* transaction on the bus */
+	unsigned char pos;		/* bytes of it written or read so far */
+	unsigned char failed;		/* transactions that did not complete */
+	unsigned long queued;		/* sched_clock() when submitted */
+	void ( *complete )( struct i2c_batch *batch );	/* from the main loop */
+	void *arg;			/* for the owner */
+} I2C_BATCH;
 
 /*==============================================================*/
 /* Function Prototypes						*/
@@ -201,9 +262,16 @@ void i2c_initialize( void );
 void i2c_send( void *ws );
 void i2c_interface_enable_local_control( unsigned char channel, unsigned char link_id );
 void i2c_interface_disable( unsigned char channel, unsigned char link_id );
+unsigned char i2c_channel_state( unsigned channel, unsigned char *score );
 void i2c_master_write( IPMI_WS *ws );
 void i2c_master_read( IPMI_WS *ws );
 void i2c_test_read( void );
 void i2c_test_write( void );
 void i2c_set_slave_receive_callback( void ( *callback_fn )( void *, int ) );
 void i2c_set_read_buffer( unsigned char *buf, unsigned buf_len );
+int i2c_batch_submit( I2C_BATCH *batch );
+void i2c_batch_process( void );
+#ifdef I2C_PROFILE
+void i2c_profile_reset( void );
+void i2c_profile_print( void );
+#endif
@@ -0,0 +1,216 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/i2ctime.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+I2C master transfer timing
+
+The I2C drivers time every master transfer against the free running
+microsecond clock, timer_us(), from the moment they ask for the bus until
+the last byte is acknowledged. The times are kept per slave address:
+
+- a smoothed transfer time and deviation, the same estimator TCP uses for
+  its round trip time, from which i2ctime_timeout() derives the deadline
+  for the next transfer to that address. A target that answers in 3 ms
+  gets its bus back within a few ms of hanging instead of waiting out a
+  fixed timeout. A transfer that runs out of time doubles the deviation
+  so a target that has slowed down is not cut off over and over.
+- a histogram of transfer times in power of 2 buckets from 256 us, for
+  diagnosis. [SYS STATS] prints them and the statistics commands hand 
+  them out, see stats.h.
+
+I2CTIME_NUM_TARGETS addresses are tracked, a new one takes over the entry
+used longest ago.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "arch.h"
+#include "ipmi.h"
+#include "ws.h"
+#include "i2c.h"
+#include "timer.h"
+#include "i2ctime.h"
+
+extern unsigned long lbolt;
+
+I2CTIME_TARGET i2ctime_target[I2CTIME_NUM_TARGETS];
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+I2CTIME_TARGET *i2ctime_lookup( unsigned char addr );
+
+/* find the entry for addr, taking one over for a new address, called
+ * with interrupts disabled */
+I2CTIME_TARGET *
+i2ctime_lookup( unsigned char addr )
+{
+	I2CTIME_TARGET *t, *oldest = &i2ctime_target[0];
+	unsigned i;
+
+	for( i = 0; i < I2CTIME_NUM_TARGETS; i++ ) {
+		t = &i2ctime_target[i];
+		if( !t->used ) {
+			/* entries are used in order, no match past here */
+			oldest = t;
+			break;
+		}
+		if( t->addr == addr ) {
+			t->last_use = lbolt;
+			return( t );
+		}
+		if( ( long )( t->last_use - oldest->last_use ) < 0 )
+			oldest = t;
+	}
+
+	memset( oldest, 0, sizeof( I2CTIME_TARGET ) );
+	oldest->used = 1;
+	oldest->addr = addr;
+	oldest->last_use = lbolt;
+	return( oldest );
+}
+
+/*==============================================================
+ * i2ctime_timeout()
+ * 	Timeout in us for a transfer of len bytes to addr.
+ *==============================================================*/
+unsigned long
+i2ctime_timeout( unsigned char addr, unsigned len )
+{
+	I2CTIME_TARGET *t;
+	unsigned long timeout, wire = 2 * ( len + 1 ) * I2CTIME_BYTE;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	t = i2ctime_lookup( addr );
+	if( t->count )
+		timeout = ( t->srtt >> 3 ) + t->rttvar;
+	else
+		timeout = I2CTIME_INITIAL;
+
+	if( timeout < wire )
+		timeout = wire;
+	if( timeout < I2CTIME_MIN )
+		timeout = I2CTIME_MIN;
+	if( timeout > I2CTIME_MAX )
+		timeout = I2CTIME_MAX;
+	t->timeout = timeout;
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	return( timeout );
+}
+
+/*==============================================================
+ * i2ctime_done()
+ * 	A transfer to addr that started at timer_us() start has
+ * 	completed, update its estimate and histogram.
+ *==============================================================*/
+void
+i2ctime_done( unsigned char addr, unsigned long start )
+{
+	I2CTIME_TARGET *t;
+	unsigned long us = timer_us() - start;
+	long delta;
+	unsigned bucket;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	t = i2ctime_lookup( addr );
+	if( !t->count ) {
+		t->srtt = us << 3;
+		t->rttvar = us << 1;
+	} else {
+		delta = us - ( t->srtt >> 3 );
+		t->srtt += delta;
+		if( delta < 0 )
+			delta = -delta;
+		t->rttvar += delta - ( t->rttvar >> 2 );
+	}
+	t->count++;
+	if( us > t->max )
+		t->max = us;
+
+	for( bucket = 0; bucket < I2CTIME_HIST_BUCKETS - 1; bucket++ ) {
+		if( us < ( I2CTIME_HIST_BASE << bucket ) )
+			break;
+	}
+	if( t->hist[bucket] != 0xffff )
+		t->hist[bucket]++;
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * i2ctime_expired()
+ * 	A transfer to addr ran out of time, back off.
+ *==============================================================*/
+void
+i2ctime_expired( unsigned char addr )
+{
+	I2CTIME_TARGET *t;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	t = i2ctime_lookup( addr );
+	if( t->expired != 0xffff )
+		t->expired++;
+	if( t->rttvar < I2CTIME_MAX )
+		t->rttvar = ( t->rttvar << 1 ) + I2CTIME_MIN;
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * i2ctime_reset()
+ * 	Forget every target.
+ *==============================================================*/
+void
+i2ctime_reset( void )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	memset( i2ctime_target, 0, sizeof( i2ctime_target ) );
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * i2ctime_print()
+ * 	[SYS STATS] lines, one per target.
+ *==============================================================*/
+void
+i2ctime_print( void )
+{
+	I2CTIME_TARGET *t;
+	unsigned i, bucket;
+
+	for( i = 0; ( i < I2CTIME_NUM_TARGETS ) && i2ctime_target[i].used; i++ ) {
+		t = &i2ctime_target[i];
+		printf( "I2C 0x%02x xfer %lu avg %luus max %luus timeout %luus expired %u hist",
+			t->addr, t->count, t->srtt >> 3, t->max, t->timeout, t->expired );
+		for( bucket = 0; bucket < I2CTIME_HIST_BUCKETS; bucket++ )
+			printf( " %u", t->hist[bucket] );
+		printf( "\n" );
+	}
+}
@@ -0,0 +1,68 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/i2ctime.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* I2C master transfer timing, see i2ctime.c */
+
+#define I2CTIME_NUM_TARGETS	16	/* slave addresses timed at once */
+#define I2CTIME_HIST_BUCKETS	8	/* bucket n counts transfers under 
+					   I2CTIME_HIST_BASE << n us, the
+					   last one the rest */
+#define I2CTIME_HIST_BASE	256
+
+/* Transfer timeouts in us. A target that has not been timed yet gets 
+ * I2CTIME_INITIAL, after that the timeout follows its transfer times. 
+ * Never less than twice the time the frame takes on the wire. */
+#ifndef I2CTIME_INITIAL
+#define I2CTIME_INITIAL		25000
+#endif
+#ifndef I2CTIME_MIN
+#define I2CTIME_MIN		5000
+#endif
+#ifndef I2CTIME_MAX
+#define I2CTIME_MAX		100000
+#endif
+#define I2CTIME_BYTE		( 9 * 1000000 / I2C_CLOCK_RATE )	/* us per byte */
+
+typedef struct i2ctime_target {
+	unsigned char used;
+	unsigned char addr;		/* slave address */
+	unsigned short expired;		/* transfers that ran out of time */
+	unsigned long count;		/* transfers timed */
+	unsigned long srtt;		/* smoothed transfer time, us * 8 */
+	unsigned long rttvar;		/* smoothed deviation, us * 4 */
+	unsigned long max;		/* longest transfer, us */
+	unsigned long timeout;		/* last timeout handed out, us */
+	unsigned long last_use;		/* lbolt, the oldest entry is reused */
+	unsigned short hist[I2CTIME_HIST_BUCKETS];
+} I2CTIME_TARGET;
+
+extern I2CTIME_TARGET i2ctime_target[I2CTIME_NUM_TARGETS];
+
+unsigned long i2ctime_timeout( unsigned char addr, unsigned len );
+void i2ctime_done( unsigned char addr, unsigned long start );
+void i2ctime_expired( unsigned char addr );
+void i2ctime_reset( void );
+void i2ctime_print( void );
@@ -0,0 +1,817 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/ipmb_sim.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+IPMB bus simulator
+
+Runs a carrier and a set of modules, each one a host build of the firmware
+(see building_posix.txt), on one simulated IPMB-L. Every controller is
+started with IPMB_BUS pointing at our socket so all frames come through here.
+The bus clocks frames out one at a time at the configured bit rate, the
+frame with the lowest destination address wins arbitration, frames can be
+dropped at random and sending to an address nobody listens on is a NAK.
+
+A scenario script drives the run. Module insertions produce the hot swap
+event / discovery traffic between carrier and modules, and the simulator 
+can send its own requests from SIM_ADDR. Every request/response pair seen 
+on the bus is timed and reported per netfn/cmd at the end, together with
+bus utilisation.
+
+Script commands, one per line, numbers in decimal except the request bytes:
+
+	insert <n>|all [ms]		start modules, ms apart (0: all at once)
+	remove <n>|all			stop the most recently inserted modules
+	poll <rounds> <netfn> <cmd> [data ..]
+					send a request to every module, wait for
+					all responses before the next round
+	sleep <ms>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "ipmi.h"
+#include "posix.h"
+
+#define SIM_BUS_PATH		"/tmp/ipmb-bus"
+#define SIM_ADDR		0x10	/* our own requester address */
+#define SIM_MAX_MODULES		26	/* one per IPMB-L address */
+#define SIM_MAX_FRAMES		256	/* frames waiting for the bus */
+#define SIM_MAX_OUTSTANDING	256	/* requests waiting for a response */
+#define SIM_MAX_CMDS		64	/* netfn/cmd pairs tracked */
+#define SIM_MAX_SAMPLES		8192	/* latency samples per netfn/cmd */
+#define SIM_TIMEOUT		1000000000LL	/* response timeout, ns */
+
+/* AMC IPMB-L addresses by geographic address, see mmc.c */
+unsigned char sim_ipmbl_table[SIM_MAX_MODULES + 1] = { 
+	0x70, 0x8A, 0x72, 0x8E, 0x92, 0x90, 0x74, 0x8C, 0x76, 0x98, 0x9C,
+	0x9A, 0xA0, 0xA4, 0x88, 0x9E, 0x86, 0x84, 0x78, 0x94, 0x7A, 0x96,
+	0x82, 0x80, 0x7C, 0x7E, 0xA2 };
+
+typedef struct sim_frame {
+	int in_use;
+	unsigned char src;
+	unsigned char dst;
+	unsigned len;
+	unsigned char data[WS_BUF_LEN];
+	unsigned long arrival;		/* arrival order */
+	long long submit;		/* ns */
+} SIM_FRAME;
+
+typedef struct sim_request {
+	int in_use;
+	unsigned char requester;
+	unsigned char responder;
+	unsigned char netfn;
+	unsigned char seq;
+	unsigned char cmd;
+	long long submit;
+} SIM_REQUEST;
+
+typedef struct sim_cmd_stats {
+	unsigned char netfn;
+	unsigned char cmd;
+	unsigned long count;
+	unsigned long timeouts;
+	unsigned nsamples;
+	unsigned samples[SIM_MAX_SAMPLES];	/* ns */
+} SIM_CMD_STATS;
+
+struct {
+	unsigned long frames;
+	unsigned long naks;
+	unsigned long lost;
+	unsigned long arbitration;
+	long long busy_time;
+} sim_bus_stats;
+
+/* settings */
+unsigned long sim_bit_rate = 100000;
+unsigned sim_loss = 0;			/* in 1/100 % */
+unsigned sim_num_modules = 8;
+long long sim_run_time = 0;		/* ns, 0 = until the script ends */
+char *sim_carrier = 0;
+char *sim_module = 0;
+char *sim_script_name = 0;
+int sim_verbose = 0;
+
+/* state */
+int sim_fd;
+struct timespec sim_epoch;
+volatile int sim_done = 0;
+SIM_FRAME sim_queue[SIM_MAX_FRAMES];
+unsigned sim_queue_count;
+unsigned long sim_arrivals;
+SIM_FRAME *sim_on_wire;
+long long sim_wire_free;		/* ns */
+SIM_REQUEST sim_outstanding[SIM_MAX_OUTSTANDING];
+SIM_CMD_STATS sim_cmd_stats[SIM_MAX_CMDS];
+unsigned sim_cmd_count;
+pid_t sim_carrier_pid;
+pid_t sim_module_pid[SIM_MAX_MODULES];
+unsigned sim_modules_inserted;
+unsigned char sim_seq;
+unsigned sim_local_pending;		/* our requests waiting for a response */
+
+/* script */
+FILE *sim_script_fp;
+unsigned sim_script_line_no;
+char sim_cmd[16];
+long long sim_wait_until;
+int sim_insert_left;
+long long sim_insert_interval;
+int sim_poll_rounds;
+unsigned char sim_poll_req[WS_BUF_LEN];
+unsigned sim_poll_len;
+
+char *sim_default_script[] = {
+	"insert all 0",			/* insertion storm */
+	"sleep 5000",
+	"poll 100 04 2d 00",		/* Get Sensor Reading */
+	"poll 20 0a 11 00 00 00 10",	/* Read FRU Data, 16 bytes */
+	"sleep 1000",
+	0
+};
+
+/*------------------------------------------------------------------------------
+ *              L O C A L   F U N C T I O N   P R O T O T Y P E S
+ *----------------------------------------------------------------------------*/
+void sim_process_command_line( int argc, char **argv );
+void sim_usage( void );
+void sim_signal( int sig );
+long long sim_now( void );
+pid_t sim_spawn( char *path, char *ga );
+void sim_insert( void );
+void sim_remove( void );
+void sim_bus_receive( void );
+void sim_enqueue( unsigned char src, unsigned char dst, unsigned char *data, unsigned len );
+void sim_bus_arbitrate( long long now );
+void sim_bus_complete( long long now );
+void sim_reply( unsigned char addr, unsigned char kind, unsigned char peer );
+void sim_trace( SIM_FRAME *frame, long long now );
+SIM_CMD_STATS *sim_get_cmd_stats( unsigned char netfn, unsigned char cmd );
+void sim_expire( long long now );
+void sim_local_failed( SIM_FRAME *frame );
+void sim_send_request( unsigned char dst, unsigned char *req, unsigned len );
+int sim_script_line( char *buf, int size );
+void sim_script_step( long long now );
+int sim_compare( const void *a, const void *b );
+void sim_report( long long elapsed );
+
+/*------------------------------------------------------------------------------
+	main()
+ *----------------------------------------------------------------------------*/
+int main(
+	int argc,
+	char **argv )
+/*----------------------------------------------------------------------------*/
+{
+	struct sockaddr_un addr;
+	struct timespec timeout;
+	fd_set fds;
+	long long now, delay;
+	unsigned i;
+
+	sim_process_command_line( argc, argv );
+	if( !sim_module ) {
+		sim_usage();
+		exit( EXIT_FAILURE );
+	}
+	if( sim_script_name && !( sim_script_fp = fopen( sim_script_name, "r" ) ) ) {
+		perror( sim_script_name );
+		exit( EXIT_FAILURE );
+	}
+
+	sim_fd = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, SIM_BUS_PATH );
+	unlink( SIM_BUS_PATH );
+	if( ( sim_fd < 0 ) || ( bind( sim_fd, ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 ) ) {
+		perror( SIM_BUS_PATH );
+		exit( EXIT_FAILURE );
+	}
+
+	signal( SIGINT, sim_signal );
+	signal( SIGTERM, sim_signal );
+	clock_gettime( CLOCK_MONOTONIC, &sim_epoch );
+
+	if( sim_carrier )
+		sim_carrier_pid = sim_spawn( sim_carrier, 0 );
+
+	while( !sim_done ) {
+		now = sim_now();
+		if( sim_run_time && ( now >= sim_run_time ) )
+			break;
+
+		if( sim_on_wire && ( now >= sim_wire_free ) )
+			sim_bus_complete( now );
+		if( !sim_on_wire && sim_queue_count )
+			sim_bus_arbitrate( now );
+		sim_expire( now );
+		sim_script_step( now );
+
+		/* sleep until the wire frees up, a frame arrives or 1 ms */
+		delay = 1000000;
+		if( sim_on_wire && ( sim_wire_free - now < delay ) )
+			delay = sim_wire_free - now > 0 ? sim_wire_free - now : 0;
+		timeout.tv_sec = 0;
+		timeout.tv_nsec = delay;
+		FD_ZERO( &fds );
+		FD_SET( sim_fd, &fds );
+		if( pselect( sim_fd + 1, &fds, 0, 0, &timeout, 0 ) > 0 )
+			sim_bus_receive();
+	}
+
+	sim_report( sim_now() );
+
+	for( i = 0; i < sim_modules_inserted; i++ )
+		kill( sim_module_pid[i], SIGTERM );
+	if( sim_carrier_pid )
+		kill( sim_carrier_pid, SIGTERM );
+	while( wait( 0 ) > 0 );
+	unlink( SIM_BUS_PATH );
+
+	exit( EXIT_SUCCESS );
+}
+
+/*------------------------------------------------------------------------------
+	sim_process_command_line()
+		Process the command line arguments.
+ *----------------------------------------------------------------------------*/
+void sim_process_command_line(
+	int argc,
+	char **argv )
+/*----------------------------------------------------------------------------*/
+{
+	int i;
+
+	for( i = 1; i < argc; i++ ) {
+		if( ( *argv[i] != '-' ) || !argv[i][1] )
+			continue;
+		if( ( argv[i][1] != 'v' ) && ( i + 1 >= argc ) ) {
+			sim_usage();
+			exit( EXIT_FAILURE );
+		}
+		switch( argv[i][1] ) {
+			case 'c':
+				sim_carrier = argv[++i];
+				break;
+			case 'm':
+				sim_module = argv[++i];
+				break;
+			case 'n':
+				sim_num_modules = atoi( argv[++i] );
+				if( sim_num_modules > SIM_MAX_MODULES )
+					sim_num_modules = SIM_MAX_MODULES;
+				break;
+			case 'r':
+				sim_bit_rate = strtoul( argv[++i], 0, 0 );
+				if( !sim_bit_rate )
+					sim_bit_rate = 100000;
+				break;
+			case 'l':
+				sim_loss = ( unsigned )( atof( argv[++i] ) * 100 );
+				break;
+			case 's':
+				sim_script_name = argv[++i];
+				break;
+			case 't':
+				sim_run_time = atoll( argv[++i] ) * 1000000000LL;
+				break;
+			case 'v':
+				sim_verbose = 1;
+				break;
+			default:
+				sim_usage();
+				exit( EXIT_FAILURE );
+		}
+	}
+}
+
+void sim_usage( void )
+/*----------------------------------------------------------------------------*/
+{
+	printf( "usage: ipmb_sim -m module [-c carrier] [-n modules] [-r bit/s]\n"
+		"                [-l loss%%] [-s script] [-t seconds] [-v]\n" );
+}
+
+void sim_signal( int sig )
+/*----------------------------------------------------------------------------*/
+{
+	sim_done = 1;
+}
+
+/* ns since start */
+long long sim_now( void )
+/*----------------------------------------------------------------------------*/
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return( ( now.tv_sec - sim_epoch.tv_sec ) * 1000000000LL 
+		+ now.tv_nsec - sim_epoch.tv_nsec );
+}
+
+/*==============================================================================
+ * 			C O N T R O L L E R S
+ *============================================================================*/
+
+/*------------------------------------------------------------------------------
+	sim_spawn()
+		Start a controller on our bus. ga is the geographic address
+		strap string, 0 for the carrier.
+ *----------------------------------------------------------------------------*/
+pid_t sim_spawn( 
+	char *path,
+	char *ga )
+/*----------------------------------------------------------------------------*/
+{
+	pid_t pid = fork();
+
+	if( pid ) 
+		return( pid );
+
+	setenv( "IPMB_BUS", SIM_BUS_PATH, 1 );
+	if( ga )
+		setenv( "COREIPM_GA", ga, 1 );
+	else
+		unsetenv( "COREIPM_GA" );
+	if( !sim_verbose ) {
+		freopen( "/dev/null", "w", stdout );
+		freopen( "/dev/null", "w", stderr );
+	}
+	execl( path, path, ( char * )0 );
+	perror( path );
+	_exit( EXIT_FAILURE );
+}
+
+/* insert the next module, straps are the GA index digits, G=0 P=1 U=2 */
+void sim_insert( void )
+/*----------------------------------------------------------------------------*/
+{
+	char ga[4], strap[3] = { 'G', 'P', 'U' };
+	unsigned slot = sim_modules_inserted;
+
+	if( slot >= sim_num_modules )
+		return;
+
+	ga[0] = strap[slot % 3];
+	ga[1] = strap[( slot / 3 ) % 3];
+	ga[2] = strap[slot / 9];
+	ga[3] = 0;
+	sim_module_pid[slot] = sim_spawn( sim_module, ga );
+	sim_modules_inserted++;
+}
+
+/* remove the most recently inserted module */
+void sim_remove( void )
+/*----------------------------------------------------------------------------*/
+{
+	if( !sim_modules_inserted )
+		return;
+
+	sim_modules_inserted--;
+	kill( sim_module_pid[sim_modules_inserted], SIGTERM );
+	waitpid( sim_module_pid[sim_modules_inserted], 0, 0 );
+}
+
+/*==============================================================================
+ * 			B U S
+ *============================================================================*/
+
+/* read frames written by the controllers */
+void sim_bus_receive( void )
+/*----------------------------------------------------------------------------*/
+{
+	struct sockaddr_un from;
+	socklen_t from_len;
+	unsigned char buf[POSIX_IPMB_HDR_LEN + WS_BUF_LEN];
+	unsigned src;
+	int len;
+
+	while( 1 ) {
+		from_len = sizeof( from );
+		len = recvfrom( sim_fd, buf, sizeof( buf ), MSG_DONTWAIT, 
+			( struct sockaddr * )&from, &from_len );
+		if( len < 0 )
+			return;
+		if( ( len < POSIX_IPMB_HDR_LEN ) || ( buf[0] != POSIX_IPMB_FRAME ) 
+		    || ( sscanf( from.sun_path, POSIX_IPMB_PATH, &src ) != 1 ) )
+			continue;
+		sim_enqueue( src, buf[1], buf + POSIX_IPMB_HDR_LEN, len - POSIX_IPMB_HDR_LEN );
+	}
+}
+
+/* queue a frame for the bus */
+void sim_enqueue( 
+	unsigned char src, 
+	unsigned char dst, 
+	unsigned char *data, 
+	unsigned len )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_FRAME *frame;
+	unsigned i;
+
+	if( sim_queue_count >= SIM_MAX_FRAMES ) {
+		sim_bus_stats.naks++;
+		if( src != SIM_ADDR )
+			sim_reply( src, POSIX_IPMB_NAK, dst );
+		return;
+	}
+	for( i = 0; sim_queue[i].in_use; i++ );
+	frame = &sim_queue[i];
+	frame->in_use = 1;
+	frame->src = src;
+	frame->dst = dst;
+	frame->len = len > WS_BUF_LEN ? WS_BUF_LEN : len;
+	memcpy( frame->data, data, frame->len );
+	frame->arrival = sim_arrivals++;
+	frame->submit = sim_now();
+	sim_queue_count++;
+}
+
+/*------------------------------------------------------------------------------
+	sim_bus_arbitrate()
+		Put the next frame on the wire. Everyone waiting starts 
+		together when the bus goes free, the wired-AND on the 
+		address byte lets the lowest destination through.
+ *----------------------------------------------------------------------------*/
+void sim_bus_arbitrate( long long now )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_FRAME *winner = 0;
+	unsigned i, bits;
+
+	for( i = 0; i < SIM_MAX_FRAMES; i++ ) {
+		if( !sim_queue[i].in_use )
+			continue;
+		if( !winner || ( sim_queue[i].dst < winner->dst ) 
+		    || ( ( sim_queue[i].dst == winner->dst ) 
+			 && ( sim_queue[i].arrival < winner->arrival ) ) )
+			winner = &sim_queue[i];
+	}
+	sim_bus_stats.arbitration += sim_queue_count - 1;
+
+	/* START, address and data bytes with their ACK bits, STOP */
+	bits = 1 + ( winner->len + 1 ) * 9 + 1;
+	sim_on_wire = winner;
+	sim_wire_free = now + bits * 1000000000LL / sim_bit_rate;
+	sim_bus_stats.busy_time += sim_wire_free - now;
+}
+
+/*------------------------------------------------------------------------------
+	sim_bus_complete()
+		The frame on the wire has been clocked out, deliver it and 
+		tell the sender how it went.
+ *----------------------------------------------------------------------------*/
+void sim_bus_complete( long long now )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_FRAME *frame = sim_on_wire;
+	struct sockaddr_un addr;
+	unsigned char buf[POSIX_IPMB_HDR_LEN + WS_BUF_LEN];
+	int acked = 1;
+
+	sim_bus_stats.frames++;
+
+	if( sim_loss && ( ( unsigned )( rand() % 10000 ) < sim_loss ) ) {
+		sim_bus_stats.lost++;
+		acked = 0;
+	} else if( frame->dst != SIM_ADDR ) {
+		buf[0] = POSIX_IPMB_FRAME;
+		buf[1] = frame->src;
+		memcpy( buf + POSIX_IPMB_HDR_LEN, frame->data, frame->len );
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sun_family = AF_UNIX;
+		snprintf( addr.sun_path, sizeof( addr.sun_path ), POSIX_IPMB_PATH, frame->dst );
+		if( sendto( sim_fd, buf, POSIX_IPMB_HDR_LEN + frame->len, MSG_DONTWAIT,
+			    ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 ) {
+			sim_bus_stats.naks++;
+			acked = 0;
+		}
+	}
+
+	if( acked )
+		sim_trace( frame, now );
+	if( frame->src != SIM_ADDR )
+		sim_reply( frame->src, acked ? POSIX_IPMB_ACK : POSIX_IPMB_NAK, frame->dst );
+	else if( !acked )
+		sim_local_failed( frame );
+
+	frame->in_use = 0;
+	sim_queue_count--;
+	sim_on_wire = 0;
+}
+
+/* send an ACK or NAK to a controller */
+void sim_reply( 
+	unsigned char addr, 
+	unsigned char kind, 
+	unsigned char peer )
+/*----------------------------------------------------------------------------*/
+{
+	struct sockaddr_un to;
+	unsigned char buf[POSIX_IPMB_HDR_LEN];
+
+	buf[0] = kind;
+	buf[1] = peer;
+	memset( &to, 0, sizeof( to ) );
+	to.sun_family = AF_UNIX;
+	snprintf( to.sun_path, sizeof( to.sun_path ), POSIX_IPMB_PATH, addr );
+	sendto( sim_fd, buf, sizeof( buf ), MSG_DONTWAIT, ( struct sockaddr * )&to, sizeof( to ) );
+}
+
+/*==============================================================================
+ * 			S T A T I S T I C S
+ *============================================================================*/
+
+/*------------------------------------------------------------------------------
+	sim_trace()
+		Match requests with their responses. The bytes after the slave
+		address are netFn/LUN, checksum, requester or responder address,
+		seq/LUN and cmd for both.
+ *----------------------------------------------------------------------------*/
+void sim_trace( 
+	SIM_FRAME *frame, 
+	long long now )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_REQUEST *req;
+	SIM_CMD_STATS *stats;
+	unsigned char netfn, seq, cmd;
+	unsigned i;
+
+	if( frame->len < 6 )
+		return;
+	netfn = frame->data[0] >> 2;
+	seq = frame->data[3] >> 2;
+	cmd = frame->data[4];
+
+	if( !( netfn & 1 ) ) {
+		for( i = 0; i < SIM_MAX_OUTSTANDING; i++ ) {
+			if( !sim_outstanding[i].in_use )
+				break;
+		}
+		if( i == SIM_MAX_OUTSTANDING )
+			return;
+		req = &sim_outstanding[i];
+		req->in_use = 1;
+		req->requester = frame->src;
+		req->responder = frame->dst;
+		req->netfn = netfn;
+		req->seq = seq;
+		req->cmd = cmd;
+		req->submit = frame->submit;
+		return;
+	}
+
+	for( i = 0; i < SIM_MAX_OUTSTANDING; i++ ) {
+		req = &sim_outstanding[i];
+		if( req->in_use && ( req->requester == frame->dst ) 
+		    && ( req->responder == frame->src ) && ( req->netfn == ( netfn & ~1 ) ) 
+		    && ( req->seq == seq ) && ( req->cmd == cmd ) ) 
+			break;
+	}
+	if( i == SIM_MAX_OUTSTANDING )
+		return;
+
+	req->in_use = 0;
+	if( req->requester == SIM_ADDR )
+		sim_local_pending--;
+	if( ( stats = sim_get_cmd_stats( req->netfn, req->cmd ) ) ) {
+		stats->count++;
+		if( stats->nsamples < SIM_MAX_SAMPLES )
+			stats->samples[stats->nsamples++] = now - req->submit;
+	}
+}
+
+/* find or add the stats entry of netfn/cmd */
+SIM_CMD_STATS *sim_get_cmd_stats( 
+	unsigned char netfn, 
+	unsigned char cmd )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned i;
+
+	for( i = 0; i < sim_cmd_count; i++ ) {
+		if( ( sim_cmd_stats[i].netfn == netfn ) && ( sim_cmd_stats[i].cmd == cmd ) )
+			return( &sim_cmd_stats[i] );
+	}
+	if( sim_cmd_count == SIM_MAX_CMDS )
+		return( 0 );
+	sim_cmd_stats[sim_cmd_count].netfn = netfn;
+	sim_cmd_stats[sim_cmd_count].cmd = cmd;
+	return( &sim_cmd_stats[sim_cmd_count++] );
+}
+
+/* count requests that never got a response */
+void sim_expire( long long now )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_CMD_STATS *stats;
+	unsigned i;
+
+	for( i = 0; i < SIM_MAX_OUTSTANDING; i++ ) {
+		if( !sim_outstanding[i].in_use 
+		    || ( now - sim_outstanding[i].submit < SIM_TIMEOUT ) )
+			continue;
+		sim_outstanding[i].in_use = 0;
+		if( sim_outstanding[i].requester == SIM_ADDR )
+			sim_local_pending--;
+		if( ( stats = sim_get_cmd_stats( sim_outstanding[i].netfn, sim_outstanding[i].cmd ) ) )
+			stats->timeouts++;
+	}
+}
+
+/* one of our requests was not acked, it will never see a response */
+void sim_local_failed( SIM_FRAME *frame )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_CMD_STATS *stats;
+
+	sim_local_pending--;
+	if( ( frame->len >= 6 ) 
+	    && ( stats = sim_get_cmd_stats( frame->data[0] >> 2, frame->data[4] ) ) )
+		stats->timeouts++;
+}
+
+int sim_compare( const void *a, const void *b )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned x = *( unsigned * )a, y = *( unsigned * )b;
+
+	return( ( x > y ) - ( x < y ) );
+}
+
+void sim_report( long long elapsed )
+/*----------------------------------------------------------------------------*/
+{
+	SIM_CMD_STATS *stats;
+	unsigned i, n;
+
+	printf( "%u modules, %lu bit/s, %.2f%% loss, %.1f s\n", sim_modules_inserted, 
+		sim_bit_rate, sim_loss / 100.0, elapsed / 1e9 );
+	printf( "bus: %.1f%% busy, %lu frames, %lu NAK, %lu lost, %lu arbitration losses\n",
+		elapsed ? 100.0 * sim_bus_stats.busy_time / elapsed : 0.0, 
+		sim_bus_stats.frames, sim_bus_stats.naks, sim_bus_stats.lost, 
+		sim_bus_stats.arbitration );
+	printf( "netfn cmd   count timeout      p50      p90      p99      max (us)\n" );
+	for( i = 0; i < sim_cmd_count; i++ ) {
+		stats = &sim_cmd_stats[i];
+		n = stats->nsamples;
+		qsort( stats->samples, n, sizeof( unsigned ), sim_compare );
+		printf( "   %02x  %02x %7lu %7lu", stats->netfn, stats->cmd, 
+			stats->count, stats->timeouts );
+		if( n )
+			printf( " %8u %8u %8u %8u", stats->samples[n / 2] / 1000,
+				stats->samples[n * 9 / 10] / 1000, 
+				stats->samples[n * 99 / 100] / 1000,
+				stats->samples[n - 1] / 1000 );
+		printf( "\n" );
+	}
+}
+
+/*==============================================================================
+ * 			S C E N A R I O
+ *============================================================================*/
+
+/* send a request from SIM_ADDR, req starts with netFn and holds cmd & data */
+void sim_send_request( 
+	unsigned char dst, 
+	unsigned char *req, 
+	unsigned len )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned char frame[WS_BUF_LEN];
+	unsigned char sum = 0;
+	unsigned i;
+
+	if( len + 5 > WS_BUF_LEN )
+		return;
+	frame[0] = req[0] << 2;
+	frame[1] = -( dst + frame[0] );
+	frame[2] = SIM_ADDR;
+	frame[3] = ( sim_seq++ & 0x3f ) << 2;
+	memcpy( frame + 4, req + 1, len - 1 );
+	for( i = 2; i < len + 3; i++ )
+		sum += frame[i];
+	frame[len + 3] = -sum;
+	sim_enqueue( SIM_ADDR, dst, frame, len + 4 );
+	sim_local_pending++;
+}
+
+/* next script line, 0 at the end */
+int sim_script_line( 
+	char *buf, 
+	int size )
+/*----------------------------------------------------------------------------*/
+{
+	if( sim_script_fp )
+		return( fgets( buf, size, sim_script_fp ) != 0 );
+	if( !sim_default_script[sim_script_line_no] )
+		return( 0 );
+	strncpy( buf, sim_default_script[sim_script_line_no++], size - 1 );
+	buf[size - 1] = 0;
+	return( 1 );
+}
+
+/*------------------------------------------------------------------------------
+	sim_script_step()
+		Advance the scenario, called on every pass of the main loop.
+ *----------------------------------------------------------------------------*/
+void sim_script_step( long long now )
+/*----------------------------------------------------------------------------*/
+{
+	char line[256], *tok;
+	unsigned i;
+	int n;
+
+	if( now < sim_wait_until )
+		return;
+
+	/* commands in progress */
+	if( sim_insert_left ) {
+		sim_insert();
+		sim_insert_left--;
+		sim_wait_until = now + sim_insert_interval;
+		return;
+	}
+	if( sim_poll_rounds ) {
+		if( sim_local_pending )
+			return;
+		for( i = 0; i < sim_modules_inserted; i++ )
+			sim_send_request( sim_ipmbl_table[i], sim_poll_req, sim_poll_len );
+		sim_poll_rounds--;
+		return;
+	}
+	if( sim_local_pending )
+		return;
+
+	while( 1 ) {
+		if( !sim_script_line( line, sizeof( line ) ) ) {
+			if( !sim_run_time )
+				sim_done = 1;
+			return;
+		}
+		if( !( tok = strtok( line, " \t\r\n" ) ) || ( *tok == '#' ) )
+			continue;
+		break;
+	}
+	strncpy( sim_cmd, tok, sizeof( sim_cmd ) - 1 );
+	tok = strtok( 0, " \t\r\n" );
+
+	if( !strcmp( sim_cmd, "insert" ) ) {
+		n = ( !tok || !strcmp( tok, "all" ) ) ? sim_num_modules : atoi( tok );
+		sim_insert_left = n;
+		tok = strtok( 0, " \t\r\n" );
+		sim_insert_interval = tok ? atoll( tok ) * 1000000 : 0;
+	} else if( !strcmp( sim_cmd, "remove" ) ) {
+		n = ( !tok || !strcmp( tok, "all" ) ) ? sim_modules_inserted : atoi( tok );
+		while( n-- )
+			sim_remove();
+	} else if( !strcmp( sim_cmd, "poll" ) ) {
+		sim_poll_rounds = tok ? atoi( tok ) : 1;
+		for( sim_poll_len = 0; ( tok = strtok( 0, " \t\r\n" ) ) 
+				&& ( sim_poll_len < WS_BUF_LEN - 5 ); sim_poll_len++ )
+			sim_poll_req[sim_poll_len] = strtoul( tok, 0, 16 );
+		if( sim_poll_len < 2 )
+			sim_poll_rounds = 0;
+	} else if( !strcmp( sim_cmd, "sleep" ) ) {
+		sim_wait_until = now + ( tok ? atoll( tok ) : 0 ) * 1000000;
+	} else {
+		fprintf( stderr, "ipmb_sim: unknown script command %s\n", sim_cmd );
+	}
+}
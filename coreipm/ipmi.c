@@ -24,6 +24,7 @@ support and contact details.
 -------------------------------------------------------------------------------
 */
 
+#include "arch.h"
 #include "fan.h"
 #include "gpio.h"
 #include "ipmi.h"
@@ -40,6 +41,10 @@ support and contact details.
 #include "event.h"
 #include "sensor.h"
 #include "module.h"
+#include "dispatch.h"
+#include "sched.h"
+#include "seq.h"
+#include "error.h"
 #include <string.h>
 
 #define FRU_INVENTORY_CACHE_ARRAY_SIZE	4
@@ -93,21 +98,12 @@ unsigned device_status = DEV_STATUS_READY;
 
 int  ipmi_verify_checksum( IPMI_PKT *pkt );
 void ipmi_process_response( IPMI_PKT *pkt, unsigned char completion_code );
-void ipmi_process_request( IPMI_PKT *pkt );
-void ipmi_default_response( IPMI_PKT *pkt );
-void ipmi_process_app_req( IPMI_PKT *pkt );
-void ipmi_process_event_req( IPMI_PKT *pkt );
-void ipmi_process_fw_req( IPMI_PKT *pkt );
-void ipmi_get_fru_inventory_area_info( IPMI_PKT *pkt );
-void ipmi_read_fru_data( IPMI_PKT *pkt );
 void fru_read_complete( void *fru_ws, int status );
-void ipmi_write_fru_data( IPMI_PKT *pkt );
 void ipmi_wd_expired( uchar *arg );
-void ipmi_process_nvstore_req( IPMI_PKT *pkt );
 void ipmi_send_message_cmd_complete( void *ws, int status );
-void ipmi_send_message_cmd( IPMI_PKT *pkt );
-void ipmi_seq_free( uchar seq );
 void init_fru_cache( void );
+void ipmi_send_response( IPMI_WS *ws, unsigned resp_data_len );
+void ipmi_bridge_response( IPMI_WS *resp_ws, IPMI_WS *req_ws );
 
 /*==============================================================*/
 /* Functions							*/
@@ -119,38 +115,21 @@ ipmi_initialize( void )
 	/* Initialize the channel tables */
 	channel_table[IPMI_CH_NUM_PRIMARY_IPMB].protocol = IPMI_CH_PROTOCOL_IPMB;
 	channel_table[IPMI_CH_NUM_PRIMARY_IPMB].medium = IPMI_CH_MEDIUM_IPMB;
+	channel_table[IPMI_CH_NUM_PRIMARY_IPMB].max_msg_len = WS_BUF_LEN;
 	
+	/* terminal mode is not limited by the medium, use the largest
+	 * buffers we have */
 	channel_table[IPMI_CH_NUM_CONSOLE].protocol = IPMI_CH_PROTOCOL_TMODE;
 	channel_table[IPMI_CH_NUM_CONSOLE].medium = IPMI_CH_MEDIUM_SERIAL;
+	channel_table[IPMI_CH_NUM_CONSOLE].max_msg_len = WS_BUF_LEN_LARGE;
 
 	channel_table[IPMI_CH_NUM_SYS_INTERFACE].protocol = IPMI_CH_PROTOCOL_TMODE;
 	channel_table[IPMI_CH_NUM_SYS_INTERFACE].medium = IPMI_CH_MEDIUM_SERIAL;
+	channel_table[IPMI_CH_NUM_SYS_INTERFACE].max_msg_len = WS_BUF_LEN_LARGE;
 
 	init_fru_cache();
-}
-
-uchar seq_array[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-/* sequence number generator */
-uchar
-ipmi_get_next_seq( uchar *seq )
-{
-	unsigned short i;
-
-	/* return the first free sequence number */
-	for( i = 0; i < 16; i++ ) {
-		if( !seq_array[i] ) { 
-			seq_array[i] = 1;
-			*seq = i;
-			return( 1 );
-		}
-	}
-	return( 0 );   	
-}
-
-void
-ipmi_seq_free( uchar seq )
-{
-	seq_array[seq] = 0;
+	dispatch_init();
+	seq_init();
 }
 
 
@@ -168,8 +147,8 @@ ipmi_seq_free( uchar seq )
  * 	A management controller that gets a request to an invalid 
  * 	(unimplemented) LUN must return an error completion code using 
  * 	that LUN as the responders LUN (RsLUN) in the response.
- * 	4) If everything OK call ipmi_process_request()
- * 	5) If ipmi_process_request() has a response ready, set ws state.
+ * 	4) If everything OK call dispatch_request()
+ * 	5) If dispatch_request() has a response ready, set ws state.
  * 	Otherwise if this is a delayed response ( completion code ==
  * 	CC_DELAYED_COMPLETION ), a completion function will do this.
  *
@@ -186,14 +165,16 @@ ipmi_process_pkt( IPMI_WS * ws )
 {
 	IPMI_PKT	*pkt;
 	uchar		cksum, completion_code = CC_NORMAL;
-	uchar		responder_slave_addr, requester_slave_addr;
+	uchar		responder_slave_addr;
+	unsigned long	start = sched_clock();
 	
-	IPMI_IPMB_HDR *ipmb_hdr = ( IPMI_IPMB_HDR * )&( ws->pkt_in );
+	IPMI_IPMB_HDR *ipmb_hdr = ( IPMI_IPMB_HDR * )( ws->pkt_in );
 
 	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_pkt: ingress\n" );
 
 	pkt = &ws->pkt;
 	pkt->hdr.ws = (char *)ws;
+	pkt->resp = 0;
 
 	switch( ws->incoming_protocol ) {
 		case IPMI_CH_PROTOCOL_IPMB:	/* used for IPMB, serial/modem Basic Mode, and LAN */
@@ -227,6 +208,13 @@ ipmi_process_pkt( IPMI_WS * ws )
 
 			if( !( ipmb_hdr->netfn % 2 ) ) {
 				/* an even netfn indicates a request */
+				pkt->hdr.netfn = ipmb_hdr->netfn;
+				pkt->resp = ( IPMI_CMD_RESP * )&( ( ( IPMI_IPMB_RESPONSE * )( ws->pkt_out ) )->completion_code );
+				if( ws->len_in < sizeof( IPMI_IPMB_REQUEST ) - IPMB_REQ_MAX_DATA_LEN ) {
+					dputstr( DBG_IPMI | DBG_ERR, "ipmi_process_pkt: Short request\n" );
+					completion_code = CC_RQST_DATA_LEN_INVALID;
+					break;
+				}
 				responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
 				cksum = -( *( ws->pkt_in ) + responder_slave_addr );;
 				if( ws->pkt_in[1] != cksum ) { /* header checksum is the second byte */
@@ -262,22 +250,23 @@ ipmi_process_pkt( IPMI_WS * ws )
 				if( ipmb_hdr->netfn % 2 ) {
 					/* an odd netfn indicates a response */
 					ipmb_req = NULL;
-					ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( ws->pkt_in );
+					ipmb_resp = ( IPMI_IPMB_RESPONSE * )( ws->pkt_in );
 					pkt->hdr.resp_data_len = ws->len_in - 8;
 				} else {
 					/* an even netfn is a request */
-					ipmb_req = ( IPMI_IPMB_REQUEST * )&( ws->pkt_in );
-					ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( ws->pkt_out );
+					ipmb_req = ( IPMI_IPMB_REQUEST * )( ws->pkt_in );
+					ipmb_resp = ( IPMI_IPMB_RESPONSE * )( ws->pkt_out );
 					pkt->hdr.responder_lun = ipmb_req->responder_lun;
 					pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command );
-					pkt->hdr.req_data_len = ws->len_in - 7;
+					pkt->hdr.req_data_len = ws->len_in 
+						- ( sizeof( IPMI_IPMB_REQUEST ) - IPMB_REQ_MAX_DATA_LEN );
 				}
 				
 				pkt->resp = ( IPMI_CMD_RESP * )&( ipmb_resp->completion_code );
 				pkt->hdr.netfn = ipmb_hdr->netfn;
 	
 				/* check if responder_lun is valid */
-				if( ipmb_req->responder_lun + 1 > NUM_LUN )
+				if( ipmb_req && ( ipmb_req->responder_lun + 1 > NUM_LUN ) )
 					completion_code = CC_INVALID_CMD;
 			}
 			
@@ -289,7 +278,13 @@ ipmi_process_pkt( IPMI_WS * ws )
 			pkt->resp = ( IPMI_CMD_RESP * )&( ( ( IPMI_TERMINAL_MODE_RESPONSE * )( ws->pkt_out ) )->completion_code );
 			pkt->hdr.netfn = ( ( IPMI_TERMINAL_MODE_REQUEST * )( ws->pkt_in ) )->netfn;
 			pkt->hdr.responder_lun = ( ( IPMI_TERMINAL_MODE_REQUEST * )( ws->pkt_in ) )->responder_lun;
-			pkt->hdr.req_data_len = ws->len_in - 3;
+			if( ws->len_in < sizeof( IPMI_TERMINAL_MODE_REQUEST ) - TERM_MODE_REQ_MAX_DATA_LEN ) {
+				dputstr( DBG_IPMI | DBG_ERR, "ipmi_process_pkt: Short request\n" );
+				completion_code = CC_RQST_DATA_LEN_INVALID;
+				break;
+			}
+			pkt->hdr.req_data_len = ws->len_in 
+				- ( sizeof( IPMI_TERMINAL_MODE_REQUEST ) - TERM_MODE_REQ_MAX_DATA_LEN );
 
 			/* check if responder_lun is valid */
 			if( pkt->hdr.responder_lun + 1 > NUM_LUN )
@@ -319,72 +314,122 @@ ipmi_process_pkt( IPMI_WS * ws )
 		return;
 	}
 	
-	if( completion_code == CC_NORMAL )
-		ipmi_process_request( pkt );
+	if( completion_code == CC_NORMAL ) {
+		dispatch_request( pkt );
+		dispatch_account( pkt, ( sched_clock() - start ) / SCHED_COUNTS_PER_USEC );
+		completion_code = pkt->resp->completion_code;
+	} else if( pkt->resp ) {
+		pkt->resp->completion_code = completion_code;
+		pkt->hdr.resp_data_len = 0;
+	}
 
-	/* ipmi_process_request fills in the |completion_code|data| portion 
+	/* dispatch_request fills in the |completion_code|data| portion 
 	 * and also sets pkt->hdr.resp_data_len */
 	
-	/* send back response */
-	if( completion_code != CC_DELAYED_COMPLETION ) {
-		ws->outgoing_protocol = ws->incoming_protocol;
-		ws->outgoing_medium = ws->incoming_medium;
-		switch( ws->outgoing_protocol ) {
-			case IPMI_CH_PROTOCOL_IPMB: {
-				IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( ws->pkt_out );
-				IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( ws->pkt_in );
-				
-//				ipmb_resp->requester_slave_addr = ipmb_req->requester_slave_addr;
-				requester_slave_addr = ipmb_req->requester_slave_addr;
-				ipmb_resp->netfn = ipmb_req->netfn + 1;
-				ipmb_resp->requester_lun = ipmb_req->requester_lun;
-				ipmb_resp->header_checksum = -( *( char * )ipmb_resp + requester_slave_addr );
-				ipmb_resp->responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
-				ipmb_resp->req_seq = ipmb_req->req_seq;
-				ipmb_resp->responder_lun = ipmb_req->responder_lun;
-				ipmb_resp->command = ipmb_req->command;
-				/* The location of data_checksum field is bogus.
-				 * It's used as a placeholder to indicate that a checksum follows the data field.
-				 * The location of the data_checksum depends on the size of the data preceeding it.*/
-				ipmb_resp->data_checksum = 
-					ipmi_calculate_checksum( &ipmb_resp->responder_slave_addr, 
-						pkt->hdr.resp_data_len + 4 ); 
-				ws->len_out = sizeof(IPMI_IPMB_RESPONSE) 
-					- IPMB_RESP_MAX_DATA_LEN  +  pkt->hdr.resp_data_len;
-				/* Assign the checksum to it's proper location */
-				*( (uchar *)ipmb_resp + ws->len_out - 1 ) = ipmb_resp->data_checksum;
-				}			
-				break;
-			
-			case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
-				IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )&( ws->pkt_out );
-				IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )&( ws->pkt_in );
-				tm_resp->netfn = tm_req->netfn + 1;
-				tm_resp->responder_lun = tm_req->responder_lun;
-				tm_resp->req_seq = tm_req->req_seq;
-				tm_resp->bridge = tm_req->bridge; /* TODO check */
-				tm_resp->command = tm_req->command;
-				ws->len_out = sizeof(IPMI_TERMINAL_MODE_RESPONSE)
-					- TERM_MODE_RESP_MAX_DATA_LEN + pkt->hdr.resp_data_len;
-				}
-				break;
-			
-			case IPMI_CH_PROTOCOL_ICMB:		/* ICMB v1.0 */
-			case IPMI_CH_PROTOCOL_SMB:		/* IPMI on SMSBus */
-			case IPMI_CH_PROTOCOL_KCS:		/* KCS System Interface Format */
-			case IPMI_CH_PROTOCOL_SMIC:		/* SMIC System Interface Format */
-			case IPMI_CH_PROTOCOL_BT10:		/* BT System Interface Format, IPMI v1.0 */
-			case IPMI_CH_PROTOCOL_BT15:		/* BT System Interface Format, IPMI v1.5 */
-				/* we should not be here  */
-				dputstr( DBG_IPMI | DBG_ERR, "ipmi_process_pkt: unsupported protocol\n" );
-				break;
-		}
-		ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
+	/* send back response. If completion code is CC_DELAYED_COMPLETION 
+	 * do nothing, the completion function will send it. */
+	if( completion_code != CC_DELAYED_COMPLETION )
+		ipmi_send_response( ws, pkt->hdr.resp_data_len );
+
+	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_pkt: egress\n" );
+}
+
+/*==============================================================
+ * ipmi_resp_max_data_len()
+ * 	The most response data, completion code not included, that
+ * 	fits both the channel the request came in on and the ws
+ * 	buffers. Handlers that can return variable amounts of data
+ * 	size their response with this.
+ *==============================================================*/
+unsigned
+ipmi_resp_max_data_len( IPMI_PKT *pkt )
+{
+	IPMI_WS *ws = ( IPMI_WS * )pkt->hdr.ws;
+	unsigned len = ws->buf_len;
+	unsigned max = channel_table[ws->incoming_channel].max_msg_len;
+
+	if( max && ( max < len ) )
+		len = max;
+
+	switch( ws->incoming_protocol ) {
+		case IPMI_CH_PROTOCOL_IPMB:
+			/* the requester's slave address goes on the wire 
+			 * ahead of the buffer and counts against the limit */
+			return( len - 1 - ( sizeof( IPMI_IPMB_RESPONSE ) - IPMB_RESP_MAX_DATA_LEN ) );
+		case IPMI_CH_PROTOCOL_TMODE:
+			return( len - ( sizeof( IPMI_TERMINAL_MODE_RESPONSE ) - TERM_MODE_RESP_MAX_DATA_LEN ) );
+		default:
+			return( 0 );
 	}
+}
 
-	/* If completion code is CC_DELAYED_COMPLETION do nothing */
+/*==============================================================
+ * ipmi_send_response()
+ * 	Frame the response to the request in ws->pkt_in and queue
+ * 	it on the channel the request came in on. The completion 
+ * 	code and resp_data_len bytes of data are already in place
+ * 	in ws->pkt_out.
+ *==============================================================*/
+void
+ipmi_send_response( IPMI_WS *ws, unsigned resp_data_len )
+{
+	uchar requester_slave_addr;
 
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_pkt: egress\n" );
+	ws->frame_out = 0;
+	ws->priority = WS_PRIO_RESPONSE;
+	ws->outgoing_protocol = ws->incoming_protocol;
+	ws->outgoing_medium = ws->incoming_medium;
+	switch( ws->outgoing_protocol ) {
+		case IPMI_CH_PROTOCOL_IPMB: {
+			IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )( ws->pkt_out );
+			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )( ws->pkt_in );
+			
+//			ipmb_resp->requester_slave_addr = ipmb_req->requester_slave_addr;
+			requester_slave_addr = ipmb_req->requester_slave_addr;
+			ipmb_resp->netfn = ipmb_req->netfn + 1;
+			ipmb_resp->requester_lun = ipmb_req->requester_lun;
+			ipmb_resp->header_checksum = -( *( char * )ipmb_resp + requester_slave_addr );
+			ipmb_resp->responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
+			ipmb_resp->req_seq = ipmb_req->req_seq;
+			ipmb_resp->responder_lun = ipmb_req->responder_lun;
+			ipmb_resp->command = ipmb_req->command;
+			/* The location of data_checksum field is bogus.
+			 * It's used as a placeholder to indicate that a checksum follows the data field.
+			 * The location of the data_checksum depends on the size of the data preceeding it.*/
+			ipmb_resp->data_checksum = 
+				ipmi_calculate_checksum( &ipmb_resp->responder_slave_addr, 
+					resp_data_len + 4 ); 
+			ws->len_out = sizeof(IPMI_IPMB_RESPONSE) 
+				- IPMB_RESP_MAX_DATA_LEN  +  resp_data_len;
+			/* Assign the checksum to it's proper location */
+			*( (uchar *)ipmb_resp + ws->len_out - 1 ) = ipmb_resp->data_checksum;
+			}			
+			break;
+		
+		case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
+			IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )( ws->pkt_out );
+			IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )( ws->pkt_in );
+			tm_resp->netfn = tm_req->netfn + 1;
+			tm_resp->responder_lun = tm_req->responder_lun;
+			tm_resp->req_seq = tm_req->req_seq;
+			tm_resp->bridge = tm_req->bridge; /* TODO check */
+			tm_resp->command = tm_req->command;
+			ws->len_out = sizeof(IPMI_TERMINAL_MODE_RESPONSE)
+				- TERM_MODE_RESP_MAX_DATA_LEN + resp_data_len;
+			}
+			break;
+		
+		case IPMI_CH_PROTOCOL_ICMB:		/* ICMB v1.0 */
+		case IPMI_CH_PROTOCOL_SMB:		/* IPMI on SMSBus */
+		case IPMI_CH_PROTOCOL_KCS:		/* KCS System Interface Format */
+		case IPMI_CH_PROTOCOL_SMIC:		/* SMIC System Interface Format */
+		case IPMI_CH_PROTOCOL_BT10:		/* BT System Interface Format, IPMI v1.0 */
+		case IPMI_CH_PROTOCOL_BT15:		/* BT System Interface Format, IPMI v1.5 */
+			/* we should not be here  */
+			dputstr( DBG_IPMI | DBG_ERR, "ipmi_send_response: unsupported protocol\n" );
+			break;
+	}
+	ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
 }
 
 /*
@@ -413,19 +458,21 @@ void
 ipmi_process_response( IPMI_PKT *pkt, unsigned char completion_code )
 {
 	IPMI_WS *req_ws = 0, *target_ws = 0, *resp_ws = 0;
+	IPMI_IPMB_RESPONSE *ipmb_resp;
 	uchar seq = 0;
-	uchar requester_slave_addr;
 	int i;
 
 	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_response: ingress\n" );
 
 	resp_ws = ( IPMI_WS * )pkt->hdr.ws;
 	if( resp_ws->incoming_protocol == IPMI_CH_PROTOCOL_IPMB ) {
-		seq = ((IPMI_IPMB_REQUEST *)(resp_ws->pkt_in))->req_seq;
+		ipmb_resp = ( IPMI_IPMB_RESPONSE * )( resp_ws->pkt_in );
+		seq = ipmb_resp->req_seq;
 	
-		/* using the seq#, check to see if there is an outstanding target request ws
-		 * corresponding to this response */
-		target_ws = ws_get_elem_seq( seq, resp_ws ); 
+		/* using the responder address, seq#, netFn and command, find
+		 * the outstanding request this response answers */
+		target_ws = seq_match( ipmb_resp->responder_slave_addr, seq,
+			ipmb_resp->netfn, ipmb_resp->command ); 
 	} else {
 		/* currently unsupported */
 		/* in instances where seq number is not used then the interface is waiting
@@ -446,131 +493,99 @@ ipmi_process_response( IPMI_PKT *pkt, unsigned char completion_code )
 #endif
 		ws_free( resp_ws );
 		return;
-	} else {
-		req_ws = target_ws->bridged_ws;
 	}
 
-	if( !req_ws ) {
-		ws_free( resp_ws );
+	/* target_ws is the Send Message request that we forwarded */
+	if( target_ws->flags & WS_FL_BRIDGED ) {
+		ipmi_bridge_response( resp_ws, target_ws );
 		ws_free( target_ws );
 		return;
 	}
-	
-	memcpy( req_ws->pkt.resp, target_ws->pkt.resp, WS_BUF_LEN ); 
-							   // TODO: make sure pkt-> pointers are set properly
-	req_ws->len_out = target_ws->len_in;
-	
+
+	/* a request of our own, its completion function gets a look at 
+	 * the response before resp_ws goes */
+	target_ws->pkt.resp = pkt->resp;
+	target_ws->pkt.hdr.resp_data_len = pkt->hdr.resp_data_len;
+	if( target_ws->ipmi_completion_function )
+		( target_ws->ipmi_completion_function )( ( void * )target_ws, XPORT_RESP_NOERR );
+	else
+		ws_free( target_ws );
 	ws_free( resp_ws );
-	ws_free( target_ws );
-	
-	/* send back response */
-	req_ws->outgoing_protocol = req_ws->incoming_protocol;
-	req_ws->outgoing_medium = req_ws->incoming_medium;
-	
-	switch( req_ws->outgoing_protocol ) {
+}
+
+/*==============================================================
+ * ipmi_bridge_response()
+ * 	Forward the response to a request bridged by Send Message
+ * 	back to whoever sent the Send Message. req_ws still holds 
+ * 	that request in pkt_in. The response goes out from where 
+ * 	it was received, only the header is rewritten so that it 
+ * 	looks like we executed the encapsulated request ourselves.
+ *==============================================================*/
+void
+ipmi_bridge_response( IPMI_WS *resp_ws, IPMI_WS *req_ws )
+{
+	IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )( resp_ws->pkt_in );
+	uchar *frame = resp_ws->pkt_in;
+	uchar netfn, command, before;
+
+	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_bridge_response: ingress\n" );
+
+	if( resp_ws->len_in < sizeof( IPMI_IPMB_RESPONSE ) - IPMB_RESP_MAX_DATA_LEN ) {
+		dputstr( DBG_IPMI | DBG_ERR, "ipmi_bridge_response: short response\n" );
+		ws_free( resp_ws );
+		return;
+	}
+	netfn = ipmb_resp->netfn;
+	command = ipmb_resp->command;
+
+	switch( req_ws->incoming_protocol ) {
 		case IPMI_CH_PROTOCOL_IPMB: {
-			IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( req_ws->pkt_out );
-			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_in );
-			
-//			ipmb_resp->requester_slave_addr = ipmb_req->requester_slave_addr;
-			requester_slave_addr = ipmb_req->requester_slave_addr;			
-			ipmb_resp->netfn = ipmb_req->netfn + 1;
+			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_in );
+
+			/* the data checksum covers rsSA and seq, adjust it 
+			 * for the new values instead of summing the frame */
+			before = frame[2] + frame[3];
 			ipmb_resp->requester_lun = ipmb_req->requester_lun;
-			ipmb_resp->header_checksum = -( *( char * )ipmb_resp + requester_slave_addr );
+			ipmb_resp->header_checksum = -( frame[0] + ipmb_req->requester_slave_addr );
 			ipmb_resp->responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
 			ipmb_resp->req_seq = ipmb_req->req_seq;
 			ipmb_resp->responder_lun = ipmb_req->responder_lun;
-			ipmb_resp->command = ipmb_req->command;
-			/* The location of data_checksum field is bogus.
-			 * It's used as a placeholder to indicate that a checksum follows the data field.
-			 * The location of the data_checksum depends on the size of the data preceeding it.*/
-			ipmb_resp->data_checksum = 
-				ipmi_calculate_checksum( &ipmb_resp->responder_slave_addr, 
-					pkt->hdr.resp_data_len + 4 ); 
-			req_ws->len_out = sizeof(IPMI_IPMB_RESPONSE) 
-				- IPMB_RESP_MAX_DATA_LEN  +  pkt->hdr.resp_data_len;
-			/* Assign the checksum to it's proper location */
-			*( (uchar *)ipmb_resp + req_ws->len_out) = ipmb_resp->data_checksum; 
-			}			
+			frame[resp_ws->len_in - 1] -= ( uchar )( frame[2] + frame[3] - before );
+			resp_ws->frame_out = frame;
+			resp_ws->len_out = resp_ws->len_in;
+			}
 			break;
-		
+
 		case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
-			IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )&( req_ws->pkt_out );
-			IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )&( req_ws->pkt_in );
-			tm_resp->netfn = tm_req->netfn + 1;
+			/* the terminal mode header is two bytes shorter and 
+			 * there is no checksum, it ends where the IPMB header 
+			 * does */
+			IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )( req_ws->pkt_in );
+			IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )&( frame[2] );
+
+			tm_resp->netfn = netfn;
 			tm_resp->responder_lun = tm_req->responder_lun;
 			tm_resp->req_seq = tm_req->req_seq;
-			tm_resp->bridge = tm_req->bridge; /* TODO check */
-			tm_resp->command = tm_req->command;
-			req_ws->len_out = sizeof(IPMI_TERMINAL_MODE_RESPONSE)
-				- TERM_MODE_RESP_MAX_DATA_LEN + pkt->hdr.resp_data_len;
+			tm_resp->bridge = tm_req->bridge;
+			tm_resp->command = command;
+			resp_ws->frame_out = &( frame[2] );
+			resp_ws->len_out = resp_ws->len_in - 3;
 			}
 			break;
-		
-		case IPMI_CH_PROTOCOL_ICMB:		/* ICMB v1.0 */
-		case IPMI_CH_PROTOCOL_SMB:		/* IPMI on SMSBus */
-		case IPMI_CH_PROTOCOL_KCS:		/* KCS System Interface Format */
-		case IPMI_CH_PROTOCOL_SMIC:		/* SMIC System Interface Format */
-		case IPMI_CH_PROTOCOL_BT10:		/* BT System Interface Format, IPMI v1.0 */
-		case IPMI_CH_PROTOCOL_BT15:		/* BT System Interface Format, IPMI v1.5 */
-			/* Unsupported protocol */
-			dputstr( DBG_IPMI | DBG_ERR, "ipmi_process_pkt: unsupported protocol\n" );
-			break;
-	}
-	
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
-}
-
-void
-ipmi_process_request( IPMI_PKT *pkt )
-{
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_request: ingress\n" );
 
-	switch( pkt->hdr.netfn ) {
-		case NETFN_GROUP_EXTENSION_REQ:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: NETFN_GROUP_EXTENSION_REQ\n" );
-			picmg_process_command( pkt );
-			break;
-		case NETFN_APP_REQ:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: NETFN_APP_REQ\n" );
-			ipmi_process_app_req( pkt );
-			break;
-		case NETFN_EVENT_REQ:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: NETFN_EVENT_REQ\n" );
-			ipmi_process_event_req( pkt );
-			break;
-		case NETFN_FW_REQ:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: NETFN_FW_REQ\n" );
-			ipmi_process_fw_req( pkt );
-			break;
-		case NETFN_NVSTORE_REQ:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: NETFN_NVSTORE_REQ\n" );
-			ipmi_process_nvstore_req( pkt );
-			break;
 		default:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_request: default\n" );
-			ipmi_default_response( pkt );
-			break;
+			/* Unsupported protocol */
+			dputstr( DBG_IPMI | DBG_ERR, "ipmi_bridge_response: unsupported protocol\n" );
+			ws_free( resp_ws );
+			return;
 	}
 	
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_request: egress\n" );
-}
-
-/* firmware transfer request */
-void
-ipmi_process_fw_req( IPMI_PKT *pkt )
-{
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_fw_req: ingress\n" );
-	pkt->resp->completion_code = CC_INVALID_CMD;
-	pkt->hdr.resp_data_len = 0;
-}
-
-void
-ipmi_default_response( IPMI_PKT *pkt )
-{
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_default_response: ingress\n" );
-	pkt->resp->completion_code = CC_INVALID_CMD;
-	pkt->hdr.resp_data_len = 0;
+	resp_ws->addr_out = req_ws->addr_in;
+	resp_ws->outgoing_channel = req_ws->incoming_channel;
+	resp_ws->outgoing_protocol = req_ws->incoming_protocol;
+	resp_ws->outgoing_medium = req_ws->incoming_medium;
+	resp_ws->priority = WS_PRIO_RESPONSE;
+	ws_set_state( resp_ws, WS_ACTIVE_MASTER_WRITE );
 }
 
 /*======================================================================*/
@@ -599,262 +614,236 @@ ipmi_default_response( IPMI_PKT *pkt )
 /*======================================================================*/
 
 void
-ipmi_process_app_req( IPMI_PKT *pkt )
+ipmi_get_device_id( IPMI_PKT *pkt )
 {
-	int err;
-
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_app_req: ingress\n" );
-
-	switch( pkt->req->command )
-	{
-		case IPMI_CMD_GET_DEVICE_ID: 
-		    {
-			/* Broadcast Get Device ID is over IPMB channels only.
-			 * Request is formatted as an entire IPMB application
-			 * request message, from the RsSA field through the 
-			 * second checksum, with the message prefixed with the
-			 * broadcast slave address, 00h. Response format is 
-			 * same as the regular Get Device ID response. */
-			    
-			GET_DEVICE_ID_CMD_RESP *gdi_resp = 
-				(GET_DEVICE_ID_CMD_RESP *)(pkt->resp);
-			
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_GET_DEVICE_ID\n" );
-			
-			gdi_resp->completion_code = CC_NORMAL;
-			gdi_resp->device_id = 0x0;
-			gdi_resp->device_sdr_provided = 1; 	/* 1 = device provides Device SDRs */
-			gdi_resp->device_revision = 0;		/* 4 bit field, binary encoded */
-			gdi_resp->device_available = 0;
-			gdi_resp->major_fw_rev = 0x01;
-			gdi_resp->minor_fw_rev = 0x00;
-			gdi_resp->ipmi_version = 0x02;
-			gdi_resp->add_dev_support = 
-				DEV_SUP_IPMB_EVENT_GEN |
-				DEV_SUP_FRU_INVENTORY |
-				DEV_SUP_SDR_REPOSITORY |
-				DEV_SUP_SENSOR;
-			gdi_resp->manuf_id[0] = 0xbe;
-			gdi_resp->manuf_id[1] = 0x12;
-			gdi_resp->manuf_id[2] = 0x0;
-			gdi_resp->product_id[0] = 0x00;
-			gdi_resp->product_id[1] = 0x80;
-			gdi_resp->aux_fw_rev[0] = 0x0;
-			gdi_resp->aux_fw_rev[1] = 0x0;
-			gdi_resp->aux_fw_rev[2] = 0x0;
-			gdi_resp->aux_fw_rev[3] = 0x0;
-		    }
-		    pkt->hdr.resp_data_len = 15;
-		    break;
-		    
-		case IPMI_CMD_COLD_RESET:
-    		    {
-			IPMI_CMD_RESP *generic_resp = ( IPMI_CMD_RESP *)(pkt->resp);
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_COLD_RESET\n" );
-
-			generic_resp->completion_code = CC_NORMAL;
-			pkt->hdr.resp_data_len = 0;
-		    }
-
-		    break;
-
-		case IPMI_CMD_WARM_RESET:
-		    {
-			IPMI_CMD_RESP *generic_resp = ( IPMI_CMD_RESP *)(pkt->resp);
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_WARM_RESET\n" );
-
-			generic_resp->completion_code = CC_NORMAL;
-			pkt->hdr.resp_data_len = 0;
-		    }
-		    break;
-
-		case IPMI_CMD_GET_SELF_TEST_RESULTS: 
-		    {
-			GET_SELF_TEST_RESULTS_CMD_RESP *gstr_resp =
-				(GET_SELF_TEST_RESULTS_CMD_RESP *)(pkt->resp);				
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_GET_SELF_TEST_RESULTS\n" );
-
-			gstr_resp->completion_code = CC_NORMAL;
-			/* Self Test function not implemented in this controller. */
-			gstr_resp->result1 = SELFTEST_RESULT_NOT_IMPLEMENTED;
-			gstr_resp->result2 = 0;
-			gstr_resp->result3 = 0;
-		    }	
-		    pkt->hdr.resp_data_len = 3;
-		    break;
-		    
-		case IPMI_CMD_RESET_WATCHDOG_TIMER: 
-		    {
-		 	/* The Reset Watchdog Timer command is used for starting
-			 * and restarting the Watchdog Timer from the initial
-			 * countdown value that was specified in the Set Watchdog
-			 * Timer command. If a pre-timeout interrupt has been 
-			 * configured, the Reset Watchdog Timer command will not
-			 * restart the timer once the pre-timeout interrupt 
-			 * interval has been reached. The only way to stop the
-			 * timer once it has reached this point is via the Set
-			 * Watchdog Timer command. 
-			 * If the counter is loaded with zero and the Reset
-			 * Watchdog command is issued to start the timer, the
-			 * associated timer events occur immediately. */
-
-			RESET_WATCHDOG_TIMER_CMD_RESP *resp = 
-				(RESET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_RESET_WATCHDOG_TIMER\n" );
-
-			switch ( wd_timer.state ) {
-				case WD_STATE_TIMER_RUNNING_POST_PRE_TIMEOUT_INTERRUPT:
-					/* can't reset if we're post pre-timeout interrupt */
-					resp->completion_code = CC_NORMAL;
-					break;
-				case WD_STATE_UNINITIALIZED:
-					resp->completion_code = 0x80;
-					break;
-				case WD_STATE_INITIALIZED_TIMER_STOPPED:
-				case WD_STATE_TIMER_RUNNING:
-				default:
-					if( wd_timer.pre_timeout_intr != WD_PRE_TIMEOUT_INTR_NONE ) {
-						timer_reset_callout_queue( (void *)&wd_timer,
-							wd_timer.init_countdown_ticks - wd_timer.pre_timeout_interval_ticks );
-						wd_timer.pre_timeout_enabled = 1;
-					} else {
-						timer_reset_callout_queue( (void *)&wd_timer,
-							wd_timer.init_countdown_ticks );
-						wd_timer.pre_timeout_enabled = 0;
-					}
-					resp->completion_code = CC_NORMAL;
-					break;
-			}
-			pkt->hdr.resp_data_len = 0;
-		    }			
-		    break;
-
-		case IPMI_CMD_SET_WATCHDOG_TIMER: 
-		    {
-			/* The Set Watchdog Timer command is used for initializing
-			 * and configuring the watchdog timer. The command is
-			 * also used for stopping the timer.
-			 * If the timer is already running, the Set Watchdog Timer
-			 * command stops the timer (unless the dont stop bit is
-			 * set) and clears the Watchdog pre-timeout interrupt flag
-			 * (see Get Message Flags command). BMC hard resets,
-			 * system hard resets, and the Cold Reset command also
-			 * stop the timer and clear the flag. */ 
-			SET_WATCHDOG_TIMER_CMD_REQ *swd_req = 
-				(SET_WATCHDOG_TIMER_CMD_REQ *)(pkt->req);
-			SET_WATCHDOG_TIMER_CMD_RESP *resp = 
-				(SET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);
-
-			unsigned long init_countdown_ticks = ( swd_req->init_countdown_msb << 8 ) |
-				swd_req->init_countdown_lsb;
-			unsigned long pre_timeout_interval_ticks = swd_req->pre_timeout_interval * 10;
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_SET_WATCHDOG_TIMER\n" );
-
-			/* parameter checking */
-			if( swd_req->timeout_action > WD_TIMEOUT_ACTION_POWER_CYCLE )
-				err++;
-
-			if( swd_req->pre_timeout_intr &&
-				( pre_timeout_interval_ticks > init_countdown_ticks ) )
-				err++;
-
-			/* stop wd timer */
-			timer_remove_callout_queue( (void *)&wd_timer);
-
-			/* set new values  */
-			wd_timer.dont_log = swd_req->dont_log;
-			wd_timer.timeout_action = swd_req->timeout_action;
-
-			wd_timer.pre_timeout_intr = swd_req->pre_timeout_intr;
-			wd_timer.pre_timeout_interval = swd_req->pre_timeout_interval;
-			wd_timer.pre_timeout_interval_ticks = pre_timeout_interval_ticks;
-
-			wd_timer.timer_use_exp_fl_clr = swd_req->timer_use_exp_fl_clr;
-
-			wd_timer.init_countdown_lsb = swd_req->init_countdown_lsb;	/* (100 ms/count) */
-			wd_timer.init_countdown_msb = swd_req->init_countdown_msb;
-			wd_timer.init_countdown_ticks = init_countdown_ticks;
-
-			wd_timer.timer_use = swd_req->timer_use;
-			wd_timer.wd_initialized = 1;
-
-			if( ( swd_req->dont_stop_timer ) && ( ( wd_timer.state == WD_STATE_TIMER_RUNNING ) ||
-			      ( wd_timer.state == WD_STATE_TIMER_RUNNING_POST_PRE_TIMEOUT_INTERRUPT ) ) ) {
-				if( wd_timer.pre_timeout_intr != WD_PRE_TIMEOUT_INTR_NONE ) {
-					/* pre-timeout interrupt required */
-					timer_add_callout_queue( (void *)&wd_timer,
-						init_countdown_ticks - pre_timeout_interval_ticks,
-						ipmi_wd_expired, 0 );
-					wd_timer.pre_timeout_enabled = 1;
-				} else {
-					timer_add_callout_queue( (void *)&wd_timer,
-						init_countdown_ticks,
-						ipmi_wd_expired, 0 );
-					wd_timer.pre_timeout_enabled = 0;
-				}
-				wd_timer.state = WD_STATE_TIMER_RUNNING;
-		  	} else {
-				wd_timer.state = WD_STATE_INITIALIZED_TIMER_STOPPED;
-		  	}
-			pkt->hdr.resp_data_len = 0;
-		    }
-		    break;
-
-		case IPMI_CMD_GET_WATCHDOG_TIMER: 
-		    {
-			GET_WATCHDOG_TIMER_CMD_RESP *gwd_resp =
-				( GET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);	
-			unsigned long ticks;			
-
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: IPMI_CMD_GET_WATCHDOG_TIMER\n" );
-
-			gwd_resp->completion_code = CC_NORMAL;	
-			gwd_resp->dont_log = wd_timer.dont_log;
-			gwd_resp->dont_stop_timer = wd_timer.timer_running;
-			gwd_resp->timer_use = wd_timer.timer_use;			
-			gwd_resp->pre_timeout_intr = wd_timer.pre_timeout_intr;	
-			gwd_resp->timeout_action = wd_timer.timeout_action;	
-			gwd_resp->pre_timeout_interval = wd_timer.pre_timeout_interval;	
-			gwd_resp->timer_use_exp_fl = wd_timer.timer_use_exp_fl;
-			gwd_resp->init_countdown_lsb = wd_timer.init_countdown_lsb;
-			gwd_resp->init_countdown_msb = wd_timer.init_countdown_msb;
-			ticks = timer_get_expiration_time( &wd_timer );
-			gwd_resp->present_countdown_lsb = ticks & 0xff;
-			gwd_resp->present_countdown_msb = ( ticks >> 8 ) & 0xff;
-
-			/* The initial countdown value and present countdown values 
-			 * should match immediately after the countdown is initialized
-			 * via a Set Watchdog Timer command and after a Reset Watchdog
-			 * Timer has been executed.
-			 * Note that internal delays in the BMC may require software to 
-			 * delay up to 100ms before seeing the countdown value change 
-			 * and be reflected in the Get Watchdog Timer command. */
-			pkt->hdr.resp_data_len = sizeof( GET_WATCHDOG_TIMER_CMD_RESP ) - 1;
-		    }
-		    break;
-
-		case IPMI_CMD_SEND_MESSAGE:
-		    ipmi_send_message_cmd( pkt );
-		    break;
+	/* Broadcast Get Device ID is over IPMB channels only.
+	 * Request is formatted as an entire IPMB application
+	 * request message, from the RsSA field through the 
+	 * second checksum, with the message prefixed with the
+	 * broadcast slave address, 00h. Response format is 
+	 * same as the regular Get Device ID response. */
+	    
+	GET_DEVICE_ID_CMD_RESP *gdi_resp = 
+		(GET_DEVICE_ID_CMD_RESP *)(pkt->resp);
+	
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_get_device_id: ingress\n" );
+	
+	gdi_resp->completion_code = CC_NORMAL;
+	gdi_resp->device_id = 0x0;
+	gdi_resp->device_sdr_provided = 1; 	/* 1 = device provides Device SDRs */
+	gdi_resp->device_revision = 0;		/* 4 bit field, binary encoded */
+	gdi_resp->device_available = 0;
+	gdi_resp->major_fw_rev = 0x01;
+	gdi_resp->minor_fw_rev = 0x00;
+	gdi_resp->ipmi_version = 0x02;
+	gdi_resp->add_dev_support = 
+		DEV_SUP_IPMB_EVENT_GEN |
+		DEV_SUP_FRU_INVENTORY |
+		DEV_SUP_SDR_REPOSITORY |
+		DEV_SUP_SENSOR;
+	gdi_resp->manuf_id[0] = COREIPM_IANA & 0xff;
+	gdi_resp->manuf_id[1] = ( COREIPM_IANA >> 8 ) & 0xff;
+	gdi_resp->manuf_id[2] = ( COREIPM_IANA >> 16 ) & 0xff;
+	gdi_resp->product_id[0] = 0x00;
+	gdi_resp->product_id[1] = 0x80;
+	gdi_resp->aux_fw_rev[0] = 0x0;
+	gdi_resp->aux_fw_rev[1] = 0x0;
+	gdi_resp->aux_fw_rev[2] = 0x0;
+	gdi_resp->aux_fw_rev[3] = 0x0;
+	pkt->hdr.resp_data_len = 15;
+}
+
+void
+ipmi_cold_reset( IPMI_PKT *pkt )
+{
+	IPMI_CMD_RESP *generic_resp = ( IPMI_CMD_RESP *)(pkt->resp);
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_cold_reset: ingress\n" );
 
+	generic_resp->completion_code = CC_NORMAL;
+	pkt->hdr.resp_data_len = 0;
+
+}
+
+void
+ipmi_warm_reset( IPMI_PKT *pkt )
+{
+	IPMI_CMD_RESP *generic_resp = ( IPMI_CMD_RESP *)(pkt->resp);
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_warm_reset: ingress\n" );
+
+	generic_resp->completion_code = CC_NORMAL;
+	pkt->hdr.resp_data_len = 0;
+}
+
+void
+ipmi_get_self_test_results( IPMI_PKT *pkt )
+{
+	GET_SELF_TEST_RESULTS_CMD_RESP *gstr_resp =
+		(GET_SELF_TEST_RESULTS_CMD_RESP *)(pkt->resp);				
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_get_self_test_results: ingress\n" );
+
+	gstr_resp->completion_code = CC_NORMAL;
+	/* Self Test function not implemented in this controller. */
+	gstr_resp->result1 = SELFTEST_RESULT_NOT_IMPLEMENTED;
+	gstr_resp->result2 = 0;
+	gstr_resp->result3 = 0;
+	pkt->hdr.resp_data_len = 3;
+}
+
+void
+ipmi_reset_watchdog_timer( IPMI_PKT *pkt )
+{
+	/* The Reset Watchdog Timer command is used for starting
+	 * and restarting the Watchdog Timer from the initial
+	 * countdown value that was specified in the Set Watchdog
+	 * Timer command. If a pre-timeout interrupt has been 
+	 * configured, the Reset Watchdog Timer command will not
+	 * restart the timer once the pre-timeout interrupt 
+	 * interval has been reached. The only way to stop the
+	 * timer once it has reached this point is via the Set
+	 * Watchdog Timer command. 
+	 * If the counter is loaded with zero and the Reset
+	 * Watchdog command is issued to start the timer, the
+	 * associated timer events occur immediately. */
+
+	RESET_WATCHDOG_TIMER_CMD_RESP *resp = 
+		(RESET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_reset_watchdog_timer: ingress\n" );
+
+	switch ( wd_timer.state ) {
+		case WD_STATE_TIMER_RUNNING_POST_PRE_TIMEOUT_INTERRUPT:
+			/* can't reset if we're post pre-timeout interrupt */
+			resp->completion_code = CC_NORMAL;
+			break;
+		case WD_STATE_UNINITIALIZED:
+			resp->completion_code = 0x80;
+			break;
+		case WD_STATE_INITIALIZED_TIMER_STOPPED:
+		case WD_STATE_TIMER_RUNNING:
 		default:
-		    {
-			IPMI_CMD_RESP *generic_resp = ( IPMI_CMD_RESP *)(pkt->resp);
+			if( wd_timer.pre_timeout_intr != WD_PRE_TIMEOUT_INTR_NONE ) {
+				timer_reset_callout_queue( (void *)&wd_timer,
+					wd_timer.init_countdown_ticks - wd_timer.pre_timeout_interval_ticks );
+				wd_timer.pre_timeout_enabled = 1;
+			} else {
+				timer_reset_callout_queue( (void *)&wd_timer,
+					wd_timer.init_countdown_ticks );
+				wd_timer.pre_timeout_enabled = 0;
+			}
+			resp->completion_code = CC_NORMAL;
+			break;
+	}
+	pkt->hdr.resp_data_len = 0;
+}
 
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_process_app_req: unknown command\n" );
+void
+ipmi_set_watchdog_timer( IPMI_PKT *pkt )
+{
+	int err = 0;
+
+	/* The Set Watchdog Timer command is used for initializing
+	 * and configuring the watchdog timer. The command is
+	 * also used for stopping the timer.
+	 * If the timer is already running, the Set Watchdog Timer
+	 * command stops the timer (unless the dont stop bit is
+	 * set) and clears the Watchdog pre-timeout interrupt flag
+	 * (see Get Message Flags command). BMC hard resets,
+	 * system hard resets, and the Cold Reset command also
+	 * stop the timer and clear the flag. */ 
+	SET_WATCHDOG_TIMER_CMD_REQ *swd_req = 
+		(SET_WATCHDOG_TIMER_CMD_REQ *)(pkt->req);
+	SET_WATCHDOG_TIMER_CMD_RESP *resp = 
+		(SET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);
+
+	unsigned long init_countdown_ticks = ( swd_req->init_countdown_msb << 8 ) |
+		swd_req->init_countdown_lsb;
+	unsigned long pre_timeout_interval_ticks = swd_req->pre_timeout_interval * 10;
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_set_watchdog_timer: ingress\n" );
+
+	/* parameter checking */
+	if( swd_req->timeout_action > WD_TIMEOUT_ACTION_POWER_CYCLE )
+		err++;
+
+	if( swd_req->pre_timeout_intr &&
+		( pre_timeout_interval_ticks > init_countdown_ticks ) )
+		err++;
+
+	/* stop wd timer */
+	timer_remove_callout_queue( (void *)&wd_timer);
+
+	/* set new values  */
+	wd_timer.dont_log = swd_req->dont_log;
+	wd_timer.timeout_action = swd_req->timeout_action;
+
+	wd_timer.pre_timeout_intr = swd_req->pre_timeout_intr;
+	wd_timer.pre_timeout_interval = swd_req->pre_timeout_interval;
+	wd_timer.pre_timeout_interval_ticks = pre_timeout_interval_ticks;
+
+	wd_timer.timer_use_exp_fl_clr = swd_req->timer_use_exp_fl_clr;
+
+	wd_timer.init_countdown_lsb = swd_req->init_countdown_lsb;	/* (100 ms/count) */
+	wd_timer.init_countdown_msb = swd_req->init_countdown_msb;
+	wd_timer.init_countdown_ticks = init_countdown_ticks;
+
+	wd_timer.timer_use = swd_req->timer_use;
+	wd_timer.wd_initialized = 1;
+
+	if( ( swd_req->dont_stop_timer ) && ( ( wd_timer.state == WD_STATE_TIMER_RUNNING ) ||
+	      ( wd_timer.state == WD_STATE_TIMER_RUNNING_POST_PRE_TIMEOUT_INTERRUPT ) ) ) {
+		if( wd_timer.pre_timeout_intr != WD_PRE_TIMEOUT_INTR_NONE ) {
+			/* pre-timeout interrupt required */
+			timer_add_callout_queue( (void *)&wd_timer,
+				init_countdown_ticks - pre_timeout_interval_ticks,
+				ipmi_wd_expired, 0 );
+			wd_timer.pre_timeout_enabled = 1;
+		} else {
+			timer_add_callout_queue( (void *)&wd_timer,
+				init_countdown_ticks,
+				ipmi_wd_expired, 0 );
+			wd_timer.pre_timeout_enabled = 0;
+		}
+		wd_timer.state = WD_STATE_TIMER_RUNNING;
+	} else {
+		wd_timer.state = WD_STATE_INITIALIZED_TIMER_STOPPED;
+	}
+	pkt->hdr.resp_data_len = 0;
+}
 
-			generic_resp->completion_code = CC_INVALID_CMD;
-			pkt->hdr.resp_data_len = 0;
-		    }
-		    break;
-	} /* switch( pkt->req->command ) */
-	
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_app_req: egress\n" );
+void
+ipmi_get_watchdog_timer( IPMI_PKT *pkt )
+{
+	GET_WATCHDOG_TIMER_CMD_RESP *gwd_resp =
+		( GET_WATCHDOG_TIMER_CMD_RESP *)(pkt->resp);	
+	unsigned long ticks;			
+
+	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_get_watchdog_timer: ingress\n" );
+
+	gwd_resp->completion_code = CC_NORMAL;	
+	gwd_resp->dont_log = wd_timer.dont_log;
+	gwd_resp->dont_stop_timer = wd_timer.timer_running;
+	gwd_resp->timer_use = wd_timer.timer_use;			
+	gwd_resp->pre_timeout_intr = wd_timer.pre_timeout_intr;	
+	gwd_resp->timeout_action = wd_timer.timeout_action;	
+	gwd_resp->pre_timeout_interval = wd_timer.pre_timeout_interval;	
+	gwd_resp->timer_use_exp_fl = wd_timer.timer_use_exp_fl;
+	gwd_resp->init_countdown_lsb = wd_timer.init_countdown_lsb;
+	gwd_resp->init_countdown_msb = wd_timer.init_countdown_msb;
+	ticks = timer_get_expiration_time( &wd_timer );
+	gwd_resp->present_countdown_lsb = ticks & 0xff;
+	gwd_resp->present_countdown_msb = ( ticks >> 8 ) & 0xff;
+
+	/* The initial countdown value and present countdown values 
+	 * should match immediately after the countdown is initialized
+	 * via a Set Watchdog Timer command and after a Reset Watchdog
+	 * Timer has been executed.
+	 * Note that internal delays in the BMC may require software to 
+	 * delay up to 100ms before seeing the countdown value change 
+	 * and be reflected in the Get Watchdog Timer command. */
+	pkt->hdr.resp_data_len = sizeof( GET_WATCHDOG_TIMER_CMD_RESP ) - 1;
 }
 
 void
@@ -914,56 +903,6 @@ ipmi_wd_expired(uchar * arg)
  */
 /*======================================================================*/
 /*======================================================================*/
-void
-ipmi_process_nvstore_req( IPMI_PKT *pkt )
-{
-	IPMI_CMD_RESP *resp = ( IPMI_CMD_RESP *)(pkt->resp);
-
-	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_process_nvstore_req: ingress\n" );
-
-	switch( pkt->req->command ) {
-		case IPMI_STO_CMD_GET_FRU_INVENTORY_AREA_INFO:
-			ipmi_get_fru_inventory_area_info( pkt );
-			break;
-		case IPMI_STO_CMD_READ_FRU_DATA:
-			ipmi_read_fru_data( pkt );
-			break;
-		case IPMI_STO_CMD_WRITE_FRU_DATA:
-			ipmi_write_fru_data( pkt );
-			break;
-		case IPMI_STO_CMD_GET_SDR_REPOSITORY_INFO:
-		case IPMI_STO_CMD_GET_SDR_REPOSITORY_ALLOCATION_INFO:
-		case IPMI_STO_CMD_RESERVE_SDR_REPOSITORY:
-		case IPMI_STO_CMD_GET_SDR:
-		case IPMI_STO_CMD_ADD_SDR:
-		case IPMI_STO_CMD_PARTIAL_ADD_SDR:
-		case IPMI_STO_CMD_DELETE_SDR:
-		case IPMI_STO_CMD_CLEAR_SDR_REPOSITORY:
-		case IPMI_STO_CMD_GET_SDR_REPOSITORY_TIME:
-		case IPMI_STO_CMD_SET_SDR_REPOSITORY_TIME:
-		case IPMI_STO_CMD_ENTER_SDR_REPOSITORY_UPDATE_MODE:
-		case IPMI_STO_CMD_EXIT_SDR_REPOSITORY_UPDATE_MODE:
-		case IPMI_STO_CMD_RUN_INITIALIZATION_AGENT:
-		case IPMI_STO_CMD_GET_SEL_INFO:
-		case IPMI_STO_CMD_GET_SEL_ALLOCATION_INFO:
-		case IPMI_STO_CMD_RESERVE_SEL:
-		case IPMI_STO_CMD_GET_SEL_ENTRY:
-		case IPMI_STO_CMD_ADD_SEL_ENTRY:
-		case IPMI_STO_CMD_PARTIAL_ADD_SEL_ENTRY:
-		case IPMI_STO_CMD_DELETE_SEL_ENTRY:
-		case IPMI_STO_CMD_CLEAR_SEL:
-		case IPMI_STO_CMD_GET_SEL_TIME:
-		case IPMI_STO_CMD_SET_SEL_TIME:
-		case IPMI_STO_CMD_GET_AUX_LOG_STATUS:
-		case IPMI_STO_CMD_SET_AUX_LOG_STATUS:
-			resp->completion_code = CC_INVALID_CMD;
-			pkt->hdr.resp_data_len = 0;
-			break;
-		default:
-			break;
-	}
-}
-
 /*======================================================================*/
 /*
  *    FRU Inventory Device Commands
@@ -1096,9 +1035,9 @@ ipmi_read_fru_data( IPMI_PKT *pkt )
 			resp->count_returned = req->count_to_read;
 		}
 		
-		/* we have a payload limit for IPMB */
-		if( resp->count_returned > 20 ) /* TODO check size */
-			resp->count_returned = 20;
+		/* the count byte goes ahead of the data */
+		if( resp->count_returned > ipmi_resp_max_data_len( pkt ) - 1 )
+			resp->count_returned = ipmi_resp_max_data_len( pkt ) - 1;
 		
 		memcpy( &( resp->data ), fru_inventory_cache[i].fru_data + fru_inventory_offset,
 			resp->count_returned );
@@ -1134,6 +1073,7 @@ ipmi_read_fru_data( IPMI_PKT *pkt )
 	ws->outgoing_protocol = IPMI_CH_PROTOCOL_NONE;
        	ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
 	ws->bridged_ws = pkt->hdr.ws;
+	ws->priority = WS_PRIO_BACKGROUND;
 	ws->ipmi_completion_function = fru_read_complete;
 	ws_set_state( ws, WS_ACTIVE_MASTER_READ );				
 }
@@ -1143,73 +1083,27 @@ fru_read_complete( void *ws, int status )
 {
 	IPMI_WS *req_ws = ( (IPMI_WS *)( ws ) )->bridged_ws;
 	IPMI_WS *fru_ws = ( (IPMI_WS *)( ws ) );
-	IPMI_PKT *pkt = &req_ws->pkt;
-	uchar requester_slave_addr;
+	READ_FRU_DATA_CMD_RESP *resp = ( READ_FRU_DATA_CMD_RESP * )( req_ws->pkt.resp );
+	unsigned count = fru_ws->len_in;
 
 	//TODO copy data to cache
 
-	/* send back response */
-	req_ws->outgoing_protocol = req_ws->incoming_protocol;
-	req_ws->outgoing_medium = req_ws->incoming_medium;
-	pkt->hdr.resp_data_len = fru_ws->len_in; // TODO Check size
-	
-	switch( req_ws->outgoing_protocol ) {
-		case IPMI_CH_PROTOCOL_IPMB: {
-			IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( req_ws->pkt_out );
-			IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_in );
-			
-			memcpy(ipmb_resp->data, fru_ws->pkt_in, IPMB_RESP_MAX_DATA_LEN ); //TODO check size
-//			ipmb_resp->requester_slave_addr = ipmb_req->requester_slave_addr;
-			requester_slave_addr = ipmb_req->requester_slave_addr;
-			ipmb_resp->netfn = ipmb_req->netfn + 1;
-			ipmb_resp->requester_lun = ipmb_req->requester_lun;
-			ipmb_resp->header_checksum = -( *( char * )ipmb_resp + requester_slave_addr );
-			ipmb_resp->responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
-			ipmb_resp->req_seq = ipmb_req->req_seq;
-			ipmb_resp->responder_lun = ipmb_req->responder_lun;
-			ipmb_resp->command = ipmb_req->command;
-			ipmb_resp->completion_code = CC_NORMAL;
-			/* The location of data_checksum field is bogus.
-			 * It's used as a placeholder to indicate that a checksum follows the data field.
-			 * The location of the data_checksum depends on the size of the data preceeding it.*/
-			ipmb_resp->data_checksum = 
-				ipmi_calculate_checksum( &ipmb_resp->responder_slave_addr, 
-					pkt->hdr.resp_data_len + 4 ); 
-			req_ws->len_out = sizeof(IPMI_IPMB_RESPONSE) 
-				- IPMB_RESP_MAX_DATA_LEN  +  pkt->hdr.resp_data_len;
-			/* Assign the checksum to it's proper location */
-			*( (uchar *)ipmb_resp + req_ws->len_out) = ipmb_resp->data_checksum; 
-			}			
-			break;
-		
-		case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
-			IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )&( req_ws->pkt_out );
-			IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )&( req_ws->pkt_in );
-			memcpy(tm_resp->data, fru_ws->pkt_in, IPMB_RESP_MAX_DATA_LEN ); //TODO check size
-
-			tm_resp->netfn = tm_req->netfn + 1;
-			tm_resp->responder_lun = tm_req->responder_lun;
-			tm_resp->req_seq = tm_req->req_seq;
-			tm_resp->bridge = tm_req->bridge; /* TODO check */
-			tm_resp->command = tm_req->command;
-			req_ws->len_out = sizeof(IPMI_TERMINAL_MODE_RESPONSE)
-				- TERM_MODE_RESP_MAX_DATA_LEN + pkt->hdr.resp_data_len;
-			}
-			break;
-		
-		case IPMI_CH_PROTOCOL_ICMB:		/* ICMB v1.0 */
-		case IPMI_CH_PROTOCOL_SMB:		/* IPMI on SMSBus */
-		case IPMI_CH_PROTOCOL_KCS:		/* KCS System Interface Format */
-		case IPMI_CH_PROTOCOL_SMIC:		/* SMIC System Interface Format */
-		case IPMI_CH_PROTOCOL_BT10:		/* BT System Interface Format, IPMI v1.0 */
-		case IPMI_CH_PROTOCOL_BT15:		/* BT System Interface Format, IPMI v1.5 */
-			/* Unsupported protocol */
-			dputstr( DBG_IPMI | DBG_ERR, "ipmi_process_pkt: unsupported protocol\n" );
-			break;
+	/* the data read from the device is the only thing copied, 
+	 * the response header is framed around it in req_ws */
+	if( status != XPORT_REQ_NOERR ) {
+		resp->completion_code = CC_DEST_UNAVAILABLE;
+		count = 0;
+	} else {
+		/* the count byte goes ahead of the data */
+		if( count > ipmi_resp_max_data_len( &req_ws->pkt ) - 1 )
+			count = ipmi_resp_max_data_len( &req_ws->pkt ) - 1;
+		resp->completion_code = CC_NORMAL;
+		memcpy( &( resp->data ), fru_ws->pkt_in, count );
 	}
-	
+	resp->count_returned = count;
+
 	ws_free( fru_ws );
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );	
+	ipmi_send_response( req_ws, count + 1 );
 }
 
 
@@ -1316,26 +1210,39 @@ ipmi_send_message_cmd( IPMI_PKT *pkt )
 {
 	SEND_MESSAGE_CMD_REQ *req = ( SEND_MESSAGE_CMD_REQ * )(pkt->req);
 	SEND_MESSAGE_CMD_RESP *resp = ( SEND_MESSAGE_CMD_RESP * )(pkt->resp);
-	unsigned short destination_protocol, destination_medium;
-	IPMI_WS *target_ws;
-	uchar seq;
+	IPMI_WS *ws = ( IPMI_WS * )( pkt->hdr.ws );
+	IPMI_IPMB_REQUEST *ipmb_req;
+	uchar *frame, before, seq = 0;
+	unsigned frame_len;
 	
 	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_send_message_cmd: ingress\n" );
 
-	if( !( target_ws = ws_alloc() ) ) {
-		resp->completion_code = CC_OUT_OF_SPACE;
+	/* Two things to check: 1) the target should be a valid 
+	 * channel 2) Bridging is only specified for delivering 
+	 * messages between different channels. Only IPMB targets
+	 * are supported at this time, TODO: we need TMODE to bridge 
+	 * console & sys i/f */
+	if( ( channel_table[req->channel_number].protocol != IPMI_CH_PROTOCOL_IPMB )
+	 || ( req->channel_number == ws->incoming_channel ) ) {
+		resp->completion_code = CC_DEST_UNAVAILABLE;
 		pkt->hdr.resp_data_len = 0;
 		return;
 	}
 
-	/* Two things to check: 1) the target should be a valid 
-	 * channel 2) Bridging is only specified for delivering 
-	 * messages between different channels */	
-	if( ( req->channel_number != IPMI_CH_NUM_PRIMARY_IPMB )
-	 || ( req->channel_number != IPMI_CH_NUM_CONSOLE )
-	 || ( req->channel_number != IPMI_CH_NUM_SYS_INTERFACE )
-	 || ( req->channel_number == ( ( IPMI_WS * )( pkt->hdr.ws ) )->incoming_channel ) ) {
-		resp->completion_code = CC_DEST_UNAVAILABLE;
+	/* The message data is a complete IPMB request, starting with 
+	 * the responder slave address which goes on the wire as the 
+	 * i2c address */
+	if( pkt->hdr.req_data_len < 2 + sizeof( IPMI_IPMB_REQUEST ) - IPMB_REQ_MAX_DATA_LEN ) {
+		resp->completion_code = CC_RQST_DATA_LEN_INVALID;
+		pkt->hdr.resp_data_len = 0;
+		return;
+	}
+	frame = &( req->message_data ) + 1;
+	frame_len = pkt->hdr.req_data_len - 2;
+
+	/* the target channel's limit counts the rsSA */
+	if( frame_len + 1 > channel_table[req->channel_number].max_msg_len ) {
+		resp->completion_code = CC_DATA_LEN_EXCEEDED;
 		pkt->hdr.resp_data_len = 0;
 		return;
 	}
@@ -1348,72 +1255,28 @@ ipmi_send_message_cmd( IPMI_PKT *pkt )
 			break;
 	}
 	
-	/*
-        Each interface has a channel number that is used when 
-        configuring the channel and for routing messages between
-        channels. Only the channel number assignments for the 
-        primary IPMB and the System Interface are fixed, the 
-        assignment of other channel numbers can vary on a per-platform
-        basis. Software uses a Get Channel Info command to determine
-        what types of channels are available and what channel number
-        assignments are used on a given platform.
-	 */
-
-	destination_protocol = channel_table[req->channel_number].protocol;
-	destination_medium = channel_table[req->channel_number].medium;
-
-	/* the medium determines the xport layer we will call ie. i2c/serial/LAN
-	 * the protocol determines how we will package the payload to be
-	 * transmitted */
-
-	/* copy the request data payload to the outgoing packet */
-	memcpy( target_ws->pkt_out, &( req->message_data ), sizeof( SEND_MESSAGE_CMD_REQ) );
-
-	/* indicate which ws we should use to send back the response to the 
-	 * bridged command */
-	target_ws->bridged_ws = pkt->hdr.ws; /* used to find the send message ws */
-	
-	/* completion function is called when target_ws is successfully sent */
-	target_ws->ipmi_completion_function = ipmi_send_message_cmd_complete;
-	target_ws->outgoing_medium = destination_medium;
-
-	/* swap in our seq number in so we can keep track */
-	switch( destination_protocol ) {
-		case IPMI_CH_PROTOCOL_IPMB:
-			ipmi_get_next_seq( &seq );
-			( ( IPMI_IPMB_REQUEST * )( target_ws->pkt_out ) )->req_seq = seq;
-			target_ws->seq_out = seq;
-			/* set completion code so that we immediately send 
-			 * a response to the Send Message command */
-			resp->completion_code = CC_NORMAL;
-			pkt->hdr.resp_data_len = 0;
-			break;
-		case IPMI_CH_PROTOCOL_TMODE:
-			resp->completion_code = CC_DEST_UNAVAILABLE;
-			pkt->hdr.resp_data_len = 0;
-			/* TODO: not supported at this time - fix. We need this to bridge 
-			 * console & sys i/f
-			if( tmode_bridging_ws ) {
-				// someone is using the channel, can't process right now 
-				resp->completion_code = CC_RQST_DATA_LEN_INVALID;
-				resp->count_returned = 0;			
-				pkt->hdr.resp_data_len = 1;
-				return;
-			}
-			tmode_bridging_ws = pkt->hdr.ws;
-			target_ws->seq_out = seq;
-			*/
-			return;
-		default:
-			resp->completion_code = CC_DEST_UNAVAILABLE;
-			pkt->hdr.resp_data_len = 0;
-			break;
+	/* The encapsulated request is forwarded from where it is in 
+	 * pkt_in. Swap our address and seq number in so we can keep 
+	 * track, the data checksum covers both and is adjusted for 
+	 * them instead of summing the frame again. */
+	if( seq_alloc( ws, req->message_data, &seq ) != ESUCCESS ) {
+		resp->completion_code = CC_BUSY;
+		pkt->hdr.resp_data_len = 0;
+		return;
 	}
-
-	dputstr( DBG_IPMI | DBG_LVL1, "ipmi_send_message_cmd: sending message\n" );
-
-	/* dispatch the target_ws: change ws state, work list processing will do the rest */
-	ws_set_state( target_ws, WS_ACTIVE_MASTER_WRITE );				
+	ipmb_req = ( IPMI_IPMB_REQUEST * )frame;
+	before = frame[2] + frame[3];
+	ipmb_req->requester_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
+	ipmb_req->req_seq = seq;
+	frame[frame_len - 1] -= ( uchar )( frame[2] + frame[3] - before );
+
+	ws->flags |= WS_FL_BRIDGED;
+
+	/* The ws answers the Send Message command first, the completion
+	 * function then sends the forwarded request from the same ws */
+	ws->ipmi_completion_function = ipmi_send_message_cmd_complete;
+	resp->completion_code = CC_NORMAL;
+	pkt->hdr.resp_data_len = 0;
 }
 
 /*  This para from "- IPMI - IPMI v1.5 Addenda, Errata, and Clarifications
@@ -1440,86 +1303,49 @@ of the device on IPMB that the request was targeted to.
  */
  
 
-/* completion function is called when target_ws is successfully sent */
+/* Completion function for the Send Message ws, called once when the 
+ * response to the Send Message command has been sent. The forwarded 
+ * request is then tracked by seq.c, the response to it is picked up 
+ * by ipmi_process_response() and this is only called again if the 
+ * request could not be sent or was not answered. */
 void
-ipmi_send_message_cmd_complete( void *target_ws, int status )
+ipmi_send_message_cmd_complete( void *arg, int status )
 {
-	IPMI_WS *req_ws;
-	uchar requester_slave_addr;
+	IPMI_WS *ws = ( IPMI_WS * )arg;
+	SEND_MESSAGE_CMD_REQ *req = ( SEND_MESSAGE_CMD_REQ * )( ws->pkt.req );
 
 	dputstr( DBG_IPMI | DBG_INOUT, "ipmi_send_message_cmd_complete: ingress\n" );
 
-	 /* Status options are :  XPORT_REQ_ERR, XPORT_REQ_NOERR */
-	switch( status ) {
-		case XPORT_REQ_ERR:
-		default:
-			dputstr( DBG_IPMI | DBG_ERR, "ipmi_send_message_cmd_complete: error when sending message\n" );
-			req_ws = (( IPMI_WS *)( target_ws ))->bridged_ws ;
-			ws_free( target_ws );
-
-			if( !req_ws ) 
-				break;
-			
-			/* if this is bridge req there is a pending response */ 
-			/* send back response */
-			req_ws->outgoing_protocol = req_ws->incoming_protocol;
-			req_ws->outgoing_medium = req_ws->incoming_medium;
-			switch( req_ws->outgoing_protocol ) {
-				case IPMI_CH_PROTOCOL_IPMB: {
-					IPMI_IPMB_RESPONSE *ipmb_resp = ( IPMI_IPMB_RESPONSE * )&( req_ws->pkt_out );
-					IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_in );
-					
-//					ipmb_resp->requester_slave_addr = ipmb_req->requester_slave_addr;
-					requester_slave_addr = ipmb_req->requester_slave_addr;
-					ipmb_resp->netfn = ipmb_req->netfn + 1;
-					ipmb_resp->requester_lun = ipmb_req->requester_lun;
-					ipmb_resp->header_checksum = -( *( char * )ipmb_resp + requester_slave_addr );
-					ipmb_resp->responder_slave_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
-					ipmb_resp->req_seq = ipmb_req->req_seq;
-					ipmb_resp->responder_lun = ipmb_req->responder_lun;
-					ipmb_resp->command = ipmb_req->command;
-					ipmb_resp->completion_code = CC_DEST_UNAVAILABLE;
-					/* The location of data_checksum field is bogus.
-					 * It's used as a placeholder to indicate that a checksum follows the data field.
-					 * The location of the data_checksum depends on the size of the data preceeding it.*/
-					ipmb_resp->data_checksum = 
-						ipmi_calculate_checksum( &ipmb_resp->responder_slave_addr, 4 ); 
-					req_ws->len_out = sizeof(IPMI_IPMB_RESPONSE) - IPMB_RESP_MAX_DATA_LEN;
-					/* Assign the checksum to it's proper location */
-					*( (uchar *)ipmb_resp + req_ws->len_out) = ipmb_resp->data_checksum;
-					}			
-					break;
-				
-				case IPMI_CH_PROTOCOL_TMODE: {		/* Terminal Mode */
-					IPMI_TERMINAL_MODE_RESPONSE *tm_resp = ( IPMI_TERMINAL_MODE_RESPONSE * )&( req_ws->pkt_out );
-					IPMI_TERMINAL_MODE_REQUEST *tm_req = ( IPMI_TERMINAL_MODE_REQUEST * )&( req_ws->pkt_in );
-					tm_resp->netfn = tm_req->netfn + 1;
-					tm_resp->responder_lun = tm_req->responder_lun;
-					tm_resp->req_seq = tm_req->req_seq;
-					tm_resp->bridge = tm_req->bridge; /* TODO check */
-					tm_resp->command = tm_req->command;
-					req_ws->len_out = sizeof(IPMI_TERMINAL_MODE_RESPONSE)
-						- TERM_MODE_RESP_MAX_DATA_LEN;
-					}
-					break;
-				
-				case IPMI_CH_PROTOCOL_ICMB:		/* ICMB v1.0 */
-				case IPMI_CH_PROTOCOL_SMB:		/* IPMI on SMSBus */
-				case IPMI_CH_PROTOCOL_KCS:		/* KCS System Interface Format */
-				case IPMI_CH_PROTOCOL_SMIC:		/* SMIC System Interface Format */
-				case IPMI_CH_PROTOCOL_BT10:		/* BT System Interface Format, IPMI v1.0 */
-				case IPMI_CH_PROTOCOL_BT15:		/* BT System Interface Format, IPMI v1.5 */
-					/* Unsupported protocol */
-					dputstr( DBG_IPMI | DBG_ERR, "ipmi_send_message_cmd_complete: unsupported protocol\n" );
-					break;
-			}
-			
-			ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	if( !ws->frame_out ) {
+		/* Send Message response is out */
+		if( status != XPORT_REQ_NOERR ) {
+			seq_free( ws );
+			ws_free( ws );
+			return;
+		}
 
-			break;
-		case XPORT_REQ_NOERR:
-			dputstr( DBG_IPMI | DBG_LVL1, "ipmi_send_message_cmd_complete: req sent successfully\n" );
-			break;
+		/* Send the encapsulated request. Keep the address of 
+		 * the requester for the response. */
+		dputstr( DBG_IPMI | DBG_LVL1, "ipmi_send_message_cmd_complete: sending message\n" );
+		ws->addr_in = ws->addr_out;
+		ws->addr_out = req->message_data;
+		ws->frame_out = &( req->message_data ) + 1;
+		ws->len_out = ws->pkt.hdr.req_data_len - 2;
+		ws->outgoing_channel = req->channel_number;
+		ws->outgoing_protocol = channel_table[req->channel_number].protocol;
+		ws->outgoing_medium = channel_table[req->channel_number].medium;
+		seq_send( ws, ipmi_send_message_cmd_complete );
+		return;
 	}
 
+	/* this is a bridged request so the requester is waiting for a 
+	 * response, send back the error */
+	dputstr( DBG_IPMI | DBG_ERR, "ipmi_send_message_cmd_complete: no response to message\n" );
+	ws->flags &= ~WS_FL_BRIDGED;
+	ws->seq_out = 0;
+	ws->ipmi_completion_function = 0;
+	ws->addr_out = ws->addr_in;
+	ws->pkt.resp->completion_code = 
+		( status == XPORT_RESP_ERR ) ? CC_TIMEOUT : CC_DEST_UNAVAILABLE;
+	ipmi_send_response( ws, 0 );
 }
@@ -136,6 +136,10 @@ response. */
 #define NETFN_OEM_REQ			0x2E
 #define NETFN_OEM_RESP			0x2F
 
+/* IANA Enterprise Number reported by Get Device ID, it also identifies
+ * our own NETFN_OEM_REQ commands */
+#define COREIPM_IANA			0x0012BE
+
 /* Controllerspecific OEM/Group 30h-3Fh 
 - Vendor specific (16 Network Functions [8 pairs]). The Manufacturer ID
 associated with the controller implementing the command identifies the
@@ -284,6 +288,7 @@ typedef struct ipmi_cmd_resp {
 #define IPMI_CH_NUM_PRIMARY_IPMB	0x0
 #define IPMI_CH_NUM_CONSOLE		0x1
 #define IPMI_CH_NUM_LOCAL		0x2
+#define IPMI_CH_NUM_LAN			0x3	/* host build, see rmcpd.c */
 #define IPMI_CH_NUM_IPMBL		0x7
 #define IPMI_CH_NUM_PRESENT_INTERFACE	0xE
 #define IPMI_CH_NUM_SYS_INTERFACE	0xF
@@ -323,8 +328,12 @@ typedef struct ipmi_cmd_resp {
 typedef struct channel {
 	unsigned short protocol;
 	unsigned short medium;
+	unsigned short max_msg_len;	/* largest message the channel carries,
+					   header and checksums included */
 } CHANNEL;
 
+extern CHANNEL channel_table[16];
+
 typedef struct pkt_hdr {
 	unsigned char	lun;
 	unsigned	req_data_len;
@@ -344,15 +353,16 @@ typedef struct ipmi_pkt {
 } IPMI_PKT;
 
 //#define WS_ARRAY_SIZE	8
-#define WS_BUF_LEN 32
+#define WS_BUF_LEN 32		/* built in buffers, the IPMB message size */
 
 typedef struct list_hdr {
 	struct list_hdr *next;
+	struct list_hdr *prev;
 } LIST_HDR;
 
 /* ipmi working set */
 typedef struct ipmi_ws {
-//	LIST_HDR hdr;
+	LIST_HDR hdr;			/* state queue linkage, must be first */
 	unsigned ws_state;
 	unsigned len_rcv;		/* requested length of incoming pkt */
 	unsigned len_in;		/* lenght of incoming pkt */
@@ -371,12 +381,19 @@ typedef struct ipmi_ws {
 	unsigned char interface;
 	unsigned char seq_out;		/* sequence number */
 	unsigned char delivery_attempts;
+	unsigned char priority;		/* WS_PRIO_xx, fixed while queued */
+	unsigned long queued;		/* sched_clock() when it started waiting to go out */
 	void *bridged_ws;		/* the ws we're bridging */
+	unsigned char *frame_out;	/* frame to send if not pkt_out, see WS_FRAME_OUT */
+	void *seq_entry;		/* request tracking, see seq.c */
 	void(*xport_completion_function)( void *, int );
 	void(*ipmi_completion_function)( void *, int );
 	IPMI_PKT pkt;
-	unsigned char pkt_in[WS_BUF_LEN];
-	unsigned char pkt_out[WS_BUF_LEN];
+	unsigned char *pkt_in;		/* buf or a pool buffer, see ws_buf_alloc() */
+	unsigned char *pkt_out;
+	unsigned buf_len;		/* size of pkt_in and of pkt_out */
+	unsigned char buf_class;	/* pool class + 1, 0 for buf */
+	unsigned char buf[2 * WS_BUF_LEN];
 } IPMI_WS;
 
 #define WS_FL_GENERAL_CALL	1
@@ -1366,7 +1383,7 @@ typedef struct get_watchdog_timer_cmd_resp {
 /*----------------------------------------------------------------------*/
 /*			Send Message Command				*/
 /*----------------------------------------------------------------------*/
-#define	IPMI_CMD_SEND_MESSAGE	0x33
+#define	IPMI_CMD_SEND_MESSAGE	0x34
 /*
 The Send Message command is used for bridging IPMI messages between channels,
 and between the system management software (SMS) and a given channel. 
@@ -1488,6 +1505,30 @@ address field. When the message is delivered to a channel that supports sessions
 holds a Session Handle.
 */
 
+/*----------------------------------------------------------------------*/
+/*		Session commands, see 22.13 - 22.19			*/
+/*----------------------------------------------------------------------*/
+#define IPMI_CMD_GET_SYSTEM_GUID	0x37	/* Get System GUID */
+#define IPMI_CMD_GET_CHANNEL_AUTH_CAP	0x38	/* Get Channel Authentication Capabilities */
+#define IPMI_CMD_SET_SESSION_PRIV	0x3B	/* Set Session Privilege Level */
+#define IPMI_CMD_CLOSE_SESSION		0x3C	/* Close Session */
+#define IPMI_CMD_GET_CHANNEL_CIPHER_SUITES 0x54	/* Get Channel Cipher Suites */
+
+/* Get Channel Authentication Capabilities response data */
+#define CH_AUTH_CAP_V20_DATA		0x80	/* auth type byte, extended data follows */
+#define CH_AUTH_CAP_NON_NULL_USERS	0x04	/* login status byte */
+#define CH_AUTH_CAP_NULL_USERS		0x02
+#define CH_AUTH_CAP_ANONYMOUS		0x01
+#define CH_AUTH_CAP_EXT_V20		0x02	/* extended capabilities byte */
+#define CH_AUTH_CAP_EXT_V15		0x01
+
+/* command specific completion codes */
+#define CC_PRIV_NOT_AVAILABLE		0x80	/* Set Session Privilege Level: level
+						   not available for this user */
+#define CC_PRIV_EXCEEDS_LIMIT		0x81	/* level exceeds the channel or user
+						   privilege limit */
+#define CC_INVALID_SESSION_ID		0x87	/* Close Session: no such session */
+
 
 /*======================================================================*/
 /*
@@ -7367,6 +7408,8 @@ typedef struct set_ipmb_state_cmd_resp {
 					   00h shall be used. */
 } SET_IPMB_STATE_CMD_RESP;
 
+#define IPMB_STATE_NO_CHANGE	0x7f	/* link id of a FFh IPMB state byte */
+
 /*----------------------------------------------------------------------*/
 /*			Compute Power Properties command 		*/
 /*----------------------------------------------------------------------*/
@@ -7834,5 +7877,16 @@ typedef struct str_lst{
 
 void ipmi_process_pkt( IPMI_WS *ws ); 
 void ipmi_initialize( void );
-unsigned char ipmi_get_next_seq( unsigned char *seq );
 unsigned char ipmi_calculate_checksum( unsigned char *ptr, int numchar );
+unsigned ipmi_resp_max_data_len( IPMI_PKT *pkt );
+void ipmi_get_device_id( IPMI_PKT *pkt );
+void ipmi_cold_reset( IPMI_PKT *pkt );
+void ipmi_warm_reset( IPMI_PKT *pkt );
+void ipmi_get_self_test_results( IPMI_PKT *pkt );
+void ipmi_reset_watchdog_timer( IPMI_PKT *pkt );
+void ipmi_set_watchdog_timer( IPMI_PKT *pkt );
+void ipmi_get_watchdog_timer( IPMI_PKT *pkt );
+void ipmi_send_message_cmd( IPMI_PKT *pkt );
+void ipmi_get_fru_inventory_area_info( IPMI_PKT *pkt );
+void ipmi_read_fru_data( IPMI_PKT *pkt );
+void ipmi_write_fru_data( IPMI_PKT *pkt );
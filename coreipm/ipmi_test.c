@@ -26,11 +26,30 @@ support and contact details.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
 #include "ipmi.h"
 #include "ws.h"
 #include "strings.h"
 #include "ipmi_pkt.h"
+#include "rmcp.h"
 #include "rmcpd.h"
+#include "crypto.h"
+#include "session.h"
+#include "timer.h"
+#include "error.h"
+#include "sched.h"
+#include "tmode.h"
+#include "tty.h"
+#include "posix.h"
 
 // AMC_INFO amc[NUM_AMC_SLOTS];
 
@@ -40,8 +59,10 @@ int g_channel_number = 0;
 int g_bridging_enabled = 0;
 int g_responder_i2c_address = 20;
 int g_outgoing_medium = IPMI_CH_MEDIUM_SERIAL;
+char *g_tty_dev = TTY_DEV;
+unsigned g_tty_baud = TTY_BAUD;
 
-unsigned long lbolt = 0;
+extern unsigned long lbolt;
 
 /* Main menu options */
 enum {
@@ -57,6 +78,63 @@ enum {
 
 #define KBD_SETTINGS	98
 #define KBD_QUIT	99
+#define KBD_RESP_WAIT	1000	/* ms to wait for the response to a menu command */
+
+/* loop test 4, terminal mode batching */
+#define LOOP_TEST_BATCH_DEV	"/dev/ttyS1"
+#define LOOP_TEST_BATCH_COUNT	1000	/* commands per run */
+#define LOOP_TEST_BATCH_WINDOW	8	/* commands in flight in the batched run */
+#define LOOP_TEST_BATCH_SENSORS	4	/* sensor numbers cycled through */
+#define LOOP_TEST_BATCH_TIMEOUT	2000	/* ms without a response before giving up */
+#define LOOP_TEST_BATCH_SEQ	64	/* terminal mode seq is 6 bits */
+
+/* loop test 5, RMCP load generator */
+#define LOOP_TEST_LAN_HOST	"127.0.0.1"
+#define LOOP_TEST_LAN_PORT	"6230"
+#define LOOP_TEST_LAN_CLIENTS	16
+#define LOOP_TEST_LAN_MAX_CLIENTS	256
+#define LOOP_TEST_LAN_COUNT	100000
+#define LOOP_TEST_LAN_TIMEOUT	1000000	/* us before a request counts as lost */
+#define LOOP_TEST_LAN_RS_ADDR	0x20	/* the BMC */
+#define LOOP_TEST_LAN_RQ_ADDR	0x81	/* remote console software ID */
+
+/* loop test 6, RMCP+ session cost */
+#define LOOP_TEST_SESSION_COUNT	10000	/* sessions set up */
+#define LOOP_TEST_SESSION_MSGS	100000	/* messages per cipher suite */
+#define LOOP_TEST_SESSION_USER	"admin"
+#define LOOP_TEST_SESSION_PASSWORD	"password"
+#define LOOP_TEST_SESSION_PKT_LEN	96	/* room for a Get Device ID request */
+#define LOOP_TEST_SESSION_GET32( p )	( ( unsigned )( p )[0] | ( ( unsigned )( p )[1] << 8 ) \
+				| ( ( unsigned )( p )[2] << 16 ) | ( ( unsigned )( p )[3] << 24 ) )
+#define LOOP_TEST_SESSION_PUT32( p, v )	do { ( p )[0] = ( v ); ( p )[1] = ( v ) >> 8; \
+				( p )[2] = ( v ) >> 16; ( p )[3] = ( v ) >> 24; } while( 0 )
+
+/* -s and -t, scripted load generator */
+#define LOAD_TEST_TARGET	"lan:127.0.0.1:6230"
+#define LOAD_TEST_WINDOW	8	/* requests in flight */
+#define LOAD_TEST_COUNT		10000
+#define LOAD_TEST_MAX_SCRIPT	65536	/* bytes */
+#define LOAD_TEST_MAX_CMDS	32	/* script lines */
+#define LOAD_TEST_MAX_DATA	32	/* request data bytes per line */
+#define LOAD_TEST_SEQ		64	/* rqSeq is 6 bits on every transport */
+#define LOAD_TEST_TIMEOUT	1000000	/* us before a request counts as lost */
+#define LOAD_TEST_IPMB_ADDR	0x10	/* our address on the simulated IPMB */
+
+/* transports */
+enum {
+	LOAD_TEST_TTY = 0,
+	LOAD_TEST_LAN,
+	LOAD_TEST_IPMB
+};
+
+/* errors, the request did not get a response or the response is no good */
+enum {
+	LOAD_TEST_ERR_TIMEOUT = 0,
+	LOAD_TEST_ERR_SEND,
+	LOAD_TEST_ERR_STRAY,		/* answers nothing in flight */
+	LOAD_TEST_ERR_BAD,		/* could not be decoded */
+	LOAD_TEST_ERR_NUM
+};
 
 char * main_str[] = {
 	"Application commands",
@@ -84,6 +162,20 @@ char * settings_str[] = {
 	"Outgoing protocol"
 };
 
+/* canned scripts for -t1 to -t4, same format as a script file */
+char *load_test_canned[] = {
+	/* 1: Get Device ID */
+	"06 01\n",
+	/* 2: Get Sensor Reading, the first four sensors */
+	"04 2d 00\n04 2d 01\n04 2d 02\n04 2d 03\n",
+	/* 3: what a shelf manager polls a controller with */
+	"06 01 x2\n06 04\n04 2d 00 x4\n04 2d 01 x4\n2c 00 00\n",
+	/* 4: error paths, every response should carry an error completion code */
+	"06 ff\n04 2d ff\n2c 00 01\n"
+};
+
+char *load_test_err_str[LOAD_TEST_ERR_NUM] = { "timeout", "send", "stray", "bad" };
+
 /*------------------------------------------------------------------------------
  *              L O C A L   F U N C T I O N   P R O T O T Y P E S
  *----------------------------------------------------------------------------*/
@@ -101,9 +193,64 @@ void kbd_atca_cmds( void );
 void app_cmd_get_device_id( void );
 void app_cmd_get_self_test_results( void );
 void app_cmd_reset_watchdog_timer( void );
+void kbd_resp( unsigned char *msg, unsigned len );
 void kbd_settings( void );
 void settings_menu( void );
 void current_settings( void );
+void loop_test_ws( void );
+void loop_test_ws_complete( void *ws, int status );
+void loop_test_cq( void );
+void loop_test_cq_callback( unsigned char *arg );
+void loop_test_sched( void );
+void loop_test_sched_callback( unsigned char *arg );
+void loop_test_sched_complete( void *ws, int status );
+void loop_test_tmode( void );
+int loop_test_tmode_old_decode( unsigned char *buf, unsigned char *out, unsigned size );
+unsigned loop_test_tmode_old_encode( unsigned char *msg, unsigned len, unsigned char *out );
+void loop_test_tmode_putchar( int ch );
+int loop_test_tmode_old_verb( unsigned char *buf );
+void loop_test_batch( char *dev, unsigned count, unsigned window );
+double loop_test_batch_run( unsigned count, unsigned window );
+int loop_test_batch_send( unsigned char seq, unsigned char sensor );
+void loop_test_batch_frame( unsigned char *msg, unsigned len );
+struct loop_test_lan_client;
+struct loop_test_session_client;
+void loop_test_lan( char *host, char *port, unsigned clients, unsigned long count, 
+	unsigned char suite );
+int loop_test_lan_ping( unsigned char *pkt );
+unsigned loop_test_lan_xfer( struct loop_test_session_client *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp );
+void loop_test_lan_send( struct loop_test_lan_client *c, unsigned long count );
+int loop_test_lan_match( struct loop_test_lan_client *c, unsigned char *pkt, int len );
+int loop_test_lan_cmp( const void *a, const void *b );
+void loop_test_session( unsigned long count, unsigned long msgs );
+int loop_test_session_setup( struct loop_test_session_client *c, unsigned char suite,
+	unsigned ( *xfer )( struct loop_test_session_client *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp ) );
+unsigned loop_test_session_xfer( struct loop_test_session_client *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp );
+unsigned loop_test_session_wrap( struct loop_test_session_client *c, 
+	unsigned char *msg, unsigned msg_len, unsigned char *pkt );
+int loop_test_session_check( struct loop_test_session_client *c, unsigned char *pkt, 
+	unsigned len, unsigned char **msg, unsigned *msg_len );
+struct load_test_cmd;
+struct load_test_sample;
+int load_test( char *script, char *name, char *target, unsigned window, 
+	unsigned long count, unsigned limit );
+char *load_test_read( char *file );
+int load_test_parse( char *text );
+int load_test_open( char *target );
+void load_test_ipmb_name( struct sockaddr_un *addr, unsigned char slave_addr );
+int load_test_send( unsigned char seq, struct load_test_cmd *c );
+void load_test_input( void );
+void load_test_frame( unsigned char *msg, unsigned len );
+void load_test_resp( unsigned char seq, unsigned char netfn, unsigned char cmd, 
+	unsigned char cc );
+int load_test_report( char *target, unsigned window, double secs, unsigned limit );
+void load_test_pct( struct load_test_sample *s, unsigned long n, unsigned *pct );
+int load_test_cmd_cmp( const void *a, const void *b );
+int load_test_us_cmp( const void *a, const void *b );
+unsigned load_test_us( struct timespec *a, struct timespec *b );
 
 /*------------------------------------------------------------------------------
  *              F U N C T I O N S
@@ -123,12 +270,13 @@ int  main(
 	char user_str[128];
 
 	ws_init();
-	tty_init();
-	// rmcpd_init_listener();
 
 	printf("\nIPMI Exerciser -- %s\n", __DATE__); // say Hi
 
 	process_command_line( argc, argv ); // process command line arguments
+
+	if( tty_open( g_tty_dev, g_tty_baud, kbd_resp ) < 0 )
+		exit( EXIT_FAILURE );
 	// Get user keyboard input
 	while( 1 )
 	{
@@ -169,7 +317,7 @@ int  main(
 				kbd_settings();
 				break;
 			case KBD_QUIT:
-				tty_restore();
+				tty_close();
 				exit( EXIT_SUCCESS );
 				break;
 			default:
@@ -196,6 +344,7 @@ void process_command_line(
 {
 	int i;
 	char *opt;
+	char *script;
 
 	// get command line arguments
 	for (i=1; i<argc; i++)
@@ -207,36 +356,72 @@ void process_command_line(
 			opt = argv[i];         // Option scanning...
 			switch ( opt[1] )
 			{
+				case 'D':	// terminal mode port
+				case 'd':	// -d device
+					if( i + 1 < argc )
+						g_tty_dev = argv[++i];
+					break;
+
+				case 'B':	// terminal mode baud rate
+				case 'b':	// -b baud
+					if( i + 1 < argc )
+						g_tty_baud = atoi( argv[++i] );
+					break;
+
 				case 'L':	// loop test
 				case 'l':
 					switch (opt[2])
 					{
 						case '0':
-							printf( "Running loop test 1\n" );
+							printf( "Running loop test 0\n" );
+							loop_test_ws();
+							exit( EXIT_SUCCESS );
 							break;
 
 						case '1':
 							printf( "Running loop test 1\n" );
+							loop_test_cq();
+							exit( EXIT_SUCCESS );
 							break;
 
 						case '2':
 							printf( "Running loop test 2\n" );
+							loop_test_sched();
+							exit( EXIT_SUCCESS );
 							break;
 
 						case '3':
 							printf( "Running loop test 3\n" );
+							loop_test_tmode();
+							exit( EXIT_SUCCESS );
 							break;
 
-						case '4':
+						case '4':	// -l4 [device [count [window]]]
 							printf( "Running loop test 4\n" );
+							loop_test_batch( 
+								( i + 1 < argc ) ? argv[i + 1] : LOOP_TEST_BATCH_DEV,
+								( i + 2 < argc ) ? atoi( argv[i + 2] ) : LOOP_TEST_BATCH_COUNT,
+								( i + 3 < argc ) ? atoi( argv[i + 3] ) : LOOP_TEST_BATCH_WINDOW );
+							exit( EXIT_SUCCESS );
 							break;
 
-						case '5':
+						case '5':	// -l5 [host [port [clients [count [suite]]]]]
 							printf( "Running loop test 5\n" );
+							loop_test_lan( 
+								( i + 1 < argc ) ? argv[i + 1] : LOOP_TEST_LAN_HOST,
+								( i + 2 < argc ) ? argv[i + 2] : LOOP_TEST_LAN_PORT,
+								( i + 3 < argc ) ? atoi( argv[i + 3] ) : LOOP_TEST_LAN_CLIENTS,
+								( i + 4 < argc ) ? atol( argv[i + 4] ) : LOOP_TEST_LAN_COUNT,
+								( i + 5 < argc ) ? atoi( argv[i + 5] ) : 0 );
+							exit( EXIT_SUCCESS );
 							break;
 
-						case '6':
+						case '6':	// -l6 [sessions [messages]]
 							printf( "Running loop test 6\n" );
+							loop_test_session( 
+								( i + 1 < argc ) ? atol( argv[i + 1] ) : LOOP_TEST_SESSION_COUNT,
+								( i + 2 < argc ) ? atol( argv[i + 2] ) : LOOP_TEST_SESSION_MSGS );
+							exit( EXIT_SUCCESS );
 							break;
 
 						default:
@@ -246,23 +431,20 @@ void process_command_line(
 					break;
 
 				case 'T':	// canned test
-				case 't':
+				case 't':	// -tN [target [window [count [p99 limit]]]]
 					switch (opt[2])
 					{
 						case '1':
-							printf( "Running Test 1\n" );
-							break;
-
 						case '2':
-							printf( "Running Test 2\n" );
-							break;
-
 						case '3':
-							printf( "Running Test 3\n" );
-							break;
-
 						case '4':
-							printf( "Running Test 4\n" );
+							printf( "Running Test %c\n", opt[2] );
+							exit( load_test( load_test_canned[opt[2] - '1'], opt,
+								( i + 1 < argc ) ? argv[i + 1] : LOAD_TEST_TARGET,
+								( i + 2 < argc ) ? atoi( argv[i + 2] ) : LOAD_TEST_WINDOW,
+								( i + 3 < argc ) ? atol( argv[i + 3] ) : LOAD_TEST_COUNT,
+								( i + 4 < argc ) ? atoi( argv[i + 4] ) : 0 ) 
+								== ESUCCESS ? EXIT_SUCCESS : EXIT_FAILURE );
 							break;
 
 						default:
@@ -271,6 +453,20 @@ void process_command_line(
 					}
 					break;
 
+				case 'S':	// scripted load
+				case 's':	// -s script [target [window [count [p99 limit]]]]
+					if( ( i + 1 >= argc ) || !( script = load_test_read( argv[i + 1] ) ) ) {
+						printf( "-s needs a script file, - for stdin\n" );
+						exit( EXIT_FAILURE );
+					}
+					exit( load_test( script, argv[i + 1],
+						( i + 2 < argc ) ? argv[i + 2] : LOAD_TEST_TARGET,
+						( i + 3 < argc ) ? atoi( argv[i + 3] ) : LOAD_TEST_WINDOW,
+						( i + 4 < argc ) ? atol( argv[i + 4] ) : LOAD_TEST_COUNT,
+						( i + 5 < argc ) ? atoi( argv[i + 5] ) : 0 ) 
+						== ESUCCESS ? EXIT_SUCCESS : EXIT_FAILURE );
+					break;
+
 				default:
 					printf("Unknown option %s ignored.\n",argv[i]);
 					break;
@@ -496,9 +692,34 @@ void kbd_app_cmds( void )
 				printf( "Invalid Entry\n" );
 		}
 		ws_process_work_list();
+		tty_poll( KBD_RESP_WAIT );
 	}
 }
 
+/*------------------------------------------------------------------------------
+	kbd_resp()
+		Print a response that came in on the terminal mode port,
+		called from tty_poll().
+	Preconditions:
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+void kbd_resp( unsigned char *msg, unsigned len )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned i;
+
+	if( len < 4 ) {
+		printf( "short response, %u bytes\n", len );
+		return;
+	}
+	/* netFn/rqLUN, rqSeq/bridge, cmd, cc, data */
+	printf( "response netfn 0x%02x cmd 0x%02x seq %u cc 0x%02x", 
+		msg[0] >> 2, msg[2], msg[1] >> 2, msg[3] );
+	for( i = 4; i < len; i++ )
+		printf( "%s%02x", ( i == 4 ) ? ": " : " ", msg[i] );
+	printf( "\n" );
+}
+
 /*------------------------------------------------------------------------------
 
 	Fill in the ws structure and set state.
@@ -805,6 +1026,7 @@ void kbd_atca_cmds( void )
 				printf( "Invalid Entry\n" );
 		}
 		ws_process_work_list();
+		tty_poll( KBD_RESP_WAIT );
 	}
 }
 
@@ -842,6 +1064,1818 @@ void atca_cmd_get_picmg_properties( void )
 	ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
 }
 
+/*==============================================================================
+ * 			L O O P   T E S T S
+ *============================================================================*/
+
+#define LOOP_TEST_WS_PASSES	1000000
+
+/*------------------------------------------------------------------------------
+	loop_test_ws()
+		Time ws_process_work_list() with every ws but one parked in
+		WS_ACTIVE_MASTER_WRITE_PENDING and the remaining ws cycling
+		through WS_ACTIVE_IN. The cost per pass should not depend on
+		WS_ARRAY_SIZE, rebuild with -DWS_ARRAY_SIZE=n to compare.
+	Preconditions: ws_init() has been called
+	Postconditions: all ws are in use
+ *----------------------------------------------------------------------------*/
+void loop_test_ws( void )
+/*----------------------------------------------------------------------------*/
+{
+	IPMI_WS		*ws, *parked;
+	struct timespec	start, end;
+	unsigned long	i;
+	double		ns;
+
+	ws = ws_alloc();
+	while( ( parked = ws_alloc() ) )
+		ws_set_state( parked, WS_ACTIVE_MASTER_WRITE_PENDING );
+
+	ws->ipmi_completion_function = loop_test_ws_complete;
+	ws_set_state( ws, WS_ACTIVE_IN );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( i = 0; i < LOOP_TEST_WS_PASSES; i++ )
+		ws_process_work_list();
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	ns = ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec );
+	printf( "WS_ARRAY_SIZE %d: %lu passes, %.1f ns per pass\n",
+		WS_ARRAY_SIZE, i, ns / i );
+}
+
+/* put the ws straight back on the incoming queue */
+void loop_test_ws_complete( void *ws, int status )
+/*----------------------------------------------------------------------------*/
+{
+	ws_set_state( ( IPMI_WS * )ws, WS_ACTIVE_IN );
+}
+
+#define LOOP_TEST_CQ_MAX_TIMERS	8192
+#define LOOP_TEST_CQ_TICKS	( 1000 * HZ )
+#define LOOP_TEST_CQ_MAX_PERIOD	( 30 * HZ )
+
+struct {
+	unsigned long deadline;
+	unsigned long fired;
+	unsigned long late_sum;
+	unsigned long late_max;
+} loop_test_cq_stats;
+
+unsigned long loop_test_cq_timers[LOOP_TEST_CQ_MAX_TIMERS];
+
+/*------------------------------------------------------------------------------
+	loop_test_cq()
+		Fill the callout queue with periodic timers of random period
+		and run the main loop once per tick for LOOP_TEST_CQ_TICKS,
+		recording how many ticks late each callback runs. Rebuild
+		with -DCQ_ARRAY_SIZE=n to change the number of timers.
+	Preconditions:
+	Postconditions: the callout queue is full
+ *----------------------------------------------------------------------------*/
+void loop_test_cq( void )
+/*----------------------------------------------------------------------------*/
+{
+	struct timespec	start, end;
+	unsigned long	count, tick;
+	double		ns;
+
+	timer_initialize();
+	srand( 1 );
+
+	for( count = 0; count < LOOP_TEST_CQ_MAX_TIMERS; count++ ) {
+		loop_test_cq_timers[count] = 1 + rand() % LOOP_TEST_CQ_MAX_PERIOD;
+		if( timer_add_callout_queue( &loop_test_cq_timers[count], 
+				loop_test_cq_timers[count], loop_test_cq_callback, 
+				( unsigned char * )&loop_test_cq_timers[count] ) != ESUCCESS )
+			break;
+		/* keep the absolute deadline, the period is re-randomized */
+		loop_test_cq_timers[count] += lbolt;
+	}
+	/* leave one entry free so that callbacks can re-arm */
+	if( count )
+		timer_remove_callout_queue( &loop_test_cq_timers[--count] );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( tick = 0; tick < LOOP_TEST_CQ_TICKS; tick++ ) {
+		lbolt++;
+		timer_process_callout_queue();
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	ns = ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec );
+	printf( "%lu timers, %lu callbacks in %lu ticks\n", 
+		count, loop_test_cq_stats.fired, tick );
+	if( loop_test_cq_stats.fired )
+		printf( "lateness: avg %.2f ticks, max %lu ticks\n",
+			( double )loop_test_cq_stats.late_sum / loop_test_cq_stats.fired,
+			loop_test_cq_stats.late_max );
+	printf( "%.1f ns per timer_process_callout_queue()\n", ns / tick );
+}
+
+/* record lateness and re-arm with a new random period */
+void loop_test_cq_callback( unsigned char *arg )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned long *deadline = ( unsigned long * )arg;
+	unsigned long late, period;
+
+	late = lbolt - *deadline;
+	loop_test_cq_stats.fired++;
+	loop_test_cq_stats.late_sum += late;
+	if( late > loop_test_cq_stats.late_max )
+		loop_test_cq_stats.late_max = late;
+
+	period = 1 + rand() % LOOP_TEST_CQ_MAX_PERIOD;
+	*deadline = lbolt + period;
+	timer_add_callout_queue( deadline, period, loop_test_cq_callback, arg );
+}
+
+#define LOOP_TEST_SCHED_TICKS	( 5 * HZ )
+#define LOOP_TEST_SCHED_BURST	4
+
+struct {
+	unsigned long timer;
+	unsigned long posted;
+	unsigned long handled;
+} loop_test_sched_stats;
+
+/*------------------------------------------------------------------------------
+	loop_test_sched()
+		Run the event-driven main loop for LOOP_TEST_SCHED_TICKS with
+		a periodic timer injecting a burst of incoming requests every
+		tick, and report how much of the time the loop spent idle.
+	Preconditions: ws_init() has been called
+	Postconditions: all injected requests have been handled
+ *----------------------------------------------------------------------------*/
+void loop_test_sched( void )
+/*----------------------------------------------------------------------------*/
+{
+	struct timespec	start, stop;
+	unsigned work;
+	unsigned long end;
+	double		ns;
+
+	timer_initialize();
+	sched_get_work();	/* sync lbolt */
+	memset( &sched_stats, 0, sizeof( sched_stats ) );
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	end = lbolt + LOOP_TEST_SCHED_TICKS;
+	timer_add_callout_queue( &loop_test_sched_stats.timer, 1, 
+		loop_test_sched_callback, 0 );
+
+	while( lbolt < end ) {
+		work = sched_get_work();
+		if( work & SCHED_WS )
+			ws_process_work_list();
+		if( work & SCHED_TIMER )
+			timer_process_callout_queue();
+	}
+	timer_remove_callout_queue( &loop_test_sched_stats.timer );
+	while( loop_test_sched_stats.handled < loop_test_sched_stats.posted )
+		ws_process_work_list();
+	clock_gettime( CLOCK_MONOTONIC, &stop );
+
+	ns = ( stop.tv_sec - start.tv_sec ) * 1e9 + ( stop.tv_nsec - start.tv_nsec );
+
+	printf( "%lu ticks, %lu requests posted, %lu handled\n", 
+		( unsigned long )LOOP_TEST_SCHED_TICKS, 
+		loop_test_sched_stats.posted, loop_test_sched_stats.handled );
+	printf( "%lu loop passes, %lu wakeups, %.1f%% idle\n", 
+		sched_stats.iterations, sched_stats.wakeups, 
+		100.0 * sched_stats.idle_time / ns );
+}
+
+/* inject a burst of incoming requests and re-arm */
+void loop_test_sched_callback( unsigned char *arg )
+/*----------------------------------------------------------------------------*/
+{
+	IPMI_WS *ws;
+	unsigned i;
+
+	for( i = 0; i < LOOP_TEST_SCHED_BURST; i++ ) {
+		if( !( ws = ws_alloc() ) )
+			break;
+		ws->ipmi_completion_function = loop_test_sched_complete;
+		ws_set_state( ws, WS_ACTIVE_IN );
+		loop_test_sched_stats.posted++;
+	}
+	timer_add_callout_queue( &loop_test_sched_stats.timer, 1, 
+		loop_test_sched_callback, 0 );
+}
+
+void loop_test_sched_complete( void *ws, int status )
+/*----------------------------------------------------------------------------*/
+{
+	loop_test_sched_stats.handled++;
+	ws_free( ( IPMI_WS * )ws );
+}
+
+#define LOOP_TEST_TMODE_PASSES	200000
+
+/* Get Device ID, Get Statistics and a Get Device ID response */
+char *loop_test_tmode_msgs[] = {
+	"[18 00 01]",
+	"[B8 00 01 BE 12 00 01 00]",
+	"[1C 00 01 00 20 81 00 02 03 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00]",
+	0
+};
+
+char *loop_test_tmode_verbs[] = {
+	"[SYS POWER OFF]",
+	"[SYS IDENTIFY]",
+	"[sys stats clear]",
+	"[SYS HEALTH QUERY]",
+	0
+};
+
+unsigned char	loop_test_tmode_out[TMODE_ENC_LEN( WS_BUF_LEN_LARGE ) + 2];
+unsigned	loop_test_tmode_pos;
+volatile int	loop_test_tmode_sink;	/* keeps the results from being optimized away */
+
+/*------------------------------------------------------------------------------
+	loop_test_tmode()
+		Time terminal mode message decode, response encode and
+		[SYS ..] verb matching with the tmode.c codec against the
+		code it replaced, and check that both give the same result.
+	Preconditions:
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+void loop_test_tmode( void )
+/*----------------------------------------------------------------------------*/
+{
+	struct timespec	start, end;
+	unsigned char	msg[WS_BUF_LEN_LARGE];
+	unsigned char	old_msg[WS_BUF_LEN_LARGE];
+	TMODE_VERB	verb;
+	unsigned long	i;
+	unsigned	m, len, count, old_len;
+	double		ns[2];
+	int		pass;
+
+	for( m = 0; loop_test_tmode_msgs[m]; m++ ) {
+		unsigned char *str = ( unsigned char * )loop_test_tmode_msgs[m];
+
+		len = strlen( ( char * )str );
+		old_len = loop_test_tmode_old_decode( str, old_msg, sizeof( old_msg ) );
+		if( ( tmode_decode( str + 1, len - 1, msg, sizeof( msg ), &count ) != ESUCCESS )
+		    || ( count != old_len ) || memcmp( msg, old_msg, count ) ) {
+			printf( "decode mismatch: %s\n", str );
+			continue;
+		}
+
+		for( pass = 0; pass < 2; pass++ ) {
+			clock_gettime( CLOCK_MONOTONIC, &start );
+			for( i = 0; i < LOOP_TEST_TMODE_PASSES; i++ ) {
+				if( pass )
+					tmode_decode( str + 1, len - 1, msg, sizeof( msg ), &count );
+				else
+					loop_test_tmode_old_decode( str, msg, sizeof( msg ) );
+			}
+			clock_gettime( CLOCK_MONOTONIC, &end );
+			ns[pass] = ( ( end.tv_sec - start.tv_sec ) * 1e9 
+				+ ( end.tv_nsec - start.tv_nsec ) ) / i;
+		}
+		printf( "decode %3u bytes: old %7.1f ns  new %7.1f ns\n", count, ns[0], ns[1] );
+
+		for( pass = 0; pass < 2; pass++ ) {
+			clock_gettime( CLOCK_MONOTONIC, &start );
+			for( i = 0; i < LOOP_TEST_TMODE_PASSES; i++ ) {
+				if( pass )
+					len = tmode_encode( msg, count, loop_test_tmode_out, 
+						sizeof( loop_test_tmode_out ) );
+				else
+					len = loop_test_tmode_old_encode( msg, count, loop_test_tmode_out );
+			}
+			clock_gettime( CLOCK_MONOTONIC, &end );
+			ns[pass] = ( ( end.tv_sec - start.tv_sec ) * 1e9 
+				+ ( end.tv_nsec - start.tv_nsec ) ) / i;
+		}
+		printf( "encode %3u bytes: old %7.1f ns  new %7.1f ns\n", count, ns[0], ns[1] );
+	}
+
+	for( m = 0; loop_test_tmode_verbs[m]; m++ ) {
+		unsigned char *str = ( unsigned char * )loop_test_tmode_verbs[m];
+
+		len = strlen( ( char * )str );
+		for( pass = 0; pass < 2; pass++ ) {
+			clock_gettime( CLOCK_MONOTONIC, &start );
+			for( i = 0; i < LOOP_TEST_TMODE_PASSES; i++ ) {
+				if( pass ) {
+					tmode_parse_verb( str, len, &verb );
+					loop_test_tmode_sink = verb.tok[1];
+				} else {
+					loop_test_tmode_sink = loop_test_tmode_old_verb( str );
+				}
+			}
+			clock_gettime( CLOCK_MONOTONIC, &end );
+			ns[pass] = ( ( end.tv_sec - start.tv_sec ) * 1e9 
+				+ ( end.tv_nsec - start.tv_nsec ) ) / i;
+		}
+		printf( "verb %-20s old %7.1f ns  new %7.1f ns  (%d/%d)\n", str, ns[0], ns[1],
+			loop_test_tmode_old_verb( str ), verb.tok[1] );
+	}
+}
+
+/* the hex decode loop of the old term_process(), without the ws */
+int loop_test_tmode_old_decode( unsigned char *buf, unsigned char *out, unsigned size )
+/*----------------------------------------------------------------------------*/
+{
+	unsigned char *ptr = buf + 1;
+	int nibble[2];
+	int nibble_count = 0;
+	int val, count = 0;
+	int buf_len = strlen( ( const char * )buf );
+
+	while( ptr < buf + buf_len ) {
+		if( ( ( ( *ptr >= 'A' ) && ( *ptr <= 'F' ) ) ||
+		      ( ( *ptr >= 'a' ) && ( *ptr <= 'f' ) ) ||
+		      ( ( *ptr >= '0' ) && ( *ptr <= '9' ) ) )&&
+			( nibble_count < 2 ) ) {
+			nibble[nibble_count] = *ptr;
+			nibble_count++;
+			ptr++;
+			if( nibble_count == 2 ) {
+				switch( nibble[0] ) {
+					case 'A': case 'a': val = 10 << 4; break;
+					case 'B': case 'b': val = 11 << 4; break;
+					case 'C': case 'c': val = 12 << 4; break;
+					case 'D': case 'd': val = 13 << 4; break;
+					case 'E': case 'e': val = 14 << 4; break;
+					case 'F': case 'f': val = 15 << 4; break;
+					default: val = ( nibble[0] - 48 ) << 4; break;
+				}
+				switch( nibble[1] ) {
+					case 'A': case 'a': val += 10; break;
+					case 'B': case 'b': val += 11; break;
+					case 'C': case 'c': val += 12; break;
+					case 'D': case 'd': val += 13; break;
+					case 'E': case 'e': val += 14; break;
+					case 'F': case 'f': val += 15; break;
+					default: val += ( nibble[1] - 48 ); break;
+				}
+				if( count >= size )
+					return( -1 );
+				out[count++] = val;
+			} 
+		} else if ( *ptr == ' ' ) {
+			nibble_count = 0;
+			loop_test_tmode_putchar( *ptr++ );	/* the old code echoed it */
+		} else if ( *ptr == ']' ) {
+			return( count );
+		} else {
+			return( -1 );
+		}
+	}
+	return( -1 );
+}
+
+/* the old serial_tm_send(), one putchar() per character */
+unsigned loop_test_tmode_old_encode( unsigned char *msg, unsigned len, unsigned char *out )
+/*----------------------------------------------------------------------------*/
+{
+	static char hex_chars[16] = { '0', '1', '2', '3', '4', '5', '6', '7', 
+		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+	unsigned i;
+
+	loop_test_tmode_pos = 0;
+	loop_test_tmode_putchar( '[' );
+	for( i = 0; i < len; i++ ) { 
+		loop_test_tmode_putchar( hex_chars[msg[i] >> 4] );
+		loop_test_tmode_putchar( hex_chars[msg[i] & 0x0f] );
+		if( i < ( len - 1 ) )
+			loop_test_tmode_putchar( ' ' );
+	}
+	loop_test_tmode_putchar( ']' );
+	return( loop_test_tmode_pos );
+}
+
+/* stands in for putchar(), kept out of line like the real one */
+void __attribute__ ((noinline)) loop_test_tmode_putchar( int ch )
+/*----------------------------------------------------------------------------*/
+{
+	loop_test_tmode_out[loop_test_tmode_pos] = ch;
+	loop_test_tmode_pos = ( loop_test_tmode_pos + 1 ) % sizeof( loop_test_tmode_out );
+}
+
+/* the strncmp() chain of the old term_process(), returns the TMODE_TOK_xx
+ * of the verb it found once its arguments have been checked too */
+int loop_test_tmode_old_verb( unsigned char *buf )
+/*----------------------------------------------------------------------------*/
+{
+	char *ptr = ( char * )buf + 1;
+
+	if( strncmp( ptr, "SYS", 3 ) && strncmp( ptr, "sys", 3 ) ) 
+		return( TMODE_TOK_UNKNOWN );
+	if( !( ptr = strchr( ptr, ' ' ) ) )
+		return( TMODE_TOK_UNKNOWN );
+	ptr++;
+	if( ( strncmp( ptr, "POWER", 5 ) == 0 ) || ( strncmp( ptr, "power", 5 ) == 0 ) ) {
+		if( !( ptr = strchr( ptr, ' ' ) ) )
+			return( TMODE_TOK_UNKNOWN );
+		ptr++;
+		if( ( strncmp( ptr, "OFF]", 4 ) == 0 ) || ( strncmp( ptr, "off]", 4 ) == 0 ) 
+		    || ( strncmp( ptr, "ON]", 3 ) == 0 ) || ( strncmp( ptr, "on]", 3 ) == 0 ) )
+			return( TMODE_TOK_POWER );
+		return( TMODE_TOK_UNKNOWN );
+	}
+	if( ( strncmp( ptr, "TMODE]", 6 ) == 0 ) || ( strncmp( ptr, "tmode]", 6 ) == 0 ) )
+		return( TMODE_TOK_TMODE );
+	if( ( strncmp( ptr, "RESET]", 6 ) == 0 ) || ( strncmp( ptr, "reset]", 6 ) == 0 ) )
+		return( TMODE_TOK_RESET );
+	if( ( strncmp( ptr, "IDENTIFY]", 9 ) == 0 ) || ( strncmp( ptr, "identify]", 9 ) == 0 ) )
+		return( TMODE_TOK_IDENTIFY );
+	if( ( strncmp( ptr, "STATS", 5 ) == 0 ) || ( strncmp( ptr, "stats", 5 ) == 0 ) ) {
+		if( ( ptr[5] == ']' ) || ( strncmp( ptr + 5, " CLEAR]", 7 ) == 0 ) 
+		    || ( strncmp( ptr + 5, " clear]", 7 ) == 0 ) )
+			return( TMODE_TOK_STATS );
+		return( TMODE_TOK_UNKNOWN );
+	}
+	if( ( strncmp( ptr, "HEALTH QUERY]", 13 ) == 0 ) 
+	    || ( strncmp( ptr, "health query]", 13 ) == 0 ) )
+		return( TMODE_TOK_HEALTH );
+	return( TMODE_TOK_UNKNOWN );
+}
+
+struct {
+	unsigned char	in_flight[LOOP_TEST_BATCH_SEQ];
+	unsigned	outstanding;
+	unsigned long	sent;
+	unsigned long	done;
+	unsigned long	errors;		/* completion code other than 0 */
+	unsigned long	stray;		/* responses that answer nothing we sent */
+} loop_test_batch_stats;
+
+/*------------------------------------------------------------------------------
+	loop_test_batch()
+		Send a scripted batch of Get Sensor Reading commands to a
+		controller on a terminal mode serial port, first one at a
+		time and then with window commands in flight, and report
+		commands per second for both. Responses are matched to the
+		requests by seq so they may come back in any order. The
+		port runs at the -b baud rate.
+	Preconditions:
+		Nothing else has the port open.
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+void loop_test_batch( char *dev, unsigned count, unsigned window )
+/*----------------------------------------------------------------------------*/
+{
+	double		rate[2];
+	int		tty_fd;
+
+	if( window > LOOP_TEST_BATCH_SEQ )
+		window = LOOP_TEST_BATCH_SEQ;
+
+	if( ( tty_fd = tty_open( dev, g_tty_baud, loop_test_batch_frame ) ) < 0 )
+		return;
+
+	/* the echo would come back in between the responses */
+	tty_write( ( unsigned char * )"[SYS ECHO OFF]\r", 15 );
+	usleep( 200000 );
+	tcflush( tty_fd, TCIFLUSH );
+
+	printf( "%u Get Sensor Reading commands on %s at %u baud\n", count, dev, g_tty_baud );
+	rate[0] = loop_test_batch_run( count, 1 );
+	rate[1] = loop_test_batch_run( count, window );
+	if( ( rate[0] > 0 ) && ( rate[1] > 0 ) )
+		printf( "batched/serial: %.2f\n", rate[1] / rate[0] );
+	printf( "tty: %lu frames in, %lu text, %lu cut short, %lu overrun, %lu writes waited\n",
+		tty_stats.rx_frames, tty_stats.rx_text, tty_stats.rx_bad, tty_stats.rx_overrun,
+		tty_stats.tx_waits );
+
+	tty_write( ( unsigned char * )"[SYS ECHO ON]\r", 14 );
+	tty_close();
+}
+
+/* one run of count commands with at most window outstanding, returns
+ * commands per second or -1 if the controller stopped answering */
+double loop_test_batch_run( unsigned count, unsigned window )
+{
+	struct timespec	start, end;
+	unsigned char	seq = 0;
+	double		secs;
+
+	memset( &loop_test_batch_stats, 0, sizeof( loop_test_batch_stats ) );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	while( loop_test_batch_stats.done < count ) {
+		while( ( loop_test_batch_stats.sent < count ) 
+		    && ( loop_test_batch_stats.outstanding < window ) ) {
+			while( loop_test_batch_stats.in_flight[seq] )
+				seq = ( seq + 1 ) % LOOP_TEST_BATCH_SEQ;
+			if( loop_test_batch_send( seq, 
+			    loop_test_batch_stats.sent % LOOP_TEST_BATCH_SENSORS ) != ESUCCESS ) {
+				perror( "write" );
+				return( -1 );
+			}
+			loop_test_batch_stats.in_flight[seq] = 1;
+			loop_test_batch_stats.outstanding++;
+			loop_test_batch_stats.sent++;
+			seq = ( seq + 1 ) % LOOP_TEST_BATCH_SEQ;
+		}
+
+		/* the responses go to loop_test_batch_frame() */
+		if( tty_poll( LOOP_TEST_BATCH_TIMEOUT ) <= 0 ) {
+			printf( "window %2u: no response, %lu of %u done\n", 
+				window, loop_test_batch_stats.done, count );
+			return( -1 );
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	secs = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+	printf( "window %2u: %lu commands in %.3f s, %.1f commands/s, %lu errors, %lu stray\n",
+		window, loop_test_batch_stats.done, secs, loop_test_batch_stats.done / secs,
+		loop_test_batch_stats.errors, loop_test_batch_stats.stray );
+	return( loop_test_batch_stats.done / secs );
+}
+
+/* send a Get Sensor Reading request for sensor with seq */
+int loop_test_batch_send( unsigned char seq, unsigned char sensor )
+{
+	unsigned char	req[4];
+
+	req[0] = NETFN_EVENT_REQ << 2;		/* lun 0 */
+	req[1] = seq << 2;			/* no bridging */
+	req[2] = IPMI_SE_CMD_GET_SENSOR_READING;
+	req[3] = sensor;
+	return( tty_send( req, sizeof( req ) ) );
+}
+
+/* match a message from the controller to the request it answers */
+void loop_test_batch_frame( unsigned char *msg, unsigned len )
+{
+	unsigned char	seq;
+
+	if( ( len < 4 ) || ( msg[0] != ( NETFN_EVENT_RESP << 2 ) ) 
+	    || ( msg[2] != IPMI_SE_CMD_GET_SENSOR_READING ) ) {
+		loop_test_batch_stats.stray++;
+		return;
+	}
+
+	seq = msg[1] >> 2;
+	if( !loop_test_batch_stats.in_flight[seq] ) {
+		loop_test_batch_stats.stray++;
+		return;
+	}
+	loop_test_batch_stats.in_flight[seq] = 0;
+	loop_test_batch_stats.outstanding--;
+	loop_test_batch_stats.done++;
+	if( msg[3] != CC_NORMAL )
+		loop_test_batch_stats.errors++;
+}
+
+typedef struct loop_test_session_client {
+	int		fd;		/* -l5 socket, left alone by the setup */
+	unsigned	console_id;
+	unsigned	id;		/* managed system session ID */
+	unsigned	seq;
+	unsigned char	suite;		/* cipher suite, 1 - 3 */
+	unsigned char	rand_console[SESSION_RAND_LEN];
+	unsigned char	rand_bmc[SESSION_RAND_LEN];
+	unsigned char	guid[16];
+	unsigned char	sik[SESSION_KEY_LEN];
+	HMAC_SHA1_CTX	integ;
+	AES_KEY		aes;
+} LOOP_TEST_SESSION_CLIENT;
+
+typedef struct loop_test_lan_client {
+	LOOP_TEST_SESSION_CLIENT session;	/* fd is the client's socket */
+	unsigned char	seq;
+	unsigned char	busy;
+	struct timespec	sent;
+} LOOP_TEST_LAN_CLIENT;
+
+struct {
+	LOOP_TEST_LAN_CLIENT client[LOOP_TEST_LAN_MAX_CLIENTS];
+	unsigned char	suite;		/* 0 for IPMI v1.5, RMCP+ cipher suite */
+	unsigned	*latency;	/* us, one per response */
+	unsigned long	sent;
+	unsigned long	done;
+	unsigned long	lost;		/* no response within LOOP_TEST_LAN_TIMEOUT */
+	unsigned long	errors;		/* completion code other than 0 */
+	unsigned long	stray;		/* datagrams that answer nothing we sent */
+} loop_test_lan_stats;
+
+/*------------------------------------------------------------------------------
+	loop_test_lan()
+		RMCP load generator. After an ASF Presence Ping, clients 
+		sockets each keep one Get Device ID request outstanding
+		against the IPMI over LAN channel at host:port until count
+		requests have been answered or given up on, then report 
+		requests per second and the latency distribution. Run
+		against a host build started with COREIPM_RMCP_PORT set.
+		Suite 0 sends IPMI v1.5 without a session, the BMC must 
+		not have a password set for that. Suites 1-3 have each 
+		client open an RMCP+ session with that cipher suite 
+		first, the BMC needs COREIPM_LAN_USER and _PASSWORD set 
+		to LOOP_TEST_SESSION_USER and _PASSWORD then.
+	Preconditions:
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+void loop_test_lan( char *host, char *port, unsigned clients, unsigned long count, 
+	unsigned char suite )
+/*----------------------------------------------------------------------------*/
+{
+	struct addrinfo	hints, *res;
+	struct epoll_event ev[LOOP_TEST_LAN_MAX_CLIENTS];
+	struct timespec	start, end, now;
+	unsigned char	pkt[RMCPD_MAX_PKT];
+	LOOP_TEST_LAN_CLIENT *c;
+	double		secs;
+	unsigned	i;
+	int		epoll_fd, n, len, rv;
+
+	if( clients > LOOP_TEST_LAN_MAX_CLIENTS )
+		clients = LOOP_TEST_LAN_MAX_CLIENTS;
+	if( suite > 3 ) {
+		printf( "cipher suite 0 to 3\n" );
+		return;
+	}
+	memset( &loop_test_lan_stats, 0, sizeof( loop_test_lan_stats ) );
+	loop_test_lan_stats.suite = suite;
+	if( !( loop_test_lan_stats.latency = malloc( count * sizeof( unsigned ) ) ) ) {
+		perror( "malloc" );
+		return;
+	}
+
+	memset( &hints, 0, sizeof hints );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if( ( rv = getaddrinfo( host, port, &hints, &res ) ) != 0 ) {
+		fprintf( stderr, "getaddrinfo: %s\n", gai_strerror( rv ) );	
+		return;
+	}
+	epoll_fd = epoll_create1( 0 );
+	for( i = 0; i < clients; i++ ) {
+		c = &loop_test_lan_stats.client[i];
+		c->session.fd = socket( res->ai_family, SOCK_DGRAM | SOCK_NONBLOCK, 0 );
+		if( ( c->session.fd < 0 ) 
+		    || ( connect( c->session.fd, res->ai_addr, res->ai_addrlen ) < 0 ) ) {
+			perror( "socket" );
+			return;
+		}
+		ev[0].events = EPOLLIN;
+		ev[0].data.ptr = c;
+		epoll_ctl( epoll_fd, EPOLL_CTL_ADD, c->session.fd, &ev[0] );
+	}
+	freeaddrinfo( res );
+
+	/* is anyone there */
+	c = &loop_test_lan_stats.client[0];
+	len = loop_test_lan_ping( pkt );
+	send( c->session.fd, pkt, len, 0 );
+	if( ( epoll_wait( epoll_fd, ev, 1, LOOP_TEST_LAN_TIMEOUT / 1000 ) != 1 ) 
+	    || ( ( len = recv( c->session.fd, pkt, sizeof( pkt ), 0 ) ) < 4 + 8 + 16 ) 
+	    || ( pkt[3] != RMCP_CLASS_ASF ) || ( pkt[8] != ASF_MSG_PRESENCE_PONG ) ) {
+		printf( "no Presence Pong from %s:%s\n", host, port );
+		return;
+	}
+	printf( "Presence Pong, IPMI %ssupported\n", 
+		( pkt[4 + 8 + 8] & ASF_PONG_ENT_IPMI ) ? "" : "not " );
+
+	/* the sessions are set up before the clock starts */
+	if( suite ) {
+		for( i = 0; i < clients; i++ ) {
+			c = &loop_test_lan_stats.client[i];
+			if( loop_test_session_setup( &c->session, suite, loop_test_lan_xfer ) 
+			    != ESUCCESS ) {
+				printf( "RMCP+ session setup failed, client %u\n", i );
+				return;
+			}
+		}
+		printf( "%u RMCP+ sessions, cipher suite %u\n", clients, suite );
+	}
+
+	printf( "%lu Get Device ID requests to %s:%s from %u clients\n", count, host, port, clients );
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( i = 0; i < clients; i++ )
+		loop_test_lan_send( &loop_test_lan_stats.client[i], count );
+
+	while( loop_test_lan_stats.done + loop_test_lan_stats.lost < count ) {
+		n = epoll_wait( epoll_fd, ev, clients, 100 );
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		for( i = 0; i < n; i++ ) {
+			c = ( LOOP_TEST_LAN_CLIENT * )ev[i].data.ptr;
+			while( ( len = recv( c->session.fd, pkt, sizeof( pkt ), MSG_DONTWAIT ) ) >= 0 ) {
+				if( !loop_test_lan_match( c, pkt, len ) ) {
+					loop_test_lan_stats.stray++;
+					continue;
+				}
+				clock_gettime( CLOCK_MONOTONIC, &now );
+				loop_test_lan_stats.latency[loop_test_lan_stats.done++] = 
+					( now.tv_sec - c->sent.tv_sec ) * 1000000
+					+ ( now.tv_nsec - c->sent.tv_nsec ) / 1000;
+				c->busy = 0;
+				loop_test_lan_send( c, count );
+			}
+		}
+
+		/* requests nobody answered */
+		for( i = 0; i < clients; i++ ) {
+			c = &loop_test_lan_stats.client[i];
+			if( c->busy && ( ( now.tv_sec - c->sent.tv_sec ) * 1000000
+			    + ( now.tv_nsec - c->sent.tv_nsec ) / 1000 > LOOP_TEST_LAN_TIMEOUT ) ) {
+				loop_test_lan_stats.lost++;
+				c->busy = 0;
+				loop_test_lan_send( c, count );
+			}
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	secs = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+	n = loop_test_lan_stats.done;
+	qsort( loop_test_lan_stats.latency, n, sizeof( unsigned ), loop_test_lan_cmp );
+	printf( "%lu responses in %.3f s, %.0f requests/s, %lu lost, %lu errors, %lu stray\n",
+		loop_test_lan_stats.done, secs, loop_test_lan_stats.done / secs,
+		loop_test_lan_stats.lost, loop_test_lan_stats.errors, loop_test_lan_stats.stray );
+	if( n )
+		printf( "latency us: p50 %u  p90 %u  p99 %u  p99.9 %u  max %u\n",
+			loop_test_lan_stats.latency[n / 2], loop_test_lan_stats.latency[n * 9 / 10],
+			loop_test_lan_stats.latency[n * 99 / 100], 
+			loop_test_lan_stats.latency[n * 999 / 1000], 
+			loop_test_lan_stats.latency[n - 1] );
+
+	for( i = 0; i < clients; i++ )
+		close( loop_test_lan_stats.client[i].session.fd );
+	close( epoll_fd );
+	free( loop_test_lan_stats.latency );
+}
+
+/* ASF Presence Ping, returns its length */
+int loop_test_lan_ping( unsigned char *pkt )
+{
+	pkt[0] = RMCP_VERSION_1;
+	pkt[1] = 0;
+	pkt[2] = RMCP_SEQ_NO_ACK;
+	pkt[3] = RMCP_CLASS_ASF;
+	pkt[4] = ( ASF_IANA >> 24 ) & 0xff;
+	pkt[5] = ( ASF_IANA >> 16 ) & 0xff;
+	pkt[6] = ( ASF_IANA >> 8 ) & 0xff;
+	pkt[7] = ASF_IANA & 0xff;
+	pkt[8] = ASF_MSG_PRESENCE_PING;
+	pkt[9] = 0;		/* message tag */
+	pkt[10] = 0;
+	pkt[11] = 0;		/* no data */
+	return( 12 );
+}
+
+/* send the client's next request, if there are any left to send */
+void loop_test_lan_send( LOOP_TEST_LAN_CLIENT *c, unsigned long count )
+{
+	unsigned char pkt[4 + LOOP_TEST_SESSION_PKT_LEN];
+	unsigned char req[7];
+	unsigned char *msg = req;
+	unsigned len;
+
+	if( loop_test_lan_stats.sent >= count )
+		return;
+
+	memset( pkt, 0, 4 + IPMI_SESSION_HDR_LEN );
+	pkt[0] = RMCP_VERSION_1;
+	pkt[2] = RMCP_SEQ_NO_ACK;
+	pkt[3] = RMCP_CLASS_IPMI;
+	if( !loop_test_lan_stats.suite ) {
+		pkt[4] = AUTH_TYPE_NONE;	/* session seq and id stay 0, no session */
+		pkt[4 + IPMI_SESSION_HDR_LEN - 1] = 7;
+		msg = pkt + 4 + IPMI_SESSION_HDR_LEN;
+	}
+
+	c->seq = ( c->seq + 1 ) & 0x3f;
+	msg[0] = LOOP_TEST_LAN_RS_ADDR;
+	msg[1] = NETFN_APP_REQ << 2;
+	msg[2] = -( msg[0] + msg[1] );
+	msg[3] = LOOP_TEST_LAN_RQ_ADDR;
+	msg[4] = c->seq << 2;
+	msg[5] = IPMI_CMD_GET_DEVICE_ID;
+	msg[6] = -( msg[3] + msg[4] + msg[5] );
+
+	/* the console side crypto is part of the round trip */
+	clock_gettime( CLOCK_MONOTONIC, &c->sent );
+	if( loop_test_lan_stats.suite )
+		len = 4 + loop_test_session_wrap( &c->session, req, sizeof( req ), pkt + 4 );
+	else
+		len = 4 + IPMI_SESSION_HDR_LEN + sizeof( req );
+	if( send( c->session.fd, pkt, len, 0 ) < 0 ) {
+		perror( "send" );
+		return;
+	}
+	c->busy = 1;
+	loop_test_lan_stats.sent++;
+}
+
+/* is pkt the response to the client's outstanding request */
+int loop_test_lan_match( LOOP_TEST_LAN_CLIENT *c, unsigned char *pkt, int len )
+{
+	unsigned char *msg = pkt + 4 + IPMI_SESSION_HDR_LEN;
+	unsigned msg_len = len - 4 - IPMI_SESSION_HDR_LEN;
+
+	if( !c->busy || ( pkt[3] != RMCP_CLASS_IPMI ) || ( len < 4 + 8 
+	    + ( loop_test_lan_stats.suite ? RMCPP_SESSION_HDR_LEN : IPMI_SESSION_HDR_LEN ) ) )
+		return( 0 );
+	if( loop_test_lan_stats.suite 
+	    && ( loop_test_session_check( &c->session, pkt + 4, len - 4, &msg, &msg_len ) 
+	    != ESUCCESS ) )
+		return( 0 );
+
+	/* rqSA, netFn/rqLUN, checksum, rsSA, rqSeq/rsLUN, cmd, cc, checksum */
+	if( ( msg_len < 8 ) || ( ( msg[1] >> 2 ) != NETFN_APP_RESP ) 
+	    || ( msg[5] != IPMI_CMD_GET_DEVICE_ID ) || ( ( msg[4] >> 2 ) != c->seq ) )
+		return( 0 );
+	if( msg[6] != CC_NORMAL )
+		loop_test_lan_stats.errors++;
+	return( 1 );
+}
+
+/* Open Session or RAKP to the BMC on the client's socket, outside a
+ * session, returns the length of the response payload, 0 if none came */
+unsigned loop_test_lan_xfer( LOOP_TEST_SESSION_CLIENT *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp )
+{
+	unsigned char	pkt[RMCPD_MAX_PKT];
+	struct pollfd	pfd;
+	int		n;
+
+	memset( pkt, 0, 4 + RMCPP_SESSION_HDR_LEN );
+	pkt[0] = RMCP_VERSION_1;
+	pkt[2] = RMCP_SEQ_NO_ACK;
+	pkt[3] = RMCP_CLASS_IPMI;
+	pkt[4] = AUTH_TYPE_RMCPP;
+	pkt[5] = type;
+	pkt[14] = len & 0xff;		/* session ID and sequence number 0 */
+	pkt[15] = len >> 8;
+	memcpy( pkt + 4 + RMCPP_SESSION_HDR_LEN, req, len );
+	if( send( c->fd, pkt, 4 + RMCPP_SESSION_HDR_LEN + len, 0 ) < 0 )
+		return( 0 );
+
+	pfd.fd = c->fd;
+	pfd.events = POLLIN;
+	if( ( poll( &pfd, 1, LOOP_TEST_LAN_TIMEOUT / 1000 ) != 1 )
+	    || ( ( n = recv( c->fd, pkt, sizeof( pkt ), 0 ) ) < 4 + RMCPP_SESSION_HDR_LEN )
+	    || ( pkt[5] != type + 1 ) )
+		return( 0 );
+	n -= 4 + RMCPP_SESSION_HDR_LEN;
+	if( n > SESSION_RESP_MAX )
+		n = SESSION_RESP_MAX;
+	memcpy( resp, pkt + 4 + RMCPP_SESSION_HDR_LEN, n );
+	return( n );
+}
+
+int loop_test_lan_cmp( const void *a, const void *b )
+{
+	unsigned x = *( unsigned * )a, y = *( unsigned * )b;
+
+	return( ( x > y ) - ( x < y ) );
+}
+
+struct {
+	unsigned long	errors;
+	double		bmc_secs;	/* in session_open(), _rakp1() and _rakp3() */
+} loop_test_session_stats;
+
+/*------------------------------------------------------------------------------
+	loop_test_session()
+		RMCP+ session layer cost, in process against session.c. 
+		Sets up count sessions, RAKP-HMAC-SHA1 and suite 3, and 
+		reports sessions per second for the whole exchange and for
+		the BMC side of it. Then with the session table nearly full
+		runs msgs Get Device ID requests through session_unwrap()
+		and msgs responses through session_wrap() for suites 1, 2
+		and 3 and reports the time per message, suite 1 is the 
+		cost of the session lookup and sequence check alone.
+	Preconditions:
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+void loop_test_session( unsigned long count, unsigned long msgs )
+/*----------------------------------------------------------------------------*/
+{
+	LOOP_TEST_SESSION_CLIENT client, idle;
+	struct timespec	start, end;
+	unsigned char	req[7], resp[WS_BUF_LEN], out[RMCPD_MAX_PKT];
+	unsigned char	*pkts, *msg;
+	unsigned	*pkt_len, msg_len, len = 0;
+	double		secs, ns_unwrap, ns_wrap, base_unwrap = 0, base_wrap = 0;
+	unsigned long	i;
+	unsigned char	suite;
+
+	session_init();
+	session_set_user( LOOP_TEST_SESSION_USER, LOOP_TEST_SESSION_PASSWORD );
+	memset( &loop_test_session_stats, 0, sizeof( loop_test_session_stats ) );
+
+	/* handshakes, each session closed once it is up */
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( i = 0; i < count; i++ ) {
+		if( loop_test_session_setup( &client, 3, loop_test_session_xfer ) != ESUCCESS ) {
+			printf( "session setup failed\n" );
+			return;
+		}
+		session_close( client.id, 0 );
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	secs = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+	printf( "%lu sessions in %.3f s, %.0f sessions/s, BMC side %.0f sessions/s\n",
+		count, secs, count / secs, count / loop_test_session_stats.bmc_secs );
+
+	/* the other sessions are in the hash table and on the idle list */
+	for( i = 0; i < SESSION_MAX - 3; i++ )
+		loop_test_session_setup( &idle, 3, loop_test_session_xfer );
+	printf( "%u sessions open, %lu messages per suite\n", session_stats.active + 1, msgs );
+
+	pkts = malloc( msgs * LOOP_TEST_SESSION_PKT_LEN );
+	pkt_len = malloc( msgs * sizeof( unsigned ) );
+	if( !pkts || !pkt_len ) {
+		perror( "malloc" );
+		return;
+	}
+	req[0] = LOOP_TEST_LAN_RS_ADDR;
+	req[1] = NETFN_APP_REQ << 2;
+	req[2] = -( req[0] + req[1] );
+	req[3] = LOOP_TEST_LAN_RQ_ADDR;
+	req[4] = 0;
+	req[5] = IPMI_CMD_GET_DEVICE_ID;
+	req[6] = -( req[3] + req[4] + req[5] );
+	memset( resp, 0x5a, sizeof( resp ) );
+
+	for( suite = 1; suite <= 3; suite++ ) {
+		if( loop_test_session_setup( &client, suite, loop_test_session_xfer ) != ESUCCESS ) {
+			printf( "suite %u session setup failed\n", suite );
+			break;
+		}
+		/* inbound, packets built ahead so only the BMC side is timed */
+		for( i = 0; i < msgs; i++ )
+			pkt_len[i] = loop_test_session_wrap( &client, req, sizeof( req ),
+				pkts + i * LOOP_TEST_SESSION_PKT_LEN );
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		for( i = 0; i < msgs; i++ ) {
+			if( ( session_unwrap( pkts + i * LOOP_TEST_SESSION_PKT_LEN, pkt_len[i], 
+			    &msg, &msg_len ) != client.id ) || ( msg_len != sizeof( req ) ) )
+				loop_test_session_stats.errors++;
+		}
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		ns_unwrap = ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) ) / msgs;
+		if( memcmp( msg, req, sizeof( req ) ) )
+			loop_test_session_stats.errors++;
+
+		/* outbound, Get Device ID response sized */
+		clock_gettime( CLOCK_MONOTONIC, &start );
+		for( i = 0; i < msgs; i++ )
+			len = session_wrap( client.id, resp, 23, out, sizeof( out ) );
+		clock_gettime( CLOCK_MONOTONIC, &end );
+		ns_wrap = ( ( end.tv_sec - start.tv_sec ) * 1e9 + ( end.tv_nsec - start.tv_nsec ) ) / msgs;
+		if( ( loop_test_session_check( &client, out, len, &msg, &msg_len ) != ESUCCESS )
+		    || ( msg_len != 23 ) || memcmp( msg, resp, 23 ) )
+			loop_test_session_stats.errors++;
+
+		if( suite == 1 ) {
+			base_unwrap = ns_unwrap;
+			base_wrap = ns_wrap;
+		}
+		printf( "suite %u: unwrap %.0f ns (+%.0f), wrap %.0f ns (+%.0f) per message\n",
+			suite, ns_unwrap, ns_unwrap - base_unwrap, ns_wrap, ns_wrap - base_wrap );
+		session_close( client.id, 0 );
+	}
+	printf( "%lu errors, %lu sequence rejects, %lu AuthCode failures\n",
+		loop_test_session_stats.errors, session_stats.seq_reject, session_stats.auth_fail );
+	free( pkts );
+	free( pkt_len );
+}
+
+/* Open Session and RAKP 1-4 for suite as the remote console, checking
+ * what comes back from the BMC. xfer takes each request to the BMC and
+ * returns the response. */
+int loop_test_session_setup( LOOP_TEST_SESSION_CLIENT *c, unsigned char suite,
+	unsigned ( *xfer )( LOOP_TEST_SESSION_CLIENT *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp ) )
+{
+	unsigned char	req[64], resp[SESSION_RESP_MAX], buf[128], mac[SHA1_DIGEST_LEN];
+	unsigned char	kuid[SESSION_KEY_LEN];
+	unsigned char	*p;
+	unsigned char	role = RAKP_ROLE_NAME_ONLY | IPMI_PRIV_ADMIN;
+	unsigned	user_len = strlen( LOOP_TEST_SESSION_USER );
+	unsigned	len;
+	int		fd = c->fd;
+
+	memset( c, 0, sizeof( LOOP_TEST_SESSION_CLIENT ) );
+	c->fd = fd;
+	c->suite = suite;
+	c->console_id = random() | 1;
+	memset( kuid, 0, sizeof( kuid ) );
+	memcpy( kuid, LOOP_TEST_SESSION_PASSWORD, strlen( LOOP_TEST_SESSION_PASSWORD ) );
+
+	/* Open Session Request */
+	memset( req, 0, 32 );
+	req[1] = IPMI_PRIV_ADMIN;
+	LOOP_TEST_SESSION_PUT32( req + 4, c->console_id );
+	req[8] = 0;
+	req[11] = 8;
+	req[12] = RMCPP_AUTH_HMAC_SHA1;
+	req[16] = 1;
+	req[19] = 8;
+	req[20] = ( suite >= 2 ) ? RMCPP_INTEG_HMAC_SHA1_96 : RMCPP_INTEG_NONE;
+	req[24] = 2;
+	req[27] = 8;
+	req[28] = ( suite == 3 ) ? RMCPP_CONF_AES_CBC_128 : RMCPP_CONF_NONE;
+	len = ( *xfer )( c, IOLAN_RMCPP_OPEN_SESSION_REQ, req, 32, resp );
+	if( ( len != 36 ) || ( resp[1] != RMCPP_ST_OK ) )
+		return( EINVAL );
+	c->id = LOOP_TEST_SESSION_GET32( resp + 8 );
+
+	/* RAKP 1 */
+	memset( req, 0, 28 );
+	LOOP_TEST_SESSION_PUT32( req + 4, c->id );
+	for( len = 0; len < SESSION_RAND_LEN; len++ )
+		c->rand_console[len] = random();
+	memcpy( req + 8, c->rand_console, SESSION_RAND_LEN );
+	req[24] = role;
+	req[27] = user_len;
+	memcpy( req + 28, LOOP_TEST_SESSION_USER, user_len );
+	len = ( *xfer )( c, IOLAN_RAKP_MSG1, req, 28 + user_len, resp );
+	if( ( len != 60 ) || ( resp[1] != RMCPP_ST_OK ) )
+		return( EINVAL );
+	memcpy( c->rand_bmc, resp + 8, SESSION_RAND_LEN );
+	memcpy( c->guid, resp + 24, 16 );
+
+	/* RAKP 2 AuthCode, HMAC_Kuid( SIDm, SIDc, Rm, Rc, GUIDc, ROLEm, ULENm, UNAMEm ) */
+	p = buf;
+	LOOP_TEST_SESSION_PUT32( p, c->console_id );	p += 4;
+	LOOP_TEST_SESSION_PUT32( p, c->id );		p += 4;
+	memcpy( p, c->rand_console, 16 );		p += 16;
+	memcpy( p, c->rand_bmc, 16 );			p += 16;
+	memcpy( p, c->guid, 16 );			p += 16;
+	*p++ = role;
+	*p++ = user_len;
+	memcpy( p, LOOP_TEST_SESSION_USER, user_len );	p += user_len;
+	hmac_sha1( kuid, sizeof( kuid ), buf, p - buf, mac );
+	if( memcmp( mac, resp + 40, SHA1_DIGEST_LEN ) )
+		return( EINVAL );
+
+	/* RAKP 3, HMAC_Kuid( Rc, SIDm, ROLEm, ULENm, UNAMEm ) */
+	p = buf;
+	memcpy( p, c->rand_bmc, 16 );			p += 16;
+	LOOP_TEST_SESSION_PUT32( p, c->console_id );	p += 4;
+	*p++ = role;
+	*p++ = user_len;
+	memcpy( p, LOOP_TEST_SESSION_USER, user_len );	p += user_len;
+	memset( req, 0, 8 );
+	LOOP_TEST_SESSION_PUT32( req + 4, c->id );
+	hmac_sha1( kuid, sizeof( kuid ), buf, p - buf, req + 8 );
+	len = ( *xfer )( c, IOLAN_RAKP_MSG3, req, 8 + SHA1_DIGEST_LEN, resp );
+	if( ( len != 20 ) || ( resp[1] != RMCPP_ST_OK ) )
+		return( EINVAL );
+
+	/* SIK, K1, K2 and the RAKP 4 ICV, HMAC_SIK( Rm, SIDc, GUIDc ) */
+	p = buf;
+	memcpy( p, c->rand_console, 16 );		p += 16;
+	memcpy( p, c->rand_bmc, 16 );			p += 16;
+	*p++ = role;
+	*p++ = user_len;
+	memcpy( p, LOOP_TEST_SESSION_USER, user_len );	p += user_len;
+	hmac_sha1( kuid, sizeof( kuid ), buf, p - buf, c->sik );
+	memset( buf, 0x01, SESSION_KEY_LEN );
+	hmac_sha1( c->sik, SESSION_KEY_LEN, buf, SESSION_KEY_LEN, mac );
+	hmac_sha1_init( &c->integ, mac, SESSION_KEY_LEN );
+	memset( buf, 0x02, SESSION_KEY_LEN );
+	hmac_sha1( c->sik, SESSION_KEY_LEN, buf, SESSION_KEY_LEN, mac );
+	aes128_set_key( &c->aes, mac );
+
+	p = buf;
+	memcpy( p, c->rand_console, 16 );		p += 16;
+	LOOP_TEST_SESSION_PUT32( p, c->id );		p += 4;
+	memcpy( p, c->guid, 16 );			p += 16;
+	hmac_sha1( c->sik, SESSION_KEY_LEN, buf, p - buf, mac );
+	if( memcmp( mac, resp + 8, RMCPP_HMAC_SHA1_96_LEN ) )
+		return( EINVAL );
+	return( ESUCCESS );
+}
+
+/* Open Session or RAKP straight into session.c, the BMC side is timed */
+unsigned loop_test_session_xfer( LOOP_TEST_SESSION_CLIENT *c, unsigned char type, 
+	unsigned char *req, unsigned len, unsigned char *resp )
+{
+	struct timespec	start, end;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	switch( type ) {
+		case IOLAN_RMCPP_OPEN_SESSION_REQ:
+			len = session_open( req, len, resp );
+			break;
+		case IOLAN_RAKP_MSG1:
+			len = session_rakp1( req, len, resp );
+			break;
+		default:
+			len = session_rakp3( req, len, resp );
+			break;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	loop_test_session_stats.bmc_secs += ( end.tv_sec - start.tv_sec ) 
+		+ ( end.tv_nsec - start.tv_nsec ) / 1e9;
+	return( len );
+}
+
+/* an IPMI message on the client's session as the console sends it, from
+ * the Auth Type byte on, returns its length */
+unsigned loop_test_session_wrap( LOOP_TEST_SESSION_CLIENT *c, 
+	unsigned char *msg, unsigned msg_len, unsigned char *pkt )
+{
+	unsigned char	mac[SHA1_DIGEST_LEN];
+	unsigned char	*payload = pkt + RMCPP_SESSION_HDR_LEN;
+	unsigned	payload_len = msg_len, len, i;
+	unsigned char	pad;
+
+	pkt[0] = AUTH_TYPE_RMCPP;
+	pkt[1] = IOLAN_PAYLOAD_IPMI_MESSAGE;
+	LOOP_TEST_SESSION_PUT32( pkt + 2, c->id );
+	LOOP_TEST_SESSION_PUT32( pkt + 6, ++c->seq );
+	if( c->suite == 3 ) {
+		pkt[1] |= RMCPP_PAYLOAD_ENCRYPTED;
+		pad = ( AES_BLOCK_LEN - ( msg_len + 1 ) % AES_BLOCK_LEN ) % AES_BLOCK_LEN;
+		payload_len = AES_BLOCK_LEN + msg_len + pad + 1;
+		for( i = 0; i < AES_BLOCK_LEN; i++ )
+			payload[i] = random();
+		memcpy( payload + AES_BLOCK_LEN, msg, msg_len );
+		for( i = 0; i < pad; i++ )
+			payload[AES_BLOCK_LEN + msg_len + i] = i + 1;
+		payload[payload_len - 1] = pad;
+		aes128_cbc_encrypt( &c->aes, payload, payload + AES_BLOCK_LEN, 
+			payload_len - AES_BLOCK_LEN );
+	} else {
+		memcpy( payload, msg, msg_len );
+	}
+	pkt[10] = payload_len & 0xff;
+	pkt[11] = payload_len >> 8;
+	len = RMCPP_SESSION_HDR_LEN + payload_len;
+
+	if( c->suite >= 2 ) {
+		pkt[1] |= RMCPP_PAYLOAD_AUTHENTICATED;
+		pad = ( 4 - ( len + 2 ) % 4 ) % 4;
+		memset( pkt + len, 0xff, pad );
+		len += pad;
+		pkt[len++] = pad;
+		pkt[len++] = RMCPP_NEXT_HEADER;
+		hmac_sha1_mac( &c->integ, pkt, len, mac );
+		memcpy( pkt + len, mac, RMCPP_HMAC_SHA1_96_LEN );
+		len += RMCPP_HMAC_SHA1_96_LEN;
+	}
+	return( len );
+}
+
+/* check a packet the BMC sent on the client's session and find the 
+ * message in it */
+int loop_test_session_check( LOOP_TEST_SESSION_CLIENT *c, unsigned char *pkt, 
+	unsigned len, unsigned char **msg, unsigned *msg_len )
+{
+	unsigned char	mac[SHA1_DIGEST_LEN];
+	unsigned char	*payload = pkt + RMCPP_SESSION_HDR_LEN;
+	unsigned	payload_len = pkt[10] | ( pkt[11] << 8 );
+
+	if( ( pkt[0] != AUTH_TYPE_RMCPP ) 
+	    || ( LOOP_TEST_SESSION_GET32( pkt + 2 ) != c->console_id ) )
+		return( EINVAL );
+	if( c->suite >= 2 ) {
+		hmac_sha1_mac( &c->integ, pkt, len - RMCPP_HMAC_SHA1_96_LEN, mac );
+		if( memcmp( mac, pkt + len - RMCPP_HMAC_SHA1_96_LEN, RMCPP_HMAC_SHA1_96_LEN ) )
+			return( EINVAL );
+	}
+	if( c->suite == 3 ) {
+		aes128_cbc_decrypt( &c->aes, payload, payload + AES_BLOCK_LEN, 
+			payload_len - AES_BLOCK_LEN );
+		*msg = payload + AES_BLOCK_LEN;
+		*msg_len = payload_len - AES_BLOCK_LEN - payload[payload_len - 1] - 1;
+	} else {
+		*msg = payload;
+		*msg_len = payload_len;
+	}
+	return( ESUCCESS );
+}
+
+/*==============================================================================
+ * 			L O A D   G E N E R A T O R
+ *============================================================================*/
+
+typedef struct load_test_cmd {
+	unsigned char	netfn;
+	unsigned char	cmd;
+	unsigned char	len;		/* request data bytes */
+	unsigned char	data[LOAD_TEST_MAX_DATA];
+	char		name[40];
+	unsigned	weight;		/* requests per pass through the script */
+	unsigned long	sent;
+	unsigned long	done;
+	unsigned long	lost;		/* timed out or not sent */
+	unsigned long	cc[256];	/* responses by completion code */
+	unsigned	pct[4];		/* us, p50 p99 p99.9 max */
+} LOAD_TEST_CMD;
+
+typedef struct load_test_sample {
+	unsigned short	cmd;		/* index in load_test_stats.cmd */
+	unsigned	us;
+} LOAD_TEST_SAMPLE;
+
+struct {
+	LOAD_TEST_CMD	cmd[LOAD_TEST_MAX_CMDS];
+	unsigned	cmds;
+	unsigned	weight;		/* sum of the cmd weights */
+	int		transport;	/* LOAD_TEST_TTY, _LAN or _IPMB */
+	int		fd;
+	unsigned char	suite;		/* LAN, 0 for IPMI v1.5 or the RMCP+ cipher suite */
+	unsigned char	rs_addr;	/* the BMC or the IPMB controller */
+	LOOP_TEST_SESSION_CLIENT session;
+	struct sockaddr_un ipmb_peer;
+	struct {
+		unsigned char	busy;
+		unsigned char	cmd;
+		struct timespec	sent;
+	} in_flight[LOAD_TEST_SEQ];
+	unsigned	outstanding;
+	unsigned char	seq;		/* next one to try */
+	unsigned long	sent;
+	unsigned long	done;
+	unsigned long	err[LOAD_TEST_ERR_NUM];
+	LOAD_TEST_SAMPLE *sample;	/* one per response */
+} load_test_stats;
+
+/*------------------------------------------------------------------------------
+	load_test()
+		Scripted load generator. Sends count requests taken from
+		the script text, window of them in flight, to target:
+
+			tty:<device>[:<baud>]	terminal mode on a serial port,
+						-b baud by default
+			lan:<host>:<port>[:<suite>]
+						IPMI over LAN, suite 0 is IPMI
+						v1.5 without a session, 1-3 an 
+						RMCP+ session as admin/password
+			ipmb:<address>		a host build on the simulated 
+						IPMB, see posix.c
+
+		Script lines are "netfn cmd [data ..] [xN]", hex bytes, 
+		xN sends the line N times per pass through the script, # 
+		starts a comment. Requests go out in script order and are
+		matched to the responses by rqSeq. Reports throughput, 
+		latency percentiles per script line, completion codes and
+		errors, then the same as one line of JSON. Returns ESUCCESS
+		if every request was answered and, with limit set, p99
+		latency stayed within limit us.
+	Preconditions:
+	Postconditions:
+ *----------------------------------------------------------------------------*/
+int load_test( char *script, char *name, char *target, unsigned window, 
+	unsigned long count, unsigned limit )
+/*----------------------------------------------------------------------------*/
+{
+	struct timespec	start, end, now;
+	struct pollfd	pfd;
+	LOAD_TEST_CMD	*c;
+	char		*text;
+	double		secs;
+	unsigned	i, w;
+	unsigned char	seq;
+	int		rv;
+
+	if( window < 1 )
+		window = 1;
+	if( window > LOAD_TEST_SEQ )
+		window = LOAD_TEST_SEQ;
+	memset( &load_test_stats, 0, sizeof( load_test_stats ) );
+
+	/* the parser writes into the text */
+	if( !( text = strdup( script ) ) )
+		return( ENOMEM );
+	rv = load_test_parse( text );
+	free( text );
+	if( rv != ESUCCESS )
+		return( rv );
+	if( !count || !( load_test_stats.sample = malloc( count * sizeof( LOAD_TEST_SAMPLE ) ) ) ) {
+		perror( "malloc" );
+		return( ENOMEM );
+	}
+	if( load_test_open( target ) != ESUCCESS ) {
+		free( load_test_stats.sample );
+		return( EIO );
+	}
+
+	printf( "%lu requests from %s, %u commands, to %s with %u in flight\n",
+		count, name, load_test_stats.cmds, target, window );
+	pfd.fd = load_test_stats.fd;
+	pfd.events = POLLIN;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	while( load_test_stats.done + load_test_stats.err[LOAD_TEST_ERR_TIMEOUT] 
+	    + load_test_stats.err[LOAD_TEST_ERR_SEND] < count ) {
+		while( ( load_test_stats.sent < count ) && ( load_test_stats.outstanding < window ) ) {
+			seq = load_test_stats.seq;
+			while( load_test_stats.in_flight[seq].busy )
+				seq = ( seq + 1 ) % LOAD_TEST_SEQ;
+			load_test_stats.seq = ( seq + 1 ) % LOAD_TEST_SEQ;
+
+			/* weighted round robin through the script */
+			w = load_test_stats.sent % load_test_stats.weight;
+			for( i = 0; w >= load_test_stats.cmd[i].weight; i++ )
+				w -= load_test_stats.cmd[i].weight;
+			c = &load_test_stats.cmd[i];
+
+			clock_gettime( CLOCK_MONOTONIC, &load_test_stats.in_flight[seq].sent );
+			if( load_test_send( seq, c ) == ESUCCESS ) {
+				load_test_stats.in_flight[seq].busy = 1;
+				load_test_stats.in_flight[seq].cmd = i;
+				load_test_stats.outstanding++;
+			} else {
+				load_test_stats.err[LOAD_TEST_ERR_SEND]++;
+				c->lost++;
+			}
+			load_test_stats.sent++;
+			c->sent++;
+		}
+
+		if( poll( &pfd, 1, 10 ) > 0 )
+			load_test_input();
+
+		/* requests nobody answered */
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		for( i = 0; i < LOAD_TEST_SEQ; i++ ) {
+			if( load_test_stats.in_flight[i].busy 
+			    && ( load_test_us( &load_test_stats.in_flight[i].sent, &now ) 
+			    > LOAD_TEST_TIMEOUT ) ) {
+				load_test_stats.in_flight[i].busy = 0;
+				load_test_stats.outstanding--;
+				load_test_stats.err[LOAD_TEST_ERR_TIMEOUT]++;
+				load_test_stats.cmd[load_test_stats.in_flight[i].cmd].lost++;
+			}
+		}
+	}
+	clock_gettime( CLOCK_MONOTONIC, &end );
+
+	if( load_test_stats.transport == LOAD_TEST_TTY ) {
+		/* frames tty.c could not make sense of */
+		load_test_stats.err[LOAD_TEST_ERR_BAD] += tty_stats.rx_bad + tty_stats.rx_overrun;
+		tty_write( ( unsigned char * )"[SYS ECHO ON]\r", 14 );
+		tty_close();
+	} else {
+		close( load_test_stats.fd );
+	}
+
+	secs = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+	rv = load_test_report( target, window, secs, limit );
+	free( load_test_stats.sample );
+	return( rv );
+}
+
+/* read a script file, - is stdin, returns the text or 0 */
+char *load_test_read( char *file )
+{
+	FILE	*fp = strcmp( file, "-" ) ? fopen( file, "r" ) : stdin;
+	char	*text;
+	size_t	len;
+
+	if( !fp ) {
+		perror( file );
+		return( 0 );
+	}
+	if( ( text = malloc( LOAD_TEST_MAX_SCRIPT + 1 ) ) ) {
+		len = fread( text, 1, LOAD_TEST_MAX_SCRIPT, fp );
+		text[len] = 0;
+	}
+	if( fp != stdin )
+		fclose( fp );
+	return( text );
+}
+
+/* fill in load_test_stats.cmd from the script text */
+int load_test_parse( char *text )
+{
+	LOAD_TEST_CMD	*c;
+	char		*line, *next, *tok, *save, *end, *name;
+	unsigned long	val;
+	unsigned	line_num = 0, bytes, i, n;
+
+	for( line = text; line && *line; line = next ) {
+		line_num++;
+		if( ( next = strchr( line, '\n' ) ) )
+			*next++ = 0;
+		if( ( tok = strchr( line, '#' ) ) )
+			*tok = 0;
+
+		c = &load_test_stats.cmd[load_test_stats.cmds];
+		memset( c, 0, sizeof( LOAD_TEST_CMD ) );
+		c->weight = 1;
+		bytes = 0;
+		for( tok = strtok_r( line, " \t\r", &save ); tok; tok = strtok_r( 0, " \t\r", &save ) ) {
+			if( ( *tok == 'x' ) && bytes ) {
+				c->weight = strtoul( tok + 1, &end, 10 );
+				if( *end || !c->weight )
+					goto bad;
+				continue;
+			}
+			val = strtoul( tok, &end, 16 );
+			if( *end || ( val > 0xff ) || ( bytes >= 2 + LOAD_TEST_MAX_DATA ) )
+				goto bad;
+			if( bytes == 0 )
+				c->netfn = val;
+			else if( bytes == 1 )
+				c->cmd = val;
+			else
+				c->data[c->len++] = val;
+			bytes++;
+		}
+		if( !bytes )
+			continue;
+		if( ( bytes < 2 ) || ( c->netfn & 1 ) || ( c->netfn > 0x3f ) )
+			goto bad;
+		if( load_test_stats.cmds == LOAD_TEST_MAX_CMDS ) {
+			printf( "script line %u: more than %u commands\n", line_num, LOAD_TEST_MAX_CMDS );
+			return( EINVAL );
+		}
+
+		/* the command name where we have one, then the data */
+		name = 0;
+		if( c->netfn == NETFN_APP_REQ )
+			name = string_find( app_str, c->cmd );
+		else if( c->netfn == NETFN_PICMG_REQ )
+			name = string_find( atca_str, c->cmd );
+		if( name )
+			n = snprintf( c->name, sizeof( c->name ), "%s", name );
+		else
+			n = snprintf( c->name, sizeof( c->name ), "%02x/%02x", c->netfn, c->cmd );
+		for( i = 0; ( i < c->len ) && ( n + 3 < sizeof( c->name ) ); i++ )
+			n += snprintf( c->name + n, sizeof( c->name ) - n, " %02x", c->data[i] );
+
+		load_test_stats.weight += c->weight;
+		load_test_stats.cmds++;
+	}
+	if( !load_test_stats.cmds ) {
+		printf( "no commands in the script\n" );
+		return( EINVAL );
+	}
+	return( ESUCCESS );
+bad:
+	printf( "script line %u: expected netfn cmd [data ..] [xN] in hex\n", line_num );
+	return( EINVAL );
+}
+
+/* open the transport target names */
+int load_test_open( char *target )
+{
+	struct addrinfo	hints, *res;
+	struct sockaddr_un addr;
+	char		buf[256], *host, *port, *suite, *end;
+	unsigned	baud = g_tty_baud;
+	int		rv;
+
+	if( !strncmp( target, "tty:", 4 ) ) {
+		load_test_stats.transport = LOAD_TEST_TTY;
+		snprintf( buf, sizeof( buf ), "%s", target + 4 );
+		if( ( end = strchr( buf, ':' ) ) ) {
+			*end++ = 0;
+			baud = atoi( end );
+		}
+		if( ( load_test_stats.fd = tty_open( buf, baud, load_test_frame ) ) < 0 )
+			return( EIO );
+
+		/* the echo would come back in between the responses */
+		tty_write( ( unsigned char * )"[SYS ECHO OFF]\r", 15 );
+		usleep( 200000 );
+		tcflush( load_test_stats.fd, TCIFLUSH );
+		return( ESUCCESS );
+	}
+
+	if( !strncmp( target, "lan:", 4 ) ) {
+		load_test_stats.transport = LOAD_TEST_LAN;
+		load_test_stats.rs_addr = LOOP_TEST_LAN_RS_ADDR;
+		snprintf( buf, sizeof( buf ), "%s", target + 4 );
+		host = buf;
+		if( ( port = strchr( host, ':' ) ) )
+			*port++ = 0;
+		else
+			port = LOOP_TEST_LAN_PORT;
+		if( ( suite = strchr( port, ':' ) ) ) {
+			*suite++ = 0;
+			load_test_stats.suite = atoi( suite );
+		}
+		if( load_test_stats.suite > 3 ) {
+			printf( "cipher suite 0 to 3\n" );
+			return( EINVAL );
+		}
+
+		memset( &hints, 0, sizeof hints );
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+		if( ( rv = getaddrinfo( host, port, &hints, &res ) ) != 0 ) {
+			fprintf( stderr, "getaddrinfo: %s\n", gai_strerror( rv ) );	
+			return( EINVAL );
+		}
+		load_test_stats.fd = socket( res->ai_family, SOCK_DGRAM, 0 );
+		if( ( load_test_stats.fd < 0 ) 
+		    || ( connect( load_test_stats.fd, res->ai_addr, res->ai_addrlen ) < 0 ) ) {
+			perror( "socket" );
+			freeaddrinfo( res );
+			return( EIO );
+		}
+		freeaddrinfo( res );
+
+		if( load_test_stats.suite ) {
+			load_test_stats.session.fd = load_test_stats.fd;
+			if( loop_test_session_setup( &load_test_stats.session, load_test_stats.suite, 
+			    loop_test_lan_xfer ) != ESUCCESS ) {
+				printf( "RMCP+ session setup failed\n" );
+				close( load_test_stats.fd );
+				return( EIO );
+			}
+		}
+		return( ESUCCESS );
+	}
+
+	if( !strncmp( target, "ipmb:", 5 ) ) {
+		load_test_stats.transport = LOAD_TEST_IPMB;
+		load_test_stats.rs_addr = strtoul( target + 5, &end, 16 );
+		if( ( end == target + 5 ) || *end || ( load_test_stats.rs_addr & 1 ) ) {
+			printf( "ipmb:<address> takes an 8 bit slave address in hex\n" );
+			return( EINVAL );
+		}
+		load_test_ipmb_name( &load_test_stats.ipmb_peer, load_test_stats.rs_addr );
+		load_test_ipmb_name( &addr, LOAD_TEST_IPMB_ADDR );
+		unlink( addr.sun_path );
+		load_test_stats.fd = socket( AF_UNIX, SOCK_DGRAM, 0 );
+		if( ( load_test_stats.fd < 0 ) 
+		    || ( bind( load_test_stats.fd, ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 ) ) {
+			perror( addr.sun_path );
+			return( EIO );
+		}
+		return( ESUCCESS );
+	}
+
+	printf( "target is tty:<device>[:<baud>], lan:<host>:<port>[:<suite>] or ipmb:<address>\n" );
+	return( EINVAL );
+}
+
+/* fill in the socket name of a controller on the simulated IPMB */
+void load_test_ipmb_name( struct sockaddr_un *addr, unsigned char slave_addr )
+{
+	memset( addr, 0, sizeof( struct sockaddr_un ) );
+	addr->sun_family = AF_UNIX;
+	snprintf( addr->sun_path, sizeof( addr->sun_path ), POSIX_IPMB_PATH, slave_addr );
+}
+
+/* send the request for script line c with seq */
+int load_test_send( unsigned char seq, LOAD_TEST_CMD *c )
+{
+	unsigned char	pkt[RMCPD_MAX_PKT];
+	unsigned char	msg[8 + LOAD_TEST_MAX_DATA];
+	unsigned char	*p;
+	unsigned	len, i;
+
+	switch( load_test_stats.transport ) {
+		case LOAD_TEST_TTY:
+			msg[0] = c->netfn << 2;		/* lun 0 */
+			msg[1] = seq << 2;		/* no bridging */
+			msg[2] = c->cmd;
+			memcpy( msg + 3, c->data, c->len );
+			return( tty_send( msg, 3 + c->len ) );
+
+		case LOAD_TEST_LAN:
+			memset( pkt, 0, 4 + IPMI_SESSION_HDR_LEN );
+			pkt[0] = RMCP_VERSION_1;
+			pkt[2] = RMCP_SEQ_NO_ACK;
+			pkt[3] = RMCP_CLASS_IPMI;
+			p = load_test_stats.suite ? msg : pkt + 4 + IPMI_SESSION_HDR_LEN;
+			break;
+
+		default:
+			p = msg;
+			break;
+	}
+
+	/* rsSA, netFn/rsLUN, checksum, rqSA, rqSeq/rqLUN, cmd, data, checksum */
+	p[0] = load_test_stats.rs_addr;
+	p[1] = c->netfn << 2;
+	p[2] = -( p[0] + p[1] );
+	p[3] = ( load_test_stats.transport == LOAD_TEST_LAN ) 
+		? LOOP_TEST_LAN_RQ_ADDR : LOAD_TEST_IPMB_ADDR;
+	p[4] = seq << 2;
+	p[5] = c->cmd;
+	memcpy( p + 6, c->data, c->len );
+	len = 6 + c->len;
+	p[len] = 0;
+	for( i = 3; i < len; i++ )
+		p[len] -= p[i];
+	len++;
+
+	if( load_test_stats.transport == LOAD_TEST_IPMB ) {
+		/* the simulated bus carries what follows the slave address */
+		pkt[0] = POSIX_IPMB_FRAME;
+		pkt[1] = LOAD_TEST_IPMB_ADDR;
+		memcpy( pkt + POSIX_IPMB_HDR_LEN, p + 1, len - 1 );
+		len += POSIX_IPMB_HDR_LEN - 1;
+		if( sendto( load_test_stats.fd, pkt, len, 0, 
+		    ( struct sockaddr * )&load_test_stats.ipmb_peer, sizeof( struct sockaddr_un ) ) < 0 )
+			return( EIO );
+		return( ESUCCESS );
+	}
+
+	if( load_test_stats.suite ) {
+		len = 4 + loop_test_session_wrap( &load_test_stats.session, msg, len, pkt + 4 );
+	} else {
+		pkt[4] = AUTH_TYPE_NONE;	/* session seq and id stay 0, no session */
+		pkt[4 + IPMI_SESSION_HDR_LEN - 1] = len;
+		len += 4 + IPMI_SESSION_HDR_LEN;
+	}
+	if( send( load_test_stats.fd, pkt, len, 0 ) < 0 )
+		return( EIO );
+	return( ESUCCESS );
+}
+
+/* read what has come in and hand the responses to load_test_resp() */
+void load_test_input( void )
+{
+	unsigned char	pkt[RMCPD_MAX_PKT];
+	unsigned char	*p;
+	unsigned	len;
+	int		n;
+
+	/* the responses go to load_test_frame() */
+	if( load_test_stats.transport == LOAD_TEST_TTY ) {
+		tty_input();
+		return;
+	}
+
+	while( ( n = recv( load_test_stats.fd, pkt, sizeof( pkt ), MSG_DONTWAIT ) ) >= 0 ) {
+		if( load_test_stats.transport == LOAD_TEST_IPMB ) {
+			/* netFn/rqLUN, checksum, rsSA, rqSeq/rsLUN, cmd, cc, .., checksum */
+			p = pkt + POSIX_IPMB_HDR_LEN;
+			if( ( n < POSIX_IPMB_HDR_LEN + 7 ) || ( pkt[0] != POSIX_IPMB_FRAME ) ) {
+				load_test_stats.err[LOAD_TEST_ERR_BAD]++;
+				continue;
+			}
+			load_test_resp( p[3] >> 2, p[0] >> 2, p[4], p[5] );
+			continue;
+		}
+
+		/* rqSA, netFn/rqLUN, checksum, rsSA, rqSeq/rsLUN, cmd, cc, .., checksum */
+		p = pkt + 4 + IPMI_SESSION_HDR_LEN;
+		len = n - 4 - IPMI_SESSION_HDR_LEN;
+		if( ( pkt[3] != RMCP_CLASS_IPMI ) || ( n < 4 + 8 
+		    + ( load_test_stats.suite ? RMCPP_SESSION_HDR_LEN : IPMI_SESSION_HDR_LEN ) )
+		    || ( load_test_stats.suite && ( loop_test_session_check( &load_test_stats.session, 
+		    pkt + 4, n - 4, &p, &len ) != ESUCCESS ) ) || ( len < 8 ) ) {
+			load_test_stats.err[LOAD_TEST_ERR_BAD]++;
+			continue;
+		}
+		load_test_resp( p[4] >> 2, p[1] >> 2, p[5], p[6] );
+	}
+}
+
+/* a terminal mode response from tty.c, netFn/rqLUN, rqSeq/bridge, cmd, cc */
+void load_test_frame( unsigned char *msg, unsigned len )
+{
+	if( len < 4 ) {
+		load_test_stats.err[LOAD_TEST_ERR_BAD]++;
+		return;
+	}
+	load_test_resp( msg[1] >> 2, msg[0] >> 2, msg[2], msg[3] );
+}
+
+/* a response with seq came in, complete the request it answers */
+void load_test_resp( unsigned char seq, unsigned char netfn, unsigned char cmd, 
+	unsigned char cc )
+{
+	struct timespec	now;
+	LOAD_TEST_CMD	*c = &load_test_stats.cmd[load_test_stats.in_flight[seq].cmd];
+	LOAD_TEST_SAMPLE *s;
+
+	if( !load_test_stats.in_flight[seq].busy || ( netfn != ( c->netfn | 1 ) ) 
+	    || ( cmd != c->cmd ) ) {
+		load_test_stats.err[LOAD_TEST_ERR_STRAY]++;
+		return;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	s = &load_test_stats.sample[load_test_stats.done++];
+	s->cmd = load_test_stats.in_flight[seq].cmd;
+	s->us = load_test_us( &load_test_stats.in_flight[seq].sent, &now );
+	load_test_stats.in_flight[seq].busy = 0;
+	load_test_stats.outstanding--;
+	c->done++;
+	c->cc[cc]++;
+}
+
+/* print the results, for people and then for scripts, returns ESUCCESS if
+ * the run passes */
+int load_test_report( char *target, unsigned window, double secs, unsigned limit )
+{
+	LOAD_TEST_SAMPLE *s = load_test_stats.sample;
+	LOAD_TEST_CMD	*c;
+	unsigned long	n = load_test_stats.done, lost = 0;
+	unsigned	pct[4];
+	unsigned	i, j, k;
+	int		pass;
+
+	/* grouped by script line for the per command figures, then as a whole */
+	qsort( s, n, sizeof( LOAD_TEST_SAMPLE ), load_test_cmd_cmp );
+	for( i = 0; i < load_test_stats.cmds; i++ ) {
+		c = &load_test_stats.cmd[i];
+		load_test_pct( s, c->done, c->pct );
+		s += c->done;
+		lost += c->lost;
+	}
+	qsort( load_test_stats.sample, n, sizeof( LOAD_TEST_SAMPLE ), load_test_us_cmp );
+	load_test_pct( load_test_stats.sample, n, pct );
+
+	pass = ( n > 0 ) && !lost && !load_test_stats.err[LOAD_TEST_ERR_BAD] 
+		&& ( !limit || ( pct[1] <= limit ) );
+
+	printf( "%lu responses in %.3f s, %.0f requests/s\n", n, secs, n / secs );
+	printf( "%-28s %8s %8s %6s %8s %8s %8s %8s\n", "command", "sent", "done", "lost",
+		"p50 us", "p99 us", "p99.9 us", "max us" );
+	for( i = 0; i < load_test_stats.cmds; i++ ) {
+		c = &load_test_stats.cmd[i];
+		printf( "%-28s %8lu %8lu %6lu %8u %8u %8u %8u\n", c->name, c->sent, c->done, 
+			c->lost, c->pct[0], c->pct[1], c->pct[2], c->pct[3] );
+	}
+	printf( "%-28s %8lu %8lu %6lu %8u %8u %8u %8u\n", "all", load_test_stats.sent, n, 
+		lost, pct[0], pct[1], pct[2], pct[3] );
+
+	printf( "completion codes:\n" );
+	for( i = 0; i < load_test_stats.cmds; i++ ) {
+		c = &load_test_stats.cmd[i];
+		printf( "  %-26s", c->name );
+		for( j = 0; j < 256; j++ ) {
+			if( c->cc[j] )
+				printf( " %02x:%lu", j, c->cc[j] );
+		}
+		printf( "\n" );
+	}
+	printf( "errors:" );
+	for( i = 0; i < LOAD_TEST_ERR_NUM; i++ )
+		printf( " %s %lu", load_test_err_str[i], load_test_stats.err[i] );
+	printf( "\n" );
+	if( pass )
+		printf( "PASS\n" );
+	else if( limit && ( pct[1] > limit ) )
+		printf( "FAIL: p99 %u us over %u us\n", pct[1], limit );
+	else
+		printf( "FAIL: requests lost or responses malformed\n" );
+
+	/* the same on one line */
+	printf( "{\"target\":\"%s\",\"window\":%u,\"secs\":%.3f,\"rate\":%.0f,"
+		"\"sent\":%lu,\"done\":%lu,\"lost\":%lu,",
+		target, window, secs, n / secs, load_test_stats.sent, n, lost );
+	printf( "\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u,\"errors\":{", 
+		pct[0], pct[1], pct[2], pct[3] );
+	for( i = 0; i < LOAD_TEST_ERR_NUM; i++ )
+		printf( "%s\"%s\":%lu", i ? "," : "", load_test_err_str[i], load_test_stats.err[i] );
+	printf( "},\"commands\":[" );
+	for( i = 0; i < load_test_stats.cmds; i++ ) {
+		c = &load_test_stats.cmd[i];
+		printf( "%s{\"name\":\"%s\",\"netfn\":%u,\"cmd\":%u,\"sent\":%lu,\"done\":%lu,"
+			"\"lost\":%lu,\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u,\"cc\":{",
+			i ? "," : "", c->name, c->netfn, c->cmd, c->sent, c->done, c->lost, 
+			c->pct[0], c->pct[1], c->pct[2], c->pct[3] );
+		for( j = 0, k = 0; j < 256; j++ ) {
+			if( c->cc[j] )
+				printf( "%s\"%02x\":%lu", k++ ? "," : "", j, c->cc[j] );
+		}
+		printf( "}}" );
+	}
+	printf( "],\"pass\":%s}\n", pass ? "true" : "false" );
+
+	return( pass ? ESUCCESS : EIO );
+}
+
+/* p50, p99, p99.9 and max of n samples sorted by latency */
+void load_test_pct( LOAD_TEST_SAMPLE *s, unsigned long n, unsigned *pct )
+{
+	if( !n ) {
+		memset( pct, 0, 4 * sizeof( unsigned ) );
+		return;
+	}
+	pct[0] = s[n / 2].us;
+	pct[1] = s[n * 99 / 100].us;
+	pct[2] = s[n * 999 / 1000].us;
+	pct[3] = s[n - 1].us;
+}
+
+int load_test_cmd_cmp( const void *a, const void *b )
+{
+	const LOAD_TEST_SAMPLE *x = a, *y = b;
+
+	if( x->cmd != y->cmd )
+		return( ( x->cmd > y->cmd ) - ( x->cmd < y->cmd ) );
+	return( ( x->us > y->us ) - ( x->us < y->us ) );
+}
+
+int load_test_us_cmp( const void *a, const void *b )
+{
+	const LOAD_TEST_SAMPLE *x = a, *y = b;
+
+	return( ( x->us > y->us ) - ( x->us < y->us ) );
+}
+
+/* us from a to b */
+unsigned load_test_us( struct timespec *a, struct timespec *b )
+{
+	return( ( b->tv_sec - a->tv_sec ) * 1000000 + ( b->tv_nsec - a->tv_nsec ) / 1000 );
+}
+
 /*==============================================================================
  * 			P R O T O C O L   H A N D L E R S
  *============================================================================*/
@@ -866,6 +2900,19 @@ void i2c_master_write( IPMI_WS *ws )
 	
 }
 
+void rmcpd_send( IPMI_WS *ws )
+/*----------------------------------------------------------------------------*/
+{
+	printf( "rmcpd_send\n" );
+	ws_free( ws );
+}
+
+/* debug.c is not linked, session.c logs through this */
+void dputstr( unsigned flags, char *str )
+/*----------------------------------------------------------------------------*/
+{
+}
+
 // retrieve data from all AMC cards in the system and fill the AMC_INFO struct
 void
 get_amc_data( void )
@@ -30,9 +30,12 @@ support and contact details.
 #include "ws.h"
 #include "sensor.h"
 #include "timer.h"
+#include "i2c.h"
+#include "error.h"
 #include "lm75.h"
 
 #define MAX_LM75_SENSOR_COUNT 2
+#define LM75_UPDATE_INTERVAL	( 10*HZ )	/* 10 sec between readings */
 unsigned char lm75_sensor_count = 0;
 unsigned char lm75_update_sensor_timer_handle;
 
@@ -42,10 +45,20 @@ typedef struct lm75_sensor_info {
 	unsigned char reading_lo;
 	unsigned char interface;
 	unsigned char i2c_addr;
+	unsigned char configured;	/* Configuration Register written */
+	unsigned char config[2];	/* Pointer and Configuration Register */
+	unsigned char pointer;		/* Pointer Register for readings */
+	unsigned char data[2];		/* Temperature Register as read */
 } LM75_SENSOR_INFO;
 
 LM75_SENSOR_INFO lm75_sensor[MAX_LM75_SENSOR_COUNT];
 
+/* one batch per channel, at most two transactions per sensor */
+I2C_BATCH lm75_batch[I2C_NUM_CHANNELS];
+I2C_XACT lm75_xact[I2C_NUM_CHANNELS][2 * MAX_LM75_SENSOR_COUNT];
+unsigned char lm75_xact_sensor[I2C_NUM_CHANNELS][2 * MAX_LM75_SENSOR_COUNT];
+unsigned char lm75_batch_pending;
+
 void lm75_update_sensor( unsigned char *arg );
 
 /*
@@ -108,14 +121,14 @@ typedef struct configuration_register {
 FULL_SENSOR_RECORD lm75sr;
 SENSOR_DATA lm75sd;
 
-void lm75_init_completion_function( IPMI_WS *ws, int status );
-void lm75_update_sensor_completion_function( IPMI_WS *ws, int status );
+void lm75_update_sensor_complete( I2C_BATCH *batch );
 
 /*
- * Initialization is a two step process; first write to the Configuration Register
- * to set the operating mode, when this completes send another write to set the
- * Pointer Register to Temperature Register. Subsequent reads will then return
- * the value of the Temperature Register.
+ * Sensors are read through I2C device batches, one per channel, so that
+ * polling all of them is one submit per bus. Each reading writes the
+ * Pointer Register and reads the Temperature Register after a repeated
+ * START. The Configuration Register is written by the first poll that
+ * gets through to the sensor.
  *
  * Returns the instance number of the sensor
  */
@@ -124,32 +137,31 @@ lm75_init(
 	unsigned char interface,
 	unsigned char i2c_addr )
 {
+	LM75_SENSOR_INFO *sensor;
 	POINTER_REGISTER *preg;
 	CONFIGURATION_REGISTER *creg;
-	IPMI_WS *req_ws;
 	
 	// lm75_init_sensor_record();
 
-	if( !( req_ws = ws_alloc() ) ) {
+	if( ( lm75_sensor_count >= MAX_LM75_SENSOR_COUNT ) 
+	    || ( interface >= I2C_NUM_CHANNELS ) )
 		return( -1 );
-	}
-	
-	if( lm75_sensor_count >= MAX_LM75_SENSOR_COUNT )
-		return( -1 );
-	
-	lm75_sensor_count++;
 	
 	// keep track of initialized sensors
-	lm75_sensor[lm75_sensor_count - 1].interface = interface;
-	lm75_sensor[lm75_sensor_count - 1].i2c_addr = i2c_addr;
-	lm75_sensor[lm75_sensor_count - 1].sensor_id = lm75_sensor_count - 1;
+	sensor = &lm75_sensor[lm75_sensor_count];
+	sensor->interface = interface;
+	sensor->i2c_addr = i2c_addr;
+	sensor->sensor_id = lm75_sensor_count;
+	sensor->configured = 0;
 	
-	// we're going to do a write of two byes, first byte is the pointer reg,
+	// the configuration write is two bytes, first byte is the pointer reg,
 	// the second the config register
-	preg = ( POINTER_REGISTER * )&( req_ws->pkt_out[0] );
+	sensor->config[0] = 0;
+	sensor->config[1] = 0;
+	preg = ( POINTER_REGISTER * )&( sensor->config[0] );
 	preg->register_select = REGSEL_CONFIG;
 	
-	creg = ( CONFIGURATION_REGISTER * )&( req_ws->pkt_out[1] );
+	creg = ( CONFIGURATION_REGISTER * )&( sensor->config[1] );
 	creg->shutdown_mode = 0;	// disable shutdown
 	creg->thermostat_mode = 0;	// use comparator mode
 	creg->polarity = 0;		// ALERT active low
@@ -157,14 +169,15 @@ lm75_init(
 	creg->conv_resolution = 3;	// 12 bits
 	creg->one_shot = 0;
 
-	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
-	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
-	req_ws->ipmi_completion_function = lm75_init_completion_function;
-	req_ws->addr_out = i2c_addr;
-	req_ws->interface = interface;
-	req_ws->len_out = 2;
+	// readings select the temperature register
+	sensor->pointer = 0;
+	preg = ( POINTER_REGISTER * )&( sensor->pointer );
+	preg->register_select = REGSEL_TEMP;
 
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	// the first sensor starts the periodic reads, the others join in
+	if( !lm75_sensor_count++ )
+		timer_add_callout_queue( ( void * )&lm75_update_sensor_timer_handle,
+	       		HZ, lm75_update_sensor, 0 );
 
 	return( lm75_sensor_count - 1 );
 }
@@ -253,71 +266,6 @@ lm75_init_sensor_record( void )
 }
 
 
-int
-lm75_update_sensor_reading( 
-	unsigned char interface,
-	unsigned char i2c_addr, 
-	unsigned char *sensor_data )
-{
-	IPMI_WS *req_ws;
-
-	if( !( req_ws = ws_alloc() ) ) {
-		return( -1 );
-	}
-	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
-	req_ws->incoming_protocol = IPMI_CH_PROTOCOL_IPMB;
-	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
-	req_ws->outgoing_channel = IPMI_CH_NUM_PRIMARY_IPMB;
-	req_ws->addr_out = i2c_addr;
-	req_ws->interface = interface;
-	req_ws->ipmi_completion_function = lm75_update_sensor_completion_function;
-	req_ws->len_rcv = 2;	/* amount of data we want to read */
-	
-	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_READ );
-		
-	return( 0 );
-}
-
-/* This function handles completion for two events:
- * 	- initial config write to lm75
- * 	- write to switch the register selector to the temperature register
- */
-void
-lm75_init_completion_function( IPMI_WS *ws, int status )
-{
-	POINTER_REGISTER *preg;
-	unsigned char sensor_id;
-
-	preg = (POINTER_REGISTER *)&(ws->pkt_out[0]);
-	
-	if( preg->register_select == REGSEL_CONFIG ) {
-		// if we completed initial config write to lm75, 
-		// switch the register selector to the temperature register
-		preg->register_select = REGSEL_TEMP;
-		ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
-		ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
-		ws->ipmi_completion_function = lm75_init_completion_function;
-		ws->len_out = 1;
-		ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
-	} else 	if( preg->register_select == REGSEL_TEMP ) {
-		// we completed a write to switch the register 
-		// selector to the temperature register
-		
-		// find sensor id 
-		for( sensor_id = 0; sensor_id < lm75_sensor_count; sensor_id++ ) {
-			if( ( lm75_sensor[sensor_id].interface == ws->interface ) &&
-			    ( lm75_sensor[sensor_id].i2c_addr == ws->addr_out ) ) {
-				break;
-			    }
-		}
-		ws_free( ws );
-		// Register a callout to read temp sensors periodically			
-		timer_add_callout_queue( ( void * )&lm75_update_sensor_timer_handle,
-	       		10*HZ, lm75_update_sensor, ( unsigned char * )&lm75_sensor[sensor_id] ); /* 10 sec timeout */
-	}
-}
-
 /*
 The Temperature Register is a 12-bit, read-only register that stores the output
 of the most recent conversion. Two bytes must be read to obtain data.
@@ -328,51 +276,77 @@ the first conversion is complete.
 void
 lm75_update_sensor( unsigned char *arg )
 {
-	IPMI_WS *req_ws;
-	LM75_SENSOR_INFO *lm75_sensor = ( LM75_SENSOR_INFO * )arg;
-
-	if( !( req_ws = ws_alloc() ) ) {
-		return;
+	LM75_SENSOR_INFO *sensor;
+	I2C_BATCH *batch;
+	I2C_XACT *xact;
+	unsigned char channel, sensor_id;
+
+	for( channel = 0; channel < I2C_NUM_CHANNELS; channel++ ) {
+		batch = &lm75_batch[channel];
+		batch->count = 0;
+		for( sensor_id = 0; sensor_id < lm75_sensor_count; sensor_id++ ) {
+			sensor = &lm75_sensor[sensor_id];
+			if( sensor->interface != channel )
+				continue;
+			if( !sensor->configured ) {
+				lm75_xact_sensor[channel][batch->count] = sensor_id;
+				xact = &lm75_xact[channel][batch->count++];
+				xact->addr = sensor->i2c_addr;
+				xact->wbuf = sensor->config;
+				xact->wlen = 2;
+				xact->rlen = 0;
+			}
+			lm75_xact_sensor[channel][batch->count] = sensor_id;
+			xact = &lm75_xact[channel][batch->count++];
+			xact->addr = sensor->i2c_addr;
+			xact->wbuf = &sensor->pointer;
+			xact->wlen = 1;
+			xact->rbuf = sensor->data;
+			xact->rlen = 2;
+		}
+		if( !batch->count )
+			continue;
+		batch->channel = channel;
+		batch->xact = lm75_xact[channel];
+		batch->complete = lm75_update_sensor_complete;
+		if( i2c_batch_submit( batch ) == ESUCCESS )
+			lm75_batch_pending++;
 	}
 
-	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
-	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
-	req_ws->ipmi_completion_function = lm75_update_sensor_completion_function;
-	req_ws->addr_out = lm75_sensor->i2c_addr;
-	req_ws->interface = lm75_sensor->interface;
-	req_ws->len_in = 2;
-
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_READ );
+	// nothing went out, try again next time
+	if( !lm75_batch_pending )
+		timer_add_callout_queue( ( void * )&lm75_update_sensor_timer_handle,
+	       		LM75_UPDATE_INTERVAL, lm75_update_sensor, 0 );
 }
 
 
 void
-lm75_update_sensor_completion_function( IPMI_WS *ws, int status )
+lm75_update_sensor_complete( I2C_BATCH *batch )
 {
-	unsigned char sensor_id;
-
-	// find sensor id 
-	for( sensor_id = 0; sensor_id < lm75_sensor_count; sensor_id++ ) {
-		if( ( lm75_sensor[sensor_id].interface == ws->interface ) &&
-		    ( lm75_sensor[sensor_id].i2c_addr == ws->addr_out ) ) {
-			break;
-	    	}
-	}
-	
-	switch ( status ) {
-		case XPORT_REQ_NOERR:
-			lm75_sensor[sensor_id].reading_hi = ws->pkt_in[0]; 
-			lm75_sensor[sensor_id].reading_lo = ws->pkt_in[1]; 			
-			break;
-		case XPORT_REQ_ERR:
-		case XPORT_RESP_NOERR:
-		case XPORT_RESP_ERR:
-		default:
-			lm75_sensor[sensor_id].reading_hi = 0; 
-			lm75_sensor[sensor_id].reading_lo = 0; 			
-			break;
+	LM75_SENSOR_INFO *sensor;
+	I2C_XACT *xact;
+	unsigned char i;
+
+	for( i = 0; i < batch->count; i++ ) {
+		xact = &batch->xact[i];
+		sensor = &lm75_sensor[lm75_xact_sensor[batch->channel][i]];
+		if( !xact->rlen ) {
+			// configuration write
+			if( xact->status == I2ERR_NOERR )
+				sensor->configured = 1;
+		} else if( xact->status == I2ERR_NOERR ) {
+			sensor->reading_hi = sensor->data[0]; 
+			sensor->reading_lo = sensor->data[1]; 			
+		} else {
+			sensor->reading_hi = 0; 
+			sensor->reading_lo = 0; 			
+		}
 	}
-	ws_free( ws );
+
+	// every bus is done, schedule the next round
+	if( !--lm75_batch_pending )
+		timer_add_callout_queue( ( void * )&lm75_update_sensor_timer_handle,
+	       		LM75_UPDATE_INTERVAL, lm75_update_sensor, 0 );
 }
 
 
@@ -26,7 +26,11 @@ support and contact details.
 #ifndef lpc210x_h
 #define lpc210x_h
 
+#if defined (POSIX)
+#include "posix.h"	/* registers live in a simulated register file */
+#else
 #define REG32 (volatile unsigned int*)
+#endif
 
 #define VICIRQStatus    (*(REG32 (0xFFFFF000)))
 #define VICFIQStatus    (*(REG32 (0xFFFFF004)))
@@ -32,6 +32,10 @@ support and contact details.
 #include "serial.h"
 #include "i2c.h"
 #include "iopin.h"
+#include "sched.h"
+#if defined (POSIX)
+#include "rmcpd.h"
+#endif
 
 extern unsigned long lbolt;
 /*==============================================================
@@ -40,6 +44,7 @@ extern unsigned long lbolt;
 int main()
 {
 	unsigned long time;
+	unsigned work;
 
 	/* Initialize system */
 	ws_init();
@@ -55,17 +60,33 @@ int main()
 	
 	time = lbolt;
 	
-	/* Do forever */
+	/* Do forever. sched_get_work() idles the CPU until an interrupt
+	 * posts work, ready sources are serviced in priority order. */
 	while( 1 )
 	{
-		/* Blink system activity LEDs once every second */
-		if( ( time + 2 ) < lbolt ) {
-			time = lbolt;
-			gpio_toggle_activity_led();
+		work = sched_get_work();
+		
+		if( work & SCHED_WS )
+			ws_process_work_list();
+		
+		if( work & SCHED_I2C )
+			i2c_batch_process();
+		
+		if( work & SCHED_TIMER ) {
+			/* Blink system activity LEDs once every second */
+			if( ( time + 2 ) < lbolt ) {
+				time = lbolt;
+				gpio_toggle_activity_led();
+			}
+			timer_process_callout_queue();
 		}
-		ws_process_work_list();
-		terminal_process_work_list();
-		timer_process_callout_queue();
+		
+		if( work & SCHED_TERMINAL )
+			terminal_process_work_list();
+#if defined (POSIX)
+		if( work & SCHED_LAN )
+			rmcpd_flush();
+#endif
 	}
 }
 
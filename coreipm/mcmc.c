@@ -41,6 +41,8 @@ support and contact details.
 #include "stdio.h"
 #include "req.h"
 #include "timer.h"
+#include "seq.h"
+#include "error.h"
 
 #ifndef uchar
 #define uchar unsigned char
@@ -99,6 +101,7 @@ unsigned discovery_cmd_retry_timer_handle;
 
 void module_init2( void );
 void cmd_complete( IPMI_WS *ws, int status );
+void led_cmd_complete( IPMI_WS *ws, int status );
 void send_set_fru_led_state( uchar ipmi_ch, uchar dev_addr, uchar led_state, 
 		void( *completion_function )( void *, int ) );
 void send_get_device_id( uchar ipmi_ch, uchar dev_addr, 
@@ -505,10 +508,13 @@ send_amc_set_port_state( uchar ipmi_ch, uchar dev_addr, void( *completion_functi
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( SET_AMC_PORT_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( SET_AMC_PORT_STATE_CMD_REQ ) - 1;
@@ -543,7 +549,6 @@ send_amc_set_port_state( uchar ipmi_ch, uchar dev_addr, void( *completion_functi
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -551,7 +556,7 @@ send_amc_set_port_state( uchar ipmi_ch, uchar dev_addr, void( *completion_functi
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 /*
@@ -578,10 +583,13 @@ send_set_fru_led_state( uchar ipmi_ch, uchar dev_addr, uchar led_state, void( *c
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( SET_FRU_LED_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( SET_FRU_LED_STATE_CMD_REQ ) - 1;
@@ -629,7 +637,6 @@ send_set_fru_led_state( uchar ipmi_ch, uchar dev_addr, uchar led_state, void( *c
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -637,7 +644,7 @@ send_set_fru_led_state( uchar ipmi_ch, uchar dev_addr, uchar led_state, void( *c
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 // note this is module specific
@@ -678,10 +685,13 @@ send_get_device_id( uchar ipmi_ch, uchar dev_addr, void( *completion_function )(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GENERIC_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GENERIC_CMD_REQ ) - 1;
@@ -707,7 +717,6 @@ send_get_device_id( uchar ipmi_ch, uchar dev_addr, void( *completion_function )(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -715,7 +724,7 @@ send_get_device_id( uchar ipmi_ch, uchar dev_addr, void( *completion_function )(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -733,10 +742,13 @@ send_get_fru_inventory_area_info( uchar ipmi_ch, uchar dev_addr, void( *completi
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_FRU_INVENTORY_AREA_INFO_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_FRU_INVENTORY_AREA_INFO_CMD_REQ ) - 1;
@@ -762,7 +774,6 @@ send_get_fru_inventory_area_info( uchar ipmi_ch, uchar dev_addr, void( *completi
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -770,7 +781,7 @@ send_get_fru_inventory_area_info( uchar ipmi_ch, uchar dev_addr, void( *completi
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -793,10 +804,13 @@ send_read_fru_data( uchar ipmi_ch,
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( READ_FRU_DATA_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( READ_FRU_DATA_CMD_REQ ) - 1;
@@ -826,7 +840,6 @@ send_read_fru_data( uchar ipmi_ch,
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -834,7 +847,7 @@ send_read_fru_data( uchar ipmi_ch,
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -856,10 +869,13 @@ send_fru_control( uchar ipmi_ch,
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( FRU_CONTROL_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( FRU_CONTROL_CMD_REQ ) - 1;
@@ -888,7 +904,6 @@ send_fru_control( uchar ipmi_ch,
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -896,7 +911,7 @@ send_fru_control( uchar ipmi_ch,
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -917,10 +932,13 @@ send_get_picmg_properties( uchar ipmi_ch,
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_PICMG_PROPERTIES_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_PICMG_PROPERTIES_CMD_REQ ) - 1;
@@ -947,7 +965,6 @@ send_get_picmg_properties( uchar ipmi_ch,
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -955,7 +972,7 @@ send_get_picmg_properties( uchar ipmi_ch,
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -978,10 +995,13 @@ send_get_sensor_reading(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_SENSOR_READING_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_SENSOR_READING_CMD_REQ ) - 1;
@@ -1008,7 +1028,6 @@ send_get_sensor_reading(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1016,7 +1035,7 @@ send_get_sensor_reading(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1042,10 +1061,13 @@ send_get_device_sdr_info(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_DEVICE_SDR_INFO_CMD * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_DEVICE_SDR_INFO_CMD ) - 1;
@@ -1072,7 +1094,6 @@ send_get_device_sdr_info(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1080,7 +1101,7 @@ send_get_device_sdr_info(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void	
@@ -1102,10 +1123,13 @@ send_get_device_sdr(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_DEVICE_SDR_CMD * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_DEVICE_SDR_CMD ) - 1;
@@ -1141,7 +1165,6 @@ send_get_device_sdr(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1149,7 +1172,7 @@ send_get_device_sdr(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1170,10 +1193,13 @@ send_reserve_device_sdr_repository(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GENERIC_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GENERIC_CMD_REQ ) - 1;
@@ -1199,7 +1225,6 @@ send_reserve_device_sdr_repository(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1207,7 +1232,7 @@ send_reserve_device_sdr_repository(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1228,10 +1253,13 @@ send_get_fru_led_properties(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_LED_PROPERTIES_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_LED_PROPERTIES_CMD_REQ ) - 1;
@@ -1259,7 +1287,6 @@ send_get_fru_led_properties(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1267,7 +1294,7 @@ send_get_fru_led_properties(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1289,10 +1316,13 @@ send_get_led_color_capabilities(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_LED_COLOR_CAPABILITIES_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_LED_COLOR_CAPABILITIES_CMD_REQ ) - 1;
@@ -1321,7 +1351,6 @@ send_get_led_color_capabilities(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1329,7 +1358,7 @@ send_get_led_color_capabilities(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -1351,10 +1380,13 @@ send_get_fru_led_state(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_FRU_LED_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_FRU_LED_STATE_CMD_REQ ) - 1;
@@ -1384,7 +1416,6 @@ send_get_fru_led_state(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1392,7 +1423,7 @@ send_get_fru_led_state(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -1414,10 +1445,13 @@ send_get_device_locator_record_id(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_DEVICE_LOCATOR_RECORD_ID_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_DEVICE_LOCATOR_RECORD_ID_CMD_REQ ) - 1;
@@ -1445,7 +1479,6 @@ send_get_device_locator_record_id(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1453,7 +1486,7 @@ send_get_device_locator_record_id(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -1475,10 +1508,13 @@ send_get_amc_port_state(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_AMC_PORT_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_AMC_PORT_STATE_CMD_REQ ) - 1;
@@ -1509,7 +1545,6 @@ send_get_amc_port_state(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1517,7 +1552,7 @@ send_get_amc_port_state(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -1539,10 +1574,13 @@ send_set_amc_port_state(
 	}
 
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( SET_AMC_PORT_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( SET_AMC_PORT_STATE_CMD_REQ ) - 1;
@@ -1582,7 +1620,6 @@ send_set_amc_port_state(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1590,7 +1627,7 @@ send_set_amc_port_state(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -1612,10 +1649,13 @@ send_set_amc_clock_state(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( SET_CLOCK_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( SET_CLOCK_STATE_CMD_REQ ) - 1;
@@ -1651,7 +1691,6 @@ send_set_amc_clock_state(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1659,7 +1698,7 @@ send_set_amc_clock_state(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1680,10 +1719,13 @@ send_get_amc_clock_state(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( GET_CLOCK_STATE_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( GET_CLOCK_STATE_CMD_REQ ) - 1;
@@ -1712,7 +1754,6 @@ send_get_amc_clock_state(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1720,7 +1761,7 @@ send_get_amc_clock_state(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 void
@@ -1741,10 +1782,13 @@ send_get_fru_control_capabilities(
 	}
 	
 	pkt = &( req_ws->pkt );
-	ipmb_req = ( IPMI_IPMB_REQUEST * )&( req_ws->pkt_out );
+	ipmb_req = ( IPMI_IPMB_REQUEST * )( req_ws->pkt_out );
 	pkt->req = ( IPMI_CMD_REQ * )&( ipmb_req->command ) ;
 	req = ( FRU_CONTROL_CAPABILITIES_CMD_REQ * )pkt->req;	
-	ipmi_get_next_seq( &seq );
+	if( seq_alloc( req_ws, dev_addr, &seq ) != ESUCCESS ) {
+		ws_free( req_ws );
+		return;
+	}
 
 	pkt->hdr.ws = (char *)req_ws;
 	pkt->hdr.req_data_len = sizeof( FRU_CONTROL_CAPABILITIES_CMD_REQ ) - 1;
@@ -1772,7 +1816,6 @@ send_get_fru_control_capabilities(
 	/* Assign the checksum to it's proper location */
 	*( ( uchar * )ipmb_req + req_ws->len_out - 1 ) = ipmb_req->data_checksum; 
 
-	req_ws->ipmi_completion_function = completion_function;
 	req_ws->addr_out = dev_addr;
 	req_ws->outgoing_protocol = IPMI_CH_PROTOCOL_IPMB;
 	req_ws->outgoing_medium = IPMI_CH_MEDIUM_IPMB;
@@ -1780,7 +1823,7 @@ send_get_fru_control_capabilities(
 	dump_outgoing( req_ws );
 
 	/* dispatch the request */
-	ws_set_state( req_ws, WS_ACTIVE_MASTER_WRITE );
+	seq_send( req_ws, completion_function );
 }
 
 
@@ -2126,11 +2169,12 @@ module_event_handler( IPMI_PKT *pkt )
 	PLATFORM_EVENT_MESSAGE_CMD_REQ	*req = ( PLATFORM_EVENT_MESSAGE_CMD_REQ * )pkt->req;
 	GENERIC_EVENT_MSG *evt_msg = ( GENERIC_EVENT_MSG * )&( req->EvMRev );
 
-	uchar dev_id, dev_addr = (( IPMI_WS * )(pkt->hdr.ws))->incoming_channel;
+	IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )( (( IPMI_WS * )(pkt->hdr.ws))->pkt_in );
+	uchar dev_id, dev_addr = ipmb_req->requester_slave_addr;
 	
 	dev_id = lookup_dev_id( dev_addr );
 	
-	if( evt_msg->sensor_type == IPMI_SENSOR_HOT_SWAP ) {
+	if( evt_msg->sensor_type == IPMI_SENSOR_MODULE_HOT_SWAP ) {
 		switch( evt_msg->evt_data1 ) {
 			case MODULE_HANDLE_CLOSED:
 				mcmc_mmc_event( dev_id, AMC_EVT_HANDLE_CLOSED_MSG_RCVD );
@@ -2180,7 +2224,7 @@ mcmc_mmc_event( uchar dev_id, uchar event )
 			 * with a request to perform long blinks of the
 			 * BLUE LED, indicating to the operator that the
 			 * new Module is waiting to be activated. */
-			send_set_fru_led_state( IPMI_CH_NUM_IPMBL, dev_addr, LED_LONG_BLINK, cmd_complete );
+			send_set_fru_led_state( IPMI_CH_NUM_IPMBL, dev_addr, LED_LONG_BLINK, led_cmd_complete );
 			amc[dev_id].state = AMC_STATE_M2_LED_LONG_BLINK_SENT;
 			break;
 		case	AMC_EVT_SET_LED_STATE_CMD_OK:
@@ -2202,7 +2246,7 @@ mcmc_mmc_event( uchar dev_id, uchar event )
 		case	AMC_EVT_DEVICE_DISCOVERY_OK:
 			// TODO check the fru power record, enable power if within limits
 			if( amc[dev_id].state == AMC_STATE_M2_DEVICE_DISCOVERY_STARTED ) {
-				send_set_fru_led_state( IPMI_CH_NUM_IPMBL, dev_addr, LED_OFF, cmd_complete );
+				send_set_fru_led_state( IPMI_CH_NUM_IPMBL, dev_addr, LED_OFF, led_cmd_complete );
 				amc[dev_id].state = AMC_STATE_M2_LED_OFF_SENT;
 			}
 			break;
@@ -2312,12 +2356,31 @@ device_discovery( uchar dev_id )
 }
 
 
+/* restart discovery of a device we lost contact with */
 void
 discovery_cmd_retry( uchar *arg )
 {
-	IPMI_WS *ws = ( IPMI_WS * )arg;
+	device_discovery( ( uchar )( unsigned long )arg );
+}
+
+/*
+ * led_cmd_complete()
+ * 
+ * Completion function for Set FRU LED State, moves the module state 
+ * machine along once the MMC has answered.
+ */
+void
+led_cmd_complete( IPMI_WS *ws, int status )
+{
+	uchar dev_id = lookup_dev_id( ws->addr_out );
 
-	ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
+	if( ( status == XPORT_RESP_NOERR ) 
+	    && ( ws->pkt.resp->completion_code == CC_NORMAL ) ) {
+		ws_free( ws );
+		mcmc_mmc_event( dev_id, AMC_EVT_SET_LED_STATE_CMD_OK );
+		return;
+	}
+	ws_free( ws );
 }
 
 
@@ -2325,23 +2388,26 @@ discovery_cmd_retry( uchar *arg )
 /*
  * discovery_cmd_complete()
  * 
- * Completion function for discovery commands 
+ * Completion function for discovery commands. ws is the request, 
+ * pkt->resp the response to it. The requests are tracked so every
+ * device being discovered can have one outstanding at the same time.
  */
 void
 discovery_cmd_complete( IPMI_WS *ws, int status )
 {
 	IPMI_PKT *pkt = &ws->pkt;
-	IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )&( ws->pkt_in );
+	IPMI_IPMB_REQUEST *ipmb_req = ( IPMI_IPMB_REQUEST * )( ws->pkt_out );
 	uchar dev_id, rec_id = 0, dev_addr;
 	uchar ipmi_ch = IPMI_CH_NUM_IPMBL;
 
-	dev_addr = ipmb_req->requester_slave_addr;
+	dev_addr = ws->addr_out;
 	dev_id = lookup_dev_id( dev_addr );
 
-	if( status != XPORT_REQ_NOERR ) {
-		// add to timeout queue to retry in a few secs
+	if( status != XPORT_RESP_NOERR ) {
+		// the request has already been retried, start over in a few secs
+		ws_free( ws );
 		timer_add_callout_queue( (void *)&discovery_cmd_retry_timer_handle,
-	       		10*HZ, discovery_cmd_retry,( uchar * )ws ); /* 10 sec timeout */
+	       		10*HZ, discovery_cmd_retry,( uchar * )( unsigned long )dev_id ); /* 10 sec timeout */
 		
 		// TODO we should prevent other commands being issued to this device
 		// or cancel the discovery process at some point if we want to do something
@@ -2350,7 +2416,7 @@ discovery_cmd_complete( IPMI_WS *ws, int status )
 		return;
 	}
 
-	switch( ( pkt->hdr.netfn << 8 ) | pkt->req->command ) {
+	switch( ( ipmb_req->netfn << 8 ) | pkt->req->command ) {
 		case APP_CMD_GET_DEVICE_ID:
 			// copy data to amc.device_id
 			memcpy( &amc[dev_id].device_id, pkt->resp, sizeof( GET_DEVICE_ID_CMD_RESP ) );
@@ -122,119 +122,6 @@ void picmg_get_ipmb_link_info( IPMI_PKT * );
  * 	Get Power Level
  * 	Get Fan Speed Properties
  */
-void
-picmg_process_command( IPMI_PKT *pkt )
-{
-#ifdef PICMG
-	PICMG_CMD_RESP	*resp = ( PICMG_CMD_RESP * )pkt->resp;
-	/* Ignore checking PICMG Identifier for the time being. 
-	 * Indicates that this is a PICMG-defined group
-	 * extension command. A value of 00h shall be used.
-	 */
-	dprintf( DBG_IPMI | DBG_INOUT, "picmg_process_command: ingress\n" );
-
-	switch( pkt->req->command ) {
-		case ATCA_CMD_GET_PICMG_PROPERTIES:	/* Get PICMG Properties */
-			picmg_get_picmg_properties( pkt );
-			break;
-		case ATCA_CMD_GET_ADDRESS_INFO:		/* Get Address Info */
-			picmg_get_address_info( pkt );
-			break;
-		case ATCA_CMD_GET_SHELF_ADDRESS_INFO:	/* Get Shelf Address Info */
-			picmg_get_shelf_address_info( pkt );
-			break;
-		case ATCA_CMD_SET_SHELF_ADDRESS_INFO:	/* Set Shelf Address Info */
-			picmg_set_shelf_address_info( pkt );
-			break;
-		case ATCA_CMD_FRU_CONTROL:		/* FRU Control */
-			picmg_fru_control( pkt );
-			break;
-		case ATCA_CMD_GET_FRU_LED_PROPERTIES:	/* Get FRU LED Properties */
-			picmg_get_fru_led_properties( pkt );
-			break;
-		case ATCA_CMD_GET_LED_COLOR:		/* Get LED Color Capabilities */
-			picmg_get_led_color_capabilities( pkt );
-			break;
-		case ATCA_CMD_SET_FRU_LED_STATE:	/* Set FRU LED State */
-			picmg_set_fru_led_state( pkt );
-			break;
-		case ATCA_CMD_GET_FRU_LED_STATE:	/* Get FRU LED State */
-			picmg_get_fru_led_state( pkt );
-			break;
-		case ATCA_CMD_SET_IPMB_STATE:		/* Set IPMB State */
-			picmg_set_ipmb_state( pkt );
-			break;
-		case ATCA_CMD_SET_FRU_ACTIVATION_POLICY:	/* Set FRU Activation Policy */
-			picmg_set_fru_activation_policy( pkt );
-			break;
-		case ATCA_CMD_GET_FRU_ACTIVATION_POLICY:	/* Get FRU Activation Policy */
-			picmg_get_fru_activation_policy( pkt );
-			break;
-		case ATCA_CMD_SET_FRU_ACTIVATION:	/* Set FRU Activation */
-			picmg_set_fru_activation( pkt );
-			break;
-		case ATCA_CMD_GET_DEVICE_LOCATOR_REC_ID:	/* Get Device Locator Record ID */
-			picmg_get_device_locator_rec_id( pkt );
-			break;
-		case ATCA_CMD_SET_PORT_STATE:		/* Set Port State */
-			picmg_set_port_state( pkt );
-			break;
-		case ATCA_CMD_GET_PORT_STATE:		/* Get Port State */
-			picmg_get_port_state( pkt );
-			break;
-		case ATCA_CMD_COMPUTE_POWER_PROPERTIES:	/* Compute Power Properties */
-			picmg_compute_power_properties( pkt );
-			break;
-		case ATCA_CMD_SET_POWER_LEVEL:		/* Set Power Level */
-			picmg_set_power_level( pkt );
-			break;
-		case ATCA_CMD_GET_POWER_LEVEL:		/* Get Power Level */
-			picmg_get_power_level( pkt );
-			break;
-		case ATCA_CMD_RENEGOTIATE_POWER:	/* Renegotiate Power */
-			picmg_renegotiate_power( pkt );
-			break;
-		case ATCA_CMD_GET_FAN_SPEED_PROPERTIES:	/* Get Fan Speed Properties */
-			picmg_get_fan_speed_properties( pkt );
-			break;
-		case ATCA_CMD_SET_FAN_LEVEL:		/* Set Fan Level */
-			picmg_set_fan_level( pkt );
-			break;
-		case ATCA_CMD_GET_FAN_LEVEL:		/* Get Fan Level */
-			picmg_get_fan_level( pkt );
-			break;
-		case ATCA_CMD_BUSED_RESOURCE_CONTROL:		/* Bused Resource */
-			picmg_bused_resource_control( pkt );
-			break;
-		case ATCA_CMD_GET_IPMB_LINK_INFO:	/* Get IPMB Link Info */
-			picmg_get_ipmb_link_info( pkt );
-			break;
-#ifdef MMC
-		case ATCA_CMD_FRU_CONTROL_CAPABILITIES:	/* FRU control capabilities */
-			mmc_get_fru_control_capabilities( pkt );
-			break;
-		case ATCA_CMD_SET_AMC_PORT_STATE:
-			mmc_set_port_state( pkt );
-			break;
-		case ATCA_CMD_GET_AMC_PORT_STATE:
-			mmc_get_port_state( pkt );
-			break;
-		case ATCA_CMD_SET_CLOCK_STATE:
-			mmc_set_clock_state( pkt );
-			break;
-		case ATCA_CMD_GET_CLOCK_STATE:
-			mmc_get_clock_state( pkt );
-			break;
-#endif
-		default:
-			resp->completion_code = CC_INVALID_CMD;
-			resp->picmg_id = PICMG_ID;
-			pkt->hdr.resp_data_len = 0;
-    			break;	
-	} /* end switch */
-#endif
-}
-
 #ifdef PICMG
 void
 picmg_get_picmg_properties( IPMI_PKT *pkt )
@@ -1261,15 +1148,16 @@ picmg_set_ipmb_state( IPMI_PKT *pkt )
 
 	dprintf( DBG_IPMI | DBG_INOUT, "picmg_set_ipmb_state: ingress\n" );
 
-	if( req->ipmb_a_state )
-		i2c_interface_enable_local_control( 0, req->ipmb_a_link_id );
-	else
+	/* a byte of FFh leaves that IPMB as it is */
+	if( !req->ipmb_a_state )
 		i2c_interface_disable( 0, req->ipmb_a_link_id );
+	else if( req->ipmb_a_link_id != IPMB_STATE_NO_CHANGE )
+		i2c_interface_enable_local_control( 0, req->ipmb_a_link_id );
 
-	if( req->ipmb_b_state )
-		i2c_interface_enable_local_control( 1, req->ipmb_b_link_id );
-	else
+	if( !req->ipmb_b_state )
 		i2c_interface_disable( 1, req->ipmb_b_link_id );
+	else if( req->ipmb_b_link_id != IPMB_STATE_NO_CHANGE )
+		i2c_interface_enable_local_control( 1, req->ipmb_b_link_id );
 
 	resp->picmg_id = PICMG_ID;
 	resp->completion_code = CC_NORMAL;
@@ -24,7 +24,6 @@ support and contact details.
 -------------------------------------------------------------------------------
 */
 
-void picmg_process_command( IPMI_PKT *pkt );
 void picmg_get_address_info( IPMI_PKT *pkt );
 void picmg_get_shelf_address_info( IPMI_PKT *pkt );
 void picmg_set_shelf_address_info( IPMI_PKT *pkt );
@@ -44,7 +43,7 @@ void picmg_renegotiate_power( IPMI_PKT *pkt );
 void picmg_get_fan_speed_properties( IPMI_PKT *pkt );
 void picmg_set_fan_level( IPMI_PKT *pkt );
 void picmg_get_fan_level( IPMI_PKT *pkt );
-void picmg_bused_resource( IPMI_PKT *pkt );
+void picmg_bused_resource_control( IPMI_PKT *pkt );
 void picmg_get_ipmb_link_info( IPMI_PKT *pkt );
 void picmg_get_device_locator_rec_id( IPMI_PKT *pkt );
 void picmg_get_picmg_properties( IPMI_PKT *pkt );
@@ -0,0 +1,1261 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/posix.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+POSIX host port
+
+Lets the firmware run as a Linux process so that the real ipmi_process_pkt(),
+callout queue and ws paths can be profiled and load tested on a workstation.
+
+- Registers: every REG32 access goes through posix_reg(), which hands out a
+  word in a small register file. Drivers that only configure the chip run
+  unchanged. GPIO pins read back whatever iopin_set()/iopin_clear() wrote
+  and float high until then. The geographic address straps are set with
+  COREIPM_GA.
+- Clock: lbolt is driven from CLOCK_MONOTONIC by sched.c, the microsecond
+  timers run off a timerfd, see TIMER1 below.
+- IPMB: each controller binds a datagram socket named after its slave 
+  address (POSIX_IPMB_PATH). A master write is one datagram holding the
+  bytes that follow the slave address on the wire, sending to an address
+  nobody has bound is a NAK. With IPMB_BUS set, frames go through the
+  bus simulator (ipmb_sim.c) which models the shared medium. There a 
+  write is timed until the bus acknowledges it and times out like it
+  does in i2c.c. Master reads and device batches are not simulated, 
+  nothing answers them.
+- Console: serial.c runs on simulated UARTs. The debug port is stdout, or
+  with COREIPM_CONSOLE set a pseudo-terminal for ipmi_test, screen and the
+  like, see UARTS below. COREIPM_CONSOLE_BAUD sets the line speed, 
+  COREIPM_CONSOLE_LOG names a file for the per message timing and 
+  COREIPM_DEBUG the global_debug_setting mask, in hex.
+- LAN: with COREIPM_RMCP_PORT set, IPMI over LAN on that UDP port, see
+  rmcpd.c.
+
+This file replaces i2c.c and iopin.c in the host build.
+*/
+
+#define _GNU_SOURCE		/* fopencookie() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "arch.h"
+#include "ipmi.h"
+#include "ws.h"
+#include "i2c.h"
+#include "i2ctime.h"
+#include "timer.h"
+#include "iopin.h"
+#include "moduleio.h"
+#include "module.h"
+#include "serial.h"
+#include "debug.h"
+#include "error.h"
+#include "sched.h"
+#include "rmcpd.h"
+
+/*==============================================================
+ * REGISTER FILE
+ *==============================================================*/
+#define POSIX_REG_COUNT		512	/* power of 2 */
+
+#define POSIX_IOPIN0		0xE0028000
+#define POSIX_IOPIN1		0xE0028010
+
+typedef struct posix_reg_entry {
+	unsigned long addr;
+	unsigned int value;
+} POSIX_REG_ENTRY;
+
+POSIX_REG_ENTRY posix_reg_file[POSIX_REG_COUNT];
+unsigned posix_reg_count;
+
+/*==============================================================
+ * posix_reg()
+ * 	Return the simulated register at addr, creating it on 
+ * 	first use.
+ *==============================================================*/
+volatile unsigned int *
+posix_reg( unsigned long addr )
+{
+	unsigned i = ( addr >> 2 ) & ( POSIX_REG_COUNT - 1 );
+
+	while( posix_reg_file[i].addr != addr ) {
+		if( !posix_reg_file[i].addr ) {
+			if( ++posix_reg_count >= POSIX_REG_COUNT ) {
+				fprintf( stderr, "posix_reg: register file full\n" );
+				exit( EXIT_FAILURE );
+			}
+			posix_reg_file[i].addr = addr;
+			/* inputs are pulled up */
+			if( ( addr == POSIX_IOPIN0 ) || ( addr == POSIX_IOPIN1 ) )
+				posix_reg_file[i].value = 0xffffffff;
+			break;
+		}
+		i = ( i + 1 ) & ( POSIX_REG_COUNT - 1 );
+	}
+	return( &posix_reg_file[i].value );
+}
+
+/*==============================================================
+ * IOPIN
+ *==============================================================*/
+void
+iopin_set( unsigned long long bit )
+{
+	*posix_reg( POSIX_IOPIN1 ) |= ( unsigned )( bit >> 32 );
+	*posix_reg( POSIX_IOPIN0 ) |= ( unsigned )bit;	
+}
+
+void
+iopin_clear( unsigned long long bit )
+{
+	*posix_reg( POSIX_IOPIN1 ) &= ~( unsigned )( bit >> 32 );
+	*posix_reg( POSIX_IOPIN0 ) &= ~( unsigned )bit;	
+}
+
+/* Geographic address straps. COREIPM_GA holds one of G(rounded), 
+ * U(nconnected) or P(ulled up) for each of GA0, GA1 and GA2, an 
+ * unconnected pin follows the P1 output. */
+char *posix_ga;
+
+unsigned char
+iopin_get( unsigned long long bit )
+{
+	unsigned long long ga[3] = { GA0, GA1, GA2 };
+	int i;
+
+	if( posix_ga || ( posix_ga = getenv( "COREIPM_GA" ) ) ) {
+		for( i = 0; ( i < 3 ) && posix_ga[i]; i++ ) {
+			if( bit != ga[i] )
+				continue;
+			switch( posix_ga[i] ) {
+				case 'G': return( 0 );
+				case 'P': return( 1 );
+				case 'U': return( iopin_get( P1 ) );
+			}
+		}
+	}
+
+	if( bit >= 0x100000000ULL )
+		return( ( *posix_reg( POSIX_IOPIN1 ) & ( unsigned )( bit >> 32 ) ) ? 1 : 0 );
+	else
+		return( ( *posix_reg( POSIX_IOPIN0 ) & ( unsigned )bit ) ? 1 : 0 );
+}
+
+void
+iopin_assign( unsigned long long bit, unsigned long long mask )
+{
+	iopin_clear( mask & ~bit );
+	iopin_set( mask & bit );
+}
+
+/*==============================================================
+ * IPMB
+ *==============================================================*/
+#define MAX_DELIVERY_ATTEMPTS 1
+
+unsigned int local_i2c_address;
+unsigned int remote_i2c_address;
+int posix_ipmb_fd = -1;
+int posix_ipmb_enabled = 1;
+void ( *i2c_slave_receive_callback )( void *, int ) = 0;
+I2C_STATS i2c_stats[I2C_NUM_CHANNELS];	/* everything goes on channel 0 */
+
+/* With IPMB_BUS set in the environment frames go through the bus 
+ * simulator at that path instead of straight to the peer. The bus
+ * answers every frame with an ACK or NAK once it has been clocked
+ * out, writes wait their turn in posix_ipmb_txq until then. The one
+ * on the bus is at the head, the rest go by transmit priority. */
+char *posix_ipmb_bus;
+IPMI_WS *posix_ipmb_txq[WS_ARRAY_SIZE];
+unsigned posix_ipmb_tx_count;
+unsigned long posix_ipmb_tx_start;	/* timer_us() the last frame went out */
+
+void posix_ipmb_name( struct sockaddr_un *addr, unsigned char slave_addr );
+int posix_ipmb_send( IPMI_WS *ws );
+void posix_ipmb_tx_done( int status );
+void posix_ipmb_tx_next( void );
+void posix_ipmb_tx_timeout( unsigned char *arg );
+void posix_ipmb_isr( int fd );
+void i2c_master_complete( IPMI_WS *ws, int status );
+
+/* fill in the socket name of slave_addr */
+void
+posix_ipmb_name( struct sockaddr_un *addr, unsigned char slave_addr )
+{
+	memset( addr, 0, sizeof( struct sockaddr_un ) );
+	addr->sun_family = AF_UNIX;
+	snprintf( addr->sun_path, sizeof( addr->sun_path ), 
+		POSIX_IPMB_PATH, slave_addr );
+}
+
+/*==============================================================
+ * i2c_initialize()
+ *==============================================================*/
+void 
+i2c_initialize( void )
+{
+	struct sockaddr_un addr;
+
+	local_i2c_address = module_get_i2c_address( I2C_ADDRESS_LOCAL );
+	remote_i2c_address = module_get_i2c_address( I2C_ADDRESS_REMOTE );
+	posix_ipmb_bus = getenv( "IPMB_BUS" );
+
+	posix_ipmb_fd = socket( AF_UNIX, SOCK_DGRAM, 0 );
+	posix_ipmb_name( &addr, local_i2c_address );
+	unlink( addr.sun_path );
+	if( ( posix_ipmb_fd < 0 ) 
+	    || ( bind( posix_ipmb_fd, ( struct sockaddr * )&addr, sizeof( addr ) ) < 0 ) ) {
+		perror( addr.sun_path );
+		exit( EXIT_FAILURE );
+	}
+	sched_attach( posix_ipmb_fd, posix_ipmb_isr );
+	printf( "IPMB address 0x%02x on %s%s%s\n", local_i2c_address, addr.sun_path,
+		posix_ipmb_bus ? " via " : "", posix_ipmb_bus ? posix_ipmb_bus : "" );
+}
+
+/*==============================================================
+ * posix_ipmb_send()
+ * 	Put a frame on the wire, returns 0 or the errno of the
+ * 	failed send.
+ *==============================================================*/
+int
+posix_ipmb_send( IPMI_WS *ws )
+{
+	struct sockaddr_un addr;
+	unsigned char hdr[POSIX_IPMB_HDR_LEN];
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	hdr[0] = POSIX_IPMB_FRAME;
+	if( posix_ipmb_bus ) {
+		/* the bus needs the destination, it knows who we are */
+		hdr[1] = ws->addr_out;
+		memset( &addr, 0, sizeof( addr ) );
+		addr.sun_family = AF_UNIX;
+		strncpy( addr.sun_path, posix_ipmb_bus, sizeof( addr.sun_path ) - 1 );
+	} else {
+		hdr[1] = local_i2c_address;
+		posix_ipmb_name( &addr, ws->addr_out );
+	}
+
+	/* the frame goes out from the ws, no staging copy */
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = POSIX_IPMB_HDR_LEN;
+	iov[1].iov_base = WS_FRAME_OUT( ws );
+	iov[1].iov_len = ws->len_out;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof( addr );
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	posix_ipmb_tx_start = timer_us();
+	if( sendmsg( posix_ipmb_fd, &msg, MSG_DONTWAIT ) < 0 )
+		return( errno );
+	if( posix_ipmb_bus )
+		timer_us_arm( TIMER_US_SLOT_I2C, i2ctime_timeout( ws->addr_out, ws->len_out ),
+			posix_ipmb_tx_timeout, 0 );
+	return( 0 );
+}
+
+/*==============================================================
+ * posix_ipmb_tx_done()
+ * 	Bus mode, complete the write at the head of the queue and 
+ * 	start the next one.
+ *==============================================================*/
+void
+posix_ipmb_tx_done( int status )
+{
+	IPMI_WS *ws;
+
+	timer_us_cancel( TIMER_US_SLOT_I2C );
+	while( posix_ipmb_tx_count ) {
+		ws = posix_ipmb_txq[0];
+		memmove( posix_ipmb_txq, posix_ipmb_txq + 1, 
+			--posix_ipmb_tx_count * sizeof( IPMI_WS * ) );
+		if( status == I2ERR_NOERR )
+			i2ctime_done( ws->addr_out, posix_ipmb_tx_start );
+		else if( status == I2ERR_TIMEOUT )
+			i2ctime_expired( ws->addr_out );
+
+		/* start the next write before completing this one, the
+		 * completion may queue another */
+		if( posix_ipmb_tx_count )
+			posix_ipmb_tx_next();
+		if( !posix_ipmb_tx_count || !posix_ipmb_send( posix_ipmb_txq[0] ) ) {
+			i2c_master_complete( ws, status );
+			return;
+		}
+		i2c_master_complete( ws, status );
+		/* bus has gone away */
+		status = I2ERR_SLARW_SENT_NOT_ACKED;
+	}
+}
+
+/* move the most urgent waiting write to the head of the queue */
+void
+posix_ipmb_tx_next( void )
+{
+	IPMI_WS *ws;
+	unsigned i;
+
+	i = ws_prio_select( posix_ipmb_txq, posix_ipmb_tx_count );
+	ws = posix_ipmb_txq[i];
+	for( ; i > 0; i-- )
+		posix_ipmb_txq[i] = posix_ipmb_txq[i - 1];
+	posix_ipmb_txq[0] = ws;
+}
+
+/* the bus did not answer in time, give up on the frame */
+void
+posix_ipmb_tx_timeout( unsigned char *arg )
+{
+	dputstr( DBG_I2C | DBG_ERR, "posix_ipmb_tx_timeout: \n" );
+	posix_ipmb_tx_done( I2ERR_TIMEOUT );
+}
+
+/*==============================================================
+ * posix_ipmb_isr()
+ * 	Slave receive, one ws per frame. Like the slave ISR in i2c.c
+ * 	the frame lands straight in ws->pkt_in, the ws is allocated
+ * 	before the read and given back if the datagram turns out to
+ * 	be something else. Bus mode ACK/NAKs complete the write in 
+ * 	progress.
+ *==============================================================*/
+void
+posix_ipmb_isr( int fd )
+{
+	IPMI_WS *ws;
+	unsigned char hdr[POSIX_IPMB_HDR_LEN], discard[WS_BUF_LEN];
+	struct iovec iov[2];
+	struct msghdr msg;
+	int len;
+
+	for( ;; ) {
+		ws = ws_alloc();
+		iov[0].iov_base = hdr;
+		iov[0].iov_len = POSIX_IPMB_HDR_LEN;
+		iov[1].iov_base = ws ? ws->pkt_in : discard;
+		iov[1].iov_len = ws ? ws->buf_len : WS_BUF_LEN;
+		memset( &msg, 0, sizeof( msg ) );
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+
+		if( ( len = recvmsg( fd, &msg, MSG_DONTWAIT | MSG_TRUNC ) ) < 0 ) {
+			if( ws )
+				ws_free( ws );
+			return;
+		}
+
+		if( ( len < POSIX_IPMB_HDR_LEN ) || ( hdr[0] != POSIX_IPMB_FRAME ) ) {
+			if( ws )
+				ws_free( ws );
+			/* an answer for a frame that has timed out is
+			 * dropped, unless the next one went to the same
+			 * address */
+			if( ( len < POSIX_IPMB_HDR_LEN ) || !posix_ipmb_tx_count
+			    || ( hdr[1] != posix_ipmb_txq[0]->addr_out ) )
+				continue;
+			if( hdr[0] == POSIX_IPMB_ACK )
+				posix_ipmb_tx_done( I2ERR_NOERR );
+			else if( hdr[0] == POSIX_IPMB_NAK )
+				posix_ipmb_tx_done( I2ERR_SLARW_SENT_NOT_ACKED );
+			continue;
+		}
+
+		if( !ws ) {
+			dputstr( DBG_I2C | DBG_ERR, "posix_ipmb_isr: ws_alloc failed\n" );
+			continue;
+		}
+		len -= POSIX_IPMB_HDR_LEN;
+		if( ( len > ws->buf_len ) || !posix_ipmb_enabled ) {
+			ws_free( ws );
+			continue;
+		}
+		
+		ws->incoming_protocol = IPMI_CH_PROTOCOL_IPMB;
+		ws->incoming_medium = IPMI_CH_MEDIUM_IPMB;
+		ws->incoming_channel = IPMI_CH_NUM_PRIMARY_IPMB;
+		ws->ipmi_completion_function = i2c_slave_receive_callback;
+		ws->len_in = len;
+		ws->flags = 0;
+		/* i2c.c answers remote_i2c_address, which is the only
+		 * peer an MMC has. A carrier here talks to several
+		 * modules so answer whoever asked. */
+		if( ( len > 2 ) && !( ( ws->pkt_in[0] >> 2 ) & 1 ) )
+			ws->addr_out = ws->pkt_in[2];
+		else
+			ws->addr_out = remote_i2c_address;
+		ws_set_state( ws, WS_ACTIVE_IN );
+	}
+}
+
+/*==============================================================
+ * i2c_master_write()
+ *==============================================================*/
+void 
+i2c_master_write( IPMI_WS *ws )
+{
+	ws->xport_completion_function = ( void ( * )( void *, int ) )i2c_master_complete;
+
+	if( !posix_ipmb_enabled ) {
+		i2c_master_complete( ws, I2ERR_SLARW_SENT_NOT_ACKED );
+		return;
+	}
+
+	if( posix_ipmb_bus ) {
+		posix_ipmb_txq[posix_ipmb_tx_count] = ws;
+		if( ++posix_ipmb_tx_count == 1 && posix_ipmb_send( ws ) )
+			posix_ipmb_tx_done( I2ERR_SLARW_SENT_NOT_ACKED );
+		return;
+	}
+	
+	switch( posix_ipmb_send( ws ) ) {
+		case 0:
+			i2ctime_done( ws->addr_out, posix_ipmb_tx_start );
+			i2c_master_complete( ws, I2ERR_NOERR );
+			break;
+		case EAGAIN:
+			/* receiver is busy, back to the queue */
+			ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
+			break;
+		case ENOENT:
+		case ECONNREFUSED:
+			/* no one at this address */
+			i2c_master_complete( ws, I2ERR_SLARW_SENT_NOT_ACKED );
+			break;
+		default:
+			i2c_master_complete( ws, I2ERR_STATE_TRANSITION );
+			break;
+	}
+}
+
+/*==============================================================
+ * i2c_master_read()
+ * 	Master reads are not simulated, the slave never answers.
+ *==============================================================*/
+void
+i2c_master_read( IPMI_WS *ws )
+{
+	ws->xport_completion_function = ( void ( * )( void *, int ) )i2c_master_complete;
+	i2c_master_complete( ws, I2ERR_SLARW_SENT_NOT_ACKED );
+}
+
+/* Master op transport completion routine, same policy as i2c.c */
+void
+i2c_master_complete( IPMI_WS *ws, int status )
+{
+	if( status == I2ERR_NOERR ) {
+		i2c_stats[0].master_count++;
+		ws_set_state( ws, WS_ACTIVE_MASTER_WRITE_SUCCESS );
+		if( ws->ipmi_completion_function )
+			( ws->ipmi_completion_function )( ( void * )ws, XPORT_REQ_NOERR );
+		else 
+			ws_free( ws );
+		return;
+	}
+
+	if( ( status == I2ERR_SLARW_SENT_NOT_ACKED ) || ( status == I2ERR_NAK_RCVD ) )
+		i2c_stats[0].nak_count++;
+	else
+		i2c_stats[0].error_count++;
+
+	ws->delivery_attempts++;
+	if( ( WS_ACTIVE_MASTER_WRITE_PENDING == ws->ws_state ) 
+	    && ( ws->delivery_attempts < MAX_DELIVERY_ATTEMPTS ) ) {
+		i2c_stats[0].retry_count++;
+		ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
+	} else if( ( WS_ACTIVE_MASTER_READ_PENDING == ws->ws_state ) 
+	    && ( ws->delivery_attempts < MAX_DELIVERY_ATTEMPTS ) ) {
+		i2c_stats[0].retry_count++;
+		ws_set_state( ws, WS_ACTIVE_MASTER_READ );
+	} else if( ws->ipmi_completion_function ) {
+		( ws->ipmi_completion_function )( ( void * )ws, XPORT_REQ_ERR );
+	} else { 
+		ws_free( ws );
+	}
+}
+
+/* Handlers for ATCA_CMD_SET_IPMB_STATE, there is only IPMB-A */
+void
+i2c_interface_enable_local_control( uchar channel, uchar link_id )
+{
+	if( channel == 0 )
+		posix_ipmb_enabled = 1;
+}
+
+void
+i2c_interface_disable( uchar channel, uchar link_id )
+{
+	if( channel == 0 )
+		posix_ipmb_enabled = 0;
+}
+
+/* IPMB-A is up unless isolated, IPMB-B is not simulated */
+unsigned char
+i2c_channel_state( unsigned channel, unsigned char *score )
+{
+	*score = 0;
+	if( ( channel == 0 ) && posix_ipmb_enabled )
+		return( I2C_CH_STATE_ENABLED_FUNCTIONAL );
+	return( I2C_CH_STATE_DISABLED );
+}
+
+/* slave reads are not simulated */
+void
+i2c_set_read_buffer( unsigned char *buf, unsigned buf_len )
+{
+}
+
+void
+i2c_set_slave_receive_callback( void ( *callback_fn )( void *, int ) )
+{
+	i2c_slave_receive_callback = callback_fn;
+}
+
+/*==============================================================
+ * i2c_batch_submit()
+ * 	Device batches are not simulated, no device answers. The 
+ * 	batch completes from the main loop as it does in i2c.c.
+ *==============================================================*/
+I2C_BATCH *posix_batch_done_head;
+I2C_BATCH *posix_batch_done_tail;
+
+int
+i2c_batch_submit( I2C_BATCH *batch )
+{
+	unsigned i;
+
+	if( !batch->count || ( batch->channel >= I2C_NUM_CHANNELS ) )
+		return( EINVAL );
+	if( batch->busy )
+		return( EAGAIN );
+
+	batch->busy = 1;
+	batch->cur = batch->count;
+	batch->pos = 0;
+	batch->failed = batch->count;
+	for( i = 0; i < batch->count; i++ )
+		batch->xact[i].status = I2ERR_SLARW_SENT_NOT_ACKED;
+	i2c_stats[batch->channel].nak_count += batch->count;
+
+	batch->next = 0;
+	if( posix_batch_done_tail )
+		posix_batch_done_tail->next = batch;
+	else
+		posix_batch_done_head = batch;
+	posix_batch_done_tail = batch;
+	sched_post( SCHED_I2C );
+	return( ESUCCESS );
+}
+
+/* SCHED_I2C, same as i2c.c */
+void
+i2c_batch_process( void )
+{
+	I2C_BATCH *batch;
+
+	while( ( batch = posix_batch_done_head ) ) {
+		if( !( posix_batch_done_head = batch->next ) )
+			posix_batch_done_tail = 0;
+		batch->next = 0;
+		batch->busy = 0;
+		if( batch->complete )
+			( batch->complete )( batch );
+	}
+}
+
+/*==============================================================
+ * TIMER1
+ *==============================================================*/
+/* The microsecond timers of timer.c, one timerfd set to the earliest 
+ * deadline of the armed slots. It is created the first time a slot is
+ * armed. */
+int posix_timer_us_fd = -1;
+struct {
+	void ( *func )( unsigned char * );
+	unsigned char *arg;
+	unsigned long deadline;		/* timer_us() */
+} posix_timer_us_slot[TIMER_US_SLOTS];
+
+void posix_timer_us_set( void );
+void posix_timer_us_isr( int fd );
+
+/*==============================================================
+ * timer_us()
+ * 	Free running microsecond count, CLOCK_MONOTONIC.
+ *==============================================================*/
+unsigned long
+timer_us( void )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return( now.tv_sec * 1000000 + now.tv_nsec / 1000 );
+}
+
+/*==============================================================
+ * timer_us_arm()
+ *==============================================================*/
+void
+timer_us_arm( 
+	unsigned slot, 
+	unsigned long us, 
+	void( *func )( unsigned char * ), 
+	unsigned char *arg )
+{
+	if( posix_timer_us_fd < 0 ) {
+		if( ( posix_timer_us_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK ) ) < 0 ) {
+			perror( "timerfd_create" );
+			exit( EXIT_FAILURE );
+		}
+		sched_attach( posix_timer_us_fd, posix_timer_us_isr );
+	}
+	if( us < TIMER_US_MIN )
+		us = TIMER_US_MIN;
+
+	posix_timer_us_slot[slot].func = func;
+	posix_timer_us_slot[slot].arg = arg;
+	posix_timer_us_slot[slot].deadline = timer_us() + us;
+	posix_timer_us_set();
+}
+
+/*==============================================================
+ * timer_us_cancel()
+ *==============================================================*/
+void
+timer_us_cancel( unsigned slot )
+{
+	if( !posix_timer_us_slot[slot].func )
+		return;
+	posix_timer_us_slot[slot].func = 0;
+	posix_timer_us_set();
+}
+
+/* program the timerfd for the earliest deadline, or stop it */
+void
+posix_timer_us_set( void )
+{
+	struct itimerspec its;
+	unsigned long deadline = 0;
+	unsigned slot;
+
+	for( slot = 0; slot < TIMER_US_SLOTS; slot++ ) {
+		if( posix_timer_us_slot[slot].func 
+		    && ( !deadline || ( ( long )( posix_timer_us_slot[slot].deadline - deadline ) < 0 ) ) )
+			deadline = posix_timer_us_slot[slot].deadline;
+	}
+
+	memset( &its, 0, sizeof( its ) );
+	if( deadline ) {
+		its.it_value.tv_sec = deadline / 1000000;
+		its.it_value.tv_nsec = ( deadline % 1000000 ) * 1000;
+	}
+	timerfd_settime( posix_timer_us_fd, TFD_TIMER_ABSTIME, &its, 0 );
+}
+
+/* the Timer1 match interrupt, run the slots that are due */
+void
+posix_timer_us_isr( int fd )
+{
+	unsigned long long expirations;
+	void ( *func )( unsigned char * );
+	unsigned long now = timer_us();
+	unsigned slot;
+
+	read( fd, &expirations, sizeof( expirations ) );
+	for( slot = 0; slot < TIMER_US_SLOTS; slot++ ) {
+		if( !( func = posix_timer_us_slot[slot].func )
+		    || ( ( long )( now - posix_timer_us_slot[slot].deadline ) < 0 ) )
+			continue;
+		posix_timer_us_slot[slot].func = 0;
+		( *func )( posix_timer_us_slot[slot].arg );
+	}
+	posix_timer_us_set();
+}
+
+/*==============================================================
+ * UARTS
+ *==============================================================*/
+/* serial.c runs on top of these. The debug port is stdout, or with 
+ * COREIPM_CONSOLE set a pseudo-terminal that ipmi_test, screen and the
+ * like can open. With COREIPM_CONSOLE_BAUD, or with a PTY, characters
+ * take as long as they would on the wire, a start, 8 data and a stop 
+ * bit each, and so the THRE interrupt that refills the transmit FIFO
+ * comes no faster than on the target. Received characters are handed
+ * to serial_rx_char() at the same rate. Once the debug port is 
+ * simulated stdout goes through it as well, a busy console holds up 
+ * printf() and dputstr() the way it does on the target. Nothing is 
+ * connected to the ITLA port, what is sent there is dropped. */
+#define POSIX_UART_BAUD		9600	/* as set up by uart_initialize() */
+#define POSIX_UART_RX_LEN	1024	/* read ahead from the PTY */
+#define POSIX_UART_RX_TRIGGER	4	/* characters per receive interrupt */
+#define POSIX_UART_REQS		16	/* requests timed at once */
+
+/* U0LSR bits, see serial.c */
+#define POSIX_LSR_THRE		0x20
+#define POSIX_LSR_TEMT		0x40
+
+/* A terminal mode message going by on the wire, enough of it to match
+ * a response to its request: netFn/LUN, seq/bridge and command. */
+typedef struct posix_tm_msg {
+	unsigned char state;		/* POSIX_TM_xx */
+	unsigned char digits;		/* hex digits of hdr seen */
+	unsigned char hdr[3];
+	unsigned long start;		/* the '[' went by */
+} POSIX_TM_MSG;
+
+#define POSIX_TM_IDLE	0
+#define POSIX_TM_HDR	1	/* after the '[' */
+#define POSIX_TM_DATA	2	/* header seen, waiting for the ']' */
+
+/* a request waiting for its response */
+typedef struct posix_tm_req {
+	unsigned char hdr[3];
+	unsigned long start;		/* '[' received */
+	unsigned long end;		/* ']' received */
+} POSIX_TM_REQ;
+
+typedef struct posix_uart {
+	int fd;				/* PTY master, -1 if there is none */
+	int slave_fd;			/* held open so the master is never hung up */
+	FILE *out;			/* or here, the debug port without a PTY */
+	unsigned long char_ns;		/* time per character, 0 no limit */
+	unsigned char tx_fifo[UART_TX_FIFO_LEN];
+	unsigned long tx_time[UART_TX_FIFO_LEN];	/* each character is out */
+	unsigned tx_len;
+	unsigned long tx_end;		/* the transmitter is empty */
+	unsigned char thre;		/* THRE interrupt pending */
+	unsigned char rx_buf[POSIX_UART_RX_LEN];
+	unsigned rx_head;		/* rx_buf[rx_tail] to rx_buf[rx_head] */
+	unsigned rx_tail;		/* have not been received yet */
+	unsigned long rx_start;		/* rx_buf[rx_tail] starts coming in */
+	POSIX_TM_MSG rx_msg;
+	POSIX_TM_MSG tx_msg;
+	POSIX_TM_REQ req[POSIX_UART_REQS];
+	unsigned req_count;
+} POSIX_UART;
+
+typedef struct posix_uart_stats {
+	unsigned long tx_drop;		/* characters nobody read */
+	unsigned long msg_count;	/* responses matched to their request */
+	unsigned long msg_unmatched;	/* requests or responses without the other */
+	unsigned long min_time;		/* ']' received to ']' sent, us */
+	unsigned long max_time;
+	unsigned long total_time;
+} POSIX_UART_STATS;
+
+POSIX_UART posix_uart[UART_PORT_COUNT];
+POSIX_UART_STATS posix_uart_stats;
+int posix_uart_timer_fd = -1;		/* the UART interrupts */
+unsigned long posix_uart_timer;		/* when it goes off, 0 disarmed */
+FILE *posix_uart_log;			/* COREIPM_CONSOLE_LOG */
+
+extern unsigned global_debug_setting;
+
+void serial_rx_char( int uart, unsigned char ch );
+void serial_tx_fill( int uart );
+char *posix_uart_open( int uart, char *name );
+ssize_t posix_console_write( void *cookie, const char *buf, size_t len );
+unsigned long posix_uart_thre_time( POSIX_UART *u );
+void posix_uart_retire( int uart );
+void posix_uart_out( POSIX_UART *u, unsigned char *buf, unsigned len );
+void posix_uart_rx( int uart, unsigned long now );
+void posix_uart_rx_isr( int fd );
+void posix_uart_isr( int fd );
+void posix_uart_schedule( void );
+void posix_tm_char( POSIX_UART *u, POSIX_TM_MSG *m, unsigned char ch, unsigned long t, int rx );
+void posix_tm_end( POSIX_UART *u, POSIX_TM_MSG *m, unsigned long t, int rx );
+
+/*==============================================================
+ * posix_uart_init()
+ * 	Called at the end of uart_initialize().
+ *==============================================================*/
+void
+posix_uart_init( void ) 
+{
+	char *console = getenv( "COREIPM_CONSOLE" );
+	char *baud = getenv( "COREIPM_CONSOLE_BAUD" );
+	char *log = getenv( "COREIPM_CONSOLE_LOG" );
+	char *debug = getenv( "COREIPM_DEBUG" );
+	cookie_io_functions_t console_io = { 0, posix_console_write, 0, 0 };
+	unsigned long rate = console ? POSIX_UART_BAUD : 0;
+	char *slave;
+	int uart;
+
+	setvbuf( stdout, 0, _IOLBF, 0 );
+
+	/* the other way in for consoles */
+	if( rmcpd_init() != ESUCCESS )
+		exit( EXIT_FAILURE );
+
+	if( debug )
+		global_debug_setting = strtoul( debug, 0, 16 );
+	if( baud )
+		rate = strtoul( baud, 0, 10 );
+
+	if( ( posix_uart_timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK ) ) < 0 ) {
+		perror( "posix_uart_init: timerfd_create" );
+		exit( EXIT_FAILURE );
+	}
+	sched_attach( posix_uart_timer_fd, posix_uart_isr );
+
+	for( uart = 0; uart < UART_PORT_COUNT; uart++ ) {
+		posix_uart[uart].fd = -1;
+		posix_uart[uart].slave_fd = -1;
+		posix_uart[uart].char_ns = rate ? 10 * 1000000000UL / rate : 0;
+	}
+	posix_uart_stats_reset();
+
+	if( log ) {
+		if( !( posix_uart_log = fopen( log, "w" ) ) ) {
+			perror( log );
+			exit( EXIT_FAILURE );
+		}
+		setvbuf( posix_uart_log, 0, _IOLBF, 0 );
+		fprintf( posix_uart_log, "# netfn seq cmd req_us wait_us resp_us total_us\n" );
+	}
+
+	if( !console ) {
+		posix_uart[UART_DEBUG].out = stdout;
+		if( !rate )
+			return;
+	} else {
+		slave = posix_uart_open( UART_DEBUG, console );
+		printf( "Console on %s", slave );
+		if( strcmp( console, "pty" ) )
+			printf( " as %s", console );
+		if( rate )
+			printf( " at %lu baud", rate );
+		printf( "\n" );
+	}
+
+	/* from here on printf() output queues on the debug port like it 
+	 * does with the target C library */
+	fflush( stdout );
+	stdout = fopencookie( 0, "w", console_io );
+	setvbuf( stdout, 0, _IOLBF, 0 );
+}
+
+/* Give uart a pseudo-terminal and return the name of its slave side. 
+ * Unless name is "pty" it is made a link to the slave so the console 
+ * can be found under a fixed name. */
+char *
+posix_uart_open( int uart, char *name )
+{
+	POSIX_UART *u = &posix_uart[uart];
+	struct termios tio;
+	char *slave = 0;
+
+	if( ( ( u->fd = posix_openpt( O_RDWR | O_NOCTTY | O_NONBLOCK ) ) < 0 )
+	    || grantpt( u->fd ) || unlockpt( u->fd ) 
+	    || !( slave = ptsname( u->fd ) )
+	    || ( ( u->slave_fd = open( slave, O_RDWR | O_NOCTTY ) ) < 0 ) ) {
+		perror( slave ? slave : "posix_uart_open" );
+		exit( EXIT_FAILURE );
+	}
+
+	/* the characters go through as they are */
+	tcgetattr( u->slave_fd, &tio );
+	cfmakeraw( &tio );
+	tcsetattr( u->slave_fd, TCSANOW, &tio );
+
+	if( strcmp( name, "pty" ) ) {
+		unlink( name );
+		if( symlink( slave, name ) < 0 ) {
+			perror( name );
+			exit( EXIT_FAILURE );
+		}
+	}
+	sched_attach( u->fd, posix_uart_rx_isr );
+	return( slave );
+}
+
+/* stdout once the debug port is simulated, UART_DEBUG is UART_0 */
+ssize_t
+posix_console_write( void *cookie, const char *buf, size_t len )
+{
+	size_t i;
+
+	for( i = 0; i < len; i++ )
+		putchar_0( buf[i] );
+	return( len );
+}
+
+/*==============================================================
+ * posix_uart_tx()
+ * 	Write to the transmit holding register. The character is on
+ * 	the wire once the ones ahead of it are.
+ *==============================================================*/
+void
+posix_uart_tx( int uart, unsigned char ch )
+{
+	POSIX_UART *u = &posix_uart[uart];
+	unsigned long now = sched_clock();
+
+	/* serial_tx_fill() only writes an empty FIFO */
+	if( u->tx_len == UART_TX_FIFO_LEN )
+		return;
+
+	if( ( long )( u->tx_end - now ) < 0 )
+		u->tx_end = now;
+	u->tx_end += u->char_ns;
+	u->tx_fifo[u->tx_len] = ch;
+	u->tx_time[u->tx_len++] = u->tx_end;
+	u->thre = 0;
+	posix_uart_schedule();
+}
+
+/*==============================================================
+ * posix_uart_lsr()
+ * 	Read the line status register, only THRE and TEMT are kept.
+ *==============================================================*/
+unsigned char
+posix_uart_lsr( int uart )
+{
+	POSIX_UART *u = &posix_uart[uart];
+	unsigned long now = sched_clock();
+	unsigned char lsr = 0;
+
+	if( u->tx_len && ( ( long )( now - posix_uart_thre_time( u ) ) >= 0 ) )
+		posix_uart_retire( uart );
+	if( !u->tx_len ) {
+		lsr |= POSIX_LSR_THRE;
+		if( ( long )( now - u->tx_end ) >= 0 )
+			lsr |= POSIX_LSR_TEMT;
+	}
+	return( lsr );
+}
+
+/* the last character in the FIFO moves to the shift register, the 
+ * FIFO is empty */
+unsigned long
+posix_uart_thre_time( POSIX_UART *u )
+{
+	return( u->tx_time[u->tx_len - 1] - u->char_ns );
+}
+
+/* The FIFO has drained, what was in it goes to the other end in one 
+ * go. The last character of a message gets there on time, the ones
+ * before it up to UART_TX_FIFO_LEN character times late. */
+void
+posix_uart_retire( int uart )
+{
+	POSIX_UART *u = &posix_uart[uart];
+	unsigned i;
+
+	for( i = 0; i < u->tx_len; i++ )
+		posix_tm_char( u, &u->tx_msg, u->tx_fifo[i], u->tx_time[i], 0 );
+	posix_uart_out( u, u->tx_fifo, u->tx_len );
+	u->tx_len = 0;
+	u->thre = 1;
+}
+
+/* characters that have left uart */
+void
+posix_uart_out( POSIX_UART *u, unsigned char *buf, unsigned len )
+{
+	int n;
+
+	if( u->out ) {
+		fwrite( buf, 1, len, u->out );
+		return;
+	}
+	if( u->fd < 0 ) 
+		return;
+
+	/* Nobody is reading. Like on a cable with nothing on the other 
+	 * end the characters are lost, so is what was waiting. */
+	if( ( n = write( u->fd, buf, len ) ) < ( int )len ) {
+		posix_uart_stats.tx_drop += len - ( n > 0 ? n : 0 );
+		tcflush( u->slave_fd, TCIFLUSH );
+	}
+}
+
+/* hand the characters that have come in by now to the receive side */
+void
+posix_uart_rx( int uart, unsigned long now )
+{
+	POSIX_UART *u = &posix_uart[uart];
+	unsigned long t;
+	unsigned char ch;
+
+	if( u->rx_tail == u->rx_head )
+		return;
+
+	while( u->rx_tail != u->rx_head ) {
+		t = u->rx_start + u->char_ns;
+		if( ( long )( now - t ) < 0 )
+			break;
+		u->rx_start = t;
+		ch = u->rx_buf[u->rx_tail++];
+		posix_tm_char( u, &u->rx_msg, ch, t, 1 );
+		serial_rx_char( uart, ch );
+	}
+
+	/* there is room again, the PTY can be read */
+	if( ( u->rx_head == POSIX_UART_RX_LEN ) && u->rx_tail )
+		sched_mask( u->fd, 0 );
+}
+
+/*==============================================================
+ * posix_uart_rx_isr()
+ * 	Something was written to a PTY. It is read ahead of the 
+ * 	UART, up to POSIX_UART_RX_LEN characters, and received at 
+ * 	the baud rate.
+ *==============================================================*/
+void
+posix_uart_rx_isr( int fd )
+{
+	POSIX_UART *u;
+	unsigned long now = sched_clock();
+	int uart, n;
+
+	for( uart = 0; ( uart < UART_PORT_COUNT ) && ( posix_uart[uart].fd != fd ); uart++ )
+		;
+	if( uart == UART_PORT_COUNT )
+		return;
+	u = &posix_uart[uart];
+
+	if( u->rx_tail == u->rx_head ) {
+		/* the line was idle, this starts coming in now */
+		u->rx_head = u->rx_tail = 0;
+		if( ( long )( now - u->rx_start ) > 0 )
+			u->rx_start = now;
+	} else if( u->rx_tail ) {
+		memmove( u->rx_buf, u->rx_buf + u->rx_tail, u->rx_head - u->rx_tail );
+		u->rx_head -= u->rx_tail;
+		u->rx_tail = 0;
+	}
+
+	if( ( n = read( fd, u->rx_buf + u->rx_head, POSIX_UART_RX_LEN - u->rx_head ) ) > 0 )
+		u->rx_head += n;
+
+	/* full, the rest stays with the PTY until the UART has caught up */
+	if( u->rx_head == POSIX_UART_RX_LEN )
+		sched_mask( fd, 1 );
+
+	posix_uart_rx( uart, now );
+	posix_uart_schedule();
+}
+
+/*==============================================================
+ * posix_uart_isr()
+ * 	The UART interrupt: characters received and the transmit
+ * 	FIFO empty, on every port.
+ *==============================================================*/
+void
+posix_uart_isr( int fd )
+{
+	POSIX_UART *u;
+	unsigned long long expired;
+	unsigned long now = sched_clock();
+	int uart;
+
+	if( read( fd, &expired, sizeof( expired ) ) < 0 )
+		return;
+	posix_uart_timer = 0;
+
+	for( uart = 0; uart < UART_PORT_COUNT; uart++ ) {
+		u = &posix_uart[uart];
+		posix_uart_rx( uart, now );
+		if( u->tx_len && ( ( long )( now - posix_uart_thre_time( u ) ) >= 0 ) )
+			posix_uart_retire( uart );
+		if( u->thre ) {
+			u->thre = 0;
+			serial_tx_fill( uart );
+		}
+	}
+	posix_uart_schedule();
+}
+
+/* set the timer for the next thing due on any UART */
+void
+posix_uart_schedule( void )
+{
+	POSIX_UART *u;
+	struct itimerspec its;
+	unsigned long next = 0, t;
+	unsigned n;
+	int uart, due = 0;
+
+	for( uart = 0; uart < UART_PORT_COUNT; uart++ ) {
+		u = &posix_uart[uart];
+		if( u->thre ) {
+			t = sched_clock();
+		} else if( u->tx_len ) {
+			t = posix_uart_thre_time( u );
+		} else {
+			n = u->rx_head - u->rx_tail;
+			if( !n )
+				continue;
+			/* the trigger level, or the last one there is */
+			t = u->rx_start + ( n < POSIX_UART_RX_TRIGGER ? n : POSIX_UART_RX_TRIGGER ) 
+				* u->char_ns;
+		}
+		if( !due || ( ( long )( t - next ) < 0 ) )
+			next = t;
+		due = 1;
+	}
+
+	/* nothing to do, or the timer goes off early enough */
+	if( !due || ( posix_uart_timer && ( ( long )( next - posix_uart_timer ) >= 0 ) ) )
+		return;
+
+	memset( &its, 0, sizeof( its ) );
+	its.it_value.tv_sec = next / 1000000000;
+	its.it_value.tv_nsec = next % 1000000000;
+	if( !its.it_value.tv_sec && !its.it_value.tv_nsec )
+		its.it_value.tv_nsec = 1;
+	timerfd_settime( posix_uart_timer_fd, TFD_TIMER_ABSTIME, &its, 0 );
+	posix_uart_timer = next;
+}
+
+/* Follow the terminal mode messages going by for the per message 
+ * timing. rx is set for characters received, clear for the ones 
+ * sent. Messages whose header is not hex, the verbs and their 
+ * answers, are not timed. */
+void
+posix_tm_char( 
+	POSIX_UART *u, 
+	POSIX_TM_MSG *m, 
+	unsigned char ch, 
+	unsigned long t, 
+	int rx )
+{
+	int digit;
+
+	if( ch == '[' ) {
+		m->state = POSIX_TM_HDR;
+		m->digits = 0;
+		m->start = t;
+		return;
+	}
+	if( m->state == POSIX_TM_IDLE )
+		return;
+	if( ch == ']' ) {
+		if( m->state == POSIX_TM_DATA )
+			posix_tm_end( u, m, t, rx );
+		m->state = POSIX_TM_IDLE;
+		return;
+	}
+	if( ( m->state != POSIX_TM_HDR ) || ( ch == ' ' ) )
+		return;
+
+	if( ( ch >= '0' ) && ( ch <= '9' ) )
+		digit = ch - '0';
+	else if( ( ( ch | 0x20 ) >= 'a' ) && ( ( ch | 0x20 ) <= 'f' ) )
+		digit = ( ch | 0x20 ) - 'a' + 10;
+	else {
+		m->state = POSIX_TM_IDLE;
+		return;
+	}
+	m->hdr[m->digits / 2] = ( m->digits & 1 ) ? ( m->hdr[m->digits / 2] << 4 ) | digit : digit;
+	if( ++m->digits == 2 * sizeof( m->hdr ) )
+		m->state = POSIX_TM_DATA;
+}
+
+/* A message has gone by. Requests, even netFn, are timed from when 
+ * their ']' has been received, responses, odd netFn, are matched by 
+ * seq and command once their ']' has been sent. That leaves out the
+ * echo of a request. */
+void
+posix_tm_end( POSIX_UART *u, POSIX_TM_MSG *m, unsigned long t, int rx )
+{
+	POSIX_TM_REQ *req;
+	unsigned long total;
+	unsigned i;
+	int response = ( m->hdr[0] >> 2 ) & 1;
+
+	if( rx && !response ) {
+		if( u->req_count == POSIX_UART_REQS ) {
+			/* the oldest one is not going to get an answer */
+			posix_uart_stats.msg_unmatched++;
+			memmove( u->req, u->req + 1, --u->req_count * sizeof( POSIX_TM_REQ ) );
+		}
+		req = &u->req[u->req_count++];
+		memcpy( req->hdr, m->hdr, sizeof( req->hdr ) );
+		req->start = m->start;
+		req->end = t;
+		return;
+	}
+	if( rx || !response )
+		return;
+
+	for( i = 0; i < u->req_count; i++ ) {
+		req = &u->req[i];
+		if( ( ( req->hdr[0] >> 2 ) + 1 == ( m->hdr[0] >> 2 ) )
+		    && ( ( req->hdr[1] >> 2 ) == ( m->hdr[1] >> 2 ) )
+		    && ( req->hdr[2] == m->hdr[2] ) )
+			break;
+	}
+	if( i == u->req_count ) {
+		posix_uart_stats.msg_unmatched++;
+		return;
+	}
+
+	total = ( t - req->end ) / 1000;
+	posix_uart_stats.msg_count++;
+	posix_uart_stats.total_time += total;
+	if( total < posix_uart_stats.min_time )
+		posix_uart_stats.min_time = total;
+	if( total > posix_uart_stats.max_time )
+		posix_uart_stats.max_time = total;
+
+	if( posix_uart_log )
+		fprintf( posix_uart_log, "%02x %02x %02x %lu %lu %lu %lu\n",
+			req->hdr[0] >> 2, req->hdr[1] >> 2, req->hdr[2],
+			( req->end - req->start ) / 1000, ( m->start - req->end ) / 1000,
+			( t - m->start ) / 1000, total );
+
+	memmove( req, req + 1, ( --u->req_count - i ) * sizeof( POSIX_TM_REQ ) );
+}
+
+/* [SYS STATS] line, see stats.c */
+void
+posix_uart_stats_print( void )
+{
+	printf( "CONSOLE msgs %lu unmatched %lu min %luus avg %luus max %luus dropped %lu\n",
+		posix_uart_stats.msg_count, posix_uart_stats.msg_unmatched,
+		posix_uart_stats.msg_count ? posix_uart_stats.min_time : 0,
+		posix_uart_stats.msg_count ? posix_uart_stats.total_time / posix_uart_stats.msg_count : 0,
+		posix_uart_stats.max_time, posix_uart_stats.tx_drop );
+}
+
+void
+posix_uart_stats_reset( void )
+{
+	memset( &posix_uart_stats, 0, sizeof( posix_uart_stats ) );
+	posix_uart_stats.min_time = ~0UL;
+}
@@ -0,0 +1,58 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/posix.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* POSIX host port
+ *
+ * Target registers are redirected to a simulated register file so that
+ * the firmware compiles unchanged and runs as a Linux process. Drivers
+ * whose registers would have to behave like hardware are replaced by 
+ * posix.c (i2c) or reach a simulated device through it (serial). */
+
+#define REG32( addr )	posix_reg( addr )
+
+/* no vectored interrupts on the host, ISRs are plain functions */
+#define interrupt
+
+/* simulated IPMB, one datagram socket per slave address */
+#ifndef POSIX_IPMB_PATH
+#define POSIX_IPMB_PATH	"/tmp/ipmb-%02x"
+#endif
+
+/* simulated IPMB datagrams, a kind and an address byte followed by the 
+ * bytes that follow the slave address on the wire */
+#define POSIX_IPMB_FRAME	0	/* address is the peer */
+#define POSIX_IPMB_ACK		1	/* bus, the last frame was acked */
+#define POSIX_IPMB_NAK		2	/* bus, the last frame was not acked */
+#define POSIX_IPMB_HDR_LEN	2
+
+volatile unsigned int *posix_reg( unsigned long addr );
+
+/* simulated UARTs, see serial.c */
+void posix_uart_init( void );
+void posix_uart_tx( int uart, unsigned char ch );
+unsigned char posix_uart_lsr( int uart );
+void posix_uart_stats_print( void );
+void posix_uart_stats_reset( void );
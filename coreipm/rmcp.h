@@ -31,6 +31,16 @@ support and contact details.
 #define RMCP_MSG_NORMAL 0	// used by IPMI
 #define RMCP_MSG_ACK	1
 
+#define RMCP_VERSION_1	0x06	// RMCP Version 1.0
+#define RMCP_SEQ_NO_ACK	0xFF	// no RMCP ACK wanted, always used for IPMI
+#define RMCP_ACK_BIT	0x80	// class byte, RMCP ACK message
+
+// RMCP Message Class, class byte [4:0]
+#define RMCP_CLASS_ASF	6
+#define RMCP_CLASS_IPMI	7
+#define RMCP_CLASS_OEM	8
+#define RMCP_CLASS_MASK	0x1F
+
 #ifndef uchar
 #define uchar unsigned char
 #endif
@@ -164,9 +174,54 @@ typedef struct ipmi_session_hdr_plus {
 				   tracked for authenticated and unauthenticated
 				   packets. 0000_0000h is used for packets that 
 				   are sent outside of a session. */
-	uchar	payload_len;	/* IPMI Msg/Payload length in bytes. 1-based. */
+	uchar	payload_len[2];	/* IPMI Msg/Payload length in bytes, LS byte 
+				   first. 1-based. */
 } IPMI_SESSION_HDR_PLUS;
 
+/* Payload Type byte */
+#define RMCPP_PAYLOAD_ENCRYPTED		0x80
+#define RMCPP_PAYLOAD_AUTHENTICATED	0x40
+#define RMCPP_PAYLOAD_TYPE_MASK		0x3F
+
+/* the Payload Type Numbers are IOLAN_xx in ipmi.h */
+
+/* IPMI v2.0 session header without the OEM fields: auth type, payload 
+ * type, session ID, session sequence number, payload length */
+#define RMCPP_SESSION_HDR_LEN		12
+
+/* Authentication, Integrity and Confidentiality Algorithm Numbers */
+#define RMCPP_AUTH_NONE			0x00
+#define RMCPP_AUTH_HMAC_SHA1		0x01
+#define RMCPP_INTEG_NONE		0x00
+#define RMCPP_INTEG_HMAC_SHA1_96	0x01
+#define RMCPP_CONF_NONE			0x00
+#define RMCPP_CONF_AES_CBC_128		0x01
+
+#define RMCPP_HMAC_SHA1_96_LEN		12	/* AuthCode and RAKP 4 ICV */
+#define RMCPP_NEXT_HEADER		0x07	/* session trailer */
+
+/* RMCP+ and RAKP Message Status Codes */
+#define RMCPP_ST_OK			0x00
+#define RMCPP_ST_NO_RESOURCES		0x01	/* insufficient resources to create a session */
+#define RMCPP_ST_INVALID_SESSION_ID	0x02
+#define RMCPP_ST_INVALID_PAYLOAD_TYPE	0x03
+#define RMCPP_ST_INVALID_AUTH_ALG	0x04
+#define RMCPP_ST_INVALID_INTEG_ALG	0x05
+#define RMCPP_ST_INVALID_ROLE		0x09
+#define RMCPP_ST_UNAUTHORIZED_NAME	0x0D
+#define RMCPP_ST_INVALID_INTEG_VALUE	0x0F
+#define RMCPP_ST_INVALID_CONF_ALG	0x10
+#define RMCPP_ST_NO_CIPHER_SUITE	0x11
+#define RMCPP_ST_ILLEGAL_PARAMETER	0x12
+
+/* Privilege levels (roles) */
+#define IPMI_PRIV_CALLBACK		0x01
+#define IPMI_PRIV_USER			0x02
+#define IPMI_PRIV_OPERATOR		0x03
+#define IPMI_PRIV_ADMIN			0x04
+#define IPMI_PRIV_OEM			0x05
+#define RAKP_ROLE_NAME_ONLY		0x10	/* RAKP 1, username only lookup */
+
 /*
   IPMI Session Trailer
 
@@ -214,6 +269,39 @@ typedef struct rmcp_ack_msg {
 #endif
 } RMCP_ACK_MSG;
 
+/*
+  ASF messages, RMCP class 6. The only ones an IPMI LAN channel has to 
+  answer are Presence Ping and, with the IPMI bit set in the supported 
+  entities, Presence Pong.
+*/
+#define ASF_IANA		0x000011BE	// ASF IANA Enterprise Number
+#define ASF_MSG_PRESENCE_PONG	0x40
+#define ASF_MSG_PRESENCE_PING	0x80
+
+#define ASF_PONG_ENT_IPMI	0x80	// Supported Entities: IPMI supported
+#define ASF_PONG_ENT_ASF_10	0x01	// ASF version 1.0
+
+typedef struct asf_msg_hdr {
+	uchar	iana[4];	// IANA Enterprise Number, MS byte first
+	uchar	msg_type;	// ASF_MSG_xx
+	uchar	msg_tag;	// returned in the response
+	uchar	reserved;
+	uchar	data_len;	// bytes of data that follow
+} ASF_MSG_HDR;
+
+typedef struct asf_pong_data {
+	uchar	iana[4];	// OEM IANA, ASF_IANA if no OEM extensions
+	uchar	oem[4];		// OEM defined
+	uchar	supported_entities;	// ASF_PONG_ENT_xx
+	uchar	supported_interactions;	// 0, no ASF security extensions
+	uchar	reserved[6];
+} ASF_PONG_DATA;
+
+/* IPMI v1.5 session header lengths, the AuthCode is only there when the 
+ * Authentication Type is not none */
+#define IPMI_SESSION_HDR_LEN		10	// auth type, seq, id, msg len
+#define IPMI_SESSION_AUTHCODE_LEN	16
+
 
 
 
@@ -24,90 +24,1196 @@ See http://www.coreipm.com for documentation, latest information, licensing,
 support and contact details.
 -------------------------------------------------------------------------------
 */
+
+/*
+IPMI over LAN
+
+The LAN channel of the host build. RMCP datagrams come in on UDP port 
+COREIPM_RMCP_PORT, 623 on a real system, the daemon stays off when it is 
+not set so several controllers can run on one host. Every local address
+family gets a non-blocking socket, the sockets are in an epoll set and one
+wakeup drains every socket that has something.
+
+- RMCP class ASF: Presence Ping is answered with a Pong that has the IPMI
+  bit set, straight from the receive path.
+- RMCP class IPMI: the session header is decoded and the message is handed
+  to ipmi_process_pkt() in a ws of its own, IPMI_CH_PROTOCOL_IPMB on 
+  IPMI_CH_MEDIUM_LAN, as it would be coming off IPMB. The response goes 
+  back through the ws work list to rmcpd_send() with the session header of
+  the request.
+
+IPMI v1.5 messages are served with authentication type none only, v1.5 
+sessions are not implemented. IPMI v2.0 (RMCP+) sessions are, see 
+session.c, once COREIPM_LAN_PASSWORD is set, COREIPM_LAN_USER names the 
+user and is empty if not set. Open Session and the RAKP messages are 
+answered straight from the receive path, messages on a session are checked
+and decrypted before they are queued and encrypted again on the way out.
+With a password set a console has to open a session for anything but 
+finding out how to, outside a session rmcpd_queue() only takes Get Channel
+Authentication Capabilities, Get Channel Cipher Suites and Get System 
+GUID. On a session dispatch_request() checks every command against the 
+privilege level of the session, rmcpd_get_priv().
+LAN requests are addressed to the BMC, 20h, or to our own IPMB address, 
+both mean this controller.
+
+Datagrams move RMCPD_BATCH_LEN at a time, recvmmsg() drains a socket and
+whatever the receive path answers collects in an out batch that goes in
+one sendmmsg(). Where the socket work happens is set by
+COREIPM_LAN_WORKERS:
+
+	0	in the main loop, the epoll set is a scheduler interrupt
+		source (the default)
+	1-8	in that many worker threads. Each has sockets of its own on
+		the port, SO_REUSEPORT with more than one, and the kernel
+		picks the worker by the console's address so a console
+		stays with one worker.
+
+Workers do the RMCP and session headers, the ASF and RMCP+ handshake
+answers and the session crypto, the main loop does everything between
+rmcpd_queue() and rmcpd_send() as before. Messages go between them on a
+pair of single producer single consumer rings per worker, with an
+eventfd each way as the doorbell. The session table is shared, session.c
+locks it.
+
+Where the response goes is kept per ws in rmcpd_peer[], so any number of
+consoles can have requests in the pipeline at the same time.
+*/
+
+#define _GNU_SOURCE		/* recvmmsg(), sendmmsg() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include "ipmi.h"
+#include "ws.h"
+#include "i2c.h"
+#include "module.h"
+#include "sched.h"
+#include "timer.h"
+#include "debug.h"
+#include "error.h"
 #include "rmcp.h"
+#include "crypto.h"
+#include "session.h"
+#include "rmcpd.h"
 
-#define MYPORT PRIMARY_RMCP_PORT // the port users will be connecting to
-#define MAXBUFLEN 100
+#define RMCPD_BMC_ADDR	0x20	/* LAN requests to the BMC use this rsSA */
+#define RMCPD_MAX_MSG	( WS_BUF_LEN_LARGE + 1 )	/* rsSA or rqSA and a frame */
+#define RMCPD_PONG_LEN	( sizeof( RMCP_MSG_HDR ) - 1 + sizeof( ASF_MSG_HDR ) \
+			+ sizeof( ASF_PONG_DATA ) )
 
+/* where the response to the request in a ws goes */
+typedef struct rmcpd_peer {
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	int fd;				/* socket the request came in on */
+	unsigned char valid;
+	unsigned char auth_type;
+	unsigned char session_seq[4];
+	unsigned char session_id[4];
+	unsigned char rq_addr;		/* rqSA, goes ahead of the response */
+	unsigned char rs_addr;		/* rsSA the request was sent to */
+	unsigned char worker;		/* rmcpd_worker[] that owns fd */
+	unsigned rmcpp_session;		/* RMCP+ managed system session ID, 
+					   0 outside a session */
+} RMCPD_PEER;
 
+/* an IPMI message on its way between a worker and the main loop, rsSA
+ * first going in and rqSA first coming out */
+typedef struct rmcpd_msg {
+	RMCPD_PEER peer;
+	unsigned len;
+	unsigned char msg[RMCPD_MAX_MSG];
+} RMCPD_MSG;
 
-void 
-*get_in_addr( struct sockaddr *sa )
-{
-	if( sa->sa_family == AF_INET ) {
-		return &( ( ( struct sockaddr_in * )sa )->sin_addr );
-	}
-	return &( ( ( struct sockaddr_in6 * )sa )->sin6_addr );
-}
+/* Single producer single consumer ring. The producer fills the entry
+ * at head and then moves head, the consumer is done with the entry at
+ * tail before it moves tail. */
+typedef struct rmcpd_ring {
+	unsigned head;			/* next free entry */
+	unsigned tail;			/* next entry to take */
+	RMCPD_MSG entry[RMCPD_RING_LEN];
+} RMCPD_RING;
+
+/* datagrams for one recvmmsg() or sendmmsg() */
+typedef struct rmcpd_batch {
+	struct mmsghdr msg[RMCPD_BATCH_LEN];
+	struct iovec iov[RMCPD_BATCH_LEN];
+	struct sockaddr_storage addr[RMCPD_BATCH_LEN];
+	unsigned char buf[RMCPD_BATCH_LEN][RMCPD_MAX_PKT];
+	unsigned count;			/* out batch: datagrams queued */
+	int fd;				/* out batch: socket they go out on */
+} RMCPD_BATCH;
 
+typedef struct rmcpd_worker {
+	int fd[RMCPD_MAX_SOCKETS];
+	unsigned fd_count;
+	int epoll_fd;
+	int event_fd;			/* main loop has put responses in tx */
+	unsigned char index;
+	unsigned char posted;		/* rx has new requests, worker only */
+	unsigned char kick;		/* tx has new responses, main loop only */
+	RMCPD_RING rx;			/* requests for the main loop */
+	RMCPD_RING tx;			/* responses for the consoles */
+	RMCPD_BATCH in;
+	RMCPD_BATCH out;
+	RMCPD_STATS stats;		/* socket side counters */
+	pthread_t thread;
+} RMCPD_WORKER;
+
+extern IPMI_WS ws_array[];
+
+RMCPD_WORKER	rmcpd_worker[RMCPD_MAX_WORKERS];
+unsigned	rmcpd_worker_count;	/* entries of rmcpd_worker[] in use */
+int		rmcpd_threads;		/* worker threads, 0 runs inline */
+int		rmcpd_event_fd = -1;	/* workers have put requests in rx */
+RMCPD_PEER	rmcpd_peer[WS_ARRAY_SIZE];
+RMCPD_MSG	rmcpd_tx_msg;		/* the one response in flight inline */
+unsigned char	rmcpd_rmcpp;		/* RMCP+ sessions enabled */
+unsigned char	rmcpd_retry_pending;
+unsigned	rmcpd_retry_handle;
+RMCPD_STATS	rmcpd_stats;		/* main loop side counters */
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+int rmcpd_worker_init( RMCPD_WORKER *w, unsigned index, struct addrinfo *servinfo );
+void rmcpd_batch_init( RMCPD_BATCH *b );
+void *rmcpd_worker_main( void *arg );
+void rmcpd_isr( int fd );
+void rmcpd_isr_rings( int fd );
+void rmcpd_retry( unsigned char *arg );
+void rmcpd_drain( void );
+void rmcpd_rx_batch( RMCPD_WORKER *w, int fd );
+void rmcpd_rx_asf( RMCPD_WORKER *w, int fd, unsigned char *pkt, unsigned len,
+	struct sockaddr_storage *addr, socklen_t addr_len );
+void rmcpd_rx_ipmi( RMCPD_WORKER *w, int fd, unsigned char *pkt, unsigned len,
+	struct sockaddr_storage *addr, socklen_t addr_len );
+void rmcpd_rx_rmcpp( RMCPD_WORKER *w, RMCPD_PEER *from, unsigned char *sess,
+	unsigned len );
+void rmcpd_deliver( RMCPD_WORKER *w, RMCPD_PEER *from, unsigned char *msg,
+	unsigned msg_len );
+int rmcpd_queue( RMCPD_PEER *from, unsigned char *msg, unsigned msg_len );
+int rmcpd_sessionless( unsigned char *msg );
+void rmcpd_tx( RMCPD_WORKER *w, RMCPD_MSG *m );
+void rmcpd_tx_ring( RMCPD_WORKER *w );
+void rmcpd_send_rmcpp( RMCPD_WORKER *w, RMCPD_PEER *to, unsigned char type,
+	unsigned char *payload, unsigned len );
+unsigned char *rmcpd_out_alloc( RMCPD_WORKER *w, int fd,
+	struct sockaddr_storage *addr, socklen_t addr_len );
+void rmcpd_out_commit( RMCPD_WORKER *w, unsigned len );
+void rmcpd_out_flush( RMCPD_WORKER *w );
+void rmcpd_doorbell( int fd );
+RMCPD_MSG *rmcpd_ring_put( RMCPD_RING *r );
+void rmcpd_ring_commit( RMCPD_RING *r );
+RMCPD_MSG *rmcpd_ring_get( RMCPD_RING *r );
+void rmcpd_ring_done( RMCPD_RING *r );
+
+/*==============================================================
+ * rmcpd_init()
+ * 	Bind the RMCP port on every local address family, for
+ * 	each worker, and hook the sockets or the workers into the
+ * 	scheduler. Does nothing unless COREIPM_RMCP_PORT is set.
+ *==============================================================*/
 int 
-rmcpd_init_listener( void )
+rmcpd_init( void )
 {
-	int sockfd;
-	struct addrinfo hints, *servinfo, *p;
+	struct addrinfo hints, *servinfo;
+	char *port, *user, *password, *workers;
+	unsigned i;
 	int rv;
-	int numbytes;
-	struct sockaddr_storage their_addr;
-	char buf[MAXBUFLEN];
-	size_t addr_len;
-	char s[INET6_ADDRSTRLEN];
+
+	if( !( port = getenv( "COREIPM_RMCP_PORT" ) ) )
+		return( ESUCCESS );
+
+	if( ( workers = getenv( "COREIPM_LAN_WORKERS" ) ) ) {
+		rmcpd_threads = atoi( workers );
+		if( ( rmcpd_threads < 0 ) || ( rmcpd_threads > RMCPD_MAX_WORKERS ) ) {
+			fprintf( stderr, "rmcpd: COREIPM_LAN_WORKERS must be 0 to %d\n",
+				RMCPD_MAX_WORKERS );
+			return( EINVAL );
+		}
+	}
+	rmcpd_worker_count = rmcpd_threads ? rmcpd_threads : 1;
+
+	session_init();
+	if( ( password = getenv( "COREIPM_LAN_PASSWORD" ) ) ) {
+		if( !( user = getenv( "COREIPM_LAN_USER" ) ) )
+			user = "";
+		if( session_set_user( user, password ) != ESUCCESS ) {
+			fprintf( stderr, "rmcpd: user name or password too long\n" );
+			return( EINVAL );
+		}
+		rmcpd_rmcpp = 1;
+	}
 
 	memset( &hints, 0, sizeof hints );
-	hints.ai_family = AF_UNSPEC; // set to AF_INET to force IPv4
+	hints.ai_family = AF_UNSPEC;
 	hints.ai_socktype = SOCK_DGRAM;
 	hints.ai_flags = AI_PASSIVE; // use my IP
-	if( ( rv = getaddrinfo( NULL, MYPORT, &hints, &servinfo ) ) != 0 ) {
-		fprintf( stderr, "getaddrinfo: %s\n", gai_strerror( rv ) );	
-		return 1;
-	}
-	
-	// loop through all the results and bind to the first we can
-	for( p = servinfo; p != NULL; p = p->ai_next ) {
-		if( ( sockfd = socket(p->ai_family, p->ai_socktype,
+	if( ( rv = getaddrinfo( NULL, port, &hints, &servinfo ) ) != 0 ) {
+		fprintf( stderr, "rmcpd: getaddrinfo: %s\n", gai_strerror( rv ) );	
+		return( EINVAL );
+	}
+	for( i = 0; i < rmcpd_worker_count; i++ ) {
+		if( rmcpd_worker_init( &rmcpd_worker[i], i, servinfo ) != ESUCCESS ) {
+			fprintf( stderr, "rmcpd: failed to bind port %s\n", port );
+			freeaddrinfo( servinfo );
+			return( EIO );
+		}
+	}
+	freeaddrinfo( servinfo );
+
+	channel_table[IPMI_CH_NUM_LAN].protocol = IPMI_CH_PROTOCOL_IPMB;
+	channel_table[IPMI_CH_NUM_LAN].medium = IPMI_CH_MEDIUM_LAN;
+	channel_table[IPMI_CH_NUM_LAN].max_msg_len = WS_BUF_LEN_LARGE;
+
+	if( !rmcpd_threads ) {
+		sched_attach( rmcpd_worker[0].epoll_fd, rmcpd_isr );
+	} else {
+		if( ( rmcpd_event_fd = eventfd( 0, EFD_NONBLOCK ) ) < 0 ) {
+			perror( "rmcpd: eventfd" );
+			return( EIO );
+		}
+		sched_attach( rmcpd_event_fd, rmcpd_isr_rings );
+		for( i = 0; i < rmcpd_worker_count; i++ ) {
+			if( ( rv = pthread_create( &rmcpd_worker[i].thread, 0,
+			    rmcpd_worker_main, &rmcpd_worker[i] ) ) != 0 ) {
+				fprintf( stderr, "rmcpd: pthread_create: %s\n", strerror( rv ) );
+				return( EIO );
+			}
+		}
+	}
+	printf( "RMCP%s on UDP port %s, %u socket%s", rmcpd_rmcpp ? "+" : "", port,
+		rmcpd_worker[0].fd_count, rmcpd_worker[0].fd_count > 1 ? "s" : "" );
+	if( rmcpd_threads )
+		printf( " each for %d worker thread%s", rmcpd_threads,
+			rmcpd_threads > 1 ? "s" : "" );
+	printf( "\n" );
+	return( ESUCCESS );
+}
+
+/* open the sockets and epoll set of worker w */
+int 
+rmcpd_worker_init( RMCPD_WORKER *w, unsigned index, struct addrinfo *servinfo )
+{
+	struct addrinfo *p;
+	struct epoll_event ev;
+	int fd, on = 1;
+
+	w->index = index;
+	w->event_fd = -1;
+	rmcpd_batch_init( &w->in );
+	rmcpd_batch_init( &w->out );
+
+	if( ( w->epoll_fd = epoll_create1( 0 ) ) < 0 ) {
+		perror( "rmcpd: epoll_create1" );
+		return( EIO );
+	}
+
+	for( p = servinfo; p && ( w->fd_count < RMCPD_MAX_SOCKETS ); p = p->ai_next ) {
+		if( ( fd = socket( p->ai_family, p->ai_socktype | SOCK_NONBLOCK,
 				p->ai_protocol ) ) == -1 ) {
 			perror( "rmcpd: socket" );
 			continue;
 		}
-		if( bind( sockfd, p->ai_addr, p->ai_addrlen ) == -1 ) {
-			close( sockfd );
+		/* the IPv4 socket takes the IPv4 traffic */
+		if( p->ai_family == AF_INET6 )
+			setsockopt( fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof( on ) );
+		/* every worker binds the port, the kernel hashes the
+		 * console's address to pick one */
+		if( rmcpd_threads > 1 )
+			setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof( on ) );
+		if( bind( fd, p->ai_addr, p->ai_addrlen ) == -1 ) {
 			perror( "rmcpd: bind" );
+			close( fd );
 			continue;
 		}
-		break;
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if( epoll_ctl( w->epoll_fd, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+			perror( "rmcpd: epoll_ctl" );
+			close( fd );
+			continue;
+		}
+		w->fd[w->fd_count++] = fd;
 	}
-	
-	if( p == NULL ) {
-		fprintf( stderr, "listener: failed to bind socket\n" );
-		return 2;
+	if( !w->fd_count ) {
+		close( w->epoll_fd );
+		w->epoll_fd = -1;
+		return( EIO );
 	}
+	if( !rmcpd_threads )
+		return( ESUCCESS );
 
-	freeaddrinfo( servinfo );
-	printf( "rmcpd: waiting to recvfrom...\n" );
-	addr_len = sizeof their_addr;
-	if( ( numbytes = recvfrom( sockfd, buf, MAXBUFLEN - 1 , 0,
-		( struct sockaddr * )&their_addr, &addr_len ) ) == -1 ) {
-			perror( "recvfrom" );
-			exit( 1 );
+	if( ( w->event_fd = eventfd( 0, EFD_NONBLOCK ) ) < 0 ) {
+		perror( "rmcpd: eventfd" );
+		return( EIO );
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = w->event_fd;
+	if( epoll_ctl( w->epoll_fd, EPOLL_CTL_ADD, w->event_fd, &ev ) == -1 ) {
+		perror( "rmcpd: epoll_ctl" );
+		return( EIO );
+	}
+	return( ESUCCESS );
+}
+
+/* point each mmsghdr of b at its own buffer and address */
+void
+rmcpd_batch_init( RMCPD_BATCH *b )
+{
+	unsigned i;
+
+	memset( b, 0, sizeof( RMCPD_BATCH ) );
+	for( i = 0; i < RMCPD_BATCH_LEN; i++ ) {
+		b->iov[i].iov_base = b->buf[i];
+		b->iov[i].iov_len = RMCPD_MAX_PKT;
+		b->msg[i].msg_hdr.msg_name = &b->addr[i];
+		b->msg[i].msg_hdr.msg_namelen = sizeof( b->addr[i] );
+		b->msg[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msg[i].msg_hdr.msg_iovlen = 1;
 	}
-	printf( "rmcpd: got packet from %s\n",
-			inet_ntop( their_addr.ss_family,
-				get_in_addr( ( struct sockaddr * )&their_addr ),
-				s, sizeof s ) );
+}
+
+/*==============================================================
+ * rmcpd_worker_main()
+ * 	Worker thread. Sleeps in epoll_wait() until a socket has
+ * 	datagrams or the main loop rings with responses, whatever
+ * 	comes of it goes out in one batch per wakeup.
+ *==============================================================*/
+void *
+rmcpd_worker_main( void *arg )
+{
+	RMCPD_WORKER *w = ( RMCPD_WORKER * )arg;
+	struct epoll_event ev[RMCPD_MAX_SOCKETS + 1];
+	uint64_t count;
+	int i, n;
 
-	printf( "rmcpd: packet is %d bytes long\n", numbytes );
-	buf[numbytes] = '\0';
-	printf( "rmcpd: packet contains \"%s\"\n", buf );
-	close( sockfd );
-	return 0;
+	for( ;; ) {
+		if( ( n = epoll_wait( w->epoll_fd, ev, RMCPD_MAX_SOCKETS + 1, -1 ) ) < 0 ) {
+			if( errno == EINTR )
+				continue;
+			perror( "rmcpd: epoll_wait" );
+			exit( EXIT_FAILURE );
+		}
+		for( i = 0; i < n; i++ ) {
+			if( ev[i].data.fd == w->event_fd ) {
+				if( read( w->event_fd, &count, sizeof( count ) ) > 0 )
+					rmcpd_tx_ring( w );
+			} else {
+				rmcpd_rx_batch( w, ev[i].data.fd );
+			}
+		}
+		rmcpd_out_flush( w );
+	}
+	return( 0 );
 }
 
+/*==============================================================
+ * rmcpd_isr()
+ * 	Inline mode, the epoll set is readable. Drain every socket
+ * 	in it that has datagrams waiting and send the answers.
+ *==============================================================*/
+void
+rmcpd_isr( int fd )
+{
+	RMCPD_WORKER *w = &rmcpd_worker[0];
+	struct epoll_event ev[RMCPD_MAX_SOCKETS];
+	int i, n;
+
+	n = epoll_wait( fd, ev, RMCPD_MAX_SOCKETS, 0 );
+	for( i = 0; i < n; i++ )
+		rmcpd_rx_batch( w, ev[i].data.fd );
+	rmcpd_out_flush( w );
+}
+
+/*==============================================================
+ * rmcpd_isr_rings()
+ * 	Workers have rung, queue the requests they have put in
+ * 	their rx rings.
+ *==============================================================*/
+void
+rmcpd_isr_rings( int fd )
+{
+	uint64_t count;
+
+	if( read( fd, &count, sizeof( count ) ) > 0 )
+		rmcpd_drain();
+}
+
+/* try again for requests that found no free ws */
+void
+rmcpd_retry( unsigned char *arg )
+{
+	rmcpd_retry_pending = 0;
+	sched_post( SCHED_LAN );
+}
+
+/* Hand the requests in the rx rings to rmcpd_queue(). When the ws pool
+ * runs dry the rest wait in the rings, the next rmcpd_flush() or a tick
+ * from now takes them, whichever comes first. */
+void
+rmcpd_drain( void )
+{
+	RMCPD_RING *ring;
+	RMCPD_MSG *m;
+	unsigned i;
+
+	for( i = 0; i < rmcpd_worker_count; i++ ) {
+		ring = &rmcpd_worker[i].rx;
+		while( ( m = rmcpd_ring_get( ring ) ) ) {
+			if( rmcpd_queue( &m->peer, m->msg, m->len ) == EAGAIN ) {
+				if( !rmcpd_retry_pending ) {
+					rmcpd_retry_pending = 1;
+					timer_add_callout_queue( ( void * )&rmcpd_retry_handle,
+						1, rmcpd_retry, 0 );
+				}
+				return;
+			}
+			rmcpd_ring_done( ring );
+		}
+	}
+}
+
+/*==============================================================
+ * rmcpd_rx_batch()
+ * 	Read fd until it is empty, RMCPD_BATCH_LEN datagrams per
+ * 	system call.
+ *==============================================================*/
+void
+rmcpd_rx_batch( RMCPD_WORKER *w, int fd )
+{
+	RMCPD_BATCH *b = &w->in;
+	unsigned char *pkt;
+	unsigned len;
+	int i, n;
+
+	do {
+		for( i = 0; i < RMCPD_BATCH_LEN; i++ )
+			b->msg[i].msg_hdr.msg_namelen = sizeof( b->addr[i] );
+		if( ( n = recvmmsg( fd, b->msg, RMCPD_BATCH_LEN, MSG_DONTWAIT, 0 ) ) <= 0 )
+			break;
+		w->stats.rx += n;
+
+		for( i = 0; i < n; i++ ) {
+			pkt = b->buf[i];
+			len = b->msg[i].msg_len;
+
+			/* RMCP header: version, reserved, sequence number, class */
+			if( ( len < sizeof( RMCP_MSG_HDR ) - 1 )
+			    || ( b->msg[i].msg_hdr.msg_flags & MSG_TRUNC )
+			    || ( pkt[0] != RMCP_VERSION_1 ) ) {
+				w->stats.bad_hdr++;
+				continue;
+			}
+			switch( pkt[3] ) {
+				case RMCP_CLASS_ASF:
+					rmcpd_rx_asf( w, fd, pkt, len, &b->addr[i],
+						b->msg[i].msg_hdr.msg_namelen );
+					break;
+				case RMCP_CLASS_IPMI:
+					rmcpd_rx_ipmi( w, fd, pkt, len, &b->addr[i],
+						b->msg[i].msg_hdr.msg_namelen );
+					break;
+				default:
+					/* RMCP ACKs and everything else */
+					w->stats.unsupported++;
+					break;
+			}
+		}
+
+		/* let the main loop start on these while we read on */
+		if( w->posted ) {
+			w->posted = 0;
+			rmcpd_doorbell( rmcpd_event_fd );
+		}
+	} while( n == RMCPD_BATCH_LEN );
+}
+
+/*==============================================================
+ * rmcpd_rx_asf()
+ * 	Answer an ASF Presence Ping, ACKing it first if the sender
+ * 	asked for that.
+ *==============================================================*/
+void
+rmcpd_rx_asf( 
+	RMCPD_WORKER *w,
+	int fd, 
+	unsigned char *pkt, 
+	unsigned len, 
+	struct sockaddr_storage *addr, 
+	socklen_t addr_len )
+{
+	ASF_MSG_HDR *asf = ( ASF_MSG_HDR * )( pkt + sizeof( RMCP_MSG_HDR ) - 1 );
+	ASF_MSG_HDR *pong;
+	ASF_PONG_DATA *data;
+	unsigned char *resp;
+
+	if( ( len < sizeof( RMCP_MSG_HDR ) - 1 + sizeof( ASF_MSG_HDR ) )
+	    || ( asf->iana[0] != ( ( ASF_IANA >> 24 ) & 0xff ) ) 
+	    || ( asf->iana[1] != ( ( ASF_IANA >> 16 ) & 0xff ) )
+	    || ( asf->iana[2] != ( ( ASF_IANA >> 8 ) & 0xff ) ) 
+	    || ( asf->iana[3] != ( ASF_IANA & 0xff ) ) ) {
+		w->stats.bad_hdr++;
+		return;
+	}
+	if( asf->msg_type != ASF_MSG_PRESENCE_PING ) {
+		w->stats.unsupported++;
+		return;
+	}
+
+	if( pkt[2] != RMCP_SEQ_NO_ACK ) {
+		resp = rmcpd_out_alloc( w, fd, addr, addr_len );
+		resp[0] = RMCP_VERSION_1;
+		resp[1] = 0;
+		resp[2] = pkt[2];
+		resp[3] = RMCP_ACK_BIT | RMCP_CLASS_ASF;
+		rmcpd_out_commit( w, sizeof( RMCP_MSG_HDR ) - 1 );
+	}
+
+	resp = rmcpd_out_alloc( w, fd, addr, addr_len );
+	pong = ( ASF_MSG_HDR * )( resp + sizeof( RMCP_MSG_HDR ) - 1 );
+	data = ( ASF_PONG_DATA * )( pong + 1 );
+	memset( resp, 0, RMCPD_PONG_LEN );
+	resp[0] = RMCP_VERSION_1;
+	resp[2] = pkt[2];
+	resp[3] = RMCP_CLASS_ASF;
+	memcpy( pong->iana, asf->iana, sizeof( pong->iana ) );
+	pong->msg_type = ASF_MSG_PRESENCE_PONG;
+	pong->msg_tag = asf->msg_tag;
+	pong->data_len = sizeof( ASF_PONG_DATA );
+	memcpy( data->iana, asf->iana, sizeof( data->iana ) );
+	data->supported_entities = ASF_PONG_ENT_IPMI | ASF_PONG_ENT_ASF_10;
+	rmcpd_out_commit( w, RMCPD_PONG_LEN );
+	w->stats.ping++;
+}
+
+/*==============================================================
+ * rmcpd_rx_ipmi()
+ * 	Strip the session header off an IPMI message, IPMI v1.5 
+ * 	or RMCP+, and pass it on.
+ *==============================================================*/
+void
+rmcpd_rx_ipmi( 
+	RMCPD_WORKER *w,
+	int fd, 
+	unsigned char *pkt, 
+	unsigned len, 
+	struct sockaddr_storage *addr, 
+	socklen_t addr_len )
+{
+	unsigned char *sess = pkt + sizeof( RMCP_MSG_HDR ) - 1;
+	unsigned hdr_len = sizeof( RMCP_MSG_HDR ) - 1 + IPMI_SESSION_HDR_LEN;
+	unsigned msg_len;
+	RMCPD_PEER from;
+
+	if( len < sizeof( RMCP_MSG_HDR ) ) {
+		w->stats.bad_hdr++;
+		return;
+	}
+	memcpy( &from.addr, addr, addr_len );
+	from.addr_len = addr_len;
+	from.fd = fd;
+	from.worker = w->index;
+	from.auth_type = sess[0] & 0x0f;
+	from.rmcpp_session = 0;
+
+	switch( from.auth_type ) {
+		case AUTH_TYPE_NONE:
+			if( len < hdr_len ) {
+				w->stats.bad_hdr++;
+				return;
+			}
+			memcpy( from.session_seq, sess + 1, 4 );
+			memcpy( from.session_id, sess + 5, 4 );
+			msg_len = sess[IPMI_SESSION_HDR_LEN - 1];
+			if( hdr_len + msg_len > len ) {
+				w->stats.bad_hdr++;
+				return;
+			}
+			rmcpd_deliver( w, &from, pkt + hdr_len, msg_len );
+			break;
+		case AUTH_TYPE_RMCPP:
+			if( !rmcpd_rmcpp ) {
+				w->stats.unsupported++;
+				return;
+			}
+			rmcpd_rx_rmcpp( w, &from, sess, len - ( sizeof( RMCP_MSG_HDR ) - 1 ) );
+			break;
+		default:
+			/* the v1.5 authenticated formats */
+			w->stats.unsupported++;
+			break;
+	}
+}
+
+/*==============================================================
+ * rmcpd_rx_rmcpp()
+ * 	An RMCP+ packet, sess is the session header. Messages on 
+ * 	a session go through session_unwrap() before they are
+ * 	passed on, outside a session Open Session and RAKP are
+ * 	answered and unauthenticated IPMI messages, the console's
+ * 	Get Channel Authentication Capabilities, are passed on.
+ *==============================================================*/
+void
+rmcpd_rx_rmcpp( RMCPD_WORKER *w, RMCPD_PEER *from, unsigned char *sess, unsigned len )
+{
+	unsigned char resp[SESSION_RESP_MAX];
+	unsigned char *msg;
+	unsigned msg_len, resp_len;
+
+	if( len < RMCPP_SESSION_HDR_LEN ) {
+		w->stats.bad_hdr++;
+		return;
+	}
+
+	if( sess[2] | sess[3] | sess[4] | sess[5] ) {
+		if( !( from->rmcpp_session = session_unwrap( sess, len, &msg, &msg_len ) ) ) {
+			w->stats.session_drop++;
+			return;
+		}
+		rmcpd_deliver( w, from, msg, msg_len );
+		return;
+	}
+
+	msg = sess + RMCPP_SESSION_HDR_LEN;
+	msg_len = sess[10] | ( sess[11] << 8 );
+	if( RMCPP_SESSION_HDR_LEN + msg_len > len ) {
+		w->stats.bad_hdr++;
+		return;
+	}
+	switch( sess[1] ) {
+		case IOLAN_PAYLOAD_IPMI_MESSAGE:
+			rmcpd_deliver( w, from, msg, msg_len );
+			return;
+		case IOLAN_RMCPP_OPEN_SESSION_REQ:
+			resp_len = session_open( msg, msg_len, resp );
+			break;
+		case IOLAN_RAKP_MSG1:
+			resp_len = session_rakp1( msg, msg_len, resp );
+			break;
+		case IOLAN_RAKP_MSG3:
+			resp_len = session_rakp3( msg, msg_len, resp );
+			break;
+		default:
+			/* and anything authenticated or encrypted */
+			w->stats.unsupported++;
+			return;
+	}
+	/* the response payload types follow the requests */
+	if( resp_len )
+		rmcpd_send_rmcpp( w, from, sess[1] + 1, resp, resp_len );
+}
+
+/* Pass an IPMI message on to rmcpd_queue(), directly inline or through
+ * the rx ring of worker w. The main loop is rung once per batch. */
+void
+rmcpd_deliver( RMCPD_WORKER *w, RMCPD_PEER *from, unsigned char *msg, unsigned msg_len )
+{
+	RMCPD_MSG *m;
+
+	if( !rmcpd_threads ) {
+		if( rmcpd_queue( from, msg, msg_len ) == EAGAIN ) {
+			rmcpd_stats.no_ws++;
+			dputstr( DBG_LAN | DBG_ERR, "rmcpd_deliver: no ws\n" );
+		}
+		return;
+	}
+
+	if( msg_len > RMCPD_MAX_MSG ) {
+		w->stats.bad_hdr++;
+		return;
+	}
+	if( !( m = rmcpd_ring_put( &w->rx ) ) ) {
+		w->stats.ring_full++;
+		return;
+	}
+	m->peer = *from;
+	m->len = msg_len;
+	memcpy( m->msg, msg, msg_len );
+	rmcpd_ring_commit( &w->rx );
+	w->posted = 1;
+}
+
+/*==============================================================
+ * rmcpd_queue()
+ * 	Queue an IPMI message for ipmi_process_pkt(), msg starts 
+ * 	with the rsSA. What is left without the rsSA is what an 
+ * 	IPMB frame has after the slave address. from says where
+ * 	the response goes. Returns EAGAIN if there is no ws for
+ * 	it right now, EINVAL if it is not for us.
+ *==============================================================*/
+int 
+rmcpd_queue( RMCPD_PEER *from, unsigned char *msg, unsigned msg_len )
+{
+	unsigned char rs_addr, local_addr;
+	RMCPD_PEER *peer;
+	IPMI_WS *ws;
+
+	/* rsSA, netFn/rsLUN, checksum, rqSA, rqSeq/rqLUN, cmd, checksum */
+	if( ( msg_len < 7 ) || ( ( unsigned char )( msg[0] + msg[1] + msg[2] ) != 0 ) ) {
+		rmcpd_stats.bad_hdr++;
+		return( EINVAL );
+	}
+	rs_addr = msg[0];
+	local_addr = module_get_i2c_address( I2C_ADDRESS_LOCAL );
+	if( ( rs_addr != RMCPD_BMC_ADDR ) && ( rs_addr != local_addr ) ) {
+		rmcpd_stats.unsupported++;
+		return( EINVAL );
+	}
+	if( rmcpd_rmcpp && !from->rmcpp_session && !rmcpd_sessionless( msg ) ) {
+		rmcpd_stats.no_session++;
+		return( EINVAL );
+	}
+
+	if( !( ws = ws_alloc() ) )
+		return( EAGAIN );
+	/* bigger buffers only for requests that need them, a busy LAN
+	 * would use up the pool otherwise */
+	if( ( msg_len - 1 > ws->buf_len ) 
+	    && ( ws_buf_alloc( ws, msg_len - 1 ) != ESUCCESS ) ) {
+		ws_free( ws );
+		return( EAGAIN );
+	}
+
+	peer = &rmcpd_peer[ws - ws_array];
+	*peer = *from;
+	peer->valid = 1;
+	peer->rq_addr = msg[3];
+	peer->rs_addr = rs_addr;
+
+	/* ipmi_process_pkt() checks the header checksum against our own 
+	 * address, make it one for that */
+	memcpy( ws->pkt_in, msg + 1, msg_len - 1 );
+	ws->pkt_in[1] = -( ws->pkt_in[0] + local_addr );
+
+	ws->incoming_protocol = IPMI_CH_PROTOCOL_IPMB;
+	ws->incoming_medium = IPMI_CH_MEDIUM_LAN;
+	ws->incoming_channel = IPMI_CH_NUM_LAN;
+	ws->len_in = msg_len - 1;
+	ws->flags = 0;
+	ws->addr_out = peer->rq_addr;
+	rmcpd_stats.rx_ipmi++;
+	ws_set_state( ws, WS_ACTIVE_IN );
+	return( ESUCCESS );
+}
+
+/* the requests a console needs to open a session, all that is served
+ * outside one once a password is set */
+int
+rmcpd_sessionless( unsigned char *msg )
+{
+	if( ( msg[1] >> 2 ) != NETFN_APP_REQ )
+		return( 0 );
+	switch( msg[5] ) {
+		case IPMI_CMD_GET_CHANNEL_AUTH_CAP:
+		case IPMI_CMD_GET_CHANNEL_CIPHER_SUITES:
+		case IPMI_CMD_GET_SYSTEM_GUID:
+			return( 1 );
+		default:
+			return( 0 );
+	}
+}
+
+/*==============================================================
+ * rmcpd_send()
+ * 	Send the response in ws to the console the request came 
+ * 	from, called from the ws work list. It goes out with the
+ * 	next rmcpd_flush(). The ws is done with once this returns,
+ * 	LAN has no retries.
+ *==============================================================*/
+void
+rmcpd_send( IPMI_WS *ws )
+{
+	RMCPD_PEER *peer = &rmcpd_peer[ws - ws_array];
+	RMCPD_WORKER *w = &rmcpd_worker[peer->worker];
+	unsigned char *frame = WS_FRAME_OUT( ws );
+	unsigned char local_addr;
+	RMCPD_MSG *m;
+
+	if( !peer->valid || ( ws->len_out < 6 ) || ( ws->len_out + 1 > 0xff ) ) {
+		dputstr( DBG_LAN | DBG_ERR, "rmcpd_send: nothing to send\n" );
+		rmcpd_stats.tx_err++;
+		goto done;
+	}
+	peer->valid = 0;
+
+	/* answer with the address the request was sent to, the data
+	 * checksum covers it */
+	local_addr = frame[2];
+	if( peer->rs_addr != local_addr ) {
+		frame[2] = peer->rs_addr;
+		frame[ws->len_out - 1] -= peer->rs_addr - local_addr;
+	}
+
+	if( !rmcpd_threads ) {
+		m = &rmcpd_tx_msg;
+	} else if( !( m = rmcpd_ring_put( &w->tx ) ) ) {
+		rmcpd_stats.ring_full++;
+		goto done;
+	}
+	m->peer = *peer;
+	m->msg[0] = peer->rq_addr;
+	memcpy( m->msg + 1, frame, ws->len_out );
+	m->len = ws->len_out + 1;
+	if( !rmcpd_threads ) {
+		rmcpd_tx( w, m );
+	} else {
+		rmcpd_ring_commit( &w->tx );
+		w->kick = 1;
+	}
+	sched_post( SCHED_LAN );
+
+done:
+	ws_set_state( ws, WS_ACTIVE_MASTER_WRITE_SUCCESS );
+	if( ws->ipmi_completion_function )
+		( ws->ipmi_completion_function )( ( void * )ws, XPORT_REQ_NOERR );
+	else
+		ws_free( ws );
+}
+
+/*==============================================================
+ * rmcpd_flush()
+ * 	SCHED_LAN, run from the main loop once the work list has
+ * 	been through. Sends the responses rmcpd_send() has queued,
+ * 	or rings the workers that have some, and picks up requests
+ * 	that are still waiting for a ws.
+ *==============================================================*/
+void
+rmcpd_flush( void )
+{
+	RMCPD_WORKER *w;
+	unsigned i;
+
+	if( !rmcpd_threads ) {
+		if( rmcpd_worker_count )
+			rmcpd_out_flush( &rmcpd_worker[0] );
+		return;
+	}
+	for( i = 0; i < rmcpd_worker_count; i++ ) {
+		w = &rmcpd_worker[i];
+		if( w->kick ) {
+			w->kick = 0;
+			rmcpd_doorbell( w->event_fd );
+		}
+	}
+	rmcpd_drain();
+}
+
+/* Put the response in m in the out batch of w, under the header it
+ * needs. RMCP+ encrypts and signs the message as one piece, rqSA
+ * first. The session may have gone while the request was processed. */
+void
+rmcpd_tx( RMCPD_WORKER *w, RMCPD_MSG *m )
+{
+	RMCPD_PEER *peer = &m->peer;
+	unsigned char *out;
+	unsigned len;
+
+	if( peer->auth_type == AUTH_TYPE_RMCPP ) {
+		if( !peer->rmcpp_session ) {
+			rmcpd_send_rmcpp( w, peer, IOLAN_PAYLOAD_IPMI_MESSAGE, m->msg, m->len );
+			return;
+		}
+		out = rmcpd_out_alloc( w, peer->fd, &peer->addr, peer->addr_len );
+		out[0] = RMCP_VERSION_1;
+		out[1] = 0;
+		out[2] = RMCP_SEQ_NO_ACK;
+		out[3] = RMCP_CLASS_IPMI;
+		if( !( len = session_wrap( peer->rmcpp_session, m->msg, m->len,
+		    out + sizeof( RMCP_MSG_HDR ) - 1,
+		    RMCPD_MAX_PKT - ( sizeof( RMCP_MSG_HDR ) - 1 ) ) ) ) {
+			w->stats.session_drop++;
+			return;
+		}
+		rmcpd_out_commit( w, sizeof( RMCP_MSG_HDR ) - 1 + len );
+		return;
+	}
+
+	out = rmcpd_out_alloc( w, peer->fd, &peer->addr, peer->addr_len );
+	out[0] = RMCP_VERSION_1;
+	out[1] = 0;
+	out[2] = RMCP_SEQ_NO_ACK;
+	out[3] = RMCP_CLASS_IPMI;
+	out[4] = peer->auth_type;
+	memcpy( out + 5, peer->session_seq, 4 );
+	memcpy( out + 9, peer->session_id, 4 );
+	out[13] = m->len;
+	memcpy( out + 14, m->msg, m->len );
+	rmcpd_out_commit( w, sizeof( RMCP_MSG_HDR ) - 1 + IPMI_SESSION_HDR_LEN + m->len );
+}
+
+/* worker side of SCHED_LAN, send what the main loop has put in tx */
+void
+rmcpd_tx_ring( RMCPD_WORKER *w )
+{
+	RMCPD_MSG *m;
+
+	while( ( m = rmcpd_ring_get( &w->tx ) ) ) {
+		rmcpd_tx( w, m );
+		rmcpd_ring_done( &w->tx );
+	}
+}
+
+/* send an RMCP+ payload outside a session */
+void
+rmcpd_send_rmcpp( 
+	RMCPD_WORKER *w,
+	RMCPD_PEER *to, 
+	unsigned char type, 
+	unsigned char *payload, 
+	unsigned len )
+{
+	unsigned hdr_len = sizeof( RMCP_MSG_HDR ) - 1 + RMCPP_SESSION_HDR_LEN;
+	unsigned char *out;
+
+	out = rmcpd_out_alloc( w, to->fd, &to->addr, to->addr_len );
+	memset( out, 0, hdr_len );
+	out[0] = RMCP_VERSION_1;
+	out[2] = RMCP_SEQ_NO_ACK;
+	out[3] = RMCP_CLASS_IPMI;
+	out[4] = AUTH_TYPE_RMCPP;
+	out[5] = type;
+	out[14] = len & 0xff;		/* session ID and sequence number 0 */
+	out[15] = len >> 8;
+	memcpy( out + hdr_len, payload, len );
+	rmcpd_out_commit( w, hdr_len + len );
+}
+
+/*==============================================================
+ * rmcpd_out_alloc()
+ * 	Buffer for the next datagram in the out batch of w, to
+ * 	addr on socket fd, RMCPD_MAX_PKT long. The batch is sent
+ * 	first if it is full or for another socket.
+ *==============================================================*/
+unsigned char *
+rmcpd_out_alloc(
+	RMCPD_WORKER *w,
+	int fd, 
+	struct sockaddr_storage *addr, 
+	socklen_t addr_len )
+{
+	RMCPD_BATCH *b = &w->out;
+
+	if( ( b->count == RMCPD_BATCH_LEN ) || ( b->count && ( b->fd != fd ) ) )
+		rmcpd_out_flush( w );
+	b->fd = fd;
+	memcpy( &b->addr[b->count], addr, addr_len );
+	b->msg[b->count].msg_hdr.msg_namelen = addr_len;
+	return( b->buf[b->count] );
+}
+
+/* the datagram rmcpd_out_alloc() handed out is len bytes, add it */
+void
+rmcpd_out_commit( RMCPD_WORKER *w, unsigned len )
+{
+	RMCPD_BATCH *b = &w->out;
+
+	b->iov[b->count].iov_len = len;
+	b->count++;
+}
+
+/* send the out batch of w, a datagram the socket refuses is dropped */
+void
+rmcpd_out_flush( RMCPD_WORKER *w )
+{
+	RMCPD_BATCH *b = &w->out;
+	unsigned sent = 0;
+	int n;
+
+	while( sent < b->count ) {
+		if( ( n = sendmmsg( b->fd, b->msg + sent, b->count - sent, MSG_DONTWAIT ) ) <= 0 ) {
+			w->stats.tx_err++;
+			n = 1;
+		} else {
+			w->stats.tx += n;
+		}
+		sent += n;
+	}
+	b->count = 0;
+}
+
+/* wake whoever waits on eventfd fd */
+void
+rmcpd_doorbell( int fd )
+{
+	uint64_t one = 1;
+
+	if( write( fd, &one, sizeof( one ) ) < 0 )
+		dputstr( DBG_LAN | DBG_ERR, "rmcpd_doorbell: write failed\n" );
+}
+
+/*==============================================================
+ * Rings between the workers and the main loop. Each side only
+ * writes its own index, the acquire and release make the entry
+ * contents visible before the index that covers them.
+ *==============================================================*/
+
+/* entry to fill at the head of r, 0 if r is full */
+RMCPD_MSG *
+rmcpd_ring_put( RMCPD_RING *r )
+{
+	if( r->head - __atomic_load_n( &r->tail, __ATOMIC_ACQUIRE ) == RMCPD_RING_LEN )
+		return( 0 );
+	return( &r->entry[r->head & ( RMCPD_RING_LEN - 1 )] );
+}
+
+/* the entry rmcpd_ring_put() handed out is filled in */
+void
+rmcpd_ring_commit( RMCPD_RING *r )
+{
+	__atomic_store_n( &r->head, r->head + 1, __ATOMIC_RELEASE );
+}
+
+/* entry at the tail of r, 0 if r is empty */
+RMCPD_MSG *
+rmcpd_ring_get( RMCPD_RING *r )
+{
+	if( __atomic_load_n( &r->head, __ATOMIC_ACQUIRE ) == r->tail )
+		return( 0 );
+	return( &r->entry[r->tail & ( RMCPD_RING_LEN - 1 )] );
+}
+
+/* done with the entry rmcpd_ring_get() handed out */
+void
+rmcpd_ring_done( RMCPD_RING *r )
+{
+	__atomic_store_n( &r->tail, r->tail + 1, __ATOMIC_RELEASE );
+}
+
+/*==============================================================
+ * rmcpd_get_stats()
+ * 	Counters of the main loop and every worker added up. The
+ * 	worker counters are read as they are, without stopping
+ * 	the workers.
+ *==============================================================*/
+void
+rmcpd_get_stats( RMCPD_STATS *stats )
+{
+	unsigned long *sum = ( unsigned long * )stats;
+	unsigned long *count;
+	unsigned i, j;
+
+	*stats = rmcpd_stats;
+	for( i = 0; i < rmcpd_worker_count; i++ ) {
+		count = ( unsigned long * )&rmcpd_worker[i].stats;
+		for( j = 0; j < sizeof( RMCPD_STATS ) / sizeof( unsigned long ); j++ )
+			sum[j] += count[j];
+	}
+}
+
+/*==============================================================
+ * rmcpd_get_priv()
+ * 	The privilege level the request in ws is served at. That 
+ * 	of its session on LAN, User for the sessionless requests
+ * 	let through with a password set. Without a password LAN 
+ * 	is as open as every other channel.
+ *==============================================================*/
+unsigned char
+rmcpd_get_priv( IPMI_WS *ws )
+{
+	RMCPD_PEER *peer = &rmcpd_peer[ws - ws_array];
+
+	if( ( ws->incoming_medium != IPMI_CH_MEDIUM_LAN ) || !rmcpd_rmcpp )
+		return( IPMI_PRIV_ADMIN );
+	if( peer->rmcpp_session )
+		return( session_get_priv( peer->rmcpp_session ) );
+	return( IPMI_PRIV_USER );
+}
+
+/*==============================================================
+ * rmcpd_get_channel_auth_cap()
+ * 	Get Channel Authentication Capabilities, the first thing 
+ * 	a console asks. Authentication type none for IPMI v1.5, 
+ * 	and RMCP+ if a user is set.
+ *==============================================================*/
+void
+rmcpd_get_channel_auth_cap( IPMI_PKT *pkt )
+{
+	unsigned char *req = &pkt->req->data;
+	unsigned char *resp = ( unsigned char * )pkt->resp;
+	unsigned char channel = req[0] & 0x0f;
+
+	dputstr( DBG_LAN | DBG_LVL1, "rmcpd_get_channel_auth_cap: ingress\n" );
+
+	if( ( channel != IPMI_CH_NUM_PRESENT_INTERFACE ) && ( channel != IPMI_CH_NUM_LAN ) ) {
+		resp[0] = CC_INVALID_DATA_IN_REQ;
+		pkt->hdr.resp_data_len = 0;
+		return;
+	}
+	memset( resp, 0, 9 );
+	resp[0] = CC_NORMAL;
+	resp[1] = IPMI_CH_NUM_LAN;
+	resp[2] = 1 << AUTH_TYPE_NONE;
+	resp[3] = CH_AUTH_CAP_ANONYMOUS;
+	resp[4] = CH_AUTH_CAP_EXT_V15;
+	if( rmcpd_rmcpp ) {
+		resp[2] |= CH_AUTH_CAP_V20_DATA;
+		resp[3] |= session_user_len ? CH_AUTH_CAP_NON_NULL_USERS : CH_AUTH_CAP_NULL_USERS;
+		resp[4] |= CH_AUTH_CAP_EXT_V20;
+	}
+	pkt->hdr.resp_data_len = 8;	/* OEM ID and aux data are 0 */
+}
+
+/*==============================================================
+ * rmcpd_set_session_priv()
+ * 	Set Session Privilege Level, up to what the session asked
+ * 	for in RAKP 1. Level 0 reads the current one.
+ *==============================================================*/
+void
+rmcpd_set_session_priv( IPMI_PKT *pkt )
+{
+	unsigned char *req = &pkt->req->data;
+	unsigned char *resp = ( unsigned char * )pkt->resp;
+	IPMI_WS *ws = ( IPMI_WS * )pkt->hdr.ws;
+	RMCPD_PEER *peer = &rmcpd_peer[ws - ws_array];
+
+	pkt->hdr.resp_data_len = 0;
+	if( ( ws->incoming_medium != IPMI_CH_MEDIUM_LAN ) || !peer->rmcpp_session ) {
+		resp[0] = CC_CMD_ILLEGAL;
+		return;
+	}
+	resp[0] = session_set_priv( peer->rmcpp_session, req[0] & 0x0f, &resp[1] );
+	if( resp[0] == CC_NORMAL )
+		pkt->hdr.resp_data_len = 1;
+}
+
+/*==============================================================
+ * rmcpd_close_session()
+ * 	Close Session. A session closing itself is released once
+ * 	the response has gone out on it. Closing another session
+ * 	takes Administrator privilege.
+ *==============================================================*/
+void
+rmcpd_close_session( IPMI_PKT *pkt )
+{
+	unsigned char *req = &pkt->req->data;
+	unsigned char *resp = ( unsigned char * )pkt->resp;
+	IPMI_WS *ws = ( IPMI_WS * )pkt->hdr.ws;
+	RMCPD_PEER *peer = &rmcpd_peer[ws - ws_array];
+	unsigned id = req[0] | ( req[1] << 8 ) | ( req[2] << 16 ) | ( ( unsigned )req[3] << 24 );
+
+	pkt->hdr.resp_data_len = 0;
+	if( ( ws->incoming_medium != IPMI_CH_MEDIUM_LAN ) || !peer->rmcpp_session ) {
+		resp[0] = CC_CMD_ILLEGAL;
+		return;
+	}
+	if( ( id != peer->rmcpp_session ) 
+	    && ( session_get_priv( peer->rmcpp_session ) < IPMI_PRIV_ADMIN ) ) {
+		resp[0] = CC_SECURITY_RESTRICTION;
+		return;
+	}
+	resp[0] = session_close( id, peer->rmcpp_session );
+}
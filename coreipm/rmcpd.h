@@ -24,4 +24,42 @@ support and contact details.
 -------------------------------------------------------------------------------
 */
 
-int rmcpd_init_listener( void );
+/* IPMI over LAN for the host build, see rmcpd.c */
+
+#ifndef RMCPD_MAX_SOCKETS
+#define RMCPD_MAX_SOCKETS	4	/* one per local address family */
+#endif
+#define RMCPD_MAX_PKT		512	/* biggest datagram handled */
+#ifndef RMCPD_BATCH_LEN
+#define RMCPD_BATCH_LEN		32	/* datagrams per recvmmsg() or sendmmsg() */
+#endif
+#define RMCPD_MAX_WORKERS	8	/* COREIPM_LAN_WORKERS limit */
+#ifndef RMCPD_RING_LEN
+#define RMCPD_RING_LEN		256	/* messages queued each way per worker, 
+					   must be a power of 2 */
+#endif
+
+typedef struct rmcpd_stats {
+	unsigned long rx;		/* datagrams received */
+	unsigned long rx_ipmi;		/* IPMI messages handed to ipmi_process_pkt() */
+	unsigned long tx;		/* responses sent */
+	unsigned long ping;		/* ASF presence pings answered */
+	unsigned long bad_hdr;		/* malformed RMCP, session or message header */
+	unsigned long unsupported;	/* class, auth type or address we do not serve */
+	unsigned long no_ws;		/* dropped, no ws free */
+	unsigned long tx_err;		/* sendmsg() failed */
+	unsigned long session_drop;	/* RMCP+ packets refused by session_unwrap(),
+					   or responses for a session that is gone */
+	unsigned long ring_full;	/* dropped, a worker ring was full */
+	unsigned long no_session;	/* sessionless requests refused, a 
+					   password is set */
+} RMCPD_STATS;
+
+int rmcpd_init( void );
+void rmcpd_send( IPMI_WS *ws );
+void rmcpd_flush( void );
+void rmcpd_get_stats( RMCPD_STATS *stats );
+unsigned char rmcpd_get_priv( IPMI_WS *ws );
+void rmcpd_get_channel_auth_cap( IPMI_PKT *pkt );
+void rmcpd_set_session_priv( IPMI_PKT *pkt );
+void rmcpd_close_session( IPMI_PKT *pkt );
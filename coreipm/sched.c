@@ -0,0 +1,266 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/sched.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+Run queue scheduler
+
+Interrupt handlers and the transport layers post work bits with sched_post()
+when they hand something to the main loop. The main loop picks up all pending
+bits at once with sched_get_work() and services every ready source in
+priority order. When nothing is pending sched_get_work() puts the CPU in Idle
+mode, any interrupt brings it back.
+
+sched_idle() looks at the work bits once more with IRQs masked in the CPSR and
+only enters Idle if there still are none. An interrupt that comes in between
+ends Idle straight away and runs when the CPSR is restored, so no post waits
+for the next tick.
+*/
+
+#if defined (POSIX)
+#include <time.h>
+#include <poll.h>
+#endif
+#include "arch.h"
+#include "timer.h"
+#include "error.h"
+#include "sched.h"
+
+#define PCON_IDL	0x1	/* Idle mode, CPU clock stops until an interrupt */
+
+volatile unsigned sched_work;
+SCHED_STATS sched_stats;
+
+extern unsigned long lbolt;
+
+#if defined (POSIX)
+/* On the host file descriptors stand in for interrupt lines, they are
+ * checked on every pass and waited on while idle. */
+struct pollfd sched_pollfd[SCHED_MAX_SOURCES];
+void ( *sched_isr[SCHED_MAX_SOURCES] )( int fd );
+unsigned sched_source_count;
+struct timespec sched_epoch;
+
+void sched_hardclock( void );
+void sched_poll( int timeout );
+#endif
+
+/*==============================================================
+ * sched_post()
+ * 	Mark work as ready, may be called from interrupt context.
+ *==============================================================*/
+void
+sched_post( unsigned work )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	DISABLE_INTERRUPTS;
+	sched_work |= work;
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * sched_get_work()
+ * 	Return and clear all pending work bits, idling until 
+ * 	there is something to do.
+ *==============================================================*/
+unsigned
+sched_get_work( void )
+{
+	unsigned work;
+	unsigned int interrupt_mask;
+
+	sched_stats.iterations++;
+	while( 1 ) {
+#if defined (POSIX)
+		sched_hardclock();
+		if( sched_source_count )
+			sched_poll( 0 );
+#endif
+		interrupt_mask = CURRENT_INTERRUPT_MASK;
+		DISABLE_INTERRUPTS;
+		work = sched_work;
+		sched_work = 0;
+		ENABLE_INTERRUPTS( interrupt_mask );
+		
+		if( work )
+			return( work );
+		
+		sched_idle();
+		sched_stats.wakeups++;
+	}
+}
+
+/*==============================================================
+ * sched_clock()
+ * 	Free running time stamp in SCHED_COUNTS_PER_SEC units for 
+ * 	timing short intervals. Wraps around, only the difference
+ * 	of two stamps is meaningful.
+ *==============================================================*/
+unsigned long
+sched_clock( void )
+{
+#if defined (POSIX)
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return( now.tv_sec * 1000000000 + now.tv_nsec );
+#else
+	unsigned long tick, count, pending;
+
+	/* Timer0 resets on match and lbolt follows in hardclock(), read 
+	 * again if the tick went by in between. With interrupts masked, 
+	 * or in another interrupt handler, hardclock() can not run and 
+	 * the match flag says Timer0 has already wrapped, count that 
+	 * tick. The flag is read before the count, read again if it came
+	 * up in between. */
+	do {
+		tick = lbolt;
+		pending = T0IR & 1;
+		count = T0TC;
+	} while( ( tick != *( volatile unsigned long * )&lbolt ) 
+	    || ( pending != ( T0IR & 1 ) ) );
+
+	return( ( tick + pending ) * ( T0MR0 + 1 ) + count );
+#endif
+}
+
+#if defined (POSIX)
+/*==============================================================
+ * sched_hardclock()
+ * 	Host stand-in for the Timer0 interrupt, advances lbolt
+ * 	from the monotonic clock.
+ *==============================================================*/
+void
+sched_hardclock( void )
+{
+	struct timespec now;
+	unsigned long ticks;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	if( !sched_epoch.tv_sec && !sched_epoch.tv_nsec )
+		sched_epoch = now;
+	
+	ticks = ( now.tv_sec - sched_epoch.tv_sec ) * HZ 
+		+ ( now.tv_nsec - sched_epoch.tv_nsec ) / ( 1000000000 / HZ );
+	if( ticks != lbolt ) {
+		lbolt = ticks;
+		sched_post( SCHED_TIMER );
+	}
+}
+
+/*==============================================================
+ * sched_attach()
+ * 	Register fd as an interrupt source.
+ *==============================================================*/
+int
+sched_attach( int fd, void ( *isr )( int fd ) )
+{
+	if( sched_source_count >= SCHED_MAX_SOURCES )
+		return( ENOMEM );
+
+	sched_pollfd[sched_source_count].fd = fd;
+	sched_pollfd[sched_source_count].events = POLLIN;
+	sched_isr[sched_source_count] = isr;
+	sched_source_count++;
+	return( ESUCCESS );
+}
+
+/*==============================================================
+ * sched_mask()
+ * 	Stop or resume watching fd, the host version of masking
+ * 	an interrupt.
+ *==============================================================*/
+void
+sched_mask( int fd, int masked )
+{
+	unsigned i;
+
+	for( i = 0; i < sched_source_count; i++ ) {
+		if( sched_pollfd[i].fd == fd )
+			sched_pollfd[i].events = masked ? 0 : POLLIN;
+	}
+}
+
+/*==============================================================
+ * sched_poll()
+ * 	Wait up to timeout ms for the sources and run the isr of 
+ * 	each one that is ready.
+ *==============================================================*/
+void
+sched_poll( int timeout )
+{
+	unsigned i;
+
+	if( poll( sched_pollfd, sched_source_count, timeout ) <= 0 )
+		return;
+
+	for( i = 0; i < sched_source_count; i++ ) {
+		if( sched_pollfd[i].revents )
+			( sched_isr[i] )( sched_pollfd[i].fd );
+	}
+}
+
+/*==============================================================
+ * sched_idle()
+ * 	Wait for a source or the next tick, whichever comes first.
+ *==============================================================*/
+void
+sched_idle( void )
+{
+	struct timespec start, end;
+	long ns;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	ns = ( ( start.tv_sec - sched_epoch.tv_sec ) * 1000000000 
+		+ start.tv_nsec - sched_epoch.tv_nsec ) % ( 1000000000 / HZ );
+	sched_poll( ( 1000000000 / HZ - ns + 999999 ) / 1000000 );
+	clock_gettime( CLOCK_MONOTONIC, &end );
+	
+	sched_stats.idle_time += ( end.tv_sec - start.tv_sec ) * 1000000000 
+		+ end.tv_nsec - start.tv_nsec;
+}
+#else
+/*==============================================================
+ * sched_idle()
+ * 	Enter Idle mode until the next interrupt. Idle time is 
+ * 	measured in Timer0 counts.
+ *==============================================================*/
+void
+sched_idle( void )
+{
+	unsigned long start_tick = lbolt;
+	unsigned long start_count = T0TC;
+	unsigned long cpsr;
+
+	CPU_IRQ_DISABLE( cpsr );
+	if( !sched_work )
+		PCON = PCON_IDL;
+	CPU_IRQ_RESTORE( cpsr );	/* the interrupt that ended Idle runs here */
+	
+	sched_stats.idle_time += ( lbolt - start_tick ) * ( T0MR0 + 1 ) 
+		+ T0TC - start_count;
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/sched.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Run queue work bits, serviced by main() in this order */
+#define SCHED_WS	0x1	/* a ws entered an active queue */
+#define SCHED_TIMER	0x2	/* lbolt has advanced */
+#define SCHED_TERMINAL	0x4	/* a serial line is ready */
+#define SCHED_LAN	0x8	/* LAN responses to send, host build */
+#define SCHED_I2C	0x10	/* I2C device transactions are done, or a 
+				   channel timed out */
+
+/* idle time units */
+#if defined (POSIX)
+#define SCHED_COUNTS_PER_SEC	1000000000	/* ns */
+#else
+#define SCHED_COUNTS_PER_SEC	PCLK		/* Timer0 counts */
+#endif
+#define SCHED_COUNTS_PER_USEC	( SCHED_COUNTS_PER_SEC / 1000000 )
+
+typedef struct sched_stats {
+	unsigned long iterations;	/* main loop passes */
+	unsigned long wakeups;		/* returns from idle */
+	unsigned long idle_time;	/* time spent idle in SCHED_COUNTS_PER_SEC units */
+} SCHED_STATS;
+
+extern SCHED_STATS sched_stats;
+
+void sched_post( unsigned work );
+unsigned sched_get_work( void );
+void sched_idle( void );
+unsigned long sched_clock( void );
+#if defined (POSIX)
+/* host interrupt sources, isr is called when fd becomes readable */
+#define SCHED_MAX_SOURCES	8
+int sched_attach( int fd, void ( *isr )( int fd ) );
+void sched_mask( int fd, int masked );
+#endif
@@ -146,6 +146,7 @@ ipmi_get_device_sdr( IPMI_PKT *pkt )
 	GET_DEVICE_SDR_CMD *req = (GET_DEVICE_SDR_CMD *)( pkt->req );
 	GET_DEVICE_SDR_RESP *resp = (GET_DEVICE_SDR_RESP *)( pkt->resp );
 	unsigned short record_id, i, found = 0;
+	unsigned count;
 
 	/* if offset into record is zero we don't have to worry about the
 	 * reservation ids */
@@ -180,13 +181,25 @@ ipmi_get_device_sdr( IPMI_PKT *pkt )
 
 		/* SDR Data goes in here */
 		/* check req->bytes_to_read. FFh means read entire record. */
-		if( req->bytes_to_read + req->offset > sdr_entry_table[i].rec_len ) {
-			memcpy( resp->req_bytes, sdr_entry_table[i].record_ptr + req->offset, sdr_entry_table[i].rec_len - req->offset);
-	       		pkt->hdr.resp_data_len = sdr_entry_table[i].rec_len - req->offset + 2;
-		} else {
-			memcpy( resp->req_bytes, sdr_entry_table[i].record_ptr + req->offset, req->bytes_to_read );
-	       		pkt->hdr.resp_data_len = req->bytes_to_read + 2;
+		if( req->offset > sdr_entry_table[i].rec_len ) {
+			resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+			pkt->hdr.resp_data_len = 0;
+			return;
+		}
+		if( req->bytes_to_read + req->offset > sdr_entry_table[i].rec_len )
+			count = sdr_entry_table[i].rec_len - req->offset;
+		else
+			count = req->bytes_to_read;
+
+		/* what does not fit the channel has to be read in pieces,
+		 * the next record ID goes ahead of the data */
+		if( count > ipmi_resp_max_data_len( pkt ) - 2 ) {
+			resp->completion_code = CC_CANT_RETURN_REQ_BYTES;
+			pkt->hdr.resp_data_len = 0;
+			return;
 		}
+		memcpy( resp->req_bytes, sdr_entry_table[i].record_ptr + req->offset, count );
+		pkt->hdr.resp_data_len = count + 2;
 		
 		/* TODO return a 80h = record changed status if any of the record contents
 		have been altered since the last time the Requester issued the request 
@@ -242,7 +255,8 @@ ipmi_get_sensor_reading( IPMI_PKT *pkt )
 	
 	/* Given the req->sensor_number return the reading */
 	for( i = 0; i < current_sensor_count; i++ ) {
-		if( sensor[i]->sensor_id == req->sensor_number ) {
+		/* SDRs registered without sensor data have no entry */
+		if( sensor[i] && ( sensor[i]->sensor_id == req->sensor_number ) ) {
 			found++;
 			break;
 		}
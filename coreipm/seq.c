@@ -0,0 +1,363 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/seq.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+IPMB request tracking
+
+Every request we send on IPMB and expect a response to gets an entry here,
+keyed by the responder address and the sequence number it carries. A
+response is matched by looking up its rsSA and rqSeq in a hash table so
+the cost does not grow with the number of requests in flight, and it 
+only completes the request if its netFn and command are the ones of the
+request as well. Each target gets the full 64 value sequence space, 
+shared by all netFns, so no two requests to a target are out with the
+same number whatever their netFn. Sequence numbers are handed out round
+robin per target so a number is not reused right after the request that
+had it completed, a late response to it is not mistaken for the answer
+to a new request.
+
+A tracked request is built as usual with the seq from seq_alloc() in its
+header and handed to seq_send() in place of ws_set_state(). The request
+completion function is then called exactly once with:
+
+	XPORT_RESP_NOERR	the response came in. pkt.resp and
+				pkt.hdr.resp_data_len of the request ws
+				point at it for the duration of the call.
+	XPORT_REQ_ERR		the transport could not send the request
+	XPORT_RESP_ERR		no response after SEQ_MAX_RETRIES resends
+
+and owns the request ws from then on, without a completion function the
+ws is freed. A request whose response is late is sent again as is, with
+the same seq, every SEQ_TIMEOUT ticks.
+*/
+
+#include "arch.h"
+#include "ipmi.h"
+#include "ws.h"
+#include "timer.h"
+#include "debug.h"
+#include "error.h"
+#include "seq.h"
+
+#define SEQ_HASH( addr, seq )	\
+	( ( ( seq ) ^ ( ( addr ) << 2 ) ) & ( SEQ_HASH_SIZE - 1 ) )
+
+typedef struct seq_entry {
+	struct seq_entry *next;		/* hash chain or free list */
+	IPMI_WS *ws;			/* the request */
+	void( *completion_function )( void *, int );
+	unsigned long deadline;		/* tick the response is due by */
+	unsigned char addr;		/* responder address */
+	unsigned char seq;
+	unsigned char netfn;		/* of the request, set by seq_send() */
+	unsigned char cmd;
+	unsigned char state;		/* SEQ_ST_xx */
+	unsigned char retries;
+} SEQ_ENTRY;
+
+extern unsigned long lbolt;
+
+SEQ_ENTRY	seq_array[SEQ_MAX_OUTSTANDING];
+SEQ_ENTRY	*seq_hash[SEQ_HASH_SIZE];
+SEQ_ENTRY	*seq_free_list;
+unsigned char	seq_next[SEQ_NUM_ADDR];	/* next seq to try, per target */
+unsigned	seq_timer_handle;
+unsigned char	seq_timer_armed;	/* seq_tick() is on the callout queue */
+SEQ_STATS	seq_stats;
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+SEQ_ENTRY *seq_lookup( unsigned char addr, unsigned char seq );
+void seq_release( SEQ_ENTRY *entry );
+void seq_finish( IPMI_WS *ws, int status );
+void seq_xport_complete( void *ws, int status );
+void seq_tick( unsigned char *arg );
+void seq_arm( void );
+
+/*==============================================================
+ * seq_init()
+ *==============================================================*/
+void
+seq_init( void )
+{
+	unsigned i;
+
+	seq_free_list = 0;
+	for( i = 0; i < SEQ_MAX_OUTSTANDING; i++ ) {
+		seq_array[i].state = SEQ_ST_FREE;
+		seq_array[i].next = seq_free_list;
+		seq_free_list = &seq_array[i];
+	}
+	for( i = 0; i < SEQ_HASH_SIZE; i++ )
+		seq_hash[i] = 0;
+}
+
+/* put seq_tick() on the callout queue unless it is there already, it 
+ * only runs while requests are tracked */
+void
+seq_arm( void )
+{
+	if( !seq_timer_armed )
+		seq_timer_armed = ( timer_add_callout_queue( ( void * )&seq_timer_handle, 
+			1, seq_tick, 0 ) == ESUCCESS );
+}
+
+/* find the entry for addr/seq, called with interrupts disabled */
+SEQ_ENTRY *
+seq_lookup( unsigned char addr, unsigned char seq )
+{
+	SEQ_ENTRY *entry;
+
+	for( entry = seq_hash[SEQ_HASH( addr, seq )]; entry; entry = entry->next ) {
+		if( ( entry->addr == addr ) && ( entry->seq == seq ) )
+			break;
+	}
+	return( entry );
+}
+
+/*==============================================================
+ * seq_get_next()
+ * 	Next sequence number for a request to addr that is not in
+ * 	use by a tracked request. Requests that do not wait for a
+ * 	response can use this directly. With fewer entries than
+ * 	SEQ_NUM a free number is always found.
+ *==============================================================*/
+unsigned char
+seq_get_next( unsigned char addr )
+{
+	unsigned char *next = &seq_next[addr >> 1];
+	unsigned char seq;
+	unsigned i;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	seq = *next;
+	for( i = 0; i < SEQ_NUM; i++ ) {
+		seq = ( *next + i ) & ( SEQ_NUM - 1 );
+		if( !seq_lookup( addr, seq ) )
+			break;
+	}
+	*next = ( seq + 1 ) & ( SEQ_NUM - 1 );
+	ENABLE_INTERRUPTS( interrupt_mask );
+	return( seq );
+}
+
+/*==============================================================
+ * seq_alloc()
+ * 	Assign a sequence number for a request to addr and start
+ * 	tracking ws under it. The number is returned in seq and
+ * 	ws->seq_out. Returns ENOMEM if SEQ_MAX_OUTSTANDING requests
+ * 	are already being tracked.
+ *==============================================================*/
+int
+seq_alloc( IPMI_WS *ws, unsigned char addr, unsigned char *seq )
+{
+	SEQ_ENTRY *entry;
+	unsigned char hash;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	if( !( entry = seq_free_list ) ) {
+		seq_stats.alloc_fail++;
+		ENABLE_INTERRUPTS( interrupt_mask );
+		return( ENOMEM );
+	}
+	seq_free_list = entry->next;
+
+	entry->ws = ws;
+	entry->completion_function = 0;
+	entry->addr = addr;
+	entry->netfn = 0;
+	entry->cmd = 0;
+	entry->seq = seq_get_next( addr );
+	entry->state = SEQ_ST_RESERVED;
+	entry->retries = 0;
+
+	hash = SEQ_HASH( addr, entry->seq );
+	entry->next = seq_hash[hash];
+	seq_hash[hash] = entry;
+	seq_stats.in_use++;
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	ws->seq_entry = entry;
+	ws->seq_out = entry->seq;
+	*seq = entry->seq;
+	seq_arm();
+	return( ESUCCESS );
+}
+
+/* unlink entry from its hash chain and put it on the free list, called
+ * with interrupts disabled */
+void
+seq_release( SEQ_ENTRY *entry )
+{
+	SEQ_ENTRY **pp = &seq_hash[SEQ_HASH( entry->addr, entry->seq )];
+
+	while( *pp != entry )
+		pp = &( *pp )->next;
+	*pp = entry->next;
+
+	entry->ws->seq_entry = 0;
+	entry->ws->ipmi_completion_function = entry->completion_function;
+	entry->ws = 0;
+	entry->state = SEQ_ST_FREE;
+	entry->next = seq_free_list;
+	seq_free_list = entry;
+	seq_stats.in_use--;
+}
+
+/*==============================================================
+ * seq_send()
+ * 	Queue a request set up with seq_alloc() for transmission.
+ * 	completion_function is called once the request is done,
+ * 	see the top of this file. The netFn and command the 
+ * 	response has to carry are taken from the request frame.
+ *==============================================================*/
+void
+seq_send( IPMI_WS *ws, void( *completion_function )( void *, int ) )
+{
+	SEQ_ENTRY *entry = ( SEQ_ENTRY * )ws->seq_entry;
+	unsigned char *frame = WS_FRAME_OUT( ws );
+
+	/* netFn/rsLUN, checksum, rqSA, rqSeq/rqLUN, cmd */
+	entry->netfn = frame[0] >> 2;
+	entry->cmd = frame[4];
+	entry->completion_function = completion_function;
+	entry->state = SEQ_ST_SENDING;
+	ws->ipmi_completion_function = seq_xport_complete;
+	ws->delivery_attempts = 0;
+	ws_set_state( ws, WS_ACTIVE_MASTER_WRITE );
+}
+
+/*==============================================================
+ * seq_free()
+ * 	Stop tracking ws without calling its completion function.
+ *==============================================================*/
+void
+seq_free( IPMI_WS *ws )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	if( ws->seq_entry )
+		seq_release( ( SEQ_ENTRY * )ws->seq_entry );
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * seq_match()
+ * 	Find the request a response from addr with sequence seq,
+ * 	response netfn and command cmd answers. Tracking ends and 
+ * 	the request ws is returned with its own completion function
+ * 	restored, or 0 if nothing is waiting for this response. A 
+ * 	response that turns up while the request is being sent 
+ * 	again is dropped, the resend gets its own.
+ *==============================================================*/
+IPMI_WS *
+seq_match( unsigned char addr, unsigned char seq, unsigned char netfn, unsigned char cmd )
+{
+	SEQ_ENTRY *entry;
+	IPMI_WS *ws = 0;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	entry = seq_lookup( addr, seq );
+	if( entry && ( entry->state == SEQ_ST_WAITING ) 
+	    && ( netfn == ( entry->netfn | 1 ) ) && ( cmd == entry->cmd ) ) {
+		ws = entry->ws;
+		seq_release( entry );
+	} else {
+		seq_stats.unmatched++;
+	}
+	ENABLE_INTERRUPTS( interrupt_mask );
+	return( ws );
+}
+
+/* end tracking and hand ws back to the requester with status */
+void
+seq_finish( IPMI_WS *ws, int status )
+{
+	seq_free( ws );
+	if( ws->ipmi_completion_function )
+		( ws->ipmi_completion_function )( ( void * )ws, status );
+	else
+		ws_free( ws );
+}
+
+/* Transport completion for tracked requests. Once the request is out
+ * the response timer starts, the ws is left alone until the response
+ * comes in or the timer runs out. */
+void
+seq_xport_complete( void *arg, int status )
+{
+	IPMI_WS *ws = ( IPMI_WS * )arg;
+	SEQ_ENTRY *entry = ( SEQ_ENTRY * )ws->seq_entry;
+
+	if( status != XPORT_REQ_NOERR ) {
+		dputstr( DBG_IPMI | DBG_ERR, "seq_xport_complete: request not sent\n" );
+		seq_finish( ws, XPORT_REQ_ERR );
+		return;
+	}
+	entry->deadline = lbolt + SEQ_TIMEOUT;
+	entry->state = SEQ_ST_WAITING;
+}
+
+/*==============================================================
+ * seq_tick()
+ * 	Runs every tick while requests are tracked. Requests whose
+ * 	response is overdue are sent again or, after SEQ_MAX_RETRIES
+ * 	resends, completed with XPORT_RESP_ERR.
+ *==============================================================*/
+void
+seq_tick( unsigned char *arg )
+{
+	SEQ_ENTRY *entry;
+	unsigned i;
+
+	seq_timer_armed = 0;
+	for( i = 0; ( i < SEQ_MAX_OUTSTANDING ) && seq_stats.in_use; i++ ) {
+		entry = &seq_array[i];
+		if( ( entry->state != SEQ_ST_WAITING )
+		    || ( ( long )( lbolt - entry->deadline ) < 0 ) )
+			continue;
+
+		if( entry->retries < SEQ_MAX_RETRIES ) {
+			entry->retries++;
+			seq_stats.retries++;
+			entry->state = SEQ_ST_SENDING;
+			entry->ws->delivery_attempts = 0;
+			ws_set_state( entry->ws, WS_ACTIVE_MASTER_WRITE );
+		} else {
+			dputstr( DBG_IPMI | DBG_ERR, "seq_tick: no response\n" );
+			seq_stats.timeouts++;
+			seq_finish( entry->ws, XPORT_RESP_ERR );
+		}
+	}
+
+	if( seq_stats.in_use )
+		seq_arm();
+}
@@ -0,0 +1,77 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/seq.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Outstanding IPMB request tracking, see seq.c */
+
+#define SEQ_NUM			64	/* the IPMB rqSeq field is 6 bits */
+/* With fewer entries than SEQ_NUM every request to an address has a
+ * number of its own, a reused one could match a late response to the
+ * wrong request. */
+#ifndef SEQ_MAX_OUTSTANDING
+#if WS_ARRAY_SIZE < SEQ_NUM
+#define SEQ_MAX_OUTSTANDING	WS_ARRAY_SIZE
+#else
+#define SEQ_MAX_OUTSTANDING	( SEQ_NUM - 1 )
+#endif
+#endif
+#if SEQ_MAX_OUTSTANDING > SEQ_NUM - 1
+#error "SEQ_MAX_OUTSTANDING must be less than SEQ_NUM"
+#endif
+#define SEQ_HASH_SIZE		32	/* must be a power of 2 */
+#define SEQ_NUM_ADDR		128	/* IPMB addresses, addr >> 1 */
+
+/* Response timeout in ticks and number of times a request is sent
+ * again when the response is late. IPMB allows a responder 250ms. */
+#ifndef SEQ_TIMEOUT
+#define SEQ_TIMEOUT		3
+#endif
+#ifndef SEQ_MAX_RETRIES
+#define SEQ_MAX_RETRIES		2
+#endif
+
+/* entry states */
+#define SEQ_ST_FREE		0
+#define SEQ_ST_RESERVED		1	/* seq assigned, request not sent yet */
+#define SEQ_ST_SENDING		2	/* request queued or on the wire */
+#define SEQ_ST_WAITING		3	/* request out, waiting for the response */
+
+typedef struct seq_stats {
+	unsigned in_use;		/* requests currently tracked */
+	unsigned long alloc_fail;	/* seq_alloc() found no free entry */
+	unsigned long retries;		/* requests sent again after a timeout */
+	unsigned long timeouts;		/* requests given up on */
+	unsigned long unmatched;	/* responses nobody was waiting for */
+} SEQ_STATS;
+
+extern SEQ_STATS seq_stats;
+
+void seq_init( void );
+unsigned char seq_get_next( unsigned char addr );
+int seq_alloc( IPMI_WS *ws, unsigned char addr, unsigned char *seq );
+void seq_send( IPMI_WS *ws, void( *completion_function )( void *, int ) );
+void seq_free( IPMI_WS *ws );
+IPMI_WS *seq_match( unsigned char addr, unsigned char seq, unsigned char netfn,
+	unsigned char cmd );
@@ -87,6 +87,10 @@ responsible for handshaking between a modem peripheral and the UART1.
 #include "gpio.h"
 #include "error.h"
 #include "module.h"
+#include "sched.h"
+#include "stats.h"
+#include "tmode.h"
+#include "timer.h"
 
 #define uchar unsigned char
 
@@ -94,19 +98,97 @@ responsible for handshaking between a modem peripheral and the UART1.
 #define LF     0x0A
 #define CLI_PROMPT "BMC>"
 
-int buf_index_1 = 0;
-int data_ready_1 = 0;
-int buf_index_0 = 0;
-int data_ready_0 = 0;
+/* A terminal mode line this long carries a request of about 80 bytes,
+ * responses are not limited by it */
+#define SERIAL_LINE_LEN	256
+
+/* In raw mode the callback gets at most this many characters at a time */
+#define SERIAL_RAW_CHUNK	32
+
+/* ws term_process() leaves to the other channels */
+#define TERM_WS_RESERVE		4
 
 typedef struct port_info {
 	uchar port_name;  // UART_DEBUG or UART_ITLA which map to UART0 or UART1
 	uchar filter_type;
-	void(*callback_fn)( uchar * );
-	uchar buf[80]; 
+	uchar echo;		  // UART_FILTER_TERM, echo what is received
+	int(*callback_fn)( uchar *, unsigned );
+	uchar buf[SERIAL_LINE_LEN]; 	// frame handed to callback_fn
 } PORT_INFO;
 
 PORT_INFO serial_port[2];
+
+/* Receive rings, one per UART. The ISR is the only writer of head and
+ * frame_head, the main loop of tail and frame_tail, so neither side 
+ * has to lock the other out. The ISR frames the input as it comes in 
+ * and queues the position of every complete frame, the characters of
+ * a frame stay in the ring until the main loop has handed it to the 
+ * port callback. A frame that does not fit is dropped whole. In raw 
+ * mode there are no frames, the main loop takes whatever has arrived. */
+typedef struct rx_frame {
+	unsigned short start;		/* ring index of the first character */
+	unsigned short len;
+} RX_FRAME;
+
+typedef struct rx_ring {
+	uchar *buf;
+	unsigned mask;			/* ring length - 1 */
+	volatile unsigned head;		/* next free slot */
+	volatile unsigned tail;		/* first character not yet consumed */
+	unsigned start;			/* start of the frame being received */
+	uchar state;			/* RX_ST_xx */
+	volatile uchar frame_head;	
+	volatile uchar frame_tail;
+	RX_FRAME frame[UART_RX_FRAMES];
+} RX_RING;
+
+/* receive framing states */
+#define RX_ST_IDLE	0	/* between frames */
+#define RX_ST_FRAME	1	/* in a frame */
+#define RX_ST_ESCAPE	2	/* Basic mode, BASIC_ESCAPE seen */
+#define RX_ST_DISCARD	3	/* dropping the rest of a frame */
+
+uchar serial_rx_buf_debug[UART_RX_RING_LEN_DEBUG];
+uchar serial_rx_buf_itla[UART_RX_RING_LEN_ITLA];
+RX_RING serial_rx[UART_PORT_COUNT];
+SERIAL_STATS serial_stats[UART_PORT_COUNT];
+
+/* a frame the callback could not take yet is tried again next tick */
+unsigned serial_rx_retry_handle;
+
+/* Transmit rings, one per UART, indexed by UART_0/UART_1. Characters 
+ * are queued at head and the THRE interrupt moves them from tail into
+ * the transmit FIFO, UART_TX_FIFO_LEN at a time. busy is set while 
+ * the transmitter has data and another THRE interrupt is coming, when
+ * it is clear the first character queued has to start it.
+ *
+ * Characters are queued from the main loop, by the receive echo and by
+ * debug output from any ISR, and the ring is drained by the THRE 
+ * interrupt and by serial_tx_poll() when that interrupt can not be 
+ * taken. Every access is in interrupt context or has interrupts 
+ * masked, head and tail only change inside such a section. */
+typedef struct tx_ring {
+	uchar *buf;
+	unsigned mask;			/* ring length - 1 */
+	volatile unsigned head;		/* next free slot */
+	volatile unsigned tail;		/* next character to send */
+	volatile uchar busy;
+} TX_RING;
+
+uchar serial_tx_buf_debug[UART_TX_RING_LEN_DEBUG];
+uchar serial_tx_buf_itla[UART_TX_RING_LEN_ITLA];
+TX_RING serial_tx[UART_PORT_COUNT];
+
+/* Terminal mode responses that did not fit in the debug port ring wait
+ * here in order. The THRE interrupt sets serial_tx_ready once there is
+ * room for the first one, serial_tx_need. */
+IPMI_WS *serial_tx_wait[WS_ARRAY_SIZE];
+unsigned serial_tx_wait_count;
+unsigned serial_tx_need;
+volatile uchar serial_tx_ready;
+
+/* serial_tm_send() builds the line here, with room for CR LF */
+uchar serial_tm_buf[TMODE_ENC_LEN( WS_BUF_LEN_LARGE ) + 2];
 uchar flash_buf[256] = { 0 } ;
 int xfp_addr = 0;
 
@@ -123,9 +205,20 @@ void UART_ISR_0(void) __attribute__ ((interrupt));
 void UART_ISR_1(void) __attribute__ ((interrupt));
 #endif
 
-void term_process( uchar *buf );
+int term_process( uchar *buf, unsigned len );
+void term_health_query( void );
+void serial_rx_char( int uart, uchar ch );
+void serial_rx_error( int uart, uchar lsr );
+int serial_rx_store( RX_RING *ring, uchar ch );
+void serial_rx_frame_end( int uart, RX_RING *ring );
+void serial_rx_process( int uart );
+void serial_rx_retry( unsigned char *arg );
 int putchar_0( int ch );
 int putchar_1( int ch );
+void serial_tx_fill( int uart );
+void serial_tx_poll( int uart );
+int serial_tx_put_wait( int uart, int ch );
+void serial_tx_write( int uart, uchar *buf, unsigned len );
 
 void serial_dbg_port_msg_send( unsigned char *buf ); 
 
@@ -366,14 +459,25 @@ FIFO.
 #define UART_LSR_TX_EMPTY		0x40
 #define UART_LSR_RX_FIFO_ERROR		0x80
 
+/* Transmitter access. On the host the UARTs are simulated by posix.c, 
+ * which also calls the ISR side, serial_rx_char() and serial_tx_fill(),
+ * as characters arrive and the transmit FIFO drains. */
+#if defined (POSIX)
+#define SERIAL_THR( uart, ch )	posix_uart_tx( uart, ch )
+#define SERIAL_LSR( uart )	posix_uart_lsr( uart )
+#else
+#define SERIAL_THR( uart, ch )	\
+	do { if( ( uart ) == UART_0 ) U0THR = ( ch ); else U1THR = ( ch ); } while( 0 )
+#define SERIAL_LSR( uart )	( ( ( uart ) == UART_0 ) ? U0LSR : U1LSR )
+#endif
+
 #define UART_FCR_FIFO_ENABLE	0x01
 #define UART_FCR_FIFO_1_CHAR	0x00
 #define UART_FCR_FIFO_4_CHAR	0x40
 #define UART_FCR_FIFO_8_CHAR	0x80
 #define UART_FCR_FIFO_14_CHAR	0xC0
 
-/* TODO: change getchar, putchar to use interrupt versions instead of polling */
-/* TODO use a pool of buffers instead of line_buf_1 etc */
+/* TODO: change getchar to use interrupt versions instead of polling */
 
 
 /*==============================================================
@@ -397,7 +501,7 @@ uart_initialize( void )
 	U0LCR = 0x83;		/* 8 bits, no Parity, 1 Stop bit */
 	U0DLL = 98;		/* 9600 Baud Rate @ 12MHz VPB Clock */
 	U0LCR = 0x03;		/* Disable access to Divisor Latches */
-	U0IER = UARTINT_ENABLE_RX_DATA;   /* Enable the RDA interrupts */
+	U0IER = UARTINT_ENABLE_RX_DATA | UARTINT_ENABLE_THRE | UARTINT_ENABLE_ERROR;   /* Enable the RDA, THRE & RLS interrupts */
 #ifdef USE_FIFO
 	U0FCR = UART_FCR_FIFO_ENABLE | UART_FCR_FIFO_4_CHAR;
 #endif
@@ -413,7 +517,7 @@ uart_initialize( void )
 	U1LCR = 0x83;		/* 8 bits, no Parity, 1 Stop bit */
 	U1DLL = 98;		/* 9600 Baud Rate @ 12MHz VPB Clock */
 	U1LCR = 0x03;		/* Disable access to Divisor Latches */
-	U1IER = UARTINT_ENABLE_RX_DATA;   /* Enable the RDA interrupts */
+	U1IER = UARTINT_ENABLE_RX_DATA | UARTINT_ENABLE_THRE | UARTINT_ENABLE_ERROR;   /* Enable the RDA, THRE & RLS interrupts */
 #ifdef USE_FIFO
 	U1FCR = UART_FCR_FIFO_ENABLE | UART_FCR_FIFO_4_CHAR;
 #endif
@@ -423,12 +527,246 @@ uart_initialize( void )
 
 	serial_port[0].port_name = UART_DEBUG; 
 	serial_port[0].filter_type = UART_FILTER_TERM;
+	serial_port[0].echo = 1;
 	serial_port[0].callback_fn = term_process;
 
 	serial_port[1].port_name = UART_ITLA; 
 	serial_port[1].filter_type = UART_FILTER_RAW;
 	serial_port[1].callback_fn = 0;
 
+	serial_tx[UART_DEBUG].buf = serial_tx_buf_debug;
+	serial_tx[UART_DEBUG].mask = UART_TX_RING_LEN_DEBUG - 1;
+	serial_tx[UART_ITLA].buf = serial_tx_buf_itla;
+	serial_tx[UART_ITLA].mask = UART_TX_RING_LEN_ITLA - 1;
+
+	serial_rx[UART_DEBUG].buf = serial_rx_buf_debug;
+	serial_rx[UART_DEBUG].mask = UART_RX_RING_LEN_DEBUG - 1;
+	serial_rx[UART_ITLA].buf = serial_rx_buf_itla;
+	serial_rx[UART_ITLA].mask = UART_RX_RING_LEN_ITLA - 1;
+
+#if defined (POSIX)
+	posix_uart_init();
+#endif
+}
+
+/*==============================================================
+ * serial_rx_char()
+ * 	Called by the UART ISRs for every character received. Frames
+ * 	the input according to the port filter:
+ *
+ * 	UART_FILTER_TERM	'[' to ']'. The characters are echoed.
+ * 				A CR ends an unterminated frame, text 
+ * 				outside brackets is passed up as a frame
+ * 				of its own at the CR so it gets an error.
+ * 	UART_FILTER_BASIC	BASIC_START to BASIC_STOP, the frame is 
+ * 				stored with the escapes removed.
+ * 	UART_FILTER_RAW		no framing.
+ *==============================================================*/
+void
+serial_rx_char( int uart, uchar ch )
+{
+	RX_RING *ring = &serial_rx[uart];
+	int was_empty;
+
+	serial_stats[uart].rx_count++;
+
+	switch( serial_port[uart].filter_type ) {
+		case UART_FILTER_RAW:
+			/* no frames, only the ring length limits the input */
+			was_empty = ( ring->head == ring->tail );
+			ring->start = ring->head;
+			if( !serial_rx_store( ring, ch ) ) {
+				serial_stats[uart].overrun_count++;
+				break;
+			}
+			if( was_empty )
+				sched_post( SCHED_TERMINAL );
+			break;
+
+		case UART_FILTER_TERM:
+			if( serial_port[uart].echo ) {
+				serial_tx_put( uart, ch );	// echo character
+				if( ch == CR )
+					serial_tx_put( uart, LF );
+			}
+
+			if( ch == CR || ch == LF ) {
+				/* end of line, ends anything still open */
+				if( ring->state == RX_ST_FRAME )
+					serial_rx_frame_end( uart, ring );
+				ring->state = RX_ST_IDLE;
+				break;
+			}
+			if( ring->state == RX_ST_IDLE ) {
+				if( ch == ' ' || ch == '\t' )
+					break;
+				ring->start = ring->head;
+				ring->state = RX_ST_FRAME;
+			} else if( ring->state == RX_ST_DISCARD ) {
+				if( ch == ']' )
+					ring->state = RX_ST_IDLE;
+				break;
+			}
+			if( !serial_rx_store( ring, ch ) ) {
+				serial_stats[uart].overrun_count++;
+				ring->head = ring->start;
+				ring->state = ( ch == ']' ) ? RX_ST_IDLE : RX_ST_DISCARD;
+				break;
+			}
+			/* a frame that began with '[' ends at the ']' */
+			if( ch == ']' && ring->buf[ring->start] == '[' ) {
+				serial_rx_frame_end( uart, ring );
+				ring->state = RX_ST_IDLE;
+			}
+			break;
+
+		case UART_FILTER_BASIC:
+			if( ch == BASIC_START ) {
+				/* a start in a frame means the stop was lost */
+				if( ring->state != RX_ST_IDLE ) {
+					serial_stats[uart].error_count++;
+					ring->head = ring->start;
+				}
+				ring->start = ring->head;
+				ring->state = RX_ST_FRAME;
+				break;
+			}
+			if( ch == BASIC_HANDSHAKE || ring->state == RX_ST_IDLE )
+				break;
+			if( ch == BASIC_STOP ) {
+				if( ring->state == RX_ST_ESCAPE ) {
+					serial_stats[uart].error_count++;
+					ring->head = ring->start;
+				} else if( ring->state == RX_ST_FRAME ) {
+					serial_rx_frame_end( uart, ring );
+				}
+				ring->state = RX_ST_IDLE;
+				break;
+			}
+			if( ring->state == RX_ST_DISCARD )
+				break;
+			if( ring->state == RX_ST_ESCAPE ) {
+				ring->state = RX_ST_FRAME;
+				switch( ch ) {
+					case 0xB0: ch = BASIC_START; break;
+					case 0xB5: ch = BASIC_STOP; break;
+					case 0xB6: ch = BASIC_HANDSHAKE; break;
+					case 0xBA: ch = BASIC_ESCAPE; break;
+					case 0x3B: ch = BASIC_ESC; break;
+					default:
+						serial_stats[uart].error_count++;
+						ring->head = ring->start;
+						ring->state = RX_ST_DISCARD;
+						return;
+				}
+			} else if( ch == BASIC_ESCAPE ) {
+				ring->state = RX_ST_ESCAPE;
+				break;
+			}
+			if( !serial_rx_store( ring, ch ) ) {
+				serial_stats[uart].overrun_count++;
+				ring->head = ring->start;
+				ring->state = RX_ST_DISCARD;
+			}
+			break;
+	}
+}
+
+/* Put ch in the ring. Returns 0 if the ring is full or the frame being
+ * received would not fit in the line buffer. */
+int
+serial_rx_store( RX_RING *ring, uchar ch )
+{
+	unsigned head = ( ring->head + 1 ) & ring->mask;
+
+	if( ( head == ring->tail ) 
+	    || ( ( ( ring->head - ring->start ) & ring->mask ) >= SERIAL_LINE_LEN - 1 ) )
+		return( 0 );
+	ring->buf[ring->head] = ch;
+	ring->head = head;
+	return( 1 );
+}
+
+/* queue the frame that ends at head for the main loop */
+void
+serial_rx_frame_end( int uart, RX_RING *ring )
+{
+	uchar next = ( ring->frame_head + 1 ) % UART_RX_FRAMES;
+
+	if( next == ring->frame_tail ) {
+		serial_stats[uart].queue_full_count++;
+		ring->head = ring->start;
+		return;
+	}
+	ring->frame[ring->frame_head].start = ring->start;
+	ring->frame[ring->frame_head].len = ( ring->head - ring->start ) & ring->mask;
+	ring->frame_head = next;
+	serial_stats[uart].frame_count++;
+	sched_post( SCHED_TERMINAL );
+}
+
+/* line status interrupt, count what the UART reports */
+void
+serial_rx_error( int uart, uchar lsr )
+{
+	if( lsr & UART_LSR_OVERRUN_ERROR )
+		serial_stats[uart].hw_overrun_count++;
+	if( lsr & ( UART_LSR_PARITY_ERROR | UART_LSR_FRAMING_ERROR | UART_LSR_BREAK_INTERRUPT ) )
+		serial_stats[uart].error_count++;
+}
+
+/*==============================================================
+ * serial_rx_process()
+ * 	Main loop side. Hand the oldest complete frame, or in raw 
+ * 	mode what has arrived, to the port callback. One frame per
+ * 	call, SCHED_TERMINAL is posted again if there are more. If
+ * 	the callback returns EAGAIN the frame stays where it is and
+ * 	is handed over again on the next tick.
+ *==============================================================*/
+void
+serial_rx_process( int uart )
+{
+	RX_RING *ring = &serial_rx[uart];
+	PORT_INFO *port = &serial_port[uart];
+	unsigned start, len, i;
+
+	if( port->filter_type == UART_FILTER_RAW ) {
+		start = ring->tail;
+		len = ( ring->head - start ) & ring->mask;
+		if( len > SERIAL_RAW_CHUNK )
+			len = SERIAL_RAW_CHUNK;
+	} else {
+		if( ring->frame_tail == ring->frame_head )
+			return;
+		start = ring->frame[ring->frame_tail].start;
+		len = ring->frame[ring->frame_tail].len;
+	}
+	if( !len )
+		return;
+
+	for( i = 0; i < len; i++ )
+		port->buf[i] = ring->buf[( start + i ) & ring->mask];
+	port->buf[len] = 0;	// terminal mode frames are used as strings
+
+	if( port->callback_fn && ( ( *port->callback_fn )( port->buf, len ) == EAGAIN ) ) {
+		timer_add_callout_queue( ( void * )&serial_rx_retry_handle, 1, serial_rx_retry, 0 );
+		return;
+	}
+
+	/* done with the characters, give the space back */
+	ring->tail = ( start + len ) & ring->mask;
+	if( port->filter_type != UART_FILTER_RAW )
+		ring->frame_tail = ( ring->frame_tail + 1 ) % UART_RX_FRAMES;
+
+	if( ( ring->frame_tail != ring->frame_head ) 
+	    || ( ( port->filter_type == UART_FILTER_RAW ) && ( ring->tail != ring->head ) ) )
+		sched_post( SCHED_TERMINAL );
+}
+
+void
+serial_rx_retry( unsigned char *arg )
+{
+	sched_post( SCHED_TERMINAL );
 }
 
 
@@ -446,8 +784,9 @@ void UART_ISR_1( void )
 
 	switch( int_reg & 0x0f )
 	{
-		case UARTINT_ERROR:		// TODO: error handling
+		case UARTINT_ERROR:
 	  		temp = U1LSR;		// clear interrupt
+			serial_rx_error( UART_1, temp );
 	   		break;							
 		case UARTINT_RX_DATA_AVAIL:	// Rx char available
 		case UARTINT_CHAR_TIMEOUT:	// Character Time-out indication
@@ -456,26 +795,12 @@ void UART_ISR_1( void )
 #endif
 		    {
 			rx_char = U1RBR;	// get char and reset int
-			
-			serial_port[1].buf[buf_index_1++] = rx_char;
-			if( serial_port[1].filter_type == UART_FILTER_RAW ) {
-				if( buf_index_1 >= 32 ) {
-					data_ready_1 = 1;
-					buf_index_1 = 0;
-				}
-			} else {
-				U1THR = rx_char;	// echo character
-				if (rx_char == CR) {
-					U1THR = LF;	// echo character
-					serial_port[1].buf[buf_index_1] = 0; // end of string
-					data_ready_1 = 1;
-					buf_index_1 = 0;
-				}
-			}
+			serial_rx_char( UART_1, rx_char );
 		    }
 			break;
 		case UARTINT_THRE:		// Transmit Holding Register Empty
-			break;			// U1IIR Read has reset interrupt
+			serial_tx_fill( UART_1 );	// U1IIR Read has reset interrupt
+			break;
 		case UARTINT_MODEM:
 			temp = U1MSR;		// clear interrupt
 			break;
@@ -498,8 +823,9 @@ void UART_ISR_0( void )
 
 	switch( int_reg & 0x0f)
 	{
-		case UARTINT_ERROR:		// TODO: error handling
+		case UARTINT_ERROR:
 	  		temp = U0LSR;		// clear interrupt
+			serial_rx_error( UART_0, temp );
 	   		break;							
 		case UARTINT_RX_DATA_AVAIL:	// Rx char available
 		case UARTINT_CHAR_TIMEOUT:	// Character Time-out indication
@@ -508,26 +834,12 @@ void UART_ISR_0( void )
 #endif
 		    {
 			rx_char = U0RBR;	// get char and reset int
-						
-			serial_port[0].buf[buf_index_0++] = rx_char;
-			if( serial_port[0].filter_type == UART_FILTER_RAW ) {
-				if( buf_index_0 >= 32 ) {
-					data_ready_0 = 1;
-					buf_index_0 = 0;
-				}
-			} else {
-				U0THR = rx_char;	// echo character
-				if (rx_char == CR) {
-					U0THR = LF;	// echo character
-					serial_port[0].buf[buf_index_0] = 0; // end of string
-					data_ready_0 = 1;
-					buf_index_0 = 0;
-				}
-			}
+			serial_rx_char( UART_0, rx_char );
 		    }
 			break;
 		case UARTINT_THRE:		// Transmit Holding Register Empty
-			break;			// U1IIR Read has reset interrupt
+			serial_tx_fill( UART_0 );	// U0IIR Read has reset interrupt
+			break;
 		case UARTINT_MODEM:
 			temp = U0MSR;		// clear interrupt
 			break;
@@ -549,6 +861,8 @@ Return Value
 	If an error occurs, EOF is returned.
 */
  
+/* on the host stdout is the debug port, see posix_uart_init() */
+#if !defined (POSIX)
 int 
 #if defined (__CA__) || defined ( __GNUC__ )
 putchar( int ch )	// Write character to the debug serial port 
@@ -564,6 +878,7 @@ sendchar( int ch )	// Write character to the debug serial port
 	}
 	return EOF;
 }
+#endif
 
 /*
 putc()
@@ -643,29 +958,151 @@ fflush( int handle )
 */
 
 int 
-putchar_1( int ch )	// Write character to Serial Port 1   
+putchar_1( int ch )	// Queue character for Serial Port 1   
 {
-	if ( ch == '\n' )  {
-		while ( !( U1LSR & 0x20 ) );	// spin while Transmitter Holding Register not Empty
-		U1THR = CR;			// output CR 
-	}
+	if ( ch == '\n' )
+		serial_tx_put_wait( UART_1, CR );	// output CR 
 
-	while ( !( U1LSR & 0x20 ) );
-
-	return ( U1THR = ch );
+	return ( serial_tx_put_wait( UART_1, ch ) );
 }
 
 int 
-putchar_0( int ch )	// Write character to Serial Port 0  
+putchar_0( int ch )	// Queue character for Serial Port 0  
 {
-	if ( ch == '\n' )  {
-		while ( !( U0LSR & 0x20 ) );	// spin while Transmitter Holding Register not Empty
-		U0THR = CR;			// output CR 
+	if ( ch == '\n' )
+		serial_tx_put_wait( UART_0, CR );	// output CR 
+
+	return ( serial_tx_put_wait( UART_0, ch ) );
+}
+
+/*==============================================================
+ * serial_tx_put()
+ * 	Queue ch for transmission on uart without waiting. Returns
+ * 	ch, or EOF if the ring is full.
+ *==============================================================*/
+int
+serial_tx_put( int uart, int ch )
+{
+	TX_RING *ring = &serial_tx[uart];
+	unsigned head;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	DISABLE_INTERRUPTS;
+	head = ( ring->head + 1 ) & ring->mask;
+	if( head == ring->tail ) {
+		ENABLE_INTERRUPTS( interrupt_mask );
+		return( EOF );
 	}
+	ring->buf[ring->head] = ch;
+	ring->head = head;
+	if( !ring->busy )
+		serial_tx_fill( uart );		// transmitter idle, start it
+	ENABLE_INTERRUPTS( interrupt_mask );
+	return( ch );
+}
 
-	while ( !( U0LSR & 0x20 ) );
+/* Queue ch, waiting for room if the ring is full. putchar() and so all
+ * text output goes through here so that none of it is lost. The 
+ * transmitter is polled while waiting which works with interrupts off. */
+int
+serial_tx_put_wait( int uart, int ch )
+{
+	while( serial_tx_put( uart, ch ) == EOF )
+		serial_tx_poll( uart );
+	return( ch );
+}
 
-	return ( U0THR = ch );
+/* Queue len characters on uart in one go. Called with interrupts 
+ * disabled, the echo in the receive ISR queues on the same ring, after
+ * serial_tx_room() has shown there is space for them. */
+void
+serial_tx_write( int uart, uchar *buf, unsigned len )
+{
+	TX_RING *ring = &serial_tx[uart];
+	unsigned n;
+
+	/* up to the end of the ring, then the rest from the start */
+	n = ring->mask + 1 - ring->head;
+	if( n > len )
+		n = len;
+	memcpy( ring->buf + ring->head, buf, n );
+	memcpy( ring->buf, buf + n, len - n );
+
+	ring->head = ( ring->head + len ) & ring->mask;
+	if( !ring->busy )
+		serial_tx_fill( uart );		// transmitter idle, start it
+}
+
+/* number of characters that can be queued on uart without waiting */
+unsigned
+serial_tx_room( int uart )
+{
+	TX_RING *ring = &serial_tx[uart];
+
+	return( ring->mask - ( ( ring->head - ring->tail ) & ring->mask ) );
+}
+
+/*==============================================================
+ * serial_tx_flush()
+ * 	Wait until everything queued on uart is on the wire, e.g.
+ * 	before a reset.
+ *==============================================================*/
+void
+serial_tx_flush( int uart )
+{
+	while( ( serial_tx[uart].tail != serial_tx[uart].head ) 
+	       || !( SERIAL_LSR( uart ) & UART_LSR_TX_EMPTY ) )
+		serial_tx_poll( uart );
+}
+
+/* Refill the transmit FIFO if it is empty, for when the THRE interrupt
+ * can not be waited for: in interrupt context, with interrupts masked or
+ * on the host, where posix.c runs the interrupt side from the main loop.
+ * Otherwise the ring belongs to the interrupt and is left alone. */
+void
+serial_tx_poll( int uart )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+#if !defined (POSIX)
+	unsigned long cpsr;
+
+	CPU_IRQ_DISABLE( cpsr );
+	CPU_IRQ_RESTORE( cpsr );
+	if( !CPU_IRQ_MASKED( cpsr ) && serial_tx[uart].busy
+	    && ( interrupt_mask & ( ( uart == UART_0 ) ? IER_UART0 : IER_UART1 ) ) )
+		return;
+#endif
+
+	DISABLE_INTERRUPTS;
+	if( SERIAL_LSR( uart ) & UART_LSR_TX_HOLDING_REG_EMPTY )
+		serial_tx_fill( uart );
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * serial_tx_fill()
+ * 	Move up to UART_TX_FIFO_LEN characters from the ring into 
+ * 	the empty transmit FIFO. Called from the THRE interrupt and
+ * 	with interrupts disabled otherwise.
+ *==============================================================*/
+void
+serial_tx_fill( int uart )
+{
+	TX_RING *ring = &serial_tx[uart];
+	unsigned n;
+
+	for( n = 0; ( n < UART_TX_FIFO_LEN ) && ( ring->tail != ring->head ); n++ ) {
+		SERIAL_THR( uart, ring->buf[ring->tail] );
+		ring->tail = ( ring->tail + 1 ) & ring->mask;
+	}
+	ring->busy = ( n != 0 );
+
+	/* room for the first waiting terminal mode response? */
+	if( ( uart == UART_DEBUG ) && serial_tx_wait_count && !serial_tx_ready
+	    && ( serial_tx_room( uart ) >= serial_tx_need ) ) {
+		serial_tx_ready = 1;
+		sched_post( SCHED_TERMINAL );
+	}
 }
 /*
 int 
@@ -713,352 +1150,276 @@ bridged message tracking functionality or not.
 messages to and from the system interface are transferred using the BMC SMS LUN,
 10b, with the bridge field set to 00b.
 See Table 14-12, Terminal Mode Message Bridge Field*/
-/* buf is a null terminated string */
+/* buf is a null terminated string of len characters, one frame from
+ * the receive ring */
 /* this function processes the debug/terminal port serial data */
-void
-term_process( uchar *buf )
+/* Several messages can be sent in one go without waiting for the 
+ * responses, each gets a ws of its own and is processed as any other 
+ * request. Responses go out as the requests complete, which need not 
+ * be the order they were sent in, the console matches them up by the 
+ * seq it put in the request. When the pool runs low EAGAIN leaves the 
+ * message in the receive ring until a ws is free again, the last 
+ * TERM_WS_RESERVE ws are kept for IPMB. [SYS ECHO OFF] stops the echo
+ * so responses do not get mixed in with the characters of a batch. */
+int
+term_process( uchar *buf, unsigned len )
 {
-	uchar *ptr = buf;
-	int nibble[2];
-	int nibble_count;
-	int val, ret;
-	int count = 0;
-	int buf_len;
-	char *cmd_str;
-	unsigned power_state;
-	uchar out_buf[32]; // TODO make this bigger ?
-	int port_handle;
-	int i;
-	IPMI_TERMINAL_MODE_HDR tm_hdr = { 0, 0, 0 };
-	unsigned char *req_ptr = (unsigned char *)&tm_hdr;
+	TMODE_VERB verb;
+	unsigned count;
+	int ret;
+	IPMI_TERMINAL_MODE_HDR *tm_hdr;
 	IPMI_WS *ws;
 
 	/* first character must be '[' */
-	if( strncmp( ( const char * )ptr++, "[", 1 ) ) {
+	if( buf[0] != '[' ) {
 		putstr( "[ERR]\n" );
-		return;
+		return( ESUCCESS );
 	}
 
-	/* if not prefixed by SYS, check if this is an ipmi message */
-	if( strncmp( ( const char * )ptr, "SYS", 3 ) && strncmp( ( const char * )ptr, "sys", 3 ) ) 
+	/* a message starts with a hex digit, anything else is a verb */
+	if( ( ( buf[1] | 0x20 ) != 's' ) || ( tmode_parse_verb( buf, len, &verb ) != ESUCCESS ) 
+	    || ( verb.tok[0] != TMODE_TOK_SYS ) )
 		goto message_process;
 
-	if( ptr = ( unsigned char * )strchr( ( const char * )ptr, ' ' ) ) {
-		ptr++;
-	}
-	else {
+	if( verb.count < 2 ) {
 		putstr( "[ERR]\n" );
-		return;
+		return( ESUCCESS );
 	}
 
-	if( ( strncmp( ( const char * )ptr, "POWER", 5 ) == 0 ) 
-			|| ( strncmp( ( const char * )ptr, "power", 5 ) == 0 ) ) {
-
-		if( ptr = ( unsigned char * )strchr( ( const char * )ptr, ' ' ) ) {
-			ptr++;
-		}
-		else
-			return;
+	switch( verb.tok[1] ) {
+		case TMODE_TOK_POWER:
+			if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_OFF ) ) {
+				putstr( "[OK]\n" );
+				gpio_power_off();
+			} else if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_ON ) ) {
+				putstr( "[OK]\n" );
+				gpio_power_on();
+			} else {
+				putstr( "[ERR]\n" );
+			}
+			return( ESUCCESS );
 
-		if( ( strncmp( ( const char * )ptr, "OFF]", 4 ) == 0 ) 
-				|| ( strncmp( ( const char * )ptr, "off]", 4 ) == 0 ) ) {
-			putstr( "[OK]\n" );
-			gpio_power_off();
-		} else if( ( strncmp( ( const char * )ptr, "ON]", 3 ) == 0 ) 
-				|| (strncmp( ( const char * )ptr, "on]", 3 ) == 0) ) {
-			putstr( "[OK]\n" );
-			gpio_power_on();
-		} else {
-			putstr( "[ERR]\n" );
-		}
-		return;
-	}
+		case TMODE_TOK_TMODE:
+			putstr( verb.count == 2 ? "[OK TMODE]\n" : "[ERR]\n" );
+			return( ESUCCESS );
 
-	if( ( strncmp( ( const char * )ptr, "TMODE]", 6 ) == 0 ) 
-			|| ( strncmp( ptr, "tmode]", 6 ) == 0 ) ) {
-		putstr( "[OK TMODE]\n" );
-		return;
-	}
+		case TMODE_TOK_RESET:
+			putstr( verb.count == 2 ? "[OK]\n" : "[ERR]\n" );
+			return( ESUCCESS );
 
-	if( ( strncmp( ( const char * )ptr, "RESET]", 6 ) == 0 ) 
-			|| ( strncmp( ptr, "reset]", 6 ) == 0 ) ) {
-		putstr( "[OK]\n" );
-		return;
-	}
-
-	if( ( strncmp( ( const char * )ptr, "IDENTIFY]", 9 ) == 0 ) 
-			|| ( strncmp( ( const char * )ptr, "identify]", 9 ) == 0 ) ) {
-		gpio_led_blink( GPIO_IDENTIFY_LED, 5, 5, 0 );
-		putstr( "[OK]\n" );
-		return;
-	}
+		case TMODE_TOK_IDENTIFY:
+			if( verb.count == 2 ) {
+				gpio_led_blink( GPIO_IDENTIFY_LED, 5, 5, 0 );
+				putstr( "[OK]\n" );
+			} else {
+				putstr( "[ERR]\n" );
+			}
+			return( ESUCCESS );
+
+		/* controller statistics, see stats.c */
+		case TMODE_TOK_STATS:
+			if( verb.count == 2 ) {
+				stats_term_print();
+			} else if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_CLEAR ) ) {
+				stats_reset();
+				putstr( "[OK]\n" );
+			} else {
+				putstr( "[ERR]\n" );
+			}
+			return( ESUCCESS );
 
-	if( ( strncmp( ( const char * )ptr, "HEALTH QUERY]", 13 ) == 0 ) 
-			|| ( strncmp( ( const char * )ptr, "health query]", 13 ) == 0 ) ) {
-
-		/*
-		Return a high level version of the system health status in terse
-		format. The BMC returns a string with the following format if 
-		command is accepted.
-		
-		PWR:zzz H:xx T:xx V:xx PS:xx C:xx D:xx S:xx O:xx
-
-		Where:
-			PWR is system POWER state
-			H is overall Health
-			T is Temperature
-			V is Voltage
-			PS is Power Supply subsystem
-			F is cooling subsystem (Fans)
-			D is Hard Drive / RAID Subsystem
-			S is physical Security
-			O is Other (OEM)
-
-			zzz is: ON, 
-				OFF (soft-off or mechanical off), 
-				SLP (sleep - used when cant distinguish sleep level), 
-				S4, 
-				S3, 
-				S2, 
-				S1, 
-				?? (unknown)
-
-			and xx is: ok, nc, cr, nr, uf, or ?? where:
-
-			ok = OK (monitored parameters within normal operating ranges)
-			nc = non-critical (warning: hardware outside normal operating range)
-			cr = critical (fatal :hardware exceeding specified ratings)
-			nr = non-recoverable (potential damage: system hardware in jeopardy or damaged)
-			uf = unspecified fault (fault detected, but severity unspecified)
-			?? = status not available/unknown (typically because system power is OFF)
-		*/
-
-		unsigned power_state = gpio_get_power_state();
-
-		switch( power_state ) {
-			case POWER_STATE_ON:
-				putstr( "[OK PWR:ON " );
-				break;
-			case POWER_STATE_OFF:
-				putstr( "[OK PWR:OFF " );
-				break;
-			case POWER_STATE_SLP:
-				putstr( "[OK PWR:SLP " );
-				break;
-			case POWER_STATE_S1:
-				putstr( "[OK PWR:S1 " );
-				break;
-			case POWER_STATE_S2:
-				putstr( "[OK PWR:S2 " );
-				break;
-			case POWER_STATE_S3:
-				putstr( "[OK PWR:S3 " );
-				break;
-			case POWER_STATE_S4:
-				putstr( "[OK PWR:S4 " );
-				break;
-			default:
-				putstr( "[OK PWR:?? " );
-				break;
-		}
-		
-		/* the rest can be filled once we determine which parameters to monitor */		
-		putstr( "H:?? T:?? V:?? PS:?? C:?? D:?? S:?? O:??]\n" );
-		return;
+		case TMODE_TOK_HEALTH:
+			if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_QUERY ) )
+				term_health_query();
+			else
+				putstr( "[ERR]\n" );
+			return( ESUCCESS );
+
+		case TMODE_TOK_ECHO:
+			if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_OFF ) ) {
+				serial_config_port_echo( 0, 0 );
+				putstr( "[OK]\n" );
+			} else if( ( verb.count == 3 ) && ( verb.tok[2] == TMODE_TOK_ON ) ) {
+				serial_config_port_echo( 0, 1 );
+				putstr( "[OK]\n" );
+			} else {
+				putstr( "[ERR]\n" );
+			}
+			return( ESUCCESS );
 	}
 	
 	/* perform any module specific processing */
-	module_term_process( ptr );
+	module_term_process( verb.word[1] );
 	
 	putstr( "[ERR]\n" );
-	return;
+	return( ESUCCESS );
 
 message_process:
-	putstr( "Processing Message\n" );
-	nibble_count = 0;
-	buf_len = strlen( ( const char * )buf );
-	while( ptr < buf + buf_len ) {
-		if( ( ( ( *ptr >= 'A' ) && ( *ptr <= 'F' ) ) ||
-		      ( ( *ptr >= 'a' ) && ( *ptr <= 'f' ) ) ||
-		      ( ( *ptr >= '0' ) && ( *ptr <= '9' ) ) )&&
-			( nibble_count < 2 ) ) {
-			nibble[nibble_count] = *ptr;
-			nibble_count++;
-			//printf( "nibble_count %d = %c\n", nibble_count, *ptr );
-			ptr++;
-			if( nibble_count == 2 ) {
-				//printf( "nibble = %c%c\n", nibble[0], nibble[1] );
-				switch( nibble[0] ) {
-					case 'A': case 'a': val = 10 << 4; break;
-					case 'B': case 'b': val = 11 << 4; break;
-					case 'C': case 'c': val = 12 << 4; break;
-					case 'D': case 'd': val = 13 << 4; break;
-					case 'E': case 'e': val = 14 << 4; break;
-					case 'F': case 'f': val = 15 << 4; break;
-					default: val = ( nibble[0] - 48 ) << 4; break;
-				}
-				switch( nibble[1] ) {
-					case 'A': case 'a': val += 10; break;
-					case 'B': case 'b': val += 11; break;
-					case 'C': case 'c': val += 12; break;
-					case 'D': case 'd': val += 13; break;
-					case 'E': case 'e': val += 14; break;
-					case 'F': case 'f': val += 15; break;
-					default: val += ( nibble[1] - 48 ); break;
-				}
-				//printf( "val = %d\n", val );
-				*req_ptr++ = val;
-				count++;
-			} 
-		} else if ( *ptr == ' ' ) {
-			nibble_count = 0;
-			putchar( *ptr++ );
-		} else if ( *ptr == ']' ) {
-			putstr( "\n" );
-
-			dprintf( DBG_SERIAL | DBG_LVL1, "        netfn = 0x%2.2x  %2d  ", tm_hdr.netfn, tm_hdr.netfn );
-			switch( tm_hdr.netfn ) { 
-				case NETFN_CHASSIS_REQ: 
-					putstr("NETFN_CHASSIS_REQ\n"); 
-					cmd_str = string_find( chassis_str, tm_hdr.command ); 
-					break;
-				case NETFN_CHASSIS_RESP: 
-					putstr("NETFN_CHASSIS_RESP\n"); 
-					cmd_str = string_find( chassis_str, tm_hdr.command ); 
-					break;
-				case NETFN_BRIDGE_REQ: 
-					putstr("NETFN_BRIDGE_REQ\n"); 
-					cmd_str = string_find( bridge_str, tm_hdr.command ); 
-					break;
-				case NETFN_BRIDGE_RESP: 
-					putstr("NETFN_BRIDGE_RESP\n"); 
-					cmd_str = string_find( bridge_str, tm_hdr.command ); 
-					break;
-				case NETFN_EVENT_REQ: 
-					putstr("NETFN_EVENT_REQ\n"); 
-					cmd_str = string_find( event_str, tm_hdr.command ); 
-					break;
-				case NETFN_EVENT_RESP:
-					putstr("NETFN_EVENT_RESP\n"); 
-					cmd_str = string_find( event_str, tm_hdr.command ); 
-					break;
-				case NETFN_APP_REQ: 
-					putstr("NETFN_APP_REQ\n"); 
-					cmd_str = string_find( app_str, tm_hdr.command ); 
-					break;
-				case NETFN_APP_RESP: 
-					putstr("NETFN_APP_RESP\n"); 
-					cmd_str = string_find( app_str, tm_hdr.command ); 
-					break;
-				case NETFN_FW_REQ: 
-					putstr("NETFN_FW_REQ\n"); 
-					cmd_str = string_find( firmware_str, tm_hdr.command ); 
-					break;
-				case NETFN_FW_RESP: 
-					putstr("NETFN_FW_RESP\n"); 
-					cmd_str = string_find( firmware_str, tm_hdr.command ); 
-					break;
-				case NETFN_NVSTORE_REQ: 
-					putstr("NETFN_NVSTORE_REQ\n"); 
-					cmd_str = string_find( nvstore_str, tm_hdr.command ); 
-					break;
-				case NETFN_NVSTORE_RESP: 
-					putstr("NETFN_NVSTORE_RESP\n"); 
-					cmd_str = string_find( nvstore_str, tm_hdr.command ); 
-					break;
-				case NETFN_MEDIA_SPECIFIC_REQ: 
-					putstr("NETFN_MEDIA_SPECIFIC_REQ\n"); 
-					cmd_str = string_find( media_specific_str, tm_hdr.command ); 
-					break;
-				case NETFN_MEDIA_SPECIFIC_RESP: 
-					putstr("NETFN_MEDIA_SPECIFIC_RESP\n"); 
-					cmd_str = string_find( media_specific_str, tm_hdr.command ); 
-					break;
-				case NETFN_GROUP_EXTENSION_REQ: 
-					putstr("NETFN_GROUP_EXTENSION_REQ\n"); 
-					cmd_str = string_find( group_extension_str, tm_hdr.command ); 
-					break;
-				case NETFN_GROUP_EXTENSION_RESP: 
-					putstr("NETFN_GROUP_EXTENSION_RESP\n"); 
-					cmd_str = string_find( group_extension_str, tm_hdr.command ); 
-					break;
-				case NETFN_OEM_REQ: 
-					putstr("NETFN_OEM_REQ\n"); 
-					cmd_str = string_find( oem_str, tm_hdr.command ); 
-					break;
-				case NETFN_OEM_RESP: 
-					putstr("NETFN_OEM_RESP\n"); 
-					cmd_str = string_find( oem_str, tm_hdr.command ); 
-					break;
-				default: putstr("UNKNOWN\n"); break;
-			}
+	/* decode straight into the ws, with the biggest buffers the 
+	 * channel can use if one is free. The response uses them too. */
+	if( ( ws_stats.in_use + TERM_WS_RESERVE >= WS_ARRAY_SIZE ) || !( ws = ws_alloc() ) ) {
+		dputstr( DBG_SERIAL | DBG_LVL1, "Insufficient resources to complete command\n");
+		return( EAGAIN );
+	}
+	ws_buf_alloc( ws, channel_table[IPMI_CH_NUM_CONSOLE].max_msg_len );
 
-			dprintf( DBG_SERIAL | DBG_LVL1, "          lun = 0x%2.2x  %2d\n", tm_hdr.lun, tm_hdr.lun );
-			dprintf( DBG_SERIAL | DBG_LVL1, "          seq = 0x%2.2x  %2d\n", tm_hdr.seq, tm_hdr.seq );
-			dprintf( DBG_SERIAL | DBG_LVL1, "       bridge = 0x%2.2x  %2d\n", tm_hdr.bridge, tm_hdr.bridge );
-			if( cmd_str )
-				dprintf( DBG_SERIAL | DBG_LVL1, "      command = 0x%2.2x  %2d  %s\n", 
-						tm_hdr.command, tm_hdr.command, cmd_str );
-			else
-				dprintf( DBG_SERIAL | DBG_LVL1, "      command = 0x%2.2x  %2d  Unknown\n", 
-						tm_hdr.command, tm_hdr.command );
-				
-			if( ws = ws_alloc() ) {
-				ws->incoming_protocol = IPMI_CH_PROTOCOL_TMODE;
-				ws->incoming_medium = IPMI_CH_MEDIUM_SERIAL;
-				ws->incoming_channel = IPMI_CH_NUM_CONSOLE;
-				ws->len_in = count;
-				memcpy( ws->pkt_in, &tm_hdr, count ); 
-				ws_set_state( ws, WS_ACTIVE_IN );
-			} else {
-				dputstr( DBG_SERIAL | DBG_LVL1, "Insufficient resources to complete command\n");
-			}
-			return;
-		} else {
-			/* invalid character */
-			putstr( "[ERR]\n" );
-			return;
-		}
+	ret = tmode_decode( buf + 1, len - 1, ws->pkt_in, ws->buf_len, &count );
+	if( ( ret != ESUCCESS ) || ( count < sizeof( IPMI_TERMINAL_MODE_HDR ) ) ) {
+		ws_free( ws );
+		putstr( "[ERR]\n" );
+		return( ESUCCESS );
 	}
-	putstr( "[OK]\n" );
+
+	tm_hdr = ( IPMI_TERMINAL_MODE_HDR * )ws->pkt_in;
+	dprintf( DBG_SERIAL | DBG_LVL1, "netfn 0x%2.2x lun 0x%2.2x seq 0x%2.2x bridge 0x%2.2x command 0x%2.2x\n",
+		tm_hdr->netfn, tm_hdr->lun, tm_hdr->seq, tm_hdr->bridge, tm_hdr->command );
+			
+	ws->incoming_protocol = IPMI_CH_PROTOCOL_TMODE;
+	ws->incoming_medium = IPMI_CH_MEDIUM_SERIAL;
+	ws->incoming_channel = IPMI_CH_NUM_CONSOLE;
+	ws->len_in = count;
+	ws_set_state( ws, WS_ACTIVE_IN );
+	return( ESUCCESS );
 }
 
+/* [SYS HEALTH QUERY] */
 void
-terminal_process_work_list( void )
+term_health_query( void )
 {
-
-	if( data_ready_0 ) {
-		data_ready_0 = 0;
-		if( serial_port[0].callback_fn )
-			(*serial_port[0].callback_fn)( serial_port[0].buf );
+	/*
+	Return a high level version of the system health status in terse
+	format. The BMC returns a string with the following format if 
+	command is accepted.
+	
+	PWR:zzz H:xx T:xx V:xx PS:xx C:xx D:xx S:xx O:xx
+
+	Where:
+		PWR is system POWER state
+		H is overall Health
+		T is Temperature
+		V is Voltage
+		PS is Power Supply subsystem
+		F is cooling subsystem (Fans)
+		D is Hard Drive / RAID Subsystem
+		S is physical Security
+		O is Other (OEM)
+
+		zzz is: ON, 
+			OFF (soft-off or mechanical off), 
+			SLP (sleep - used when cant distinguish sleep level), 
+			S4, 
+			S3, 
+			S2, 
+			S1, 
+			?? (unknown)
+
+		and xx is: ok, nc, cr, nr, uf, or ?? where:
+
+		ok = OK (monitored parameters within normal operating ranges)
+		nc = non-critical (warning: hardware outside normal operating range)
+		cr = critical (fatal :hardware exceeding specified ratings)
+		nr = non-recoverable (potential damage: system hardware in jeopardy or damaged)
+		uf = unspecified fault (fault detected, but severity unspecified)
+		?? = status not available/unknown (typically because system power is OFF)
+	*/
+
+	unsigned power_state = gpio_get_power_state();
+
+	switch( power_state ) {
+		case POWER_STATE_ON:
+			putstr( "[OK PWR:ON " );
+			break;
+		case POWER_STATE_OFF:
+			putstr( "[OK PWR:OFF " );
+			break;
+		case POWER_STATE_SLP:
+			putstr( "[OK PWR:SLP " );
+			break;
+		case POWER_STATE_S1:
+			putstr( "[OK PWR:S1 " );
+			break;
+		case POWER_STATE_S2:
+			putstr( "[OK PWR:S2 " );
+			break;
+		case POWER_STATE_S3:
+			putstr( "[OK PWR:S3 " );
+			break;
+		case POWER_STATE_S4:
+			putstr( "[OK PWR:S4 " );
+			break;
+		default:
+			putstr( "[OK PWR:?? " );
+			break;
 	}
+	
+	/* the rest can be filled once we determine which parameters to monitor */		
+	putstr( "H:?? T:?? V:?? PS:?? C:?? D:?? S:?? O:??]\n" );
+}
 
-	if( data_ready_1 ) {
-		data_ready_1 = 0;
-		if( serial_port[1].callback_fn )
-			(*serial_port[1].callback_fn)( serial_port[1].buf );
+void
+terminal_process_work_list( void )
+{
+	unsigned i;
+
+	serial_rx_process( UART_0 );
+	serial_rx_process( UART_1 );
+
+	/* the transmit ring has drained, the waiting terminal mode 
+	 * responses go back to the work list in the order they came */
+	if( serial_tx_ready ) {
+		serial_tx_ready = 0;
+		for( i = 0; i < serial_tx_wait_count; i++ )
+			ws_set_state( serial_tx_wait[i], WS_ACTIVE_MASTER_WRITE );
+		serial_tx_wait_count = 0;
 	}
-	
 }	
 
-char hex_chars[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
 
-void
-serial_tm_send( unsigned char *ws ) 
+/*==============================================================
+ * serial_tm_send()
+ * 	Queue a terminal mode message on the debug port. The whole
+ * 	message goes into the transmit ring at once so it is never
+ * 	mixed up with other output. If it does not fit the ws waits
+ * 	for the ring to drain and EAGAIN is returned, the caller 
+ * 	leaves the ws alone until it is put back in the work list.
+ *==============================================================*/
+int
+serial_tm_send( unsigned char *arg ) 
 {
-	int i, hi_nibble, lo_nibble;
-	
-	putstr( "[" );
-	for( i = 0; i < ((IPMI_WS *)ws)->len_out; i++ ) { 
-		//printf( "%2.2x", ((IPMI_WS *)ws)->pkt_out[i] );
-		hi_nibble = ((IPMI_WS *)ws)->pkt_out[i] >> 4;
-		lo_nibble = ((IPMI_WS *)ws)->pkt_out[i] & 0x0f;
-		putchar( hex_chars[hi_nibble] );
-		putchar( hex_chars[lo_nibble] );
-		if( i < ( ((IPMI_WS *)ws)->len_out - 1 ) )
-			putstr( " " );
+	IPMI_WS *ws = ( IPMI_WS * )arg;
+	unsigned i, need;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	need = tmode_encode( WS_FRAME_OUT( ws ), ws->len_out, serial_tm_buf, 
+		sizeof( serial_tm_buf ) - 2 );
+	if( !need ) {
+		dputstr( DBG_SERIAL | DBG_ERR, "serial_tm_send: message too long\n" );
+		return( ESUCCESS );
 	}
-	putstr( "]\n" );
+	serial_tm_buf[need++] = CR;
+	serial_tm_buf[need++] = LF;
+
+	if( need > serial_tx[UART_DEBUG].mask ) {
+		/* will never fit, send it the slow way */
+		for( i = 0; i < need; i++ )
+			serial_tx_put_wait( UART_DEBUG, serial_tm_buf[i] );
+		return( ESUCCESS );
+	}
+
+	DISABLE_INTERRUPTS;
+	if( serial_tx_wait_count || ( serial_tx_room( UART_DEBUG ) < need ) ) {
+		if( !serial_tx_wait_count )
+			serial_tx_need = need;
+		serial_tx_wait[serial_tx_wait_count++] = ws;
+		/* the ring may have drained already */
+		if( !serial_tx[UART_DEBUG].busy )
+			serial_tx_fill( UART_DEBUG );
+		ENABLE_INTERRUPTS( interrupt_mask );
+		return( EAGAIN );
+	}
+	serial_tx_write( UART_DEBUG, serial_tm_buf, need );
+	ENABLE_INTERRUPTS( interrupt_mask );
+	return( ESUCCESS );
 }
 
 
@@ -1069,8 +1430,8 @@ puthex( unsigned char ch )
 	
 	hi_nibble = ch >> 4;
 	lo_nibble = ch & 0x0f;
-	putchar( hex_chars[hi_nibble] );
-	putchar( hex_chars[lo_nibble] );
+	putchar( tmode_hex_chars[hi_nibble] );
+	putchar( tmode_hex_chars[lo_nibble] );
 }
 
 	
@@ -1085,10 +1446,10 @@ puthex( unsigned char ch )
 	
   - set filter type
 
-      serial_config_port_filter( port_handle, [UART_FILTER_RAW | UART_FILTER_TERM] );
+      serial_config_port_filter( port_handle, [UART_FILTER_RAW | UART_FILTER_TERM | UART_FILTER_BASIC] );
        	
   - set data handler callback function. The scheduler will call the serial 
-    handler which will call this function
+    handler which will call this function with each frame and its length
 
       serial_config_port_callback( port_handle, callback_fn );
 
@@ -1114,18 +1475,36 @@ serial_get_handle( uchar port_name )
  set filter type
 On success, ESUCCESS is returned.
 On error, the function returns EOF.
- filter type = 	UART_FILTER_RAW | UART_FILTER_TERM
+ filter type = 	UART_FILTER_RAW | UART_FILTER_TERM | UART_FILTER_BASIC
+ Anything already received on the port is discarded.
 */
 int
 serial_config_port_filter( 
 	int port_handle, 
-	unsigned filter_type )  	// [UART_FILTER_RAW | UART_FILTER_TERM] );
+	unsigned filter_type )  	// [UART_FILTER_RAW | UART_FILTER_TERM | UART_FILTER_BASIC] );
 {
+	RX_RING *ring = &serial_rx[port_handle];
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
 	// TODO Error checking
+	DISABLE_INTERRUPTS;
 	serial_port[port_handle].filter_type = filter_type;
+	ring->tail = ring->head;
+	ring->frame_tail = ring->frame_head;
+	ring->state = RX_ST_IDLE;
+	ENABLE_INTERRUPTS( interrupt_mask );
 	return( ESUCCESS );
 }       
 
+/*
+  - turn the terminal mode echo of received characters on or off
+*/
+void
+serial_config_port_echo( int port_handle, uchar echo )
+{
+	serial_port[port_handle].echo = echo;
+}
+
 /*	
   - set data handler callback function. The scheduler will call the serial 
     handler which will call this function
@@ -1133,7 +1512,7 @@ serial_config_port_filter(
 int
 serial_config_port_callback( 
 	int port_handle, 
-	void ( *callback_fn )( uchar * ) )
+	int ( *callback_fn )( uchar *, unsigned ) )
 {					   
 	//TODO error checking
 	serial_port[port_handle].callback_fn = callback_fn;
@@ -30,10 +30,53 @@ support and contact details.
 #define UART_DEBUG	UART_0
 
 #define UART_FILTER_RAW		0
-#define UART_FILTER_TERM	1
+#define UART_FILTER_TERM	1	/* [..] terminal mode frames, echoed */
+#define UART_FILTER_BASIC	2	/* Basic mode frames */
+
+/* Basic mode framing characters, IPMI v1.5 section 14.4.1. A data byte 
+ * that equals one of them is sent as BASIC_ESCAPE and the byte in the 
+ * second column. */
+#define BASIC_START		0xA0	/* BASIC_ESCAPE 0xB0 */
+#define BASIC_STOP		0xA5	/* BASIC_ESCAPE 0xB5 */
+#define BASIC_HANDSHAKE		0xA6	/* BASIC_ESCAPE 0xB6 */
+#define BASIC_ESCAPE		0xAA	/* BASIC_ESCAPE 0xBA */
+#define BASIC_ESC		0x1B	/* BASIC_ESCAPE 0x3B */
 
 #define UART_PORT_COUNT		2
 
+/* Transmit ring lengths, powers of 2. The debug port ring holds a 
+ * whole terminal mode response for a WS_BUF_LEN_LARGE message. */
+#ifndef UART_TX_RING_LEN_DEBUG
+#define UART_TX_RING_LEN_DEBUG	1024
+#endif
+#ifndef UART_TX_RING_LEN_ITLA
+#define UART_TX_RING_LEN_ITLA	64
+#endif
+#define UART_TX_FIFO_LEN	16	/* characters written per THRE interrupt */
+
+/* Receive rings, powers of 2, and the number of complete frames that
+ * can wait for the main loop on each port. */
+#ifndef UART_RX_RING_LEN_DEBUG
+#define UART_RX_RING_LEN_DEBUG	512
+#endif
+#ifndef UART_RX_RING_LEN_ITLA
+#define UART_RX_RING_LEN_ITLA	128
+#endif
+#ifndef UART_RX_FRAMES
+#define UART_RX_FRAMES		16
+#endif
+
+typedef struct serial_stats {
+	unsigned long rx_count;		/* characters received */
+	unsigned long frame_count;	/* frames handed to the main loop */
+	unsigned long overrun_count;	/* frames lost, receive ring full or frame too long */
+	unsigned long queue_full_count;	/* frames lost, UART_RX_FRAMES waiting already */
+	unsigned long hw_overrun_count;	/* characters lost in the UART */
+	unsigned long error_count;	/* parity, framing, break and Basic mode escape errors */
+} SERIAL_STATS;
+
+extern SERIAL_STATS serial_stats[UART_PORT_COUNT];
+
 #ifndef EOF
 #define EOF -1
 #endif
@@ -53,6 +96,12 @@ int putchar_1( int ch );
 int getchar_0( void );
 int getchar_1( void );
 void terminal_process_work_list( void );
-void serial_tm_send( unsigned char *ws ); 
+int serial_tm_send( unsigned char *ws ); 
+int serial_tx_put( int uart, int ch );
+unsigned serial_tx_room( int uart );
+void serial_tx_flush( int uart );
 int serial_get_handle( unsigned char port_name );
+int serial_config_port_filter( int port_handle, unsigned filter_type );
+int serial_config_port_callback( int port_handle, int ( *callback_fn )( unsigned char *, unsigned ) );
+void serial_config_port_echo( int port_handle, unsigned char echo );
 //int fflush( int handle );
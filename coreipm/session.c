@@ -0,0 +1,909 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/session.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+RMCP+ sessions
+
+The IPMI v2.0 session layer of the LAN channel in the host build, rmcpd.c 
+is the transport. A session is set up with Open Session and RAKP 1-4 using
+RAKP-HMAC-SHA1 and then carries IPMI messages with the algorithms picked 
+in Open Session:
+
+	integrity		none, HMAC-SHA1-96
+	confidentiality		none, AES-CBC-128 (needs HMAC-SHA1-96)
+
+that is cipher suites 1, 2 and 3. There is one user, set with 
+session_set_user(). Its password is Kuid and, there being no BMC key, Kg.
+
+Sessions are in a table hashed on the managed system session ID, so a 
+packet finds its session in constant time however many are open. Each 
+session is also on an idle list, most recently used first, one list for 
+sessions still being set up and one for active sessions. session_tick() 
+runs from the callout queue once a second and drops sessions off the tail
+of each list until it gets to one that is not overdue, it never looks at 
+a session it leaves alone. With the table full Open Session makes room by
+dropping the oldest session still being set up, a console that has not 
+authenticated can not push out an active session.
+
+Inbound sequence numbers go through a sliding window once the AuthCode has
+been checked, see session_seq_check(). A session starts at User level, 
+Set Session Privilege Level takes it up to what Open Session asked for. 
+dispatch_request() checks each command on a session against the level it
+is at, see session_get_priv().
+
+The rmcpd worker threads share the table, session_lock guards it and 
+everything in it. Outside this file sessions are known by ID only, a 
+SESSION pointer is good for as long as the lock is held. The handshake 
+runs under the lock, it is rare. Per message work does not: 
+session_unwrap() and session_wrap() take a copy of the keys, and update
+the sequence numbers, with the lock held and do the hashing and 
+encryption on the copy after dropping it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/random.h>
+#include "ipmi.h"
+#include "timer.h"
+#include "debug.h"
+#include "error.h"
+#include "rmcp.h"
+#include "crypto.h"
+#include "session.h"
+
+/* session IDs and sequence numbers are LS byte first */
+#define SESSION_GET32( p )	( ( unsigned )( p )[0] | ( ( unsigned )( p )[1] << 8 ) \
+				| ( ( unsigned )( p )[2] << 16 ) | ( ( unsigned )( p )[3] << 24 ) )
+#define SESSION_PUT32( p, v )	do { ( p )[0] = ( v ); ( p )[1] = ( v ) >> 8; \
+				( p )[2] = ( v ) >> 16; ( p )[3] = ( v ) >> 24; } while( 0 )
+#define SESSION_HASH( id )	( ( ( id ) ^ ( ( id ) >> 16 ) ) & ( SESSION_HASH_SIZE - 1 ) )
+
+/* Open Session, RAKP 2 and RAKP 4 response lengths */
+#define SESSION_OPEN_RESP_LEN	36
+#define SESSION_RAKP2_LEN	60
+#define SESSION_RAKP4_LEN	20
+#define SESSION_ERR_RESP_LEN	8	/* tag, status, reserved, console ID */
+
+extern unsigned long lbolt;
+
+SESSION		session_array[SESSION_MAX];
+SESSION		*session_hash[SESSION_HASH_SIZE];
+SESSION		*session_free_list;
+LIST_HDR	session_setup_list;	/* Open Session and RAKP in progress */
+LIST_HDR	session_active_list;
+unsigned char	session_guid[16];	/* GUIDc */
+unsigned char	session_kuid[SESSION_KEY_LEN];
+unsigned char	session_user[SESSION_USER_LEN];
+unsigned char	session_user_len;
+unsigned char	session_user_set;
+unsigned	session_timer_handle;
+SESSION_STATS	session_stats;
+pthread_mutex_t	session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+SESSION *session_find( unsigned id );
+SESSION *session_alloc( void );
+void session_release( SESSION *s );
+void session_touch( SESSION *s );
+int session_seq_check( SESSION *s, unsigned seq );
+int session_auth_cmp( const unsigned char *a, const unsigned char *b, unsigned len );
+unsigned session_error( unsigned char *resp, const unsigned char *req, 
+	unsigned console_id, unsigned char status );
+unsigned session_open_locked( const unsigned char *req, unsigned len, unsigned char *resp );
+unsigned session_rakp1_locked( const unsigned char *req, unsigned len, unsigned char *resp );
+unsigned session_rakp3_locked( const unsigned char *req, unsigned len, unsigned char *resp );
+void session_count( unsigned long *counter );
+void session_tick( unsigned char *arg );
+
+/*==============================================================
+ * session_init()
+ *==============================================================*/
+void
+session_init( void )
+{
+	unsigned i;
+
+	session_free_list = 0;
+	for( i = 0; i < SESSION_MAX; i++ ) {
+		session_array[i].state = SESSION_ST_FREE;
+		session_array[i].hash_next = session_free_list;
+		session_free_list = &session_array[i];
+	}
+	for( i = 0; i < SESSION_HASH_SIZE; i++ )
+		session_hash[i] = 0;
+	session_setup_list.next = session_setup_list.prev = &session_setup_list;
+	session_active_list.next = session_active_list.prev = &session_active_list;
+
+	session_random( session_guid, sizeof( session_guid ) );
+	timer_add_callout_queue( ( void * )&session_timer_handle, HZ, session_tick, 0 );
+}
+
+/*==============================================================
+ * session_set_user()
+ * 	Set the user name and password RAKP checks against. The 
+ * 	name can be empty, the anonymous user.
+ *==============================================================*/
+int
+session_set_user( const char *name, const char *password )
+{
+	unsigned name_len = strlen( name );
+	unsigned password_len = strlen( password );
+
+	if( ( name_len > SESSION_USER_LEN ) || ( password_len > SESSION_KEY_LEN ) )
+		return( EINVAL );
+
+	memset( session_kuid, 0, sizeof( session_kuid ) );
+	memcpy( session_kuid, password, password_len );
+	memcpy( session_user, name, name_len );
+	session_user_len = name_len;
+	session_user_set = 1;
+	return( ESUCCESS );
+}
+
+/*==============================================================
+ * session_random()
+ * 	Fill buf from the kernel random number generator.
+ *==============================================================*/
+void
+session_random( unsigned char *buf, unsigned len )
+{
+	int n;
+
+	while( len ) {
+		if( ( n = getrandom( buf, len, 0 ) ) < 0 ) {
+			if( errno == EINTR )
+				continue;
+			perror( "session: getrandom" );
+			exit( EXIT_FAILURE );
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+/* look up a session by managed system session ID, 0 if there is none,
+ * called with session_lock held */
+SESSION *
+session_find( unsigned id )
+{
+	SESSION *s;
+
+	for( s = session_hash[SESSION_HASH( id )]; s; s = s->hash_next ) {
+		if( s->id == id )
+			break;
+	}
+	return( s );
+}
+
+/* Take a free session, or the oldest one still being set up, and give
+ * it an ID nothing else has. Called with session_lock held. */
+SESSION *
+session_alloc( void )
+{
+	SESSION *s;
+	unsigned id;
+
+	if( !( s = session_free_list ) ) {
+		if( session_setup_list.prev == &session_setup_list )
+			return( 0 );
+		session_release( ( SESSION * )session_setup_list.prev );
+		session_stats.expired++;
+		s = session_free_list;
+	}
+	session_free_list = s->hash_next;
+
+	do {
+		session_random( ( unsigned char * )&id, sizeof( id ) );
+	} while( !id || session_find( id ) );
+
+	memset( s, 0, sizeof( SESSION ) );
+	s->id = id;
+	s->hdr.next = s->hdr.prev = &s->hdr;
+	s->hash_next = session_hash[SESSION_HASH( id )];
+	session_hash[SESSION_HASH( id )] = s;
+	session_stats.active++;
+	return( s );
+}
+
+/* drop a session, keys and the rest of it are wiped, called with 
+ * session_lock held */
+void
+session_release( SESSION *s )
+{
+	SESSION **pp = &session_hash[SESSION_HASH( s->id )];
+
+	while( *pp != s )
+		pp = &( *pp )->hash_next;
+	*pp = s->hash_next;
+
+	s->hdr.prev->next = s->hdr.next;
+	s->hdr.next->prev = s->hdr.prev;
+
+	memset( s, 0, sizeof( SESSION ) );
+	s->state = SESSION_ST_FREE;
+	s->hash_next = session_free_list;
+	session_free_list = s;
+	session_stats.active--;
+}
+
+/* move s to the head of its idle list and restart its timeout */
+void
+session_touch( SESSION *s )
+{
+	LIST_HDR *list;
+
+	s->hdr.prev->next = s->hdr.next;
+	s->hdr.next->prev = s->hdr.prev;
+
+	if( s->state == SESSION_ST_ACTIVE ) {
+		list = &session_active_list;
+		s->deadline = lbolt + SESSION_IDLE_TIMEOUT;
+	} else {
+		list = &session_setup_list;
+		s->deadline = lbolt + SESSION_SETUP_TIMEOUT;
+	}
+	s->hdr.next = list->next;
+	s->hdr.prev = list;
+	list->next->prev = &s->hdr;
+	list->next = &s->hdr;
+}
+
+/* compare AuthCodes without giving away where they differ */
+int
+session_auth_cmp( const unsigned char *a, const unsigned char *b, unsigned len )
+{
+	unsigned char diff = 0;
+
+	while( len-- )
+		diff |= *a++ ^ *b++;
+	return( diff );
+}
+
+/* error response to Open Session or a RAKP message, they all start the
+ * same way */
+unsigned
+session_error( 
+	unsigned char *resp, 
+	const unsigned char *req, 
+	unsigned console_id, 
+	unsigned char status )
+{
+	resp[0] = req[0];		/* message tag */
+	resp[1] = status;
+	resp[2] = 0;
+	resp[3] = 0;
+	SESSION_PUT32( resp + 4, console_id );
+	return( SESSION_ERR_RESP_LEN );
+}
+
+/*==============================================================
+ * session_open_locked()
+ * 	Open Session Request, payload type 10h. Builds the Open 
+ * 	Session Response in resp and returns its length, 0 if the
+ * 	request is not worth an answer. An algorithm payload with
+ * 	length 0 leaves the choice to us, we pick suite 3.
+ *==============================================================*/
+unsigned
+session_open_locked( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	unsigned console_id;
+	unsigned char max_priv, auth_alg, integ_alg, conf_alg;
+	SESSION *s;
+
+	if( len < SESSION_ERR_RESP_LEN )
+		return( 0 );
+	console_id = SESSION_GET32( req + 4 );
+
+	if( ( len < 32 ) || !console_id || ( req[8] != 0 ) 
+	    || ( req[16] != 1 ) || ( req[24] != 2 ) )
+		return( session_error( resp, req, console_id, RMCPP_ST_ILLEGAL_PARAMETER ) );
+
+	max_priv = req[1] & 0x0f;
+	if( !max_priv )
+		max_priv = IPMI_PRIV_ADMIN;
+	if( max_priv > IPMI_PRIV_ADMIN )
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_ROLE ) );
+
+	auth_alg = req[11] ? req[12] & RMCPP_PAYLOAD_TYPE_MASK : RMCPP_AUTH_HMAC_SHA1;
+	integ_alg = req[19] ? req[20] & RMCPP_PAYLOAD_TYPE_MASK : RMCPP_INTEG_HMAC_SHA1_96;
+	conf_alg = req[27] ? req[28] & RMCPP_PAYLOAD_TYPE_MASK : RMCPP_CONF_AES_CBC_128;
+	if( auth_alg != RMCPP_AUTH_HMAC_SHA1 )
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_AUTH_ALG ) );
+	if( integ_alg > RMCPP_INTEG_HMAC_SHA1_96 )
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_INTEG_ALG ) );
+	if( conf_alg > RMCPP_CONF_AES_CBC_128 )
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_CONF_ALG ) );
+	if( conf_alg && !integ_alg )
+		return( session_error( resp, req, console_id, RMCPP_ST_NO_CIPHER_SUITE ) );
+
+	if( !( s = session_alloc() ) ) {
+		session_stats.no_slot++;
+		dputstr( DBG_LAN | DBG_ERR, "session_open: no free session\n" );
+		return( session_error( resp, req, console_id, RMCPP_ST_NO_RESOURCES ) );
+	}
+	s->console_id = console_id;
+	s->max_priv = max_priv;
+	s->auth_alg = auth_alg;
+	s->integ_alg = integ_alg;
+	s->conf_alg = conf_alg;
+	s->state = SESSION_ST_OPEN;
+	session_touch( s );
+	session_stats.opened++;
+
+	memset( resp, 0, SESSION_OPEN_RESP_LEN );
+	session_error( resp, req, console_id, RMCPP_ST_OK );
+	resp[2] = max_priv;
+	SESSION_PUT32( resp + 8, s->id );
+	resp[12] = 0;			/* authentication payload */
+	resp[15] = 8;
+	resp[16] = auth_alg;
+	resp[20] = 1;			/* integrity payload */
+	resp[23] = 8;
+	resp[24] = integ_alg;
+	resp[28] = 2;			/* confidentiality payload */
+	resp[31] = 8;
+	resp[32] = conf_alg;
+	return( SESSION_OPEN_RESP_LEN );
+}
+
+/*==============================================================
+ * session_rakp1_locked()
+ * 	RAKP Message 1, payload type 12h. Checks the user and 
+ * 	answers with RAKP Message 2 in resp, returns its length.
+ *==============================================================*/
+unsigned
+session_rakp1_locked( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	/* SIDm, SIDc, Rm, Rc, GUIDc, ROLEm, ULENm, UNAMEm */
+	unsigned char buf[4 + 4 + SESSION_RAND_LEN + SESSION_RAND_LEN + 16 + 2 + SESSION_USER_LEN];
+	unsigned char *p = buf;
+	unsigned char priv, user_len;
+	unsigned console_id;
+	SESSION *s;
+
+	if( len < SESSION_ERR_RESP_LEN )
+		return( 0 );
+	s = session_find( SESSION_GET32( req + 4 ) );
+	if( !s || ( s->state != SESSION_ST_OPEN ) ) {
+		session_stats.bad_pkt++;
+		return( session_error( resp, req, 0, RMCPP_ST_INVALID_SESSION_ID ) );
+	}
+	console_id = s->console_id;
+
+	user_len = ( len > 27 ) ? req[27] : 0;
+	if( ( len < 28 ) || ( user_len > SESSION_USER_LEN ) || ( len < 28 + user_len ) ) {
+		session_release( s );
+		return( session_error( resp, req, console_id, RMCPP_ST_ILLEGAL_PARAMETER ) );
+	}
+	priv = req[24] & 0x0f;
+	if( !priv || ( priv > s->max_priv ) ) {
+		session_release( s );
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_ROLE ) );
+	}
+	if( !session_user_set || ( user_len != session_user_len ) 
+	    || memcmp( req + 28, session_user, user_len ) ) {
+		session_release( s );
+		session_stats.auth_fail++;
+		return( session_error( resp, req, console_id, RMCPP_ST_UNAUTHORIZED_NAME ) );
+	}
+
+	memcpy( s->rand_console, req + 8, SESSION_RAND_LEN );
+	s->role = req[24];
+	s->max_priv = priv;
+	s->priv = ( priv < IPMI_PRIV_USER ) ? priv : IPMI_PRIV_USER;
+	s->user_len = user_len;
+	memcpy( s->user, req + 28, user_len );
+	session_random( s->rand_bmc, SESSION_RAND_LEN );
+
+	SESSION_PUT32( p, s->console_id );		p += 4;
+	SESSION_PUT32( p, s->id );			p += 4;
+	memcpy( p, s->rand_console, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	memcpy( p, s->rand_bmc, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	memcpy( p, session_guid, 16 );			p += 16;
+	*p++ = s->role;
+	*p++ = s->user_len;
+	memcpy( p, s->user, s->user_len );		p += s->user_len;
+
+	session_error( resp, req, console_id, RMCPP_ST_OK );
+	memcpy( resp + 8, s->rand_bmc, SESSION_RAND_LEN );
+	memcpy( resp + 24, session_guid, 16 );
+	hmac_sha1( session_kuid, SESSION_KEY_LEN, buf, p - buf, resp + 40 );
+
+	s->state = SESSION_ST_RAKP;
+	session_touch( s );
+	return( SESSION_RAKP2_LEN );
+}
+
+/*==============================================================
+ * session_rakp3_locked()
+ * 	RAKP Message 3, payload type 14h. Checks the console's 
+ * 	AuthCode, derives SIK, K1 and K2 and answers with RAKP
+ * 	Message 4 in resp, the session is active from then on.
+ *==============================================================*/
+unsigned
+session_rakp3_locked( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	/* the longest of the HMAC inputs, Rm, Rc, ROLEm, ULENm, UNAMEm */
+	unsigned char buf[SESSION_RAND_LEN + SESSION_RAND_LEN + 2 + SESSION_USER_LEN];
+	unsigned char mac[SHA1_DIGEST_LEN], k[SESSION_KEY_LEN];
+	unsigned char *p = buf;
+	unsigned console_id;
+	SESSION *s;
+
+	if( len < SESSION_ERR_RESP_LEN )
+		return( 0 );
+	s = session_find( SESSION_GET32( req + 4 ) );
+	if( !s || ( s->state != SESSION_ST_RAKP ) ) {
+		session_stats.bad_pkt++;
+		return( session_error( resp, req, 0, RMCPP_ST_INVALID_SESSION_ID ) );
+	}
+	console_id = s->console_id;
+
+	/* the console gave up on RAKP 2 */
+	if( req[1] != RMCPP_ST_OK ) {
+		session_release( s );
+		return( 0 );
+	}
+
+	/* HMAC_Kuid( Rc, SIDm, ROLEm, ULENm, UNAMEm ) */
+	memcpy( p, s->rand_bmc, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	SESSION_PUT32( p, s->console_id );		p += 4;
+	*p++ = s->role;
+	*p++ = s->user_len;
+	memcpy( p, s->user, s->user_len );		p += s->user_len;
+	hmac_sha1( session_kuid, SESSION_KEY_LEN, buf, p - buf, mac );
+	if( ( len < 8 + SHA1_DIGEST_LEN ) || session_auth_cmp( mac, req + 8, SHA1_DIGEST_LEN ) ) {
+		session_release( s );
+		session_stats.auth_fail++;
+		dputstr( DBG_LAN | DBG_ERR, "session_rakp3: bad AuthCode\n" );
+		return( session_error( resp, req, console_id, RMCPP_ST_INVALID_INTEG_VALUE ) );
+	}
+
+	/* SIK = HMAC_Kg( Rm, Rc, ROLEm, ULENm, UNAMEm ) */
+	p = buf;
+	memcpy( p, s->rand_console, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	memcpy( p, s->rand_bmc, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	*p++ = s->role;
+	*p++ = s->user_len;
+	memcpy( p, s->user, s->user_len );		p += s->user_len;
+	hmac_sha1( session_kuid, SESSION_KEY_LEN, buf, p - buf, s->sik );
+
+	/* K1 = HMAC_SIK( 01h x 20 ), K2 = HMAC_SIK( 02h x 20 ) */
+	memset( buf, 0x01, SESSION_KEY_LEN );
+	hmac_sha1( s->sik, SESSION_KEY_LEN, buf, SESSION_KEY_LEN, k );
+	hmac_sha1_init( &s->integ, k, SESSION_KEY_LEN );
+	memset( buf, 0x02, SESSION_KEY_LEN );
+	hmac_sha1( s->sik, SESSION_KEY_LEN, buf, SESSION_KEY_LEN, k );
+	aes128_set_key( &s->aes, k );
+	memset( k, 0, sizeof( k ) );
+
+	/* ICV = HMAC_SIK( Rm, SIDc, GUIDc ), first 96 bits */
+	p = buf;
+	memcpy( p, s->rand_console, SESSION_RAND_LEN );	p += SESSION_RAND_LEN;
+	SESSION_PUT32( p, s->id );			p += 4;
+	memcpy( p, session_guid, 16 );			p += 16;
+	hmac_sha1( s->sik, SESSION_KEY_LEN, buf, p - buf, mac );
+
+	session_error( resp, req, console_id, RMCPP_ST_OK );
+	memcpy( resp + 8, mac, RMCPP_HMAC_SHA1_96_LEN );
+
+	s->state = SESSION_ST_ACTIVE;
+	session_touch( s );
+	session_stats.established++;
+	dputstr( DBG_LAN | DBG_LVL1, "session_rakp3: session active\n" );
+	return( SESSION_RAKP4_LEN );
+}
+
+/*==============================================================
+ * session_open(), session_rakp1(), session_rakp3()
+ * 	The handshake, see the _locked versions above. Each runs 
+ * 	with session_lock held.
+ *==============================================================*/
+unsigned
+session_open( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	pthread_mutex_lock( &session_lock );
+	len = session_open_locked( req, len, resp );
+	pthread_mutex_unlock( &session_lock );
+	return( len );
+}
+
+unsigned
+session_rakp1( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	pthread_mutex_lock( &session_lock );
+	len = session_rakp1_locked( req, len, resp );
+	pthread_mutex_unlock( &session_lock );
+	return( len );
+}
+
+unsigned
+session_rakp3( const unsigned char *req, unsigned len, unsigned char *resp )
+{
+	pthread_mutex_lock( &session_lock );
+	len = session_rakp3_locked( req, len, resp );
+	pthread_mutex_unlock( &session_lock );
+	return( len );
+}
+
+/* bump a counter in session_stats from outside the lock */
+void
+session_count( unsigned long *counter )
+{
+	pthread_mutex_lock( &session_lock );
+	( *counter )++;
+	pthread_mutex_unlock( &session_lock );
+}
+
+/*==============================================================
+ * session_seq_check()
+ * 	Sliding window check of an inbound session sequence 
+ * 	number. The first one after RAKP sets where the window
+ * 	starts, after that seq may be up to SESSION_SEQ_AHEAD 
+ * 	ahead of the highest seen, which moves the window, or up
+ * 	to SESSION_SEQ_WINDOW - 1 behind it if it has not been 
+ * 	seen yet. Returns 1 if seq is accepted.
+ *==============================================================*/
+int
+session_seq_check( SESSION *s, unsigned seq )
+{
+	unsigned diff;
+
+	if( !seq )
+		return( 0 );
+	if( !s->seq_in ) {
+		s->seq_in = seq;
+		s->seq_window = 1;
+		return( 1 );
+	}
+
+	diff = seq - s->seq_in;
+	if( diff && ( diff <= SESSION_SEQ_AHEAD ) ) {
+		s->seq_window = ( diff < 32 ) ? ( s->seq_window << diff ) | 1 : 1;
+		s->seq_in = seq;
+		return( 1 );
+	}
+	diff = s->seq_in - seq;
+	if( ( diff < SESSION_SEQ_WINDOW ) && !( s->seq_window & ( 1u << diff ) ) ) {
+		s->seq_window |= 1u << diff;
+		return( 1 );
+	}
+	return( 0 );
+}
+
+/*==============================================================
+ * session_unwrap()
+ * 	Check and decrypt an IPMI message that came in on a 
+ * 	session, pkt is the packet from the Auth Type byte on.
+ * 	Returns the managed system session ID with msg and
+ * 	msg_len set to the message in pkt, or 0 if the packet is
+ * 	to be dropped.
+ *==============================================================*/
+unsigned
+session_unwrap( 
+	unsigned char *pkt, 
+	unsigned len, 
+	unsigned char **msg, 
+	unsigned *msg_len )
+{
+	unsigned char mac[SHA1_DIGEST_LEN];
+	unsigned char *payload = pkt + RMCPP_SESSION_HDR_LEN;
+	unsigned payload_len, end, id;
+	unsigned char type, pad, integ_alg, conf_alg;
+	HMAC_SHA1_CTX integ;
+	AES_KEY aes;
+	SESSION *s;
+
+	if( len < RMCPP_SESSION_HDR_LEN ) {
+		session_count( &session_stats.bad_pkt );
+		return( 0 );
+	}
+	id = SESSION_GET32( pkt + 2 );
+	type = pkt[1];
+	payload_len = pkt[10] | ( pkt[11] << 8 );
+
+	/* an IPMI message on an active session, authenticated and
+	 * encrypted as agreed */
+	pthread_mutex_lock( &session_lock );
+	if( !( s = session_find( id ) )
+	    || ( s->state != SESSION_ST_ACTIVE )
+	    || ( ( type & RMCPP_PAYLOAD_TYPE_MASK ) != IOLAN_PAYLOAD_IPMI_MESSAGE )
+	    || ( !( type & RMCPP_PAYLOAD_AUTHENTICATED ) != !s->integ_alg )
+	    || ( !( type & RMCPP_PAYLOAD_ENCRYPTED ) != !s->conf_alg )
+	    || ( RMCPP_SESSION_HDR_LEN + payload_len > len ) ) {
+		session_stats.bad_pkt++;
+		pthread_mutex_unlock( &session_lock );
+		return( 0 );
+	}
+	integ_alg = s->integ_alg;
+	conf_alg = s->conf_alg;
+	if( integ_alg )
+		integ = s->integ;
+	if( conf_alg )
+		aes = s->aes;
+	pthread_mutex_unlock( &session_lock );
+
+	/* trailer: integrity pad, pad length, next header, AuthCode */
+	if( integ_alg ) {
+		if( len < RMCPP_SESSION_HDR_LEN + payload_len + 2 + RMCPP_HMAC_SHA1_96_LEN ) {
+			session_count( &session_stats.bad_pkt );
+			return( 0 );
+		}
+		end = len - RMCPP_HMAC_SHA1_96_LEN;
+		hmac_sha1_mac( &integ, pkt, end, mac );
+		if( session_auth_cmp( mac, pkt + end, RMCPP_HMAC_SHA1_96_LEN ) ) {
+			session_count( &session_stats.auth_fail );
+			return( 0 );
+		}
+		if( ( pkt[end - 1] != RMCPP_NEXT_HEADER ) 
+		    || ( RMCPP_SESSION_HDR_LEN + payload_len + pkt[end - 2] + 2 != end ) ) {
+			session_count( &session_stats.bad_pkt );
+			return( 0 );
+		}
+	}
+
+	/* the session may have been closed in the meantime */
+	pthread_mutex_lock( &session_lock );
+	if( !( s = session_find( id ) ) || ( s->state != SESSION_ST_ACTIVE ) ) {
+		session_stats.bad_pkt++;
+		pthread_mutex_unlock( &session_lock );
+		return( 0 );
+	}
+	if( !session_seq_check( s, SESSION_GET32( pkt + 6 ) ) ) {
+		session_stats.seq_reject++;
+		pthread_mutex_unlock( &session_lock );
+		return( 0 );
+	}
+	session_touch( s );
+	pthread_mutex_unlock( &session_lock );
+
+	/* IV, then the message, confidentiality pad and pad length */
+	if( conf_alg ) {
+		if( ( payload_len < 2 * AES_BLOCK_LEN ) || ( payload_len % AES_BLOCK_LEN ) ) {
+			session_count( &session_stats.bad_pkt );
+			return( 0 );
+		}
+		aes128_cbc_decrypt( &aes, payload, payload + AES_BLOCK_LEN,
+			payload_len - AES_BLOCK_LEN );
+		pad = payload[payload_len - 1];
+		if( pad + 1 > payload_len - AES_BLOCK_LEN ) {
+			session_count( &session_stats.bad_pkt );
+			return( 0 );
+		}
+		*msg = payload + AES_BLOCK_LEN;
+		*msg_len = payload_len - AES_BLOCK_LEN - pad - 1;
+	} else {
+		*msg = payload;
+		*msg_len = payload_len;
+	}
+	return( id );
+}
+
+/*==============================================================
+ * session_wrap()
+ * 	Build the session packet for IPMI message msg on session
+ * 	id in out, from the Auth Type byte on. Returns its length,
+ * 	0 if the session is gone or the packet does not fit in
+ * 	size bytes. A session that is closing is released, this
+ * 	is the last packet on it.
+ *==============================================================*/
+unsigned
+session_wrap( 
+	unsigned id,
+	const unsigned char *msg, 
+	unsigned msg_len, 
+	unsigned char *out, 
+	unsigned size )
+{
+	unsigned char mac[SHA1_DIGEST_LEN];
+	unsigned char *payload = out + RMCPP_SESSION_HDR_LEN;
+	unsigned payload_len, len, i, console_id, seq;
+	unsigned char pad, integ_alg, conf_alg;
+	HMAC_SHA1_CTX integ;
+	AES_KEY aes;
+	SESSION *s;
+
+	pthread_mutex_lock( &session_lock );
+	if( !( s = session_find( id ) ) || ( s->state != SESSION_ST_ACTIVE ) ) {
+		pthread_mutex_unlock( &session_lock );
+		return( 0 );
+	}
+	integ_alg = s->integ_alg;
+	conf_alg = s->conf_alg;
+	if( integ_alg )
+		integ = s->integ;
+	if( conf_alg )
+		aes = s->aes;
+	console_id = s->console_id;
+	if( !++s->seq_out )
+		s->seq_out = 1;
+	seq = s->seq_out;
+	if( s->closing ) {
+		session_release( s );
+		session_stats.closed++;
+	}
+	pthread_mutex_unlock( &session_lock );
+
+	if( conf_alg ) {
+		pad = ( AES_BLOCK_LEN - ( msg_len + 1 ) % AES_BLOCK_LEN ) % AES_BLOCK_LEN;
+		payload_len = AES_BLOCK_LEN + msg_len + pad + 1;
+	} else {
+		pad = 0;
+		payload_len = msg_len;
+	}
+	/* longest trailer is 3 pad bytes, pad length, next header, AuthCode */
+	if( RMCPP_SESSION_HDR_LEN + payload_len 
+	    + ( integ_alg ? 5 + RMCPP_HMAC_SHA1_96_LEN : 0 ) > size )
+		return( 0 );
+
+	out[0] = AUTH_TYPE_RMCPP;
+	out[1] = IOLAN_PAYLOAD_IPMI_MESSAGE 
+		| ( integ_alg ? RMCPP_PAYLOAD_AUTHENTICATED : 0 )
+		| ( conf_alg ? RMCPP_PAYLOAD_ENCRYPTED : 0 );
+	SESSION_PUT32( out + 2, console_id );
+	SESSION_PUT32( out + 6, seq );
+	out[10] = payload_len & 0xff;
+	out[11] = payload_len >> 8;
+
+	if( conf_alg ) {
+		/* The IV is the sequence number encrypted under K2, it is
+		 * unpredictable without the key and never repeats within 
+		 * the session. Saves a trip to the kernel per message. */
+		memset( payload, 0, AES_BLOCK_LEN );
+		SESSION_PUT32( payload, seq );
+		SESSION_PUT32( payload + 4, id );
+		aes128_encrypt( &aes, payload, payload );
+		memcpy( payload + AES_BLOCK_LEN, msg, msg_len );
+		for( i = 0; i < pad; i++ )
+			payload[AES_BLOCK_LEN + msg_len + i] = i + 1;
+		payload[payload_len - 1] = pad;
+		aes128_cbc_encrypt( &aes, payload, payload + AES_BLOCK_LEN,
+			payload_len - AES_BLOCK_LEN );
+	} else {
+		memcpy( payload, msg, msg_len );
+	}
+	len = RMCPP_SESSION_HDR_LEN + payload_len;
+
+	if( integ_alg ) {
+		/* pad so Auth Type through Next Header is a multiple of 4 */
+		pad = ( 4 - ( len + 2 ) % 4 ) % 4;
+		memset( out + len, 0xff, pad );
+		len += pad;
+		out[len++] = pad;
+		out[len++] = RMCPP_NEXT_HEADER;
+		hmac_sha1_mac( &integ, out, len, mac );
+		memcpy( out + len, mac, RMCPP_HMAC_SHA1_96_LEN );
+		len += RMCPP_HMAC_SHA1_96_LEN;
+	}
+	return( len );
+}
+
+/*==============================================================
+ * session_set_priv()
+ * 	Set Session Privilege Level for session id, up to what it
+ * 	asked for in Open Session, level 0 leaves it as it is.
+ * 	The level the session ends up at is returned in cur.
+ * 	Returns the completion code.
+ *==============================================================*/
+unsigned char
+session_set_priv( unsigned id, unsigned char priv, unsigned char *cur )
+{
+	unsigned char cc = CC_NORMAL;
+	SESSION *s;
+
+	pthread_mutex_lock( &session_lock );
+	if( !( s = session_find( id ) ) || ( s->state != SESSION_ST_ACTIVE ) )
+		cc = CC_CMD_ILLEGAL;
+	else if( priv && ( ( priv < IPMI_PRIV_USER ) || ( priv > IPMI_PRIV_OEM ) ) )
+		cc = CC_INVALID_DATA_IN_REQ;
+	else if( priv > s->max_priv )
+		cc = CC_PRIV_EXCEEDS_LIMIT;
+	else {
+		if( priv )
+			s->priv = priv;
+		*cur = s->priv;
+	}
+	pthread_mutex_unlock( &session_lock );
+	return( cc );
+}
+
+/*==============================================================
+ * session_get_priv()
+ * 	The privilege level session id is at, 0 if it is not 
+ * 	active.
+ *==============================================================*/
+unsigned char
+session_get_priv( unsigned id )
+{
+	unsigned char priv = 0;
+	SESSION *s;
+
+	pthread_mutex_lock( &session_lock );
+	if( ( s = session_find( id ) ) && ( s->state == SESSION_ST_ACTIVE ) )
+		priv = s->priv;
+	pthread_mutex_unlock( &session_lock );
+	return( priv );
+}
+
+/*==============================================================
+ * session_close()
+ * 	Close Session for session id, asked for on session
+ * 	requester. A session closing itself goes once the response
+ * 	has been wrapped, any other goes now. A session still being
+ * 	set up is not closed, another console's handshake stays.
+ * 	Returns the completion code.
+ *==============================================================*/
+unsigned char
+session_close( unsigned id, unsigned requester )
+{
+	SESSION *s;
+
+	pthread_mutex_lock( &session_lock );
+	if( !( s = session_find( id ) ) || ( s->state != SESSION_ST_ACTIVE ) ) {
+		pthread_mutex_unlock( &session_lock );
+		return( CC_INVALID_SESSION_ID );
+	}
+	if( id == requester ) {
+		s->closing = 1;
+	} else {
+		session_release( s );
+		session_stats.closed++;
+	}
+	pthread_mutex_unlock( &session_lock );
+	return( CC_NORMAL );
+}
+
+/*==============================================================
+ * session_tick()
+ * 	Runs every second. Drops sessions that have been idle for
+ * 	too long, the oldest are at the tail of each list.
+ *==============================================================*/
+void
+session_tick( unsigned char *arg )
+{
+	LIST_HDR *list[2] = { &session_setup_list, &session_active_list };
+	SESSION *s;
+	unsigned i;
+
+	pthread_mutex_lock( &session_lock );
+	for( i = 0; i < 2; i++ ) {
+		while( list[i]->prev != list[i] ) {
+			s = ( SESSION * )list[i]->prev;
+			if( ( long )( lbolt - s->deadline ) < 0 )
+				break;
+			session_release( s );
+			session_stats.expired++;
+		}
+	}
+	pthread_mutex_unlock( &session_lock );
+
+	timer_add_callout_queue( ( void * )&session_timer_handle, HZ, session_tick, 0 );
+}
@@ -0,0 +1,114 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/session.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* RMCP+ sessions, see session.c. Needs ipmi.h and crypto.h. */
+
+#ifndef SESSION_MAX
+#define SESSION_MAX		256	/* sessions open at the same time */
+#endif
+#define SESSION_HASH_SIZE	128	/* must be a power of 2 */
+
+/* Ticks without a valid packet before a session is dropped, sessions 
+ * that are still being set up get less */
+#ifndef SESSION_IDLE_TIMEOUT
+#define SESSION_IDLE_TIMEOUT	( 60 * HZ )
+#endif
+#ifndef SESSION_SETUP_TIMEOUT
+#define SESSION_SETUP_TIMEOUT	( 5 * HZ )
+#endif
+
+/* Inbound sequence numbers are accepted up to SESSION_SEQ_AHEAD past the
+ * highest one seen so far and, once each, up to SESSION_SEQ_WINDOW - 1 
+ * behind it */
+#define SESSION_SEQ_AHEAD	16
+#define SESSION_SEQ_WINDOW	32
+
+#define SESSION_USER_LEN	16
+#define SESSION_KEY_LEN		20	/* Kuid, SIK, K1, K2 */
+#define SESSION_RAND_LEN	16
+#define SESSION_RESP_MAX	60	/* longest Open Session or RAKP response */
+
+/* session states */
+#define SESSION_ST_FREE		0
+#define SESSION_ST_OPEN		1	/* Open Session done, waiting for RAKP 1 */
+#define SESSION_ST_RAKP		2	/* RAKP 2 sent, waiting for RAKP 3 */
+#define SESSION_ST_ACTIVE	3	/* RAKP 4 sent, IPMI messages accepted */
+
+typedef struct session {
+	LIST_HDR hdr;			/* idle list linkage, must be first */
+	struct session *hash_next;	/* hash chain or free list */
+	unsigned long deadline;		/* tick the session is dropped at */
+	unsigned id;			/* managed system session ID, ours */
+	unsigned console_id;		/* remote console session ID */
+	unsigned seq_in;		/* highest inbound sequence number */
+	unsigned seq_window;		/* bit n: seq_in - n has been seen */
+	unsigned seq_out;
+	unsigned char state;		/* SESSION_ST_xx */
+	unsigned char auth_alg;
+	unsigned char integ_alg;
+	unsigned char conf_alg;
+	unsigned char max_priv;		/* asked for in Open Session */
+	unsigned char role;		/* RAKP 1 role byte */
+	unsigned char priv;		/* current privilege level */
+	unsigned char closing;		/* release once the response is out */
+	unsigned char user_len;
+	unsigned char user[SESSION_USER_LEN];
+	unsigned char rand_console[SESSION_RAND_LEN];
+	unsigned char rand_bmc[SESSION_RAND_LEN];
+	unsigned char sik[SESSION_KEY_LEN];
+	HMAC_SHA1_CTX integ;		/* HMAC-SHA1-96 keyed with K1 */
+	AES_KEY aes;			/* AES-CBC-128 keyed with K2 */
+} SESSION;
+
+typedef struct session_stats {
+	unsigned active;		/* sessions in the table */
+	unsigned long opened;		/* Open Session requests granted */
+	unsigned long established;	/* RAKP 4 sent */
+	unsigned long closed;		/* Close Session */
+	unsigned long expired;		/* dropped for being idle or to make room */
+	unsigned long no_slot;		/* Open Session with the table full */
+	unsigned long auth_fail;	/* RAKP 3 or AuthCode mismatch */
+	unsigned long seq_reject;	/* outside the window or seen before */
+	unsigned long bad_pkt;		/* malformed or for no session */
+} SESSION_STATS;
+
+/* updated with session_lock held */
+extern SESSION_STATS session_stats;
+extern unsigned char session_user_len;
+
+void session_init( void );
+int session_set_user( const char *name, const char *password );
+unsigned session_open( const unsigned char *req, unsigned len, unsigned char *resp );
+unsigned session_rakp1( const unsigned char *req, unsigned len, unsigned char *resp );
+unsigned session_rakp3( const unsigned char *req, unsigned len, unsigned char *resp );
+unsigned session_unwrap( unsigned char *pkt, unsigned len, 
+	unsigned char **msg, unsigned *msg_len );
+unsigned session_wrap( unsigned id, const unsigned char *msg, unsigned msg_len, 
+	unsigned char *out, unsigned size );
+unsigned char session_set_priv( unsigned id, unsigned char priv, unsigned char *cur );
+unsigned char session_get_priv( unsigned id );
+unsigned char session_close( unsigned id, unsigned requester );
+void session_random( unsigned char *buf, unsigned len );
@@ -0,0 +1,354 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/stats.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+Controller statistics
+
+Collects the counters kept by the subsystems, per command service times
+(dispatch.c), I2C transfer counts (i2c.c) and per target transfer times
+(i2ctime.c), the I2C interrupt profile of I2C_PROFILE builds (i2c.c), UART
+receive counts (serial.c), the work set pool and transmit wait per priority
+class (ws.c), request tracking (seq.c) and the callout queue (timer.c), and
+hands them out through the NETFN_OEM_REQ statistics commands and the
+[SYS STATS] terminal mode verb. Nothing here is on the request path, the
+counters are updated where the work is done.
+
+	[SYS STATS]		print all counters
+	[SYS STATS CLEAR]	reset them
+
+With ipmitool, Get Statistics for command 0 and Clear Statistics:
+
+	ipmitool raw 0x2e 0x01 0xbe 0x12 0x00 0x01 0x00
+	ipmitool raw 0x2e 0x02 0xbe 0x12 0x00
+*/
+
+#include <stdio.h>
+#include "arch.h"
+#include "ipmi.h"
+#include "ws.h"
+#include "i2c.h"
+#include "serial.h"
+#include "timer.h"
+#include "debug.h"
+#include "dispatch.h"
+#include "stats.h"
+#include "seq.h"
+#include "i2ctime.h"
+
+/* I2C_CH_STATE_xx as printed by [SYS STATS] */
+char *stats_ch_state[] = { "isolated", "up", "degraded", "dead" };
+
+/* WS_PRIO_xx as printed by [SYS STATS] */
+char *stats_prio_name[] = { "response", "event", "control", "background" };
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+int stats_check_iana( IPMI_PKT *pkt, uchar *iana );
+uchar *stats_put( uchar *ptr, unsigned long val, unsigned len );
+
+/*==============================================================*/
+/* Functions							*/
+/*==============================================================*/
+
+/* verify the IANA number of the request and put it in the response */
+int
+stats_check_iana( IPMI_PKT *pkt, uchar *iana )
+{
+	uchar *req_iana = ( ( GET_STATS_CMD_REQ * )pkt->req )->iana;
+
+	if( ( req_iana[0] != ( COREIPM_IANA & 0xff ) ) 
+	    || ( req_iana[1] != ( ( COREIPM_IANA >> 8 ) & 0xff ) ) 
+	    || ( req_iana[2] != ( ( COREIPM_IANA >> 16 ) & 0xff ) ) ) {
+		pkt->resp->completion_code = CC_INVALID_DATA_IN_REQ;
+		pkt->hdr.resp_data_len = 0;
+		return( 0 );
+	}
+	iana[0] = req_iana[0];
+	iana[1] = req_iana[1];
+	iana[2] = req_iana[2];
+	return( 1 );
+}
+
+/* store val in len bytes LS byte first, saturating */
+uchar *
+stats_put( uchar *ptr, unsigned long val, unsigned len )
+{
+	unsigned i;
+
+	if( ( len < sizeof( unsigned long ) ) && ( val >> ( len * 8 ) ) )
+		val = ( 1UL << ( len * 8 ) ) - 1;
+
+	for( i = 0; i < len; i++ ) {
+		*ptr++ = val & 0xff;
+		val >>= 8;
+	}
+	return( ptr );
+}
+
+/*==============================================================
+ * stats_get()
+ * 	OEM_CMD_GET_STATS handler, see stats.h for the layout.
+ *==============================================================*/
+void
+stats_get( IPMI_PKT *pkt )
+{
+	GET_STATS_CMD_REQ *req = ( GET_STATS_CMD_REQ * )pkt->req;
+	GET_STATS_CMD_RESP *resp = ( GET_STATS_CMD_RESP * )pkt->resp;
+	IPMI_CMD_STATS *stats;
+	uchar *ptr = resp->data;
+	uchar netfn, command;
+	I2CTIME_TARGET *target;
+	unsigned n;
+
+	dputstr( DBG_IPMI | DBG_INOUT, "stats_get: ingress\n" );
+
+	if( !stats_check_iana( pkt, resp->iana ) )
+		return;
+
+	switch( req->selector ) {
+		case STATS_SEL_CONTROLLER:
+			for( n = 0; dispatch_get_stats( n, &netfn, &command ); n++ )
+				;
+			ptr = stats_put( ptr, ws_stats.in_use, 1 );
+			ptr = stats_put( ptr, ws_stats.high_water, 1 );
+			ptr = stats_put( ptr, WS_ARRAY_SIZE, 1 );
+			ptr = stats_put( ptr, ws_stats.alloc_fail, 2 );
+			ptr = stats_put( ptr, timer_stats.passes, 4 );
+			ptr = stats_put( ptr, timer_stats.callouts, 4 );
+			ptr = stats_put( ptr, timer_stats.max_time, 2 );
+			ptr = stats_put( ptr, dispatch_invalid_count, 2 );
+			ptr = stats_put( ptr, n, 1 );
+			break;
+
+		case STATS_SEL_COMMAND:
+			if( ( pkt->hdr.req_data_len < 5 ) 
+			    || !( stats = dispatch_get_stats( req->index, &netfn, &command ) ) ) {
+				resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+				pkt->hdr.resp_data_len = 0;
+				return;
+			}
+			*ptr++ = netfn;
+			*ptr++ = command;
+			ptr = stats_put( ptr, stats->count, 4 );
+			ptr = stats_put( ptr, stats->min_time, 4 );
+			ptr = stats_put( ptr, stats->count ? stats->total_time / stats->count : 0, 4 );
+			ptr = stats_put( ptr, stats->max_time, 4 );
+			break;
+
+		case STATS_SEL_I2C:
+			if( ( pkt->hdr.req_data_len < 5 ) || ( req->index >= I2C_NUM_CHANNELS ) ) {
+				resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+				pkt->hdr.resp_data_len = 0;
+				return;
+			}
+			ptr = stats_put( ptr, i2c_stats[req->index].master_count, 4 );
+			ptr = stats_put( ptr, i2c_stats[req->index].retry_count, 4 );
+			ptr = stats_put( ptr, i2c_stats[req->index].nak_count, 4 );
+			ptr = stats_put( ptr, i2c_stats[req->index].error_count, 4 );
+			*ptr = i2c_channel_state( req->index, ptr + 1 );
+			ptr += 2;
+			break;
+
+		case STATS_SEL_I2C_TARGET:
+		case STATS_SEL_I2C_HIST:
+			if( ( pkt->hdr.req_data_len < 5 ) || ( req->index >= I2CTIME_NUM_TARGETS )
+			    || !i2ctime_target[req->index].used ) {
+				resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+				pkt->hdr.resp_data_len = 0;
+				return;
+			}
+			target = &i2ctime_target[req->index];
+			*ptr++ = target->addr;
+			if( req->selector == STATS_SEL_I2C_HIST ) {
+				for( n = 0; n < I2CTIME_HIST_BUCKETS; n++ )
+					ptr = stats_put( ptr, target->hist[n], 2 );
+				break;
+			}
+			ptr = stats_put( ptr, target->count, 4 );
+			ptr = stats_put( ptr, target->srtt >> 3, 2 );
+			ptr = stats_put( ptr, target->max, 2 );
+			ptr = stats_put( ptr, target->timeout, 2 );
+			ptr = stats_put( ptr, target->expired, 2 );
+			break;
+
+		case STATS_SEL_WS_PRIO:
+			if( ( pkt->hdr.req_data_len < 5 ) || ( req->index >= WS_PRIO_CLASSES ) ) {
+				resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+				pkt->hdr.resp_data_len = 0;
+				return;
+			}
+			ptr = stats_put( ptr, ws_stats.prio_sent[req->index], 4 );
+			ptr = stats_put( ptr, ws_stats.prio_max_wait[req->index], 4 );
+			ptr = stats_put( ptr, ws_stats.prio_aged, 4 );
+			break;
+
+		case STATS_SEL_SERIAL:
+			if( ( pkt->hdr.req_data_len < 5 ) || ( req->index >= UART_PORT_COUNT ) ) {
+				resp->completion_code = CC_PARAM_OUT_OF_RANGE;
+				pkt->hdr.resp_data_len = 0;
+				return;
+			}
+			ptr = stats_put( ptr, serial_stats[req->index].frame_count, 4 );
+			ptr = stats_put( ptr, serial_stats[req->index].overrun_count, 2 );
+			ptr = stats_put( ptr, serial_stats[req->index].queue_full_count, 2 );
+			ptr = stats_put( ptr, serial_stats[req->index].hw_overrun_count, 2 );
+			ptr = stats_put( ptr, serial_stats[req->index].error_count, 2 );
+			break;
+
+		default:
+			resp->completion_code = CC_INVALID_DATA_IN_REQ;
+			pkt->hdr.resp_data_len = 0;
+			return;
+	}
+
+	resp->completion_code = CC_NORMAL;
+	pkt->hdr.resp_data_len = ptr - resp->iana;
+}
+
+/*==============================================================
+ * stats_clear()
+ * 	OEM_CMD_CLEAR_STATS handler.
+ *==============================================================*/
+void
+stats_clear( IPMI_PKT *pkt )
+{
+	CLEAR_STATS_CMD_RESP *resp = ( CLEAR_STATS_CMD_RESP * )pkt->resp;
+
+	dputstr( DBG_IPMI | DBG_INOUT, "stats_clear: ingress\n" );
+
+	if( !stats_check_iana( pkt, resp->iana ) )
+		return;
+
+	stats_reset();
+	resp->completion_code = CC_NORMAL;
+	pkt->hdr.resp_data_len = 3;
+}
+
+/* zero every counter, the ws high water mark restarts from the 
+ * current use */
+void
+stats_reset( void )
+{
+	unsigned i;
+
+	dispatch_clear_stats();
+
+	ws_stats.high_water = ws_stats.in_use;
+	ws_stats.alloc_fail = 0;
+	ws_stats.buf_fail = 0;
+	ws_stats.prio_aged = 0;
+	for( i = 0; i < WS_PRIO_CLASSES; i++ ) {
+		ws_stats.prio_sent[i] = 0;
+		ws_stats.prio_max_wait[i] = 0;
+	}
+	seq_stats.alloc_fail = 0;
+	seq_stats.retries = 0;
+	seq_stats.timeouts = 0;
+	seq_stats.unmatched = 0;
+
+	timer_stats.passes = 0;
+	timer_stats.callouts = 0;
+	timer_stats.max_time = 0;
+
+	for( i = 0; i < I2C_NUM_CHANNELS; i++ ) {
+		i2c_stats[i].master_count = 0;
+		i2c_stats[i].retry_count = 0;
+		i2c_stats[i].nak_count = 0;
+		i2c_stats[i].error_count = 0;
+	}
+	for( i = 0; i < UART_PORT_COUNT; i++ ) {
+		serial_stats[i].rx_count = 0;
+		serial_stats[i].frame_count = 0;
+		serial_stats[i].overrun_count = 0;
+		serial_stats[i].queue_full_count = 0;
+		serial_stats[i].hw_overrun_count = 0;
+		serial_stats[i].error_count = 0;
+	}
+	i2ctime_reset();
+#if defined (I2C_PROFILE) && !defined (POSIX)
+	i2c_profile_reset();
+#endif
+#if defined (POSIX)
+	posix_uart_stats_reset();
+#endif
+}
+
+/*==============================================================
+ * stats_term_print()
+ * 	[SYS STATS] output, one line per subsystem and one per 
+ * 	command that has been used.
+ *==============================================================*/
+void
+stats_term_print( void )
+{
+	IPMI_CMD_STATS *stats;
+	uchar netfn, command, state, score;
+	unsigned n;
+
+	printf( "[OK STATS\n" );
+	printf( "WS use %u max %u of %u fail %lu buf fail %lu\n", 
+		ws_stats.in_use, ws_stats.high_water, WS_ARRAY_SIZE, 
+		ws_stats.alloc_fail, ws_stats.buf_fail );
+	for( n = 0; n < WS_PRIO_CLASSES; n++ ) {
+		printf( "PRIO %s sent %lu max wait %luus\n", stats_prio_name[n],
+			ws_stats.prio_sent[n], ws_stats.prio_max_wait[n] );
+	}
+	printf( "PRIO aged %lu\n", ws_stats.prio_aged );
+	printf( "SEQ out %u fail %lu retry %lu timeout %lu unmatched %lu\n",
+		seq_stats.in_use, seq_stats.alloc_fail, seq_stats.retries,
+		seq_stats.timeouts, seq_stats.unmatched );
+	printf( "TIMER passes %lu callouts %lu max %luus\n",
+		timer_stats.passes, timer_stats.callouts, timer_stats.max_time );
+	for( n = 0; n < I2C_NUM_CHANNELS; n++ ) {
+		state = i2c_channel_state( n, &score );
+		printf( "I2C%u xfer %lu retry %lu nak %lu err %lu %s score %u\n", n,
+			i2c_stats[n].master_count, i2c_stats[n].retry_count,
+			i2c_stats[n].nak_count, i2c_stats[n].error_count,
+			stats_ch_state[state], score );
+	}
+	i2ctime_print();
+#if defined (I2C_PROFILE) && !defined (POSIX)
+	i2c_profile_print();
+#endif
+	for( n = 0; n < UART_PORT_COUNT; n++ ) {
+		printf( "UART%u rx %lu frames %lu overrun %lu queue full %lu hw overrun %lu err %lu\n", n,
+			serial_stats[n].rx_count, serial_stats[n].frame_count, 
+			serial_stats[n].overrun_count, serial_stats[n].queue_full_count,
+			serial_stats[n].hw_overrun_count, serial_stats[n].error_count );
+	}
+#if defined (POSIX)
+	posix_uart_stats_print();
+#endif
+	for( n = 0; ( stats = dispatch_get_stats( n, &netfn, &command ) ); n++ ) {
+		if( !stats->count )
+			continue;
+		printf( "CMD %02X %02X count %lu min %lu avg %lu max %luus\n", 
+			netfn, command, stats->count, stats->min_time, 
+			stats->total_time / stats->count, stats->max_time );
+	}
+	printf( "INVALID %lu]\n", dispatch_invalid_count );
+}
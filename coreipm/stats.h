@@ -0,0 +1,123 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/stats.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Controller statistics, NETFN_OEM_REQ commands. The request data and
+ * the response data after the completion code start with COREIPM_IANA,
+ * LS byte first. Multi byte counters are LS byte first as well and stick
+ * at their largest value rather than wrap. Times are in us. */
+#define OEM_CMD_GET_STATS	0x01
+#define OEM_CMD_CLEAR_STATS	0x02
+
+/* Get Statistics selectors */
+#define STATS_SEL_CONTROLLER	0x00	/* work sets, callout queue */
+#define STATS_SEL_COMMAND	0x01	/* counters of command number <index> */
+#define STATS_SEL_I2C		0x02	/* counters of I2C channel <index> */
+#define STATS_SEL_SERIAL	0x03	/* receive counters of UART <index> */
+#define STATS_SEL_I2C_TARGET	0x04	/* transfer times of I2C target <index> */
+#define STATS_SEL_I2C_HIST	0x05	/* histogram of I2C target <index> */
+#define STATS_SEL_WS_PRIO	0x06	/* transmit priority class <index> */
+
+#define STATS_MAX_DATA_LEN	18
+
+typedef struct get_stats_cmd_req {
+	uchar	command;
+	uchar	iana[3];
+	uchar	selector;
+	uchar	index;		/* not for STATS_SEL_CONTROLLER */
+} GET_STATS_CMD_REQ;
+
+/* STATS_SEL_CONTROLLER data
+ *	0	ws in use
+ *	1	ws high water mark
+ *	2	WS_ARRAY_SIZE
+ *	3:4	ws_alloc() failures
+ *	5:8	callout queue passes
+ *	9:12	callouts run
+ *	13:14	longest callout queue pass
+ *	15:16	requests for unknown commands
+ *	17	number of commands with counters
+ *
+ * STATS_SEL_COMMAND data, CC_PARAM_OUT_OF_RANGE past the last command
+ *	0	netfn
+ *	1	command
+ *	2:5	requests
+ *	6:9	min service time
+ *	10:13	avg service time
+ *	14:17	max service time
+ *
+ * STATS_SEL_I2C data
+ *	0:3	master transfers
+ *	4:7	retries
+ *	8:11	NAKs
+ *	12:15	other errors
+ *	16	channel health, I2C_CH_STATE_xx
+ *	17	channel error score
+ *
+ * STATS_SEL_SERIAL data
+ *	0:3	frames received
+ *	4:5	frames lost, receive ring full or frame too long
+ *	6:7	frames lost, frame queue full
+ *	8:9	characters lost in the UART
+ *	10:11	parity, framing, break and Basic mode escape errors
+ *
+ * STATS_SEL_I2C_TARGET data, CC_PARAM_OUT_OF_RANGE past the last target
+ *	0	slave address
+ *	1:4	master transfers timed
+ *	5:6	smoothed transfer time
+ *	7:8	longest transfer time
+ *	9:10	current timeout
+ *	11:12	transfers that timed out
+ *
+ * STATS_SEL_I2C_HIST data, CC_PARAM_OUT_OF_RANGE past the last target
+ *	0	slave address
+ *	1:16	transfers under 256 us, 512 us ... 16 ms and the rest,
+ *		2 bytes each
+ *
+ * STATS_SEL_WS_PRIO data, index is WS_PRIO_xx
+ *	0:3	writes taken off the work list
+ *	4:7	longest wait on the work list
+ *	8:11	writes of any class that went ahead of a more urgent one
+ */
+typedef struct get_stats_cmd_resp {
+	uchar	completion_code;
+	uchar	iana[3];
+	uchar	data[STATS_MAX_DATA_LEN];
+} GET_STATS_CMD_RESP;
+
+typedef struct clear_stats_cmd_req {
+	uchar	command;
+	uchar	iana[3];
+} CLEAR_STATS_CMD_REQ;
+
+typedef struct clear_stats_cmd_resp {
+	uchar	completion_code;
+	uchar	iana[3];
+} CLEAR_STATS_CMD_RESP;
+
+void stats_get( IPMI_PKT *pkt );
+void stats_clear( IPMI_PKT *pkt );
+void stats_reset( void );
+void stats_term_print( void );
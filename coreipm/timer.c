@@ -27,12 +27,45 @@ support and contact details.
 #include "arch.h"
 #include "timer.h"
 #include "error.h"
+#include "sched.h"
+
+/* Callout queue
+ *
+ * Active entries are kept in a hashed timing wheel of CQ_WHEEL_SIZE slots, 
+ * an entry expiring at tick t lives in slot t % CQ_WHEEL_SIZE. Entries
+ * more than one revolution out simply stay in their slot until the wheel
+ * comes around to their tick. A second table hashed on the handle makes
+ * remove/reset/get_expiration independent of the number of entries.
+ *
+ * timer_process_callout_queue() advances the wheel one slot per elapsed 
+ * tick, moving every due entry to the due list, and then runs all of
+ * them. Interrupts are only disabled while a single entry is linked or 
+ * unlinked, or while one slot is swept, never across a callback. */
+#ifndef CQ_ARRAY_SIZE
+#define CQ_ARRAY_SIZE	32
+#endif
+#ifndef CQ_WHEEL_SIZE
+#define CQ_WHEEL_SIZE	64	/* must be a power of 2 */
+#endif
+#ifndef CQ_HASH_SIZE
+#define CQ_HASH_SIZE	32	/* must be a power of 2 */
+#endif
 
-#define CQ_ARRAY_SIZE 32
+#define CQ_HASH( handle )	\
+	( ( ( unsigned long )( handle ) ^ ( ( unsigned long )( handle ) >> 5 ) ) & ( CQ_HASH_SIZE - 1 ) )
 
 unsigned long lbolt;
 
+typedef struct cq_list {
+	struct cqe_struct *head;
+	struct cqe_struct *tail;
+} CQ_LIST;
+
 typedef struct cqe_struct {
+	struct cqe_struct *next;	/* wheel slot/due/free list linkage */
+	struct cqe_struct *prev;
+	struct cqe_struct *hnext;	/* handle hash chain */
+	CQ_LIST *list;			/* list this entry is on */
 	unsigned state;
 	unsigned long tick;
 	void *handle;
@@ -41,6 +74,21 @@ typedef struct cqe_struct {
 } CQE;
 
 CQE	cq_array[CQ_ARRAY_SIZE];
+CQ_LIST	cq_wheel[CQ_WHEEL_SIZE];
+CQ_LIST	cq_due;			/* expired entries waiting for their callback */
+CQ_LIST	cq_run;			/* the ones this pass runs */
+CQ_LIST	cq_free_list;
+CQE	*cq_hash[CQ_HASH_SIZE];
+unsigned long cq_last_tick;	/* last tick the wheel was advanced to */
+TIMER_STATS timer_stats;
+
+#if !defined (POSIX)
+/* microsecond timer callbacks, one per Timer1 match register */
+struct {
+	void ( *func )( unsigned char * );
+	unsigned char *arg;
+} timer_us_slot[TIMER_US_SLOTS];
+#endif
 
 /*==============================================================*/
 /* Function Prototypes						*/
@@ -50,14 +98,25 @@ void timer_process_callout_queue( void );
 void cq_init( void );
 CQE *cq_alloc( void );
 void cq_free( CQE *cqe );
-CQE *cq_get_expired_elem( unsigned long current_tick );
+void cq_list_append( CQ_LIST *list, CQE *cqe );
+void cq_list_remove( CQE *cqe );
+void cq_schedule( CQE *cqe );
+void cq_hash_insert( CQE *cqe );
+void cq_hash_remove( CQE *cqe );
+CQE *cq_hash_lookup( void *handle );
+void cq_expire_slot( unsigned long tick );
 void cq_set_cqe_state( CQE *cqe, unsigned state );
+#if !defined (POSIX)
 #if defined (__CA__) || defined (__CC_ARM)
 void hardclock( void ) __irq;
+void timer_us_isr( void ) __irq;
 #elif defined (__GNUC__)
 void hardclock( void ) __attribute__ ((interrupt));
+void timer_us_isr( void ) __attribute__ ((interrupt));
+#endif
 #endif
 
+#if !defined (POSIX)
 /*==============================================================
  * hardclock()
  *==============================================================*/
@@ -69,9 +128,11 @@ void hardclock( void )
 #endif
 {
 	lbolt++;
+	sched_post( SCHED_TIMER );
 	T0IR = 1;		/* Clear interrupt flag */
 	VICVectAddr = 0;	/* Acknowledge Interrupt */
 }
+#endif
 
 /*==============================================================
  * timer_initialize()
@@ -80,6 +141,7 @@ void hardclock( void )
 void
 timer_initialize( void ) 
 {
+#if !defined (POSIX)
 //	T0MR0 = 5999999;				/* 60MHz clk - 100mSec = 6,000,000-1 counts */
 //	T0MR0 = 1199999;				/* 12MHz clk - 100mSec = 1,200,000-1 counts */
 	T0MR0 = PCLK/10 - 1;
@@ -89,6 +151,16 @@ timer_initialize( void )
 	VICVectCntl3 = 0x20 | 4;			/* use it for Timer 0 Interrupt */
 	VICIntEnable = IER_TIMER0;			/* enable Timer0 interrupt */
 
+	/* Timer1 free runs at 1 MHz for the microsecond timers */
+	T1TCR = 2;					/* Timer1 reset */
+	T1PR = PCLK/1000000 - 1;
+	T1MCR = 0;					/* match interrupts as armed */
+	T1IR = 0xF;
+	T1TCR = 1;					/* Timer1 Enable */
+	VICVectAddr2 = (unsigned long)timer_us_isr;	/* set interrupt vector in 2 */
+	VICVectCntl2 = 0x20 | IS_TIMER1;		/* use it for Timer 1 Interrupt */
+	VICIntEnable = IER_TIMER1;			/* enable Timer1 interrupt */
+#endif
 	cq_init();
 }
 
@@ -103,6 +175,7 @@ timer_add_callout_queue(
 	unsigned char *arg )
 {
 	CQE *cqe;
+	unsigned int interrupt_mask;	
 
 	cqe = cq_alloc();
 	if( cqe ) {
@@ -110,6 +183,12 @@ timer_add_callout_queue(
 		cqe->arg = arg;
 		cqe->tick = ticks + lbolt;
 		cqe->handle = handle;
+		
+		interrupt_mask = CURRENT_INTERRUPT_MASK;
+		DISABLE_INTERRUPTS;
+		cq_hash_insert( cqe );
+		cq_schedule( cqe );
+		ENABLE_INTERRUPTS( interrupt_mask );
 		return( ESUCCESS );
 	} else
 		return( ENOMEM );
@@ -117,32 +196,27 @@ timer_add_callout_queue(
 
 /*==============================================================
  * timer_remove_callout_queue()
- * 	Search the callout queue using the handle and remove the 
- * 	entry if found.
+ * 	Look up the entry using the handle and remove it if found.
  *==============================================================*/
 void
 timer_remove_callout_queue(
 	void *handle )
 {
-	CQE *ptr;
-	unsigned i;
+	CQE *cqe;
 	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
 	DISABLE_INTERRUPTS;
-	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
-	{
-		ptr = &cq_array[i];
-		if( ( ptr->state == CQE_ACTIVE ) && ( ptr->handle == handle ) ) {
-			cq_free( ptr );
-			break;
-		}
+	if( ( cqe = cq_hash_lookup( handle ) ) ) {
+		cq_hash_remove( cqe );
+		cq_list_remove( cqe );
+		cq_free( cqe );
 	}
 	ENABLE_INTERRUPTS( interrupt_mask );
 }
 
 /*==============================================================
  * timer_reset_callout_queue() 
- * 	Search the callout queue using the handle and reset the
+ * 	Look up the entry using the handle and reset the
  * 	timeout value with the new value passed in ticks.
  *==============================================================*/
 void
@@ -151,17 +225,13 @@ timer_reset_callout_queue(
 	unsigned long ticks )
 {
 	CQE *cqe;
-	unsigned i;
 	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
 	DISABLE_INTERRUPTS;	
-	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
-	{
-		cqe = &cq_array[i];
-		if( ( cqe->state == CQE_ACTIVE ) && ( cqe->handle == handle ) ) {
-			cqe->tick = ticks + lbolt;
-			break;
-		}
+	if( ( cqe = cq_hash_lookup( handle ) ) ) {
+		cq_list_remove( cqe );
+		cqe->tick = ticks + lbolt;
+		cq_schedule( cqe );
 	}
 	ENABLE_INTERRUPTS( interrupt_mask );
 }
@@ -177,17 +247,10 @@ timer_get_expiration_time(
 	void *handle ) 
 {
 	CQE *cqe;
-	unsigned i;
-	unsigned long ticks = 0;
 	
-	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
-	{
-		cqe = &cq_array[i];
-		if( ( cqe->state == CQE_ACTIVE ) && ( cqe->handle == handle ) ) {
-			if( cqe->tick > lbolt )
-				return( cqe->tick - lbolt );
-			break;
-		}
+	if( ( cqe = cq_hash_lookup( handle ) ) ) {
+		if( cqe->tick > lbolt )
+			return( cqe->tick - lbolt );
 	}
 	return( 0 );
 }
@@ -195,19 +258,58 @@ timer_get_expiration_time(
 
 /*==============================================================
  * timer_process_callout_queue()
- * 	Get first expired entry, invoke it's callback and remove
- * 	from queue.
+ * 	Advance the wheel to the current tick and invoke the 
+ * 	callback of every expired entry.
  *==============================================================*/
 void
 timer_process_callout_queue( void )
 {
 	CQE *cqe;
+	unsigned long current_tick = lbolt;
+	unsigned long start = sched_clock();
+	unsigned long elapsed;
+	unsigned int interrupt_mask;	
 	
-	if( ( cqe = cq_get_expired_elem( lbolt ) ) ) {
-		cq_set_cqe_state( cqe, CQE_PENDING );
+	while( cq_last_tick != current_tick ) {
+		cq_last_tick++;
+		cq_expire_slot( cq_last_tick );
+	}
+
+	/* Run what is due now. A callback that re-arms with 0 ticks goes
+	 * back on the due list and runs on the next pass, after the rest
+	 * of the main loop has had its turn. */
+	interrupt_mask = CURRENT_INTERRUPT_MASK;
+	DISABLE_INTERRUPTS;
+	cq_run = cq_due;
+	cq_due.head = cq_due.tail = 0;
+	for( cqe = cq_run.head; cqe; cqe = cqe->next )
+		cqe->list = &cq_run;
+	ENABLE_INTERRUPTS( interrupt_mask );
+
+	while( 1 ) {
+		interrupt_mask = CURRENT_INTERRUPT_MASK;
+		DISABLE_INTERRUPTS;
+		if( ( cqe = cq_run.head ) ) {
+			cq_hash_remove( cqe );
+			cq_list_remove( cqe );
+			cq_set_cqe_state( cqe, CQE_PENDING );
+		}
+		ENABLE_INTERRUPTS( interrupt_mask );
+		
+		if( !cqe )
+			break;
+		
 		(*cqe->func)( cqe->arg );
 		cq_free( cqe );
+		timer_stats.callouts++;
 	}
+	if( cq_due.head )
+		sched_post( SCHED_TIMER );
+
+	timer_stats.passes++;
+	elapsed = ( sched_clock() - start ) / SCHED_COUNTS_PER_USEC;
+	if( elapsed > timer_stats.max_time )
+		timer_stats.max_time = elapsed;
 }
 
 /*======================================================================*
@@ -223,9 +325,26 @@ cq_init( void )
 {
 	unsigned i;
 	
+	for ( i = 0; i < CQ_WHEEL_SIZE; i++ )
+	{
+		cq_wheel[i].head = 0;
+		cq_wheel[i].tail = 0;
+	}
+	
+	for ( i = 0; i < CQ_HASH_SIZE; i++ )
+	{
+		cq_hash[i] = 0;
+	}
+
+	cq_due.head = cq_due.tail = 0;
+	cq_run.head = cq_run.tail = 0;
+	cq_free_list.head = cq_free_list.tail = 0;
+	cq_last_tick = lbolt;
+
 	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
 	{
 		cq_array[i].state = CQE_FREE;
+		cq_list_append( &cq_free_list, &cq_array[i] );
 	}
 
 }
@@ -237,21 +356,14 @@ cq_init( void )
 CQE *
 cq_alloc( void )
 {
-	CQE *cqe = 0;
-	CQE *ptr = cq_array;
-	unsigned i;
+	CQE *cqe;
 	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
 	DISABLE_INTERRUPTS;
-	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
-	{
-		ptr = &cq_array[i];
-		if( ptr->state == CQE_FREE ) {
-			ptr->tick = 0;
-			ptr->state = CQE_ACTIVE;
-			cqe = ptr;
-			break;
-		}
+	if( ( cqe = cq_free_list.head ) ) {
+		cq_list_remove( cqe );
+		cqe->tick = 0;
+		cqe->state = CQE_ACTIVE;
 	}
 	ENABLE_INTERRUPTS( interrupt_mask );
 	return cqe;
@@ -260,35 +372,135 @@ cq_alloc( void )
 /*==============================================================
  * cq_free()
  *==============================================================*/
-/* set cqe state to free */
+/* set cqe state to free and put it back on the free list */
 void 
 cq_free( CQE *cqe )
 {
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	DISABLE_INTERRUPTS;
 	cqe->state = CQE_FREE;
+	cq_list_append( &cq_free_list, cqe );
+	ENABLE_INTERRUPTS( interrupt_mask );
 }
 
 /*==============================================================
- * cq_get_expired_elem()
+ * cq_list_append()
  *==============================================================*/
-CQE *
-cq_get_expired_elem( unsigned long current_tick )
+void
+cq_list_append( CQ_LIST *list, CQE *cqe )
 {
-	CQE *cqe = 0;
-	CQE *ptr = cq_array;
-	unsigned i;
+	cqe->next = 0;
+	cqe->prev = list->tail;
+	if( list->tail )
+		list->tail->next = cqe;
+	else
+		list->head = cqe;
+	list->tail = cqe;
+	cqe->list = list;
+}
+
+/*==============================================================
+ * cq_list_remove()
+ *==============================================================*/
+void
+cq_list_remove( CQE *cqe )
+{
+	CQ_LIST *list = cqe->list;
+
+	if( !list )
+		return;
+	if( cqe->prev )
+		cqe->prev->next = cqe->next;
+	else
+		list->head = cqe->next;
+	if( cqe->next )
+		cqe->next->prev = cqe->prev;
+	else
+		list->tail = cqe->prev;
+	cqe->next = cqe->prev = 0;
+	cqe->list = 0;
+}
+
+/*==============================================================
+ * cq_schedule()
+ * 	Put an active entry on the wheel slot for its tick, or 
+ * 	straight on the due list if that tick has already been 
+ * 	swept. A zero tick is never scheduled to run.
+ *==============================================================*/
+void
+cq_schedule( CQE *cqe )
+{
+	if( cqe->tick && ( cqe->tick <= cq_last_tick ) )
+		cq_list_append( &cq_due, cqe );
+	else
+		cq_list_append( &cq_wheel[cqe->tick & ( CQ_WHEEL_SIZE - 1 )], cqe );
+}
+
+/*==============================================================
+ * cq_expire_slot()
+ * 	Move the entries in the slot for tick that are due to the 
+ * 	due list.
+ *==============================================================*/
+void
+cq_expire_slot( unsigned long tick )
+{
+	CQE *cqe, *next;
 	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
 	DISABLE_INTERRUPTS;
-	for ( i = 0; i < CQ_ARRAY_SIZE; i++ )
-	{
-		ptr = &cq_array[i];
-		if( ( ptr->state == CQE_ACTIVE ) && ( ptr->tick )
-				&& ( current_tick >= ptr->tick ) ) {
-			cqe = ptr;
-			break;
+	for( cqe = cq_wheel[tick & ( CQ_WHEEL_SIZE - 1 )].head; cqe; cqe = next ) {
+		next = cqe->next;
+		if( cqe->tick && ( cqe->tick <= tick ) ) {
+			cq_list_remove( cqe );
+			cq_list_append( &cq_due, cqe );
 		}
 	}
 	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * cq_hash_insert()
+ *==============================================================*/
+void
+cq_hash_insert( CQE *cqe )
+{
+	CQE **pp = &cq_hash[CQ_HASH( cqe->handle )];
+
+	cqe->hnext = *pp;
+	*pp = cqe;
+}
+
+/*==============================================================
+ * cq_hash_remove()
+ *==============================================================*/
+void
+cq_hash_remove( CQE *cqe )
+{
+	CQE **pp = &cq_hash[CQ_HASH( cqe->handle )];
+
+	while( *pp ) {
+		if( *pp == cqe ) {
+			*pp = cqe->hnext;
+			break;
+		}
+		pp = &( *pp )->hnext;
+	}
+	cqe->hnext = 0;
+}
+
+/*==============================================================
+ * cq_hash_lookup()
+ *==============================================================*/
+CQE *
+cq_hash_lookup( void *handle )
+{
+	CQE *cqe;
+
+	for( cqe = cq_hash[CQ_HASH( handle )]; cqe; cqe = cqe->hnext ) {
+		if( ( cqe->state == CQE_ACTIVE ) && ( cqe->handle == handle ) )
+			break;
+	}
 	return cqe;
 }
 
@@ -301,3 +513,85 @@ cq_set_cqe_state( CQE *cqe, unsigned state )
 	cqe->state = state;
 }
 
+
+#if !defined (POSIX)
+/*======================================================================*
+ * MICROSECOND TIMERS
+ *
+ * Timer1 counts microseconds and is never reset, each slot has a match
+ * register that interrupts when the count reaches its deadline. The host 
+ * build has its own in posix.c.
+ */
+
+/*==============================================================
+ * timer_us()
+ * 	Free running microsecond count. Wraps around, only the
+ * 	difference of two readings is meaningful.
+ *==============================================================*/
+unsigned long
+timer_us( void )
+{
+	return( T1TC );
+}
+
+/*==============================================================
+ * timer_us_arm()
+ * 	Call func with arg from the Timer1 interrupt us microseconds
+ * 	from now. Replaces whatever the slot was armed with.
+ *==============================================================*/
+void
+timer_us_arm( 
+	unsigned slot, 
+	unsigned long us, 
+	void( *func )( unsigned char * ), 
+	unsigned char *arg )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	if( us < TIMER_US_MIN )
+		us = TIMER_US_MIN;
+
+	DISABLE_INTERRUPTS;
+	timer_us_slot[slot].func = func;
+	timer_us_slot[slot].arg = arg;
+	( &T1MR0 )[slot] = T1TC + us;
+	T1IR = 1 << slot;			/* drop a stale match */
+	T1MCR |= 1 << ( slot * 3 );		/* interrupt on match */
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * timer_us_cancel()
+ *==============================================================*/
+void
+timer_us_cancel( unsigned slot )
+{
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;
+
+	DISABLE_INTERRUPTS;
+	T1MCR &= ~( 1 << ( slot * 3 ) );
+	timer_us_slot[slot].func = 0;
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/* Timer1 match interrupt, each armed slot fires once */
+#if defined (__CA__) || defined (__CC_ARM)
+void timer_us_isr( void ) __irq
+#elif defined (__GNUC__)
+void timer_us_isr( void )
+#endif
+{
+	unsigned slot, ir = T1IR;
+	void ( *func )( unsigned char * );
+
+	T1IR = ir;		/* Clear interrupt flags */
+	for( slot = 0; slot < TIMER_US_SLOTS; slot++ ) {
+		if( !( ir & ( 1 << slot ) ) || !( func = timer_us_slot[slot].func ) )
+			continue;
+		T1MCR &= ~( 1 << ( slot * 3 ) );
+		timer_us_slot[slot].func = 0;
+		( *func )( timer_us_slot[slot].arg );
+	}
+	VICVectAddr = 0;	/* Acknowledge Interrupt */
+}
+#endif
@@ -29,6 +29,14 @@ support and contact details.
 #define CQE_ACTIVE	1
 #define CQE_PENDING	3
 
+typedef struct timer_stats {
+	unsigned long passes;		/* timer_process_callout_queue() runs */
+	unsigned long callouts;		/* callbacks invoked */
+	unsigned long max_time;		/* longest run, us */
+} TIMER_STATS;
+
+extern TIMER_STATS timer_stats;
+
 extern void timer_initialize(void);
 extern void timer_process_callout_queue( void );
 extern int timer_add_callout_queue( 
@@ -40,5 +48,16 @@ extern void timer_remove_callout_queue( void *handle );
 unsigned long timer_get_expiration_time( void *handle );
 void timer_reset_callout_queue( void *handle, unsigned long ticks );
 
+/* Microsecond timers, for deadlines finer than a tick. The callback runs
+ * in interrupt context. Slot TIMER_US_SLOT_I2C + n belongs to I2C
+ * channel n. */
+#define TIMER_US_SLOTS		4	/* Timer1 match registers */
+#define TIMER_US_SLOT_I2C	0
+#define TIMER_US_MIN		10	/* shortest delay, us */
+unsigned long timer_us( void );
+void timer_us_arm( unsigned slot, unsigned long us, 
+	void( *func )( unsigned char * ), unsigned char *arg );
+void timer_us_cancel( unsigned slot );
+
 
 
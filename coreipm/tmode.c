@@ -0,0 +1,255 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/tmode.c
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/*
+Terminal mode codec
+
+Shared by the console (serial.c) and the host tools (posix.c, tty.c). A
+terminal mode message is a line of hex pairs in brackets, spaces between
+the pairs are optional:
+
+	[18 01 00 01]
+
+Decoding and encoding go through lookup tables and the output is built in
+a buffer the caller then writes out in one go. [SYS ..] verbs are split
+into words in one pass and every word is looked up with a perfect hash of
+its length, first and last character, so the verb can be switched on 
+instead of being compared against each known verb in turn. Case does not
+matter.
+*/
+
+#include "error.h"
+#include "tmode.h"
+
+#define XX	TMODE_HEX_INVALID
+
+/* value of a hex digit, TMODE_HEX_INVALID for anything else */
+const unsigned char tmode_hex_val[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 00 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 10 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 20 */
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,	/* 30 */
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 40 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 50 */
+	XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 60 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 70 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 80 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* 90 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* A0 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* B0 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* C0 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* D0 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,	/* E0 */
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX	/* F0 */
+};
+
+#undef XX
+
+const char tmode_hex_chars[16] = { 
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+/* The words of the [SYS ..] verbs by TMODE_VERB_HASH(). When a word is
+ * added its slot must be a free one, otherwise the hash has to change. */
+#define TMODE_VERB_HASH( len, first, last )	\
+	( ( ( len ) + ( ( first ) & 0xDF ) + ( ( ( last ) & 0xDF ) << 2 ) ) & 0x1F )
+
+typedef struct tmode_word {
+	char *str;		/* upper case */
+	unsigned char len;
+	unsigned char tok;
+} TMODE_WORD;
+
+const TMODE_WORD tmode_words[32] = {
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ "SYS", 3, TMODE_TOK_SYS },		/* 2 */
+	{ 0, 0, 0 },
+	{ "STATS", 5, TMODE_TOK_STATS },		/* 4 */
+	{ "ECHO", 4, TMODE_TOK_ECHO },		/* 5 */
+	{ 0, 0, 0 },
+	{ "RESET", 5, TMODE_TOK_RESET },		/* 7 */
+	{ 0, 0, 0 },
+	{ "ON", 2, TMODE_TOK_ON },			/* 9 */
+	{ "OFF", 3, TMODE_TOK_OFF },		/* 10 */
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ "TMODE", 5, TMODE_TOK_TMODE },		/* 13 */
+	{ "HEALTH", 6, TMODE_TOK_HEALTH },		/* 14 */
+	{ 0, 0, 0 },
+	{ "CLEAR", 5, TMODE_TOK_CLEAR },		/* 16 */
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ "IDENTIFY", 8, TMODE_TOK_IDENTIFY },	/* 21 */
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ "QUERY", 5, TMODE_TOK_QUERY },		/* 26 */
+	{ 0, 0, 0 },
+	{ 0, 0, 0 },
+	{ "POWER", 5, TMODE_TOK_POWER },		/* 29 */
+	{ 0, 0, 0 },
+	{ 0, 0, 0 }
+};
+
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+unsigned char tmode_lookup( const unsigned char *word, unsigned len );
+
+/*==============================================================
+ * tmode_decode()
+ * 	Decode the hex pairs of a terminal mode message up to the
+ * 	closing ']'. buf points past the '['. The message goes in 
+ * 	out and its length in count. Returns EINVAL for characters
+ * 	that do not belong or a missing ']', ENOMEM if the message
+ * 	is longer than size.
+ *==============================================================*/
+int
+tmode_decode( 
+	const unsigned char *buf, 
+	unsigned len, 
+	unsigned char *out, 
+	unsigned size, 
+	unsigned *count )
+{
+	const unsigned char *end = buf + len;
+	unsigned char hi, lo;
+	unsigned n = 0;
+
+	while( buf < end ) {
+		hi = tmode_hex_val[*buf];
+		if( hi != TMODE_HEX_INVALID ) {
+			if( ( buf + 1 >= end ) 
+			    || ( ( lo = tmode_hex_val[buf[1]] ) == TMODE_HEX_INVALID ) )
+				return( EINVAL );
+			if( n >= size )
+				return( ENOMEM );
+			out[n++] = ( hi << 4 ) | lo;
+			buf += 2;
+		} else if( *buf == ' ' ) {
+			buf++;
+		} else if( *buf == ']' ) {
+			*count = n;
+			return( ESUCCESS );
+		} else {
+			return( EINVAL );
+		}
+	}
+	return( EINVAL );
+}
+
+/*==============================================================
+ * tmode_encode()
+ * 	Encode a len byte message as "[hh hh ..]" in out. Returns 
+ * 	the number of characters, TMODE_ENC_LEN( len ), or 0 if 
+ * 	that is more than size.
+ *==============================================================*/
+unsigned
+tmode_encode( 
+	const unsigned char *msg, 
+	unsigned len, 
+	unsigned char *out, 
+	unsigned size )
+{
+	unsigned char *ptr = out;
+	unsigned i;
+
+	if( TMODE_ENC_LEN( len ) > size )
+		return( 0 );
+
+	*ptr++ = '[';
+	for( i = 0; i < len; i++ ) {
+		*ptr++ = tmode_hex_chars[msg[i] >> 4];
+		*ptr++ = tmode_hex_chars[msg[i] & 0x0f];
+		*ptr++ = ' ';
+	}
+	if( len )
+		ptr--;		/* no space after the last pair */
+	*ptr++ = ']';
+	return( ptr - out );
+}
+
+/* TMODE_TOK_xx of a word */
+unsigned char
+tmode_lookup( const unsigned char *word, unsigned len )
+{
+	const TMODE_WORD *entry;
+	unsigned i;
+
+	entry = &tmode_words[TMODE_VERB_HASH( len, word[0], word[len - 1] )];
+	if( entry->len != len )
+		return( TMODE_TOK_UNKNOWN );
+	for( i = 0; i < len; i++ ) {
+		if( ( word[i] & 0xDF ) != entry->str[i] )
+			return( TMODE_TOK_UNKNOWN );
+	}
+	return( entry->tok );
+}
+
+/*==============================================================
+ * tmode_parse_verb()
+ * 	Split "[word word ..]" at the spaces and look up the first
+ * 	TMODE_MAX_WORDS words. Returns EINVAL if buf does not start
+ * 	with '[' or has no ']'.
+ *==============================================================*/
+int
+tmode_parse_verb( unsigned char *buf, unsigned len, TMODE_VERB *verb )
+{
+	unsigned char *end = buf + len;
+	unsigned char *start;
+	unsigned count = 0;
+	int ret = EINVAL;
+
+	if( !len || *buf++ != '[' ) {
+		verb->count = 0;
+		return( EINVAL );
+	}
+
+	while( buf < end ) {
+		if( *buf == ' ' ) {
+			buf++;
+			continue;
+		}
+		if( *buf == ']' ) {
+			ret = ESUCCESS;
+			break;
+		}
+
+		start = buf;
+		while( ( buf < end ) && ( *buf != ' ' ) && ( *buf != ']' ) )
+			buf++;
+		if( count < TMODE_MAX_WORDS ) {
+			verb->word[count] = start;
+			verb->tok[count] = tmode_lookup( start, buf - start );
+		}
+		count++;
+	}
+	verb->count = count;
+	return( ret );
+}
@@ -0,0 +1,65 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/tmode.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Terminal mode codec, see tmode.c */
+
+#define TMODE_HEX_INVALID	0xFF	/* tmode_hex_val[] of a non hex character */
+
+/* Characters tmode_encode() needs for a len byte message: "[", the hex 
+ * pairs separated by spaces and "]" */
+#define TMODE_ENC_LEN( len )	( ( len ) ? 3 * ( len ) + 1 : 2 )
+
+/* [SYS ..] words, TMODE_TOK_UNKNOWN for anything else */
+#define TMODE_TOK_UNKNOWN	0
+#define TMODE_TOK_SYS		1
+#define TMODE_TOK_POWER		2
+#define TMODE_TOK_ON		3
+#define TMODE_TOK_OFF		4
+#define TMODE_TOK_TMODE		5
+#define TMODE_TOK_RESET		6
+#define TMODE_TOK_IDENTIFY	7
+#define TMODE_TOK_STATS		8
+#define TMODE_TOK_CLEAR		9
+#define TMODE_TOK_HEALTH	10
+#define TMODE_TOK_QUERY		11
+#define TMODE_TOK_ECHO		12
+
+#define TMODE_MAX_WORDS		4	/* words of a verb that are looked at */
+
+typedef struct tmode_verb {
+	unsigned char count;			/* words in the message */
+	unsigned char tok[TMODE_MAX_WORDS];	/* TMODE_TOK_xx of the first ones */
+	unsigned char *word[TMODE_MAX_WORDS];	/* where they start */
+} TMODE_VERB;
+
+extern const unsigned char tmode_hex_val[256];
+extern const char tmode_hex_chars[16];
+
+int tmode_decode( const unsigned char *buf, unsigned len, unsigned char *out, 
+	unsigned size, unsigned *count );
+unsigned tmode_encode( const unsigned char *msg, unsigned len, unsigned char *out, 
+	unsigned size );
+int tmode_parse_verb( unsigned char *buf, unsigned len, TMODE_VERB *verb );
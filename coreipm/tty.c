@@ -24,95 +24,272 @@ support and contact details.
 -------------------------------------------------------------------------------
 */
 
+/*
+Host side terminal mode transport
+
+ipmi_test talks to a controller's terminal mode port through here. The 
+port, a serial device or a PTY when testing, is opened non-blocking and
+read from the caller's own loop: tty_poll() waits for input, tty_input()
+takes whatever has arrived and can be called when poll()/epoll say the
+descriptor tty_open() returned is readable. Nothing runs from a signal
+handler.
+
+Frames are put back together from the byte stream as it comes in, a 
+frame is everything from a '[' to the next ']' however many reads that
+takes. Each one that decodes is handed to the callback given to 
+tty_open() as the IPMI message, anything outside the brackets (line ends,
+echo, prompts) is skipped. Writes go out whole, tty_write() waits for 
+room in the output queue rather than drop the end of a frame.
+*/
+
 #include <termios.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
-#include <sys/signal.h>
-#include <sys/types.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
 #include "ipmi.h"
+#include "ws.h"
+#include "error.h"
+#include "tmode.h"
+#include "tty.h"
+
+int		tty_fd = -1;
+struct termios	tty_oldtio;
+void		( *tty_callback )( unsigned char *msg, unsigned len );
+unsigned char	tty_frame[TTY_FRAME_LEN];	/* the frame being read, from the '[' */
+unsigned	tty_frame_len;			/* 0 in between frames */
+TTY_STATS	tty_stats;
 
-#define BAUDRATE B38400
-#define MODEMDEVICE "/dev/ttyS1"
-#define _POSIX_SOURCE 1 /* POSIX compliant source */
-#define FALSE 0
-#define TRUE 1
+/*==============================================================*/
+/* Local Function Prototypes					*/
+/*==============================================================*/
+speed_t tty_speed( unsigned baud );
+int tty_frame_done( void );
 
-volatile int STOP=FALSE; 
+/*==============================================================
+ * tty_open()
+ * 	Open dev raw 8N1 at baud and hand the messages that come
+ * 	in on it to callback. Returns the file descriptor, for the
+ * 	caller to wait on, or -1.
+ *==============================================================*/
+int
+tty_open( 
+	char *dev, 
+	unsigned baud, 
+	void ( *callback )( unsigned char *msg, unsigned len ) )
+{
+	struct termios tio;
+	speed_t speed;
+
+	if( !( speed = tty_speed( baud ) ) ) {
+		fprintf( stderr, "%s: %u baud not supported\n", dev, baud );
+		return( -1 );
+	}
+	if( ( tty_fd = open( dev, O_RDWR | O_NOCTTY | O_NONBLOCK ) ) < 0 ) {
+		perror( dev );
+		return( -1 );
+	}
+
+	tcgetattr( tty_fd, &tty_oldtio );	/* put back by tty_close() */
+	tio = tty_oldtio;
+	cfmakeraw( &tio );
+	cfsetispeed( &tio, speed );
+	cfsetospeed( &tio, speed );
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	tcflush( tty_fd, TCIOFLUSH );
+	tcsetattr( tty_fd, TCSANOW, &tio );
 
-void tty_signal_handler( int status );   /* definition of signal handler */
-int wait_flag = TRUE;       /* TRUE while no signal received */
-int fd;
-struct termios oldtio;
+	tty_callback = callback;
+	tty_frame_len = 0;
+	memset( &tty_stats, 0, sizeof( tty_stats ) );
+	return( tty_fd );
+}
 
+/* termios speed for baud, 0 if there is none */
+speed_t
+tty_speed( unsigned baud )
+{
+	switch( baud ) {
+		case 1200:	return( B1200 );
+		case 2400:	return( B2400 );
+		case 4800:	return( B4800 );
+		case 9600:	return( B9600 );
+		case 19200:	return( B19200 );
+		case 38400:	return( B38400 );
+		case 57600:	return( B57600 );
+		case 115200:	return( B115200 );
+		case 230400:	return( B230400 );
+		case 460800:	return( B460800 );
+		case 921600:	return( B921600 );
+		default:	return( 0 );
+	}
+}
+
+/*==============================================================
+ * tty_close()
+ * 	Put the port settings back and close it.
+ *==============================================================*/
 void
-tty_init( void )
+tty_close( void )
 {
-	int c, res;
-	struct termios newtio;
-	struct sigaction saio;           /* definition of signal action */
-
-	/* open the device to be non-blocking (read will return immediatly) */
-	fd = open( MODEMDEVICE, O_RDWR | O_NOCTTY | O_NONBLOCK );
-	if ( fd < 0 ) {
-		perror( MODEMDEVICE ); 
-		exit( -1 );
+	if( tty_fd < 0 )
+		return;
+	tcdrain( tty_fd );
+	tcsetattr( tty_fd, TCSANOW, &tty_oldtio );
+	close( tty_fd );
+	tty_fd = -1;
+}
+
+/*==============================================================
+ * tty_input()
+ * 	Read what has come in without waiting and hand every frame
+ * 	completed by it to the callback. Returns the number of
+ * 	messages handed over, or -1 if the port has gone away.
+ *==============================================================*/
+int
+tty_input( void )
+{
+	unsigned char buf[256];
+	unsigned char ch;
+	int frames = 0, n, i;
+
+	while( ( n = read( tty_fd, buf, sizeof( buf ) ) ) > 0 ) {
+		tty_stats.rx_bytes += n;
+		for( i = 0; i < n; i++ ) {
+			ch = buf[i];
+			if( ch == '[' ) {
+				if( tty_frame_len )
+					tty_stats.rx_bad++;
+				tty_frame[0] = ch;
+				tty_frame_len = 1;
+			} else if( !tty_frame_len ) {
+				continue;		/* in between frames */
+			} else if( tty_frame_len == sizeof( tty_frame ) ) {
+				tty_stats.rx_overrun++;
+				tty_frame_len = 0;	/* resync on the next '[' */
+			} else {
+				tty_frame[tty_frame_len++] = ch;
+				if( ch == ']' ) {
+					frames += tty_frame_done();
+					tty_frame_len = 0;
+				}
+			}
+		}
 	}
+	if( ( n == 0 ) || ( ( errno != EAGAIN ) && ( errno != EINTR ) ) )
+		return( frames ? frames : -1 );
+	return( frames );
+}
 
-	/* install the signal handler before making the device asynchronous */
-	saio.sa_handler = tty_signal_handler;
-	//saio.sa_mask = 0;
-	saio.sa_flags = 0;
-	saio.sa_restorer = NULL;
-	sigaction( SIGIO, &saio, NULL );
-  
-	/* allow the process to receive SIGIO */
-	fcntl( fd, F_SETOWN, getpid() );
-	
-	/* Make the file descriptor asynchronous (the manual page says only 
-	   O_APPEND and O_NONBLOCK, will work with F_SETFL...) */
-	fcntl( fd, F_SETFL, FASYNC );
-
-	tcgetattr( fd, &oldtio ); /* save current port settings */
-
-	/* set new port settings for canonical input processing */
-	newtio.c_cflag = BAUDRATE | CRTSCTS | CS8 | CLOCAL | CREAD;
-	newtio.c_iflag = IGNPAR | ICRNL;
-	newtio.c_oflag = 0;
-	newtio.c_cc[VMIN] = 1;
-	newtio.c_cc[VTIME] = 0;
-	tcflush( fd, TCIFLUSH );
-	tcsetattr( fd, TCSANOW, &newtio );
+/* a whole frame is in tty_frame, decode it and hand the message over, 
+ * returns 1 if it was a message */
+int
+tty_frame_done( void )
+{
+	unsigned char msg[WS_BUF_LEN_LARGE];
+	unsigned len;
+
+	if( tmode_decode( tty_frame + 1, tty_frame_len - 1, msg, sizeof( msg ), &len ) 
+	    != ESUCCESS ) {
+		tty_stats.rx_text++;
+		return( 0 );
+	}
+	tty_stats.rx_frames++;
+	if( tty_callback )
+		( *tty_callback )( msg, len );
+	return( 1 );
 }
 
-/***************************************************************************
-* signal handler. sets wait_flag to FALSE, to indicate above loop that     *
-* characters have been received.                                           *
-***************************************************************************/
+/*==============================================================
+ * tty_poll()
+ * 	Wait up to timeout ms for at least one message, a frame may
+ * 	take several reads. Returns the number of messages handed
+ * 	to the callback, 0 on timeout or -1 if the port has gone
+ * 	away.
+ *==============================================================*/
+int
+tty_poll( int timeout )
+{
+	struct pollfd pfd;
+	struct timespec start, now;
+	int frames = 0, elapsed = 0, n;
 
-void
-tty_signal_handler( int status )
+	pfd.fd = tty_fd;
+	pfd.events = POLLIN;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	do {
+		if( ( n = poll( &pfd, 1, timeout - elapsed ) ) < 0 ) {
+			if( errno != EINTR )
+				return( -1 );
+		} else if( n ) {
+			if( ( n = tty_input() ) < 0 )
+				return( -1 );
+			frames += n;
+		}
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		elapsed = ( now.tv_sec - start.tv_sec ) * 1000 
+			+ ( now.tv_nsec - start.tv_nsec ) / 1000000;
+	} while( !frames && ( elapsed < timeout ) );
+	return( frames );
+}
+
+/*==============================================================
+ * tty_write()
+ * 	Write all of buf, waiting up to TTY_WRITE_TIMEOUT ms at a 
+ * 	time for room. Returns ESUCCESS or EIO.
+ *==============================================================*/
+int
+tty_write( unsigned char *buf, unsigned len )
 {
-	int res;
-	char buf[255];
-	
- 	/* after receiving SIGIO, set wait_flag = FALSE, input is available
-	 * and can be read */
-	printf( "received SIGIO signal.\n" );
-	wait_flag = FALSE;
-	res = read( fd, buf, 255 );
-	buf[res] = 0;
-	printf( ":%s:%d\n", buf, res );
-	wait_flag = TRUE;      /* wait for new input */
+	struct pollfd pfd;
+	int n;
+
+	pfd.fd = tty_fd;
+	pfd.events = POLLOUT;
+	while( len ) {
+		if( ( n = write( tty_fd, buf, len ) ) > 0 ) {
+			buf += n;
+			len -= n;
+			continue;
+		}
+		if( ( n < 0 ) && ( errno == EINTR ) )
+			continue;
+		if( ( n < 0 ) && ( errno == EAGAIN ) 
+		    && ( poll( &pfd, 1, TTY_WRITE_TIMEOUT ) > 0 ) ) {
+			tty_stats.tx_waits++;
+			continue;
+		}
+		tty_stats.tx_err++;
+		return( EIO );
+	}
+	return( ESUCCESS );
 }
 
-void
-tty_restore( void )
+/*==============================================================
+ * tty_send()
+ * 	Send a len byte IPMI message as a terminal mode frame.
+ *==============================================================*/
+int
+tty_send( unsigned char *msg, unsigned len )
 {
-	/* restore old port settings */
-	tcsetattr( fd, TCSANOW, &oldtio);
+	unsigned char buf[TTY_FRAME_LEN + 1];
+	unsigned n;
+
+	if( !( n = tmode_encode( msg, len, buf, sizeof( buf ) - 1 ) ) ) {
+		tty_stats.tx_err++;
+		return( EINVAL );
+	}
+	buf[n++] = '\r';
+	if( tty_write( buf, n ) != ESUCCESS )
+		return( EIO );
+	tty_stats.tx_frames++;
+	return( ESUCCESS );
 }
 
 void 
@@ -131,28 +308,15 @@ serial_tm_send_debug( IPMI_WS *ws )
 	ws_free( ws );
 }
 
-void 
-serial_tm_send( IPMI_WS *ws )
+/* the ws is completed by the caller, ws_process_work_list(). A frame
+ * that could not be sent is counted in tty_stats and dropped. */
+int 
+serial_tm_send( unsigned char *arg )
 /*----------------------------------------------------------------------------*/
 {
-	int i;
-	char buf[128];
-	char *ptr = buf;
-	int pos = 0;
-	
-	pos = sprintf( ptr, "[" );
-	ptr += pos;	
-	for( i = 0; i < ws->len_out; i++ ) {
-		pos = sprintf( ptr, "%2.2x", ws->pkt_out[i] );
-		ptr += pos;	
-		if( i < ( ws->len_out - 1 ) ) {
-			pos = sprintf( ptr, " " );
-			ptr += pos;
-		}
-	}
-	sprintf( ptr, "]\n" );
-	//printf( "%s", buf );
-	write( fd, buf, strlen( buf ) );
-	ws_free( ws );
+	IPMI_WS *ws = ( IPMI_WS * )arg;
+
+	tty_send( WS_FRAME_OUT( ws ), ws->len_out );
+	return( ESUCCESS );
 }
 
@@ -0,0 +1,53 @@
+/*
+-------------------------------------------------------------------------------
+coreIPM/tty.h
+
+Author: Gokhan Sozmen
+-------------------------------------------------------------------------------
+Copyright (C) 2007-2008 Gokhan Sozmen
+-------------------------------------------------------------------------------
+coreIPM is free software; you can redistribute it and/or modify it under the 
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 2 of the License, or (at your option) any later 
+version.
+
+coreIPM is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with 
+coreIPM; if not, write to the Free Software Foundation, Inc., 51 Franklin
+Street, Fifth Floor, Boston, MA 02110-1301, USA.
+-------------------------------------------------------------------------------
+See http://www.coreipm.com for documentation, latest information, licensing, 
+support and contact details.
+-------------------------------------------------------------------------------
+*/
+
+/* Host side terminal mode transport, see tty.c */
+
+#define TTY_DEV			"/dev/ttyS1"
+#define TTY_BAUD		9600	/* the controller's UARTs, see serial.c */
+#define TTY_FRAME_LEN		TMODE_ENC_LEN( WS_BUF_LEN_LARGE )	/* '[' to ']' */
+#define TTY_WRITE_TIMEOUT	1000	/* ms to wait for room in the output queue */
+
+typedef struct tty_stats {
+	unsigned long rx_bytes;
+	unsigned long rx_frames;	/* messages handed to the callback */
+	unsigned long rx_text;		/* frames that are not hex, [SYS ..] replies */
+	unsigned long rx_bad;		/* frames cut short by the next '[' */
+	unsigned long rx_overrun;	/* frames longer than TTY_FRAME_LEN */
+	unsigned long tx_frames;
+	unsigned long tx_waits;		/* writes that had to wait for room */
+	unsigned long tx_err;		/* writes that failed or timed out */
+} TTY_STATS;
+
+extern TTY_STATS tty_stats;
+
+int tty_open( char *dev, unsigned baud, 
+	void ( *callback )( unsigned char *msg, unsigned len ) );
+void tty_close( void );
+int tty_input( void );
+int tty_poll( int timeout );
+int tty_write( unsigned char *buf, unsigned len );
+int tty_send( unsigned char *msg, unsigned len );
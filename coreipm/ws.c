@@ -30,14 +30,59 @@ support and contact details.
 #include "debug.h"
 #include "serial.h"
 #include "ws.h"
+#include "sched.h"
+#include "error.h"
+#if defined (POSIX)
+#include "rmcpd.h"
+#endif
+#include <string.h>
 
 extern unsigned long lbolt;
 
 /*======================================================================*
  * WORKING SET MANAGEMENT
+ *
+ * Every ws lives on exactly one queue, the one for its current ws_state.
+ * WS_FREE is the free list. Queues are FIFO so the oldest entry in a 
+ * given state is always at the head, allocation, release and state 
+ * transitions are constant time regardless of WS_ARRAY_SIZE.
+ * WS_ACTIVE_MASTER_WRITE is split into one queue per WS_PRIO_xx class,
+ * see ws_get_elem().
  */
-IPMI_WS	ws_array[WS_ARRAY_SIZE];
+typedef struct ws_queue {
+	LIST_HDR *head;
+	LIST_HDR *tail;
+} WS_QUEUE;
 
+/*
+ * Buffer pool. Each class hands out buffers of twice its length, the
+ * first half is pkt_in and the second pkt_out. A bit set in busy marks
+ * the buffer with that index as taken.
+ */
+typedef struct ws_pool {
+	unsigned	len;
+	unsigned	count;
+	unsigned char	*bufs;
+	unsigned	busy;
+} WS_POOL;
+
+IPMI_WS		ws_array[WS_ARRAY_SIZE];
+WS_QUEUE	ws_queue[WS_NUM_STATES];
+WS_QUEUE	ws_prio_queue[WS_PRIO_CLASSES];	/* WS_ACTIVE_MASTER_WRITE by class */
+WS_STATS	ws_stats;
+
+unsigned char	ws_pool_medium[WS_POOL_MEDIUM_COUNT][2 * WS_BUF_LEN_MEDIUM];
+unsigned char	ws_pool_large[WS_POOL_LARGE_COUNT][2 * WS_BUF_LEN_LARGE];
+WS_POOL		ws_pool[WS_POOL_CLASSES] = {
+	{ WS_BUF_LEN_MEDIUM, WS_POOL_MEDIUM_COUNT, &ws_pool_medium[0][0], 0 },
+	{ WS_BUF_LEN_LARGE, WS_POOL_LARGE_COUNT, &ws_pool_large[0][0], 0 }
+};
+
+WS_QUEUE *ws_queue_of( IPMI_WS *ws, unsigned state );
+void ws_enqueue( IPMI_WS *ws, unsigned state );
+void ws_dequeue( IPMI_WS *ws );
+void ws_buf_release( IPMI_WS *ws );
+int ws_write_queued( void );
 
 /* initialize ws structures */
 void 
@@ -45,113 +90,299 @@ ws_init( void )
 {
 	unsigned i;
 	
+	for ( i = 0; i < WS_NUM_STATES; i++ )
+	{
+		ws_queue[i].head = 0;
+		ws_queue[i].tail = 0;
+	}
+	for ( i = 0; i < WS_PRIO_CLASSES; i++ )
+	{
+		ws_prio_queue[i].head = 0;
+		ws_prio_queue[i].tail = 0;
+	}
+
 	for ( i = 0; i < WS_ARRAY_SIZE; i++ )
 	{
-		ws_array[i].ws_state = WS_FREE;
+		ws_buf_release( &ws_array[i] );
+		ws_array[i].priority = WS_PRIO_CONTROL;
+		ws_enqueue( &ws_array[i], WS_FREE );
 	}
 
 }
 
+/* the queue ws goes on in state */
+WS_QUEUE *
+ws_queue_of( IPMI_WS *ws, unsigned state )
+{
+	if( state == WS_ACTIVE_MASTER_WRITE )
+		return( &ws_prio_queue[ws->priority] );
+	return( &ws_queue[state] );
+}
+
+/* append ws to the tail of the queue for state & set ws state */
+void
+ws_enqueue( IPMI_WS *ws, unsigned state )
+{
+	WS_QUEUE *queue = ws_queue_of( ws, state );
+
+	ws->hdr.next = 0;
+	ws->hdr.prev = queue->tail;
+	if( queue->tail )
+		queue->tail->next = &ws->hdr;
+	else
+		queue->head = &ws->hdr;
+	queue->tail = &ws->hdr;
+	ws->ws_state = state;
+
+	/* wake up the main loop for anything it has to act on */
+	if( ( state == WS_ACTIVE_IN ) 
+	    || ( state == WS_ACTIVE_MASTER_WRITE ) 
+	    || ( state == WS_ACTIVE_MASTER_READ ) )
+		sched_post( SCHED_WS );
+}
+
+/* unlink ws from the queue for its current state */
+void
+ws_dequeue( IPMI_WS *ws )
+{
+	WS_QUEUE *queue = ws_queue_of( ws, ws->ws_state );
+
+	if( ws->hdr.prev )
+		ws->hdr.prev->next = ws->hdr.next;
+	else
+		queue->head = ws->hdr.next;
+	if( ws->hdr.next )
+		ws->hdr.next->prev = ws->hdr.prev;
+	else
+		queue->tail = ws->hdr.prev;
+	ws->hdr.next = 0;
+	ws->hdr.prev = 0;
+}
+
 /* get a free ws elem */
 IPMI_WS *
 ws_alloc( void )
 {
-	IPMI_WS *ws = 0;
-	IPMI_WS *ptr = ws_array;
-	unsigned i;
-	//unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+	IPMI_WS *ws;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
-	//DISABLE_INTERRUPTS;
-	for ( i = 0; i < WS_ARRAY_SIZE; i++ )
-	{
-		ptr = &ws_array[i];
-		if( ptr->ws_state == WS_FREE ) {
-			ptr->ws_state = WS_PENDING;
-			ws = ptr;
-			break;
-		}
+	DISABLE_INTERRUPTS;
+	ws = ( IPMI_WS * )ws_queue[WS_FREE].head;
+	if( ws ) {
+		ws_dequeue( ws );
+		ws_enqueue( ws, WS_PENDING );
+		if( ++ws_stats.in_use > ws_stats.high_water )
+			ws_stats.high_water = ws_stats.in_use;
+	} else {
+		ws_stats.alloc_fail++;
 	}
-	//ENABLE_INTERRUPTS( interrupt_mask );
+	ENABLE_INTERRUPTS( interrupt_mask );
 	return ws;
 }
 
-/* set ws state to free */
+/* set ws state to free. Only the header is cleared, the frame buffers
+ * are always written by the transport or the ipmi layer before they 
+ * are read. */
 void 
 ws_free( IPMI_WS *ws )
 {
-	int len, i;
-	char *ptr = (char *)ws;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
-	len = sizeof( IPMI_WS );
-	for( i = 0 ; i < len ; i++ ) {
-		*ptr++ = 0;
-	}	
+	DISABLE_INTERRUPTS;
+	ws_dequeue( ws );
+	ws_buf_release( ws );
+	memset( ws, 0, ( char * )&ws->pkt_in - ( char * )ws );
 	ws->incoming_protocol = IPMI_CH_PROTOCOL_NONE;
-	ws->ws_state = WS_FREE;
+	ws->priority = WS_PRIO_CONTROL;
+	ws_enqueue( ws, WS_FREE );
+	ws_stats.in_use--;
+	ENABLE_INTERRUPTS( interrupt_mask );
+}
+
+/*==============================================================
+ * ws_buf_alloc()
+ * 	Make pkt_in and pkt_out at least len bytes each. The 
+ * 	smallest pool class with a free buffer is used. Returns
+ * 	ENOMEM if there is none, the ws keeps the buffers it has.
+ * 	Nothing in the old buffers is carried over so this is done
+ * 	before a frame is received or built in them.
+ *==============================================================*/
+int
+ws_buf_alloc( IPMI_WS *ws, unsigned len )
+{
+	WS_POOL *pool;
+	unsigned class, i;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	if( len <= ws->buf_len )
+		return( ESUCCESS );
+
+	DISABLE_INTERRUPTS;
+	for( class = 0; class < WS_POOL_CLASSES; class++ ) {
+		pool = &ws_pool[class];
+		if( pool->len < len )
+			continue;
+		for( i = 0; i < pool->count; i++ ) {
+			if( pool->busy & ( 1U << i ) )
+				continue;
+			ws_buf_release( ws );
+			pool->busy |= ( 1U << i );
+			ws->pkt_in = pool->bufs + i * 2 * pool->len;
+			ws->pkt_out = ws->pkt_in + pool->len;
+			ws->buf_len = pool->len;
+			ws->buf_class = class + 1;
+			ENABLE_INTERRUPTS( interrupt_mask );
+			return( ESUCCESS );
+		}
+	}
+	ws_stats.buf_fail++;
+	ENABLE_INTERRUPTS( interrupt_mask );
+	return( ENOMEM );
 }
 
+/* give back any pool buffer and point pkt_in and pkt_out at the built
+ * in buffers, called with interrupts disabled */
+void
+ws_buf_release( IPMI_WS *ws )
+{
+	WS_POOL *pool;
+
+	if( ws->buf_class ) {
+		pool = &ws_pool[ws->buf_class - 1];
+		pool->busy &= ~( 1U << ( ( ws->pkt_in - pool->bufs ) / ( 2 * pool->len ) ) );
+	}
+	ws->pkt_in = ws->buf;
+	ws->pkt_out = ws->buf + WS_BUF_LEN;
+	ws->buf_len = WS_BUF_LEN;
+	ws->buf_class = 0;
+}
+
+/* get the oldest ws elem in the given state. The elem is moved to the 
+ * back of its queue so that an elem the caller leaves in the same state 
+ * does not starve the others. For WS_ACTIVE_MASTER_WRITE it is the 
+ * oldest of the most urgent class once aged, see ws_prio_rank(). */
 IPMI_WS *
 ws_get_elem( unsigned state )
 {
-	IPMI_WS *ws = 0;
-	IPMI_WS *ptr = ws_array;
-	unsigned i;
-	//unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+	IPMI_WS *ws, *elem;
+	unsigned class, rank, best_rank = ~0, first = WS_PRIO_CLASSES;
+	unsigned long wait;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
 
-	//DISABLE_INTERRUPTS;	
-	for ( i = 0; i < WS_ARRAY_SIZE; i++ )
-	{
-		ptr = &ws_array[i];
-		if( ptr->ws_state == state ) {
-			if( ws ) {
-				if( ptr->timestamp < ws->timestamp ) 
-					ws = ptr;
-			} else {
-				ws = ptr;
+	DISABLE_INTERRUPTS;	
+	if( state == WS_ACTIVE_MASTER_WRITE ) {
+		ws = 0;
+		for( class = 0; class < WS_PRIO_CLASSES; class++ ) {
+			if( !( elem = ( IPMI_WS * )ws_prio_queue[class].head ) )
+				continue;
+			if( first == WS_PRIO_CLASSES )
+				first = class;
+			/* equal ranks go oldest first */
+			rank = ws_prio_rank( elem );
+			if( ( rank < best_rank ) || ( ( rank == best_rank ) 
+			    && ( ( long )( elem->queued - ws->queued ) < 0 ) ) ) {
+				best_rank = rank;
+				ws = elem;
 			}
 		}
+		if( ws ) {
+			ws_stats.prio_sent[ws->priority]++;
+			if( ws->priority != first )
+				ws_stats.prio_aged++;
+			wait = ( sched_clock() - ws->queued ) / SCHED_COUNTS_PER_USEC;
+			if( wait > ws_stats.prio_max_wait[ws->priority] )
+				ws_stats.prio_max_wait[ws->priority] = wait;
+		}
+	} else {
+		ws = ( IPMI_WS * )ws_queue[state].head;
 	}
-	
-	if( ws )
+	if( ws ) {
 		ws->timestamp = lbolt;
-
-	//ENABLE_INTERRUPTS( interrupt_mask );
+		if( ws->hdr.next ) {
+			ws_dequeue( ws );
+			ws_enqueue( ws, state );
+		}
+	}
+	ENABLE_INTERRUPTS( interrupt_mask );
 	return ws;
 }
 
-IPMI_WS *
-ws_get_elem_seq( uchar seq, IPMI_WS *ws_ignore )
+/* class ws counts as after aging, 0 is the most urgent */
+unsigned
+ws_prio_rank( IPMI_WS *ws )
 {
-	IPMI_WS *ws = 0;
-	IPMI_WS *ptr = ws_array;
-	unsigned i;
-	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+	return( ws_prio_aged( ws->priority, ws->queued ) );
+}
 
-	//DISABLE_INTERRUPTS;		
-	for ( i = 0; i < WS_ARRAY_SIZE; i++ )
-	{
-		ptr = &ws_array[i];
-		if( ptr == ws_ignore )
-			continue;
-		if( ( ptr->ws_state != WS_FREE ) && ( ptr->seq_out == seq ) ) {
-			ws = ptr;
-			break;
+/* class priority counts as after waiting since queued */
+unsigned
+ws_prio_aged( unsigned priority, unsigned long queued )
+{
+	unsigned long age;
+
+	age = ( sched_clock() - queued ) / ( SCHED_COUNTS_PER_USEC * WS_PRIO_AGE );
+	return( ( age < priority ) ? priority - age : 0 );
+}
+
+/*==============================================================
+ * ws_prio_select()
+ * 	Pick the entry of list, oldest first, that should go out
+ * 	next by the same rule as ws_get_elem(). Used by transports
+ * 	that keep their own transmit queue. Returns its index.
+ *==============================================================*/
+unsigned
+ws_prio_select( IPMI_WS **list, unsigned count )
+{
+	unsigned i, rank, best = 0, best_rank = ~0;
+
+	for( i = 0; i < count; i++ ) {
+		rank = ws_prio_rank( list[i] );
+		if( rank < best_rank ) {
+			best_rank = rank;
+			best = i;
 		}
 	}
-	//ENABLE_INTERRUPTS( interrupt_mask );
-	return ws;
+	return( best );
 }
 
+/* any ws waiting in one of the WS_ACTIVE_MASTER_WRITE queues */
+int
+ws_write_queued( void )
+{
+	unsigned class;
+
+	for( class = 0; class < WS_PRIO_CLASSES; class++ ) {
+		if( ws_prio_queue[class].head )
+			return( 1 );
+	}
+	return( 0 );
+}
+
+/* move ws to the tail of the queue for the new state */
 void
 ws_set_state( IPMI_WS * ws, unsigned state )
 {
-	ws->ws_state = state;
+	unsigned int interrupt_mask = CURRENT_INTERRUPT_MASK;	
+
+	DISABLE_INTERRUPTS;	
+	/* the wait to go out starts when a ws is first queued, one 
+	 * coming back for a retry or a busy transport keeps its age */
+	if( ( ( state == WS_ACTIVE_MASTER_WRITE ) || ( state == WS_ACTIVE_MASTER_READ ) )
+	    && ( ws->ws_state != WS_ACTIVE_MASTER_WRITE_PENDING )
+	    && ( ws->ws_state != WS_ACTIVE_MASTER_READ_PENDING ) )
+		ws->queued = sched_clock();
+	ws_dequeue( ws );
+	ws_enqueue( ws, state );
+	ENABLE_INTERRUPTS( interrupt_mask );
 }
 
 /*==============================================================
  * ws_process_work_list()
  * 	Go through the active list, calling the ipmi handler for 
  * 	incoming entries and transport handler for outgoing entries.
+ * 	One entry per state is handled on each pass, if any are 
+ * 	left the run queue is posted again so that the other work 
+ * 	sources get their turn in between.
  *==============================================================*/
 void ws_process_work_list( void ) 
 {
@@ -176,12 +407,29 @@ void ws_process_work_list( void )
 				break;
 				
 			case IPMI_CH_MEDIUM_SERIAL:	/* Asynch. Serial/Modem (RS-232) 	*/
-				serial_tm_send( ( unsigned char * )ws );
+				/* if the transmit ring is too full the ws 
+				 * waits in serial.c, which puts it back in
+				 * this queue once there is room */
+				if( serial_tm_send( ( unsigned char * )ws ) != ESUCCESS )
+					break;
+				/* the frame is out, same policy as i2c_master_complete() */
+				ws_set_state( ws, WS_ACTIVE_MASTER_WRITE_SUCCESS );
+				if( ws->ipmi_completion_function )
+					( ws->ipmi_completion_function )( (void *)ws, XPORT_REQ_NOERR );
+				else
+					ws_free( ws );
 				break;
 				
+#if defined (POSIX)
+			case IPMI_CH_MEDIUM_LAN:	/* 802.3 LAN 				*/
+				rmcpd_send( ws );
+				break;
+#endif
 			case IPMI_CH_MEDIUM_ICMB10:	/* ICMB v1.0 				*/
 			case IPMI_CH_MEDIUM_ICMB09:	/* ICMB v0.9 				*/
+#if !defined (POSIX)
 			case IPMI_CH_MEDIUM_LAN:	/* 802.3 LAN 				*/
+#endif
 			case IPMI_CH_MEDIUM_LAN_AUX:	/* Other LAN				*/
 			case IPMI_CH_MEDIUM_PCI_SMB:	/* PCI SMBus				*/
 			case IPMI_CH_MEDIUM_SMB_1x:	/* SMBus v1.0/1.1			*/
@@ -200,6 +448,11 @@ void ws_process_work_list( void )
 		if( ws->incoming_protocol == IPMI_CH_PROTOCOL_IPMB )
 			i2c_master_read( ws );
 	}
+	
+	if( ws_queue[WS_ACTIVE_IN].head 
+	    || ws_write_queued() 
+	    || ws_queue[WS_ACTIVE_MASTER_READ].head )
+		sched_post( SCHED_WS );
 }
 
 /* Default handler for incoming packets */
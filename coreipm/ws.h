@@ -34,12 +34,62 @@ support and contact details.
 #define WS_ACTIVE_MASTER_WRITE_SUCCESS  0x7
 #define WS_ACTIVE_MASTER_READ		0x8
 #define WS_ACTIVE_MASTER_READ_PENDING	0x9
+#define WS_NUM_STATES			0xA	/* one queue per state */
 
+#ifndef WS_ARRAY_SIZE
 #define WS_ARRAY_SIZE	16
+#endif
 #define WS_BUF_LEN 32
 
+/* Messages bigger than the built in buffers borrow their pkt_in and 
+ * pkt_out from a pool of fixed size classes, see ws_buf_alloc() */
+#define WS_BUF_LEN_MEDIUM	64
+#define WS_BUF_LEN_LARGE	256
+#ifndef WS_POOL_MEDIUM_COUNT
+#define WS_POOL_MEDIUM_COUNT	4
+#endif
+#ifndef WS_POOL_LARGE_COUNT
+#define WS_POOL_LARGE_COUNT	2
+#endif
+#define WS_POOL_CLASSES		2
+/* each class keeps its buffers in a 32 bit busy map */
+#if ( WS_POOL_MEDIUM_COUNT > 32 ) || ( WS_POOL_LARGE_COUNT > 32 )
+#error "WS_POOL_MEDIUM_COUNT and WS_POOL_LARGE_COUNT can not exceed 32"
+#endif
+
 #define WS_FL_GENERAL_CALL	1
 #define WS_FL_REPEATED_START	2
+#define WS_FL_BRIDGED		4	/* request forwarded by Send Message */
+
+/* Transmit priority classes, most urgent first. Outgoing work waits in
+ * one queue per class and the most urgent goes first, except that a ws
+ * counts as one class more urgent for every WS_PRIO_AGE us it has
+ * waited so bulk traffic still gets through under load. */
+#define WS_PRIO_RESPONSE	0	/* responses to requests we received */
+#define WS_PRIO_EVENT		1	/* Platform Event messages */
+#define WS_PRIO_CONTROL		2	/* other requests, the default */
+#define WS_PRIO_BACKGROUND	3	/* sensor polling and FRU reads */
+#define WS_PRIO_CLASSES		4
+#ifndef WS_PRIO_AGE
+#define WS_PRIO_AGE		50000
+#endif
+
+/* The transports send len_out bytes from here. Frames that are only
+ * passing through are sent from where they were received with just 
+ * the header rewritten, frame_out points into pkt_in for those. */
+#define WS_FRAME_OUT( ws )	( ( ws )->frame_out ? ( ws )->frame_out : ( ws )->pkt_out )
+
+typedef struct ws_stats {
+	unsigned in_use;		/* ws currently allocated */
+	unsigned high_water;		/* most ever allocated at once */
+	unsigned long alloc_fail;	/* ws_alloc() found none free */
+	unsigned long buf_fail;		/* ws_buf_alloc() found none free */
+	unsigned long prio_sent[WS_PRIO_CLASSES];	/* writes started per class */
+	unsigned long prio_max_wait[WS_PRIO_CLASSES];	/* longest wait to start, us */
+	unsigned long prio_aged;	/* writes that went ahead of a more urgent class */
+} WS_STATS;
+
+extern WS_STATS ws_stats;
 
 /* transport layer completion codes */
 #define XPORT_REQ_NOERR 	0 
@@ -51,10 +101,13 @@ void ws_set_state( IPMI_WS *, unsigned );
 void ws_init( void );
 IPMI_WS *ws_alloc( void );
 void ws_free( IPMI_WS *ws );
+int ws_buf_alloc( IPMI_WS *ws, unsigned len );
 IPMI_WS *ws_get_elem( unsigned state );
+unsigned ws_prio_rank( IPMI_WS *ws );
+unsigned ws_prio_aged( unsigned priority, unsigned long queued );
+unsigned ws_prio_select( IPMI_WS **list, unsigned count );
 void ws_set_state( IPMI_WS * ws, unsigned state );
 void ws_process_work_list( void );
-IPMI_WS *ws_get_elem_seq( uchar seq, IPMI_WS* ws_ignore );
 void ws_process_incoming( IPMI_WS *ws );
 
 